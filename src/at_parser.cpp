@@ -0,0 +1,154 @@
+#include "at_parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct AtUrcName {
+  const char *name; // without the leading '+' and trailing ':'
+  AtUrc urc;
+};
+
+static const AtUrcName urcNames[] = {
+  {"CFTPSSTART", AT_URC_CFTPSSTART},
+  {"CFTPSLOGIN", AT_URC_CFTPSLOGIN},
+  {"CFTPSLOGOUT", AT_URC_CFTPSLOGOUT},
+  {"CFTPSSTOP", AT_URC_CFTPSSTOP},
+  {"CFTPSPUTFILE", AT_URC_CFTPSPUTFILE},
+  {"CFTPSNOTIFY", AT_URC_CFTPSNOTIFY},
+  {"HTTPACTION", AT_URC_HTTPACTION},
+  {"HTTPREAD", AT_URC_HTTPREAD},
+  {"CGNSSINFO", AT_URC_CGNSSINFO},
+  {"CCLK", AT_URC_CCLK},
+  {"CREG", AT_URC_CREG},
+  {"CSQ", AT_URC_CSQ},
+};
+
+AtParser::AtParser() {
+  clear();
+  _bytesIn = 0;
+  _lines = 0;
+  _truncatedLines = 0;
+}
+
+void AtParser::clear() {
+  _head = 0;
+  _tail = 0;
+  _lineLength = 0;
+  _lineTruncated = false;
+  _dataRemaining = 0;
+  _line[0] = '\0';
+}
+
+size_t AtParser::feed(const uint8_t *data, size_t length) {
+  if (length > space()) length = space();
+  for (size_t i = 0; i < length; i++) {
+    _ring[(_head + i) & (AT_RING_SIZE - 1)] = data[i];
+  }
+  _head += length;
+  _bytesIn += length;
+  return length;
+}
+
+bool AtParser::next(AtEvent &event) {
+  // hand out binary payload straight from the ring, one contiguous slice at a time
+  if (_dataRemaining > 0) {
+    size_t available = _head - _tail;
+    if (available == 0) return false;
+    size_t offset = _tail & (AT_RING_SIZE - 1);
+    size_t count = AT_RING_SIZE - offset;
+    if (count > available) count = available;
+    if (count > _dataRemaining) count = _dataRemaining;
+
+    event.type = AT_EVENT_DATA;
+    event.urc = AT_URC_UNKNOWN;
+    event.line = "";
+    event.args = "";
+    event.data = _ring + offset;
+    event.length = count;
+    event.code = 0;
+    _tail += count;
+    _dataRemaining -= count;
+    return true;
+  }
+
+  while (_tail != _head) {
+    char c = (char)_ring[_tail & (AT_RING_SIZE - 1)];
+    _tail++;
+
+    if (c == '\r') continue;
+    if (c == '\n') {
+      if (_lineLength == 0) continue; // blank separator line
+      _line[_lineLength] = '\0';
+      classify(event);
+      _lineLength = 0;
+      _lineTruncated = false;
+      return true;
+    }
+
+    // the data prompt is not followed by a line ending
+    if (_lineLength == 0 && c == '>') {
+      event.type = AT_EVENT_PROMPT;
+      event.urc = AT_URC_UNKNOWN;
+      event.line = ">";
+      event.length = 1;
+      event.args = "";
+      event.data = NULL;
+      event.code = 0;
+      return true;
+    }
+
+    if (_lineLength < AT_LINE_SIZE - 1) {
+      _line[_lineLength++] = c;
+    } else if (!_lineTruncated) {
+      _lineTruncated = true;
+      _truncatedLines++;
+    }
+  }
+  return false;
+}
+
+void AtParser::classify(AtEvent &event) {
+  _lines++;
+  event.type = AT_EVENT_LINE;
+  event.urc = AT_URC_UNKNOWN;
+  event.line = _line;
+  event.length = _lineLength;
+  event.args = "";
+  event.data = NULL;
+  event.code = 0;
+
+  if (strcmp(_line, "OK") == 0) {
+    event.type = AT_EVENT_OK;
+    return;
+  }
+  if (strcmp(_line, "ERROR") == 0) {
+    event.type = AT_EVENT_ERROR;
+    return;
+  }
+  if (strncmp(_line, "+CME ERROR:", 11) == 0 || strncmp(_line, "+CMS ERROR:", 11) == 0) {
+    event.type = AT_EVENT_CME_ERROR;
+    event.code = atoi(_line + 11);
+    return;
+  }
+  if (_line[0] != '+') return;
+
+  const char *colon = strchr(_line, ':');
+  if (colon == NULL) return;
+
+  event.type = AT_EVENT_URC;
+  size_t nameLength = colon - _line - 1;
+  for (size_t i = 0; i < sizeof(urcNames) / sizeof(urcNames[0]); i++) {
+    if (strlen(urcNames[i].name) == nameLength && strncmp(_line + 1, urcNames[i].name, nameLength) == 0) {
+      event.urc = urcNames[i].urc;
+      break;
+    }
+  }
+
+  const char *args = colon + 1;
+  while (*args == ' ') args++;
+  event.args = args;
+
+  // "+HTTPREAD: DATA,<n>" style headers announce a raw payload window
+  if (strncmp(args, "DATA,", 5) == 0) {
+    _dataRemaining = strtoul(args + 5, NULL, 10);
+  }
+}
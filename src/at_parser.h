@@ -0,0 +1,113 @@
+#ifndef __AT_PARSER_H__
+#define __AT_PARSER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// incremental tokenizer for SIM7600 AT responses. bytes are pumped from the
+// modem stream into a fixed ring buffer and pulled out as classified events,
+// so no heap memory is touched. has no Arduino dependencies so it can be
+// built on the host against any stream with available() and readBytes().
+
+#define AT_RING_SIZE 1024 // must be a power of two
+#define AT_LINE_SIZE 256
+
+enum AtEventType {
+  AT_EVENT_NONE,
+  AT_EVENT_OK,
+  AT_EVENT_ERROR,
+  AT_EVENT_CME_ERROR, // +CME ERROR / +CMS ERROR, code in event.code
+  AT_EVENT_PROMPT,    // '>' data prompt, e.g. after +CFTRANRX
+  AT_EVENT_URC,       // "+NAME: args" line, id in event.urc
+  AT_EVENT_LINE,      // any other text line (echo, file listings, payload text)
+  AT_EVENT_DATA       // slice of a binary payload window
+};
+
+enum AtUrc {
+  AT_URC_UNKNOWN,
+  AT_URC_CFTPSSTART,
+  AT_URC_CFTPSLOGIN,
+  AT_URC_CFTPSLOGOUT,
+  AT_URC_CFTPSSTOP,
+  AT_URC_CFTPSPUTFILE,
+  AT_URC_CFTPSNOTIFY,
+  AT_URC_HTTPACTION,
+  AT_URC_HTTPREAD,
+  AT_URC_CGNSSINFO,
+  AT_URC_CCLK,
+  AT_URC_CREG,
+  AT_URC_CSQ
+};
+
+struct AtEvent {
+  AtEventType type;
+  AtUrc urc;
+  const char *line;    // NUL terminated line, valid until the next call to next()
+  size_t length;       // line length, or payload slice length for AT_EVENT_DATA
+  const char *args;    // text after "+NAME: " for URCs, empty string otherwise
+  const uint8_t *data; // payload slice, points into the ring buffer
+  int code;            // CME/CMS error code
+};
+
+class AtParser {
+public:
+  AtParser();
+
+  // drop all buffered bytes and any partial line or payload window
+  void clear();
+
+  // copy raw bytes into the ring buffer, returns how many fit
+  size_t feed(const uint8_t *data, size_t length);
+
+  // move whatever the stream has buffered into the ring buffer
+  template <typename S>
+  size_t pump(S &stream) {
+    size_t total = 0;
+    int available;
+    while ((available = stream.available()) > 0 && space() > 0) {
+      size_t offset = _head & (AT_RING_SIZE - 1);
+      size_t count = AT_RING_SIZE - offset;
+      if (count > space()) count = space();
+      if (count > (size_t)available) count = available;
+      count = stream.readBytes((char *)_ring + offset, count);
+      if (count == 0) break;
+      _head += count;
+      _bytesIn += count;
+      total += count;
+    }
+    return total;
+  }
+
+  // pull the next complete event out of the buffer, false if none is ready.
+  // payload slices point into the ring and stay valid until the next
+  // pump() or feed()
+  bool next(AtEvent &event);
+
+  // treat the next length bytes as binary payload instead of text. windows
+  // announced as "+NAME: DATA,<n>" are opened automatically
+  void expectData(size_t length) { _dataRemaining = length; }
+  size_t dataRemaining() const { return _dataRemaining; }
+
+  size_t buffered() const { return _head - _tail; }
+  size_t space() const { return AT_RING_SIZE - (_head - _tail); }
+
+  uint32_t bytesIn() const { return _bytesIn; }
+  uint32_t lines() const { return _lines; }
+  uint32_t truncatedLines() const { return _truncatedLines; }
+
+private:
+  void classify(AtEvent &event);
+
+  uint8_t _ring[AT_RING_SIZE];
+  size_t _head;
+  size_t _tail;
+  char _line[AT_LINE_SIZE];
+  size_t _lineLength;
+  bool _lineTruncated;
+  size_t _dataRemaining;
+  uint32_t _bytesIn;
+  uint32_t _lines;
+  uint32_t _truncatedLines;
+};
+
+#endif
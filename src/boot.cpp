@@ -0,0 +1,62 @@
+#include "boot.h"
+
+BootSequence::BootSequence() : _count(0) {}
+
+uint32_t BootSequence::add(const char *name, BootStageFunction run, uint32_t after, int core) {
+  if (_count == BOOT_MAX_STAGES) return 0;
+  BootStage &stage = _stages[_count];
+  stage.name = name;
+  stage.run = run;
+  stage.after = after;
+  stage.core = core;
+  stage.startMs = 0;
+  stage.endMs = 0;
+  stage.ok = false;
+  stage.skipped = false;
+  stage.done = false;
+  stage.sequence = this;
+  return 1UL << _count++;
+}
+
+void BootSequence::stageTask(void *arg) {
+  BootStage *stage = (BootStage *)arg;
+  BootSequence *sequence = stage->sequence;
+
+  bool runnable = true;
+  for (size_t i = 0; i < sequence->_count; i++) {
+    if (!(stage->after & (1UL << i))) continue;
+    while (!sequence->_stages[i].done) {
+      portDelay(BOOT_POLL_MS);
+    }
+    if (!sequence->_stages[i].ok) runnable = false;
+  }
+
+  stage->startMs = portMillis();
+  if (runnable) {
+    stage->ok = stage->run();
+  } else {
+    stage->skipped = true;
+  }
+  stage->endMs = portMillis();
+  stage->done = true;
+  portTaskExit();
+}
+
+bool BootSequence::run(uint32_t stackSize) {
+  for (size_t i = 0; i < _count; i++) {
+    // a stage that can't get a task counts as failed so its dependants don't wait forever
+    if (!portTaskCreate(stageTask, _stages[i].name, stackSize, &_stages[i], 2, _stages[i].core)) {
+      _stages[i].startMs = _stages[i].endMs = portMillis();
+      _stages[i].done = true;
+    }
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < _count; i++) {
+    while (!_stages[i].done) {
+      portDelay(BOOT_POLL_MS);
+    }
+    ok = ok && _stages[i].ok;
+  }
+  return ok;
+}
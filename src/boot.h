@@ -0,0 +1,53 @@
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "port.h"
+
+// dependency driven boot. each stage runs on its own task as soon as the
+// stages it names in its after mask are done, so independent work (camera
+// and SD against modem power-up and registration) overlaps. a stage whose
+// dependency failed is skipped. start and end times are kept for the boot
+// report. built on port.h so boot orders can be exercised on the host
+
+#define BOOT_MAX_STAGES 8
+#define BOOT_POLL_MS 5
+
+typedef bool (*BootStageFunction)();
+
+struct BootStage {
+  const char *name;
+  BootStageFunction run;
+  uint32_t after;          // bit per stage index that has to finish first
+  int core;
+  uint32_t startMs;        // portMillis(), so measured from power-on
+  uint32_t endMs;
+  bool ok;
+  bool skipped;
+  std::atomic<bool> done;
+  class BootSequence *sequence;
+};
+
+class BootSequence {
+public:
+  BootSequence();
+
+  // returns the stage's bit for later after masks, 0 when full
+  uint32_t add(const char *name, BootStageFunction run, uint32_t after = 0, int core = 0);
+
+  // start every stage and wait for all of them, false if any failed or was skipped
+  bool run(uint32_t stackSize);
+
+  size_t count() const { return _count; }
+  const BootStage &stage(size_t index) const { return _stages[index]; }
+
+private:
+  static void stageTask(void *arg);
+
+  BootStage _stages[BOOT_MAX_STAGES];
+  size_t _count;
+};
+
+#endif
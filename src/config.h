@@ -10,12 +10,163 @@
 #define OTA_UPDATE_PORT 80
 #define OTA_UPDATE_ENDPOINT String("") + DEVICENAME + "-firmware.bin"
 #define OTA_VERSION_ENDPOINT String("") + DEVICENAME + "-version.txt"
+#define OTA_DELTA_ENDPOINT(version) String("") + DEVICENAME + "-" + (version) + ".patch" // made by tools/make_delta.py
+#define OTA_DIGEST_ENDPOINT String("") + DEVICENAME + "-firmware.sha256" // sha256sum of the firmware
+#define OTA_READ_WINDOW 4096        // bytes asked for per +HTTPREAD
+#define OTA_READ_TIMEOUT 10000
+#define OTA_READ_RETRIES 3          // reads in a row that may return nothing
+#define OTA_ACTION_TIMEOUT 60000    // +HTTPACTION fetches the whole body into the modem first
+// #define OTA_STAGE_TO_SD           // also keep a copy of the image in FIRMWARE_FILE_NAME
+#define MODEM_RX_BUFFER 8192        // UART receive buffer, holds a whole read window
 
 #define uS_TO_S_FACTOR 1000000
 
+// SD card logging
+#define LOG_RING_SIZE 16384           // bytes of log waiting for the SD task, power of two
+#define LOG_SECTOR_SIZE 512           // file writes are whole multiples of this
+#define LOG_BATCH_SIZE 4096           // most bytes written per file write
+#define LOG_FLUSH_MS 2000             // write a partial sector after this long
+#define LOG_DRAIN_INTERVAL_MS 50      // log task poll period when the ring is empty
+#define LOG_MAX_FILE_SIZE (1024 * 1024)
+#define LOG_ROTATE_KEEP 3             // rotated files kept next to LOG_FILE_NAME
+#define LOG_UPLOAD_ENABLED            // rotated files go up compressed with the report
+
+// EFS transfers over UART
+#define EFS_WINDOW_SIZE 1024      // bytes written between modem checks
+#define EFS_WINDOW_GAP_MS 0       // extra pause after each window
+#define EFS_PROMPT_TIMEOUT 5000   // wait for '>' after +CFTRANRX
+#define EFS_STALL_TIMEOUT 5000    // abort when a window makes no progress
+#define EFS_COMMIT_TIMEOUT 10000  // wait for OK after the last byte
+#define EFS_COMPRESS_BLOCK 512    // input fed to the LZSS encoder at a time
+#define COMPRESSED_SUFFIX ".lzs"  // reports and logs go up LZSS compressed, tools/lzss_decompress.py
+
+// motion gating of uploads
+#define MOTION_NOISE_FLOOR 4        // mean abs diff per pixel treated as sensor noise
+#define MOTION_THRESHOLD_K 3        // block changed above quiet mean + K * quiet deviation
+#define MOTION_TRIGGER_PERMILLE 20  // changed blocks per thousand that count as an event
+#define MOTION_GLOBAL_PERMILLE 600  // more change than this is treated as a lighting change
+#define MOTION_LEARN_SHIFT 4        // background learns 1/16 of each quiet frame
+#define MOTION_WARMUP_FRAMES 5
+
+// PSRAM frame history
+#define FRAME_RING_SLOT_SIZE (384 * 1024) // largest frame kept
+#define FRAME_RING_HISTORY 4              // frames remembered
+#define FRAME_RING_SLOTS 8                // history plus frames still held by uploads
+#define FRAME_PRE_TRIGGER 2               // earlier frames uploaded with each event
+
+// upload a re-encoded crop of the changed region, the full frame stays on SD
+#define ROI_UPLOAD_ENABLED
+#define ROI_MIN_BLOCKS 2          // changed regions smaller than this are noise
+#define ROI_MARGIN 64             // pixels of context around the changed blocks
+#define ROI_MIN_SIZE 256          // smallest crop side
+#define ROI_MAX_SIDE 800          // larger crops are downscaled by halves
+#define ROI_BUDGET (40 * 1024)    // bytes per re-encoded crop
+#define ROI_QUALITY_MAX 80        // encoder quality, 1-100 with higher better
+#define ROI_QUALITY_MIN 30
+#define ROI_QUALITY_STEP 15
+#define FULL_FRAME_DIR "/frames"  // full frames of cropped uploads
+
+// two-tier upload: a thumbnail right away, the full frame later or when the
+// server lists it in the request file. with ROI_UPLOAD_ENABLED the thumbnail
+// is of the cropped region
+#define UPLOAD_THUMBNAIL_FIRST
+#define THUMBNAIL_MAX_SIDE 320                // UXGA comes out at 200x150
+#define THUMBNAIL_BUDGET (8 * 1024)
+#define FULL_FRAME_QUEUE_DIR "/sd/fullres"    // kept full frames, queued like the outbox
+#define FULL_FRAME_REQUEST_ENDPOINT String("") + DEVICENAME + "-request.txt"
+#define FULL_FRAME_POLL_INTERVAL_MS (5UL * 60000) // request file poll while frames are kept
+#define FULL_FRAME_UPLOAD_AFTER_S (6UL * 3600)   // unrequested frames go up after this, 0 for never
+
+// link-adaptive capture level, see the level table in main.cpp
+#define LINK_TARGET_EVENT_MS 20000      // aim to upload each event's full frames within this
+#define LINK_STEP_UP_EVENTS 3           // events in a row with room to spare before a bigger level
+#define LINK_HEADROOM_PERCENT 70        // the next level up has to predict under this share of the target
+#define LINK_PRIOR_BPS_PER_CSQ 500      // throughput guess per CSQ step before the first upload
+#define LINK_CSQ_DROP 5                 // a CSQ this much lower discounts the learned throughput
+#define LINK_SIGNAL_INTERVAL_MS 60000
+
+// capture/upload pipeline
+#define PIPELINE_CAPTURE_INTERVAL_MS 10000
+#define PIPELINE_HOUSEKEEPING_MS 10000
+#define PIPELINE_QUEUE_DEPTH 2
+#define PIPELINE_DROP_POLICY PIPELINE_DROP_OLDEST // PIPELINE_DROP_NEWEST, PIPELINE_DROP_OLDEST or PIPELINE_BLOCK
+#define PIPELINE_BLOCK_TIMEOUT_MS 30000
+#define PIPELINE_CAPTURE_CORE 1
+#define PIPELINE_UPLOAD_CORE 0
+#define PIPELINE_STACK_SIZE 8192
+
+// boot
+#define BOOT_STACK_SIZE 8192
+#define MODEM_BOOT_TIMEOUT_MS 10000      // wait for the first AT answer after power-up
+#define MODEM_REGISTER_TIMEOUT_MS 60000  // before giving up on the cached network mode
+#define MODEM_NETWORK_MODE 38            // +CNMP until one is cached, 38 = LTE only
+#define MODEM_NETWORK_AUTO 2
+#define MODEM_INIT_ATTEMPTS 5            // modem.init() tries before giving up on the modem
+#define MODEM_REGISTER_ATTEMPTS 5        // MODEM_REGISTER_TIMEOUT_MS waits in automatic mode
+#define MODEM_FAIL_SLEEP_MS (10UL * 60000) // deep sleep with the modem unpowered when it won't come up
+#define BOOT_UPLOAD_WAIT_MS 600000       // events queue on the SD card when the modem stage takes longer
+
+// local wall clock, resynced from the modem on this schedule
+#define CLOCK_RESYNC_INTERVAL_MS (6UL * 3600 * 1000)
+
+// job intervals, kept by the power scheduler
+#define REPORT_INTERVAL_MS (24UL * 3600 * 1000)
+#define OTA_CHECK_INTERVAL_MS (30UL * 60000)
+#define OUTBOX_RETRY_INTERVAL_MS (10UL * 60000) // wake up for queued uploads this often
+
+// daily report. the battery reading is the modem supply (+CBC), mapped
+// linearly between these for the percentage
+#define METRICS_REPORT_SIZE 768
+#define REPORT_SIZE (256 + METRICS_REPORT_SIZE) // the fixed lines and the metrics, src/report.h
+#define BAT_EMPTY_MV 3300
+#define BAT_FULL_MV 4200
+
+// power scheduling. deep sleep loses the PSRAM frame history and the motion
+// background, so it only pays off with capture intervals of minutes
+#define POWER_LIGHT_SLEEP_MIN_MS 200      // shorter gaps are waited out awake
+#define POWER_DEEP_SLEEP_MIN_MS 120000    // gaps this long reboot instead of light sleeping
+#define POWER_MODEM_PSM_MIN_MS 600000     // deep sleeps this long put the modem in PSM
+#define POWER_DEEP_WAKE_MS 4000           // warm boot until the camera is ready
+// rough draw for the energy estimate, measure on the real board
+#define POWER_ACTIVE_MA 110
+#define POWER_LIGHT_SLEEP_MA 8            // PSRAM and camera stay powered
+#define POWER_DEEP_SLEEP_MA 1
+#define POWER_MODEM_ON_MA 20              // registered and idle
+#define POWER_MODEM_PSM_MA 1
+
+// GNSS
+#define GNSS_REPORT_INTERVAL 60             // seconds between +CGNSSINFO reports, 0 turns them off
+#define GNSS_MAX_FIX_AGE_MS (30UL * 60000)  // cached fixes older than this are refreshed
+#define GNSS_FIX_BUDGET_MS 60000            // longest a report waits for a fix
+#define GNSS_POLL_INTERVAL_MS 2000
+#define GNSS_GOOD_HDOP 2.0                  // stop polling once a fix is this precise
+
+// SD store-and-forward queue for failed uploads
+#define OUTBOX_DIR "/sd/outbox"     // SD is mounted at /sd in the VFS
+
+// binary telemetry, one record per interval kept in an SD ring, the unsent
+// ones go up as a batch with each report
+#define TELEMETRY_FILE "/sd/telemetry.bin"
+#define TELEMETRY_INTERVAL_MS (60UL * 60000)
+#define TELEMETRY_SLOTS 336         // two weeks of hourly records
+
+// modem FTP session reuse
+#define FTP_IDLE_TIMEOUT 300000         // log out after this long without uploads
+#define FTP_HEALTH_CHECK_INTERVAL 60000 // probe an idle session before reusing it
+#define FTP_PUT_RETRIES 3
+
+// direct TCP photo upload, falls back to EFS + FTP when it fails
+// #define TCP_UPLOAD_ENABLED
+#define TCP_UPLOAD_HOST "13.246.234.82"
+#define TCP_UPLOAD_PORT 5005
+#define TCP_UPLOAD_CHUNK 1024
+#define TCP_UPLOAD_STALL_TIMEOUT 10000
+#define TCP_UPLOAD_ACK_TIMEOUT 30000
+
 #define SerialAT Serial1
 // #define DUMP_AT_COMMANDS
 #define GSM_BAUD 9600
+#define MODEM_UART_BAUD 115200
 #define TINY_GSM_MODEM_SIM7600
 #define GNSS_MODE 2
 #define DPO_MODE true
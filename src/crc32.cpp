@@ -0,0 +1,25 @@
+#include "crc32.h"
+
+static uint32_t crcTable[256];
+
+// fill the lookup table once at startup, before any task can race on it
+static struct CrcTableInit {
+  CrcTableInit() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int bit = 0; bit < 8; bit++) {
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      crcTable[i] = c;
+    }
+  }
+} crcTableInit;
+
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  crc = ~crc;
+  while (length--) {
+    crc = crcTable[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
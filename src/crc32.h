@@ -0,0 +1,11 @@
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// standard CRC-32 (IEEE 802.3, same as zlib.crc32). pass the previous
+// result back in to checksum data in pieces, starting from 0
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length);
+
+#endif
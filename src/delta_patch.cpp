@@ -0,0 +1,126 @@
+#include "delta_patch.h"
+#include <string.h>
+
+static uint32_t getLe32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+DeltaPatcher::DeltaPatcher() {
+  memset(&_target, 0, sizeof(_target));
+  memset(&_header, 0, sizeof(_header));
+  _state = STATE_FAILED;
+}
+
+void DeltaPatcher::begin(const DeltaTarget &target) {
+  _target = target;
+  memset(&_header, 0, sizeof(_header));
+  _state = STATE_HEADER;
+  _fieldLength = 0;
+  _fieldNeeded = DELTA_HEADER_SIZE;
+  _oldOffset = 0;
+  _remaining = 0;
+  _written = 0;
+  _copied = 0;
+  _literal = 0;
+}
+
+bool DeltaPatcher::fail() {
+  _state = STATE_FAILED;
+  return false;
+}
+
+bool DeltaPatcher::emit(const uint8_t *data, size_t length) {
+  if (!_target.write(data, length, _target.context)) return fail();
+  _written += length;
+  _remaining -= length;
+  if (_remaining == 0) {
+    _state = _written == _header.newSize ? STATE_DONE : STATE_OPCODE;
+    _fieldLength = 0;
+    _fieldNeeded = 1;
+  }
+  return true;
+}
+
+bool DeltaPatcher::feed(const uint8_t *data, size_t length) {
+  while (length > 0) {
+    switch (_state) {
+      case STATE_HEADER:
+      case STATE_OPCODE: {
+        size_t count = _fieldNeeded - _fieldLength;
+        if (count > length) count = length;
+        memcpy(_field + _fieldLength, data, count);
+        _fieldLength += count;
+        data += count;
+        length -= count;
+        if (_fieldLength < _fieldNeeded) break;
+
+        if (_state == STATE_HEADER) {
+          if (memcmp(_field, DELTA_MAGIC, 4) != 0) return fail();
+          _header.oldSize = getLe32(_field + 4);
+          _header.newSize = getLe32(_field + 8);
+          memcpy(_header.oldDigest, _field + 12, SHA256_SIZE);
+          memcpy(_header.newDigest, _field + 12 + SHA256_SIZE, SHA256_SIZE);
+          if (!_target.begin(_header, _target.context)) return fail();
+          _state = _header.newSize ? STATE_OPCODE : STATE_DONE;
+          _fieldLength = 0;
+          _fieldNeeded = 1;
+          break;
+        }
+
+        // the opcode byte tells how many argument bytes follow
+        if (_fieldNeeded == 1) {
+          if (_field[0] == 'A') {
+            _fieldNeeded = 9;
+          } else if (_field[0] == 'D') {
+            _fieldNeeded = 5;
+          } else {
+            return fail();
+          }
+          break;
+        }
+
+        if (_field[0] == 'A') {
+          _oldOffset = getLe32(_field + 1);
+          _remaining = getLe32(_field + 5);
+          if (_oldOffset > _header.oldSize || _remaining > _header.oldSize - _oldOffset) return fail();
+          _state = STATE_ADD;
+        } else {
+          _remaining = getLe32(_field + 1);
+          _state = STATE_DATA;
+        }
+        if (_remaining == 0 || _remaining > _header.newSize - _written) return fail();
+        break;
+      }
+
+      case STATE_ADD: {
+        size_t count = _remaining;
+        if (count > length) count = length;
+        if (count > DELTA_CHUNK_SIZE) count = DELTA_CHUNK_SIZE;
+        if (!_target.readOld(_oldOffset, _chunk, count, _target.context)) return fail();
+        for (size_t i = 0; i < count; i++) _chunk[i] += data[i];
+        _oldOffset += count;
+        _copied += count;
+        data += count;
+        length -= count;
+        if (!emit(_chunk, count)) return false;
+        break;
+      }
+
+      case STATE_DATA: {
+        size_t count = _remaining;
+        if (count > length) count = length;
+        _literal += count;
+        if (!emit(data, count)) return false;
+        data += count;
+        length -= count;
+        break;
+      }
+
+      case STATE_DONE:
+      case STATE_FAILED:
+        // anything past the end of the new image means the patch is bad
+        return fail();
+    }
+  }
+  return true;
+}
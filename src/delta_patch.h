@@ -0,0 +1,80 @@
+#ifndef __DELTA_PATCH_H__
+#define __DELTA_PATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256.h"
+
+// streaming applier for the SCD1 firmware patch format written by
+// tools/make_delta.py. the (decompressed) patch is a header followed by
+// operations, all integers little endian:
+//   "SCD1" | u32 old size | u32 new size | old sha256 | new sha256
+//   'A' u32 old offset, u32 length, length bytes added to the old bytes
+//   'D' u32 length, length literal bytes
+// bytes can be fed in pieces of any size; output goes out in order through
+// the target, old bytes are read back on demand, so RAM use is fixed at
+// DELTA_CHUNK_SIZE. no Arduino dependencies
+
+#define DELTA_MAGIC "SCD1"
+#define DELTA_HEADER_SIZE (4 + 4 + 4 + 2 * SHA256_SIZE)
+#define DELTA_CHUNK_SIZE 512
+
+struct DeltaHeader {
+  uint32_t oldSize;
+  uint32_t newSize;
+  uint8_t oldDigest[SHA256_SIZE];
+  uint8_t newDigest[SHA256_SIZE];
+};
+
+struct DeltaTarget {
+  // header parsed; check the old image and get ready for newSize bytes
+  bool (*begin)(const DeltaHeader &header, void *context);
+  bool (*readOld)(uint32_t offset, uint8_t *out, size_t length, void *context);
+  bool (*write)(const uint8_t *data, size_t length, void *context);
+  void *context;
+};
+
+class DeltaPatcher {
+public:
+  DeltaPatcher();
+
+  void begin(const DeltaTarget &target);
+  // apply the next piece of the patch, false once the patch or the target failed
+  bool feed(const uint8_t *data, size_t length);
+  // every byte of the new image has been written
+  bool finished() const { return _state == STATE_DONE; }
+  bool failed() const { return _state == STATE_FAILED; }
+
+  const DeltaHeader &header() const { return _header; }
+  uint32_t written() const { return _written; }
+  uint32_t copiedBytes() const { return _copied; }   // from ADD operations
+  uint32_t literalBytes() const { return _literal; } // from DATA operations
+
+private:
+  enum State {
+    STATE_HEADER,
+    STATE_OPCODE,
+    STATE_ADD,
+    STATE_DATA,
+    STATE_DONE,
+    STATE_FAILED
+  };
+
+  bool fail();
+  bool emit(const uint8_t *data, size_t length);
+
+  DeltaTarget _target;
+  DeltaHeader _header;
+  State _state;
+  uint8_t _field[DELTA_HEADER_SIZE]; // header or opcode being gathered
+  size_t _fieldLength;
+  size_t _fieldNeeded;
+  uint32_t _oldOffset;
+  uint32_t _remaining;              // bytes left in the current operation
+  uint32_t _written;
+  uint32_t _copied;
+  uint32_t _literal;
+  uint8_t _chunk[DELTA_CHUNK_SIZE];
+};
+
+#endif
@@ -0,0 +1,285 @@
+#include "efs_transfer.h"
+#include <new>
+#include <esp_log.h>
+#include "config.h"
+#include "modem_at.h"
+#include "metrics.h"
+#include "lzss.h"
+
+struct EfsBufferSource {
+  const uint8_t *data;
+  size_t remaining;
+};
+
+struct EfsCompressSource {
+  LzssEncoder encoder;
+  uint8_t *work;            // LZSS_WORK_SIZE
+  const uint8_t *data;      // input in memory
+  fs::File *file;           // or on the SD card
+  size_t length;
+  size_t offset;
+  bool counting;            // first pass, output only counted
+  bool ended;
+  bool finished;            // stream ended cleanly
+  uint8_t input[EFS_COMPRESS_BLOCK];
+  uint8_t output[LZSS_MAX_OUTPUT(EFS_COMPRESS_BLOCK)];
+  size_t outputLength;
+  size_t outputOffset;
+};
+
+// hand out a memory buffer without copying it
+static size_t bufferSource(const uint8_t **chunk, size_t maxLength, void *context) {
+  EfsBufferSource *source = (EfsBufferSource *)context;
+  size_t count = min(maxLength, source->remaining);
+  *chunk = source->data;
+  source->data += count;
+  source->remaining -= count;
+  return count;
+}
+
+static bool compressSink(const uint8_t *data, size_t length, void *context) {
+  EfsCompressSource *source = (EfsCompressSource *)context;
+  if (source->counting) return true;
+  if (source->outputLength + length > sizeof(source->output)) return false;
+  memcpy(source->output + source->outputLength, data, length);
+  source->outputLength += length;
+  return true;
+}
+
+// start a new stream from the beginning of the input
+static bool compressRewind(EfsCompressSource *source, bool counting) {
+  source->offset = 0;
+  source->counting = counting;
+  source->ended = false;
+  source->finished = false;
+  source->outputLength = 0;
+  source->outputOffset = 0;
+  source->encoder.begin(source->work, compressSink, source);
+  return !source->file || source->file->seek(0);
+}
+
+// feed the encoder the next block of input, or end the stream after the
+// last one. false once there is nothing more
+static bool compressNext(EfsCompressSource *source) {
+  if (source->ended) return false;
+  if (source->offset == source->length) {
+    source->ended = true;
+    source->finished = source->encoder.finish();
+    return source->finished;
+  }
+  size_t count = min((size_t)EFS_COMPRESS_BLOCK, source->length - source->offset);
+  const uint8_t *block = source->data + source->offset;
+  if (source->file) {
+    if (source->file->read(source->input, count) != count) {
+      source->ended = true;
+      return false;
+    }
+    block = source->input;
+  }
+  source->offset += count;
+  return source->encoder.write(block, count);
+}
+
+// hand out the compressed stream a block of input at a time
+static size_t compressSource(const uint8_t **chunk, size_t maxLength, void *context) {
+  EfsCompressSource *source = (EfsCompressSource *)context;
+  while (source->outputOffset == source->outputLength) {
+    source->outputLength = 0;
+    source->outputOffset = 0;
+    if (!compressNext(source)) return 0;
+  }
+  size_t count = min(maxLength, source->outputLength - source->outputOffset);
+  *chunk = source->output + source->outputOffset;
+  source->outputOffset += count;
+  return count;
+}
+
+// time the UART needs for length bytes at 10 bits per byte
+static unsigned long nominalWindowMs(size_t length) {
+  return (unsigned long)((uint64_t)length * 10 * 1000 / MODEM_UART_BAUD) + 1;
+}
+
+// delete a file whose transfer failed part way, the modem keeps what it got
+static void efsDelete(const char *fileName) {
+  char command[96];
+  snprintf(command, sizeof(command), "+FSDEL=\"%s\"", fileName);
+  if (atSendWait(command, NULL, 10000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to delete partial EFS file %s", fileName);
+  }
+}
+
+// after the '>' prompt the modem takes exactly the announced length before
+// it answers anything. make up the rest with zeros so it leaves data mode
+static void efsAbort(const char *fileName, size_t remaining) {
+  static const uint8_t padding[64] = {0};
+  Stream &stream = atStream();
+  unsigned long startTime = millis();
+  while (remaining > 0) {
+    size_t count = stream.write(padding, min(sizeof(padding), remaining));
+    remaining -= count;
+    if (count == 0) {
+      if (millis() - startTime > EFS_STALL_TIMEOUT) {
+        ESP_LOGI(TAG, "EFS padding stalled with %u bytes to go", (unsigned)remaining);
+        return;
+      }
+      delay(1);
+    }
+  }
+  stream.flush();
+  atWaitFor(NULL, EFS_COMMIT_TIMEOUT);
+  efsDelete(fileName);
+}
+
+boolean efsTransfer(const char *fileName, size_t length, EfsSource source, void *context, EfsTransferStats *stats) {
+  EfsTransferStats localStats;
+  if (stats == NULL) stats = &localStats;
+  memset(stats, 0, sizeof(*stats));
+
+  if (atSendOnce("+FSCD=E:", NULL, 20000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to switch EFS directory");
+  }
+
+  ESP_LOGI(TAG, "File length: %u", (unsigned)length);
+  char uploadCommand[96];
+  snprintf(uploadCommand, sizeof(uploadCommand), "+CFTRANRX=\"e:/%s\",%u", fileName, (unsigned)length);
+  ESP_LOGI(TAG, "upload command: %s", uploadCommand);
+  atSend(uploadCommand);
+  if (atWaitPrompt(EFS_PROMPT_TIMEOUT) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to start file upload to EFS");
+    return false;
+  }
+
+  Stream &stream = atStream();
+  unsigned long startTime = millis();
+  int status = AT_RESPONSE_TIMEOUT;
+  size_t sent = 0;
+  while (sent < length) {
+    const uint8_t *chunk;
+    size_t chunkLength = source(&chunk, min((size_t)EFS_WINDOW_SIZE, length - sent), context);
+    if (chunkLength == 0) {
+      ESP_LOGI(TAG, "EFS source ended after %u of %u bytes", (unsigned)sent, (unsigned)length);
+      efsAbort(fileName, length - sent);
+      return false;
+    }
+
+    // a full UART TX buffer makes write() come back short, keep at it
+    // until the window is out or the link stalls
+    unsigned long windowStart = millis();
+    size_t written = 0;
+    while (written < chunkLength) {
+      size_t count = stream.write(chunk + written, chunkLength - written);
+      written += count;
+      if (written < chunkLength) {
+        if (millis() - windowStart > EFS_STALL_TIMEOUT) {
+          ESP_LOGI(TAG, "EFS transfer stalled after %u bytes", (unsigned)(sent + written));
+          efsAbort(fileName, length - sent - written);
+          return false;
+        }
+        delay(1);
+      }
+    }
+    stream.flush();
+    if (millis() - windowStart > 2 * nominalWindowMs(chunkLength)) {
+      stats->slowWindows++;
+    }
+    sent += chunkLength;
+
+    // the modem answers ERROR as soon as it gives up, no need to wait out the timeout
+    status = atPoll();
+    if (status == AT_RESPONSE_ERROR) {
+      // out of data mode already, only the file is left to clean up
+      ESP_LOGI(TAG, "Modem rejected EFS data after %u bytes", (unsigned)sent);
+      efsDelete(fileName);
+      return false;
+    }
+
+    if (EFS_WINDOW_GAP_MS > 0) {
+      delay(EFS_WINDOW_GAP_MS);
+    }
+  }
+
+  if (status != AT_RESPONSE_MATCH) {
+    status = atWaitFor(NULL, EFS_COMMIT_TIMEOUT);
+  }
+
+  stats->bytes = sent;
+  stats->inputBytes = sent;
+  stats->elapsedMs = millis() - startTime;
+  metricRecord(METRIC_EFS_TRANSFER, stats->elapsedMs * 1000);
+  stats->bytesPerSecond = stats->elapsedMs ? (uint32_t)((uint64_t)sent * 1000 / stats->elapsedMs) : 0;
+
+  if (status != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to write file to EFS");
+    efsDelete(fileName);
+    return false;
+  }
+
+  ESP_LOGI(TAG, "File successfully written to EFS: %u bytes in %lu ms (%u B/s, %u slow windows)",
+           (unsigned)sent, stats->elapsedMs, stats->bytesPerSecond, stats->slowWindows);
+  return true;
+}
+
+boolean efsTransferBuffer(const char *fileName, const uint8_t *data, size_t length, EfsTransferStats *stats) {
+  EfsBufferSource source = {data, length};
+  return efsTransfer(fileName, length, bufferSource, &source, stats);
+}
+
+static boolean transferCompressed(const char *fileName, EfsCompressSource *source, EfsTransferStats *stats) {
+  EfsTransferStats localStats;
+  if (stats == NULL) stats = &localStats;
+  source->work = (uint8_t *)malloc(LZSS_WORK_SIZE);
+  if (!source->work) {
+    ESP_LOGE(TAG, "Failed to allocate compression window");
+    return false;
+  }
+
+  unsigned long startTime = millis();
+  boolean ok = compressRewind(source, true);
+  while (ok && compressNext(source)) {}
+  size_t compressed = source->encoder.outputBytes();
+  unsigned long countMs = millis() - startTime;
+  ok = ok && source->finished && compressRewind(source, false) &&
+       efsTransfer(fileName, compressed, compressSource, source, stats);
+  free(source->work);
+  stats->inputBytes = source->length;
+  if (!ok) {
+    ESP_LOGI(TAG, "Compressed EFS transfer of %u bytes failed", (unsigned)source->length);
+    return false;
+  }
+  ESP_LOGI(TAG, "Compressed %u to %u bytes (%u%%), %lu ms to size the stream", (unsigned)source->length,
+           (unsigned)compressed, source->length ? (unsigned)(compressed * 100 / source->length) : 0, countMs);
+  return true;
+}
+
+// over 1 KB with its blocks, kept off the caller's stack. nothing in it
+// needs destroying, free() is enough
+static EfsCompressSource *compressSourceCreate() {
+  void *memory = malloc(sizeof(EfsCompressSource));
+  if (!memory) {
+    ESP_LOGE(TAG, "Failed to allocate compression source");
+    return NULL;
+  }
+  return new (memory) EfsCompressSource();
+}
+
+boolean efsTransferCompressed(const char *fileName, const uint8_t *data, size_t length, EfsTransferStats *stats) {
+  EfsCompressSource *source = compressSourceCreate();
+  if (!source) return false;
+  source->data = data;
+  source->file = NULL;
+  source->length = length;
+  boolean ok = transferCompressed(fileName, source, stats);
+  free(source);
+  return ok;
+}
+
+boolean efsTransferCompressedFile(const char *fileName, fs::File &file, EfsTransferStats *stats) {
+  EfsCompressSource *source = compressSourceCreate();
+  if (!source) return false;
+  source->data = NULL;
+  source->file = &file;
+  source->length = file.size();
+  boolean ok = transferCompressed(fileName, source, stats);
+  free(source);
+  return ok;
+}
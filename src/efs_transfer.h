@@ -0,0 +1,35 @@
+#ifndef __EFS_TRANSFER_H__
+#define __EFS_TRANSFER_H__
+
+#include <Arduino.h>
+#include <FS.h>
+
+// streams data into a SIM7600 EFS file with +CFTRANRX: waits for the '>'
+// prompt, writes in EFS_WINDOW_SIZE windows, and checks the modem for an
+// early ERROR between windows. a transfer that fails part way pads the
+// modem out of data mode and deletes the partial file. text can go up LZSS
+// compressed on the fly
+
+struct EfsTransferStats {
+  size_t bytes;
+  unsigned long elapsedMs;
+  uint32_t bytesPerSecond;
+  uint32_t slowWindows;  // windows that took well over their nominal UART time
+  size_t inputBytes;     // before compression, same as bytes otherwise
+};
+
+// hands out the next contiguous chunk of at most maxLength bytes, returns
+// its length (0 when the source is exhausted)
+typedef size_t (*EfsSource)(const uint8_t **chunk, size_t maxLength, void *context);
+
+boolean efsTransfer(const char *fileName, size_t length, EfsSource source, void *context, EfsTransferStats *stats = NULL);
+boolean efsTransferBuffer(const char *fileName, const uint8_t *data, size_t length, EfsTransferStats *stats = NULL);
+
+// the same as an SCZ1 stream (lzss.h). +CFTRANRX needs the stream length up
+// front, so the input is compressed twice, once to count and once to send,
+// and RAM stays at the encoder's fixed window whatever the input size
+boolean efsTransferCompressed(const char *fileName, const uint8_t *data, size_t length, EfsTransferStats *stats = NULL);
+// compress an SD card file from its start, e.g. a rotated log segment
+boolean efsTransferCompressedFile(const char *fileName, fs::File &file, EfsTransferStats *stats = NULL);
+
+#endif
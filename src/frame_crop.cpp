@@ -0,0 +1,107 @@
+#include "frame_crop.h"
+#include <esp_log.h>
+#include "config.h"
+
+struct CropContext {
+  RoiRect rect;         // at decode scale
+  uint8_t *pixels;      // rect.width * rect.height BGR, the camera library's RGB888 order
+  bool complete;        // every row of rect was written
+};
+
+static FrameCropStats stats;
+
+static bool writeCrop(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+  CropContext *context = (CropContext *)arg;
+  const RoiRect &rect = context->rect;
+  if (!data) {
+    // start and end of the image
+    return true;
+  }
+  if (y >= rect.y + rect.height) {
+    // blocks arrive top to bottom, nothing below the crop is needed
+    context->complete = true;
+    return false;
+  }
+
+  int x0 = max((int)x, (int)rect.x);
+  int x1 = min((int)x + w, (int)rect.x + rect.width);
+  int y0 = max((int)y, (int)rect.y);
+  int y1 = min((int)y + h, (int)rect.y + rect.height);
+  for (int row = y0; row < y1; row++) {
+    const uint8_t *src = data + ((size_t)(row - y) * w + (x0 - x)) * 3;
+    uint8_t *dst = context->pixels + ((size_t)(row - rect.y) * rect.width + (x0 - rect.x)) * 3;
+    for (int column = x0; column < x1; column++) {
+      dst[0] = src[2];
+      dst[1] = src[1];
+      dst[2] = src[0];
+      src += 3;
+      dst += 3;
+    }
+  }
+  return true;
+}
+
+bool frameCrop(const FrameCropCodec &codec, const uint8_t *jpeg, size_t length, const RoiRect &rect,
+               uint8_t scaleShift, size_t budget, uint8_t **out, size_t *outLength, uint8_t *quality) {
+  *out = NULL;
+  *outLength = 0;
+
+  CropContext context;
+  context.rect.x = rect.x >> scaleShift;
+  context.rect.y = rect.y >> scaleShift;
+  context.rect.width = max(rect.width >> scaleShift, 1);
+  context.rect.height = max(rect.height >> scaleShift, 1);
+  context.complete = false;
+  size_t pixelBytes = (size_t)context.rect.width * context.rect.height * 3;
+  context.pixels = (uint8_t *)ps_calloc(pixelBytes, 1);
+  if (!context.pixels) {
+    ESP_LOGE(TAG, "Failed to allocate %u byte crop buffer", (unsigned)pixelBytes);
+    stats.failures++;
+    return false;
+  }
+
+  uint32_t startTime = millis();
+  bool decoded = codec.decode(jpeg, length, scaleShift, writeCrop, &context);
+  stats.lastDecodeMs = millis() - startTime;
+  // the writer cuts decoding short below the crop, which reads as a failure
+  if (!decoded && !context.complete) {
+    ESP_LOGI(TAG, "Failed to decode frame for cropping");
+    free(context.pixels);
+    stats.failures++;
+    return false;
+  }
+
+  startTime = millis();
+  for (int q = ROI_QUALITY_MAX; ; q -= ROI_QUALITY_STEP) {
+    uint8_t *encoded = NULL;
+    size_t encodedLength = 0;
+    if (!codec.encode(context.pixels, context.rect.width, context.rect.height, (uint8_t)q, &encoded, &encodedLength)) {
+      ESP_LOGI(TAG, "Failed to encode crop at quality %d", q);
+      break;
+    }
+    boolean last = q - ROI_QUALITY_STEP < ROI_QUALITY_MIN;
+    if (encodedLength <= budget || last) {
+      if (encodedLength > budget) stats.overBudget++;
+      *out = encoded;
+      *outLength = encodedLength;
+      *quality = (uint8_t)q;
+      break;
+    }
+    free(encoded);
+  }
+  stats.lastEncodeMs = millis() - startTime;
+  free(context.pixels);
+
+  if (!*out) {
+    stats.failures++;
+    return false;
+  }
+  stats.crops++;
+  stats.bytesIn += length;
+  stats.bytesOut += *outLength;
+  return true;
+}
+
+const FrameCropStats &frameCropStats() {
+  return stats;
+}
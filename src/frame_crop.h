@@ -0,0 +1,46 @@
+#ifndef __FRAME_CROP_H__
+#define __FRAME_CROP_H__
+
+#include <Arduino.h>
+#include "roi.h"
+
+// cut a region out of a camera JPEG and re-encode it smaller. the frame is
+// decoded at 1/2^scaleShift scale with only the rows and columns inside the
+// region kept, then encoded stepping quality down from ROI_QUALITY_MAX until
+// it fits the budget. the codec is passed in: the camera library's decoder
+// and integer encoder on the device, libjpeg in the host bench
+
+struct FrameCropStats {
+  uint32_t crops;
+  uint32_t failures;
+  uint32_t overBudget;    // still larger than the budget at ROI_QUALITY_MIN
+  uint64_t bytesIn;       // full frames
+  uint64_t bytesOut;      // crops
+  uint32_t lastDecodeMs;
+  uint32_t lastEncodeMs;
+};
+
+// gets the decoded image a block at a time, top to bottom, 3 bytes a pixel
+// in RGB order, data NULL at start and end. false stops the decode
+typedef bool (*FrameCropWriter)(void *context, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data);
+
+struct FrameCropCodec {
+  // decode at 1/2^scaleShift, false on a bad frame or when write stopped it
+  bool (*decode)(const uint8_t *jpeg, size_t length, uint8_t scaleShift, FrameCropWriter write, void *context);
+  // encode width x height pixels, BGR as the camera library's RGB888, at
+  // quality 1-100 into a buffer the caller frees
+  bool (*encode)(const uint8_t *pixels, uint16_t width, uint16_t height, uint8_t quality, uint8_t **out,
+                 size_t *outLength);
+};
+
+// esp_jpg_decode and fmt2jpg, in frame_crop_camera.cpp
+extern const FrameCropCodec frameCropCameraCodec;
+
+// out is allocated by the codec for the caller to free. false when the
+// frame couldn't be decoded or encoded
+bool frameCrop(const FrameCropCodec &codec, const uint8_t *jpeg, size_t length, const RoiRect &rect,
+               uint8_t scaleShift, size_t budget, uint8_t **out, size_t *outLength, uint8_t *quality);
+
+const FrameCropStats &frameCropStats();
+
+#endif
@@ -0,0 +1,37 @@
+#include "frame_crop.h"
+#include <esp_jpg_decode.h>
+#include <img_converters.h>
+
+struct CameraDecode {
+  const uint8_t *jpeg;
+  size_t length;
+  FrameCropWriter write;
+  void *context;
+};
+
+static size_t readJpeg(void *arg, size_t index, uint8_t *buf, size_t len) {
+  CameraDecode *decode = (CameraDecode *)arg;
+  if (index >= decode->length) return 0;
+  if (len > decode->length - index) len = decode->length - index;
+  if (buf) memcpy(buf, decode->jpeg + index, len);
+  return len;
+}
+
+static bool writeBlock(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+  CameraDecode *decode = (CameraDecode *)arg;
+  return decode->write(decode->context, x, y, w, h, data);
+}
+
+static bool cameraDecode(const uint8_t *jpeg, size_t length, uint8_t scaleShift, FrameCropWriter write,
+                         void *context) {
+  CameraDecode decode = {jpeg, length, write, context};
+  return esp_jpg_decode(length, (jpg_scale_t)scaleShift, readJpeg, writeBlock, &decode) == ESP_OK;
+}
+
+static bool cameraEncode(const uint8_t *pixels, uint16_t width, uint16_t height, uint8_t quality, uint8_t **out,
+                         size_t *outLength) {
+  return fmt2jpg((uint8_t *)pixels, (size_t)width * height * 3, width, height, PIXFORMAT_RGB888, quality, out,
+                 outLength);
+}
+
+const FrameCropCodec frameCropCameraCodec = {cameraDecode, cameraEncode};
@@ -0,0 +1,109 @@
+#include "frame_ring.h"
+#include <string.h>
+
+FrameRing::FrameRing()
+  : _arena(NULL), _freeCount(0), _head(0), _count(0), _history(0), _sequence(0) {
+  memset(_frames, 0, sizeof(_frames));
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool FrameRing::begin(uint8_t *arena, size_t arenaSize, size_t slotSize, uint16_t history) {
+  memset(_frames, 0, sizeof(_frames));
+  memset(&_stats, 0, sizeof(_stats));
+  _arena = arena;
+  _head = 0;
+  _count = 0;
+  _freeCount = 0;
+
+  size_t slots = slotSize ? arenaSize / slotSize : 0;
+  if (slots > FRAME_RING_MAX_SLOTS) slots = FRAME_RING_MAX_SLOTS;
+  if (arena == NULL || slots == 0) return false;
+
+  for (size_t i = 0; i < slots; i++) {
+    _frames[i].data = arena + i * slotSize;
+    _freeSlots[_freeCount++] = (uint8_t)(slots - 1 - i);
+  }
+  _history = history == 0 || history > slots ? (uint16_t)slots : history;
+  _stats.slots = (uint16_t)slots;
+  _stats.slotSize = slotSize;
+  return true;
+}
+
+int FrameRing::allocSlot() {
+  if (_freeCount == 0) return -1;
+  int slot = _freeSlots[--_freeCount];
+  _stats.slotsInUse++;
+  if (_stats.slotsInUse > _stats.peakSlotsInUse) _stats.peakSlotsInUse = _stats.slotsInUse;
+  return slot;
+}
+
+StoredFrame *FrameRing::at(uint16_t index) {
+  if (index >= _count) return NULL;
+  return &_frames[_ring[(_head + index) % FRAME_RING_MAX_SLOTS]];
+}
+
+StoredFrame *FrameRing::push(const uint8_t *data, size_t length, int64_t captureUs, uint16_t width, uint16_t height) {
+  if (_arena == NULL) return NULL;
+  if (length > _stats.slotSize) {
+    _stats.oversize++;
+    return NULL;
+  }
+
+  // drop the oldest remembered frame; its slot frees once uploads let go
+  if (_count == _history) {
+    StoredFrame *oldest = at(0);
+    _head = (_head + 1) % FRAME_RING_MAX_SLOTS;
+    _count--;
+    _stats.evictions++;
+    release(oldest);
+  }
+
+  int slot = allocSlot();
+  if (slot < 0) {
+    _stats.exhausted++;
+    return NULL;
+  }
+
+  StoredFrame *frame = &_frames[slot];
+  memcpy(frame->data, data, length);
+  frame->length = length;
+  frame->captureUs = captureUs;
+  frame->sequence = ++_sequence;
+  frame->width = width;
+  frame->height = height;
+  frame->refs = 1;
+  frame->uploaded = false;
+
+  _ring[(_head + _count) % FRAME_RING_MAX_SLOTS] = (uint8_t)slot;
+  _count++;
+  _stats.bytesInUse += length;
+  if (_stats.bytesInUse > _stats.peakBytesInUse) _stats.peakBytesInUse = _stats.bytesInUse;
+  return frame;
+}
+
+void FrameRing::retain(StoredFrame *frame) {
+  frame->refs++;
+}
+
+void FrameRing::release(StoredFrame *frame) {
+  if (frame->refs == 0 || --frame->refs > 0) return;
+  _stats.bytesInUse -= frame->length;
+  _stats.slotsInUse--;
+  frame->length = 0;
+  _freeSlots[_freeCount++] = (uint8_t)(frame - _frames);
+}
+
+void FrameRing::clear() {
+  while (_count > 0) {
+    StoredFrame *oldest = at(0);
+    _head = (_head + 1) % FRAME_RING_MAX_SLOTS;
+    _count--;
+    release(oldest);
+  }
+}
+
+uint8_t FrameRing::fragmentationPercent() const {
+  size_t held = (size_t)_stats.slotsInUse * _stats.slotSize;
+  if (held == 0) return 0;
+  return (uint8_t)(100 - _stats.bytesInUse * 100 / held);
+}
@@ -0,0 +1,81 @@
+#ifndef __FRAME_RING_H__
+#define __FRAME_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// history of the last few compressed frames, kept in fixed-size slots carved
+// out of one arena so PSRAM never fragments. the ring holds a reference to
+// each frame it remembers; uploads take their own with retain() so a frame
+// being sent survives eviction. insert and evict are O(1). no Arduino
+// dependencies, the arena is handed in by the caller
+
+#define FRAME_RING_MAX_SLOTS 16
+
+struct StoredFrame {
+  uint8_t *data;
+  size_t length;
+  int64_t captureUs;   // capture time on the esp_timer clock
+  uint32_t sequence;
+  uint16_t width;
+  uint16_t height;
+  uint8_t refs;
+  bool uploaded;
+};
+
+struct FramePoolStats {
+  uint16_t slots;
+  uint16_t slotsInUse;
+  uint16_t peakSlotsInUse;
+  size_t slotSize;
+  size_t bytesInUse;   // frame bytes actually stored
+  size_t peakBytesInUse;
+  uint32_t oversize;   // frames larger than a slot
+  uint32_t exhausted;  // inserts that found every slot referenced
+  uint32_t evictions;
+};
+
+class FrameRing {
+public:
+  FrameRing();
+
+  // carve the arena into slotSize slots, up to FRAME_RING_MAX_SLOTS. history
+  // is how many frames the ring remembers; the remaining slots are headroom
+  // for frames still referenced by uploads
+  bool begin(uint8_t *arena, size_t arenaSize, size_t slotSize, uint16_t history);
+
+  // copy a frame in, evicting the oldest one when the history is full.
+  // NULL when the frame is too big or no slot is free
+  StoredFrame *push(const uint8_t *data, size_t length, int64_t captureUs, uint16_t width, uint16_t height);
+
+  // frames currently remembered, 0 is the oldest
+  uint16_t count() const { return _count; }
+  StoredFrame *at(uint16_t index);
+  StoredFrame *newest() { return _count ? at(_count - 1) : NULL; }
+
+  void retain(StoredFrame *frame);
+  void release(StoredFrame *frame);
+
+  // forget everything; frames still retained elsewhere stay valid until released
+  void clear();
+
+  // percentage of held slot space not used by frame bytes
+  uint8_t fragmentationPercent() const;
+  const FramePoolStats &stats() const { return _stats; }
+
+private:
+  int allocSlot();
+
+  uint8_t *_arena;
+  StoredFrame _frames[FRAME_RING_MAX_SLOTS]; // one descriptor per slot
+  uint8_t _freeSlots[FRAME_RING_MAX_SLOTS];  // free list stack
+  uint16_t _freeCount;
+  uint8_t _ring[FRAME_RING_MAX_SLOTS];       // slot indices, oldest first from _head
+  uint16_t _head;
+  uint16_t _count;
+  uint16_t _history;
+  uint32_t _sequence;
+  FramePoolStats _stats;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "ftp_session.h"
+#include <esp_log.h>
+#include "config.h"
+#include "secrets.h"
+#include "modem_at.h"
+#include "metrics.h"
+
+static boolean ftpLoggedIn = false;
+static boolean ftpDropped = false;    // URC or failed command says the session is gone
+static boolean ftpNeedsCheck = false; // probe the session before the next put
+static unsigned long ftpLastUse = 0;
+static FtpSessionStats ftpStats;
+
+// logout and stop FTP service on modem
+static void stopFtp(void) {
+  char response[AT_LINE_SIZE];
+  if (atSendWait("+CFTPSLOGOUT", "+CFTPSLOGOUT:", 2000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+      atResultCode(response) == 0) {
+    ESP_LOGI(TAG, "Logged out FTP");
+  } else {
+    ESP_LOGI(TAG, "Failed to log out FTP");
+  }
+
+  if (atSendWait("+CFTPSSTOP", "+CFTPSSTOP:", 2000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+      atResultCode(response) == 0) {
+    ESP_LOGI(TAG, "Stopped FTP service on modem");
+  } else {
+    ESP_LOGI(TAG, "Failed to stop FTP service on modem");
+  }
+}
+
+// start FTP service on modem and login
+static boolean initFtp(void) {
+  char response[AT_LINE_SIZE];
+  unsigned long startTime = millis();
+
+  if (atSendWait("+CFTPSSTART", "+CFTPSSTART:", 10000) == AT_RESPONSE_ERROR) {
+    ESP_LOGI(TAG, "Failed to start FTP service on modem");
+    stopFtp();
+    atSendWait("+CFTPSSTART", NULL, 5000);
+  } else {
+    ESP_LOGI(TAG, "Started FTP service on modem");
+  }
+
+  char loginCommand[160];
+  snprintf(loginCommand, sizeof(loginCommand), "+CFTPSLOGIN=\"%s\",%d,\"%s\",\"%s\",0", FTP_SERVER, FTP_PORT, FTP_USER, FTP_PASS);
+  unsigned long loginUs = micros();
+  boolean ok = atSendWait(loginCommand, "+CFTPSLOGIN:", 20000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+               atResultCode(response) == 0;
+  metricRecord(METRIC_FTP_LOGIN, micros() - loginUs);
+  ftpStats.setupMs += millis() - startTime;
+  if (!ok) {
+    ESP_LOGI(TAG, "Failed to login FTP");
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Logged in FTP");
+  ftpStats.logins++;
+  return true;
+}
+
+// send file to FTP server (must be logged in first)
+static int sendFileToFtp(const char *fileName) {
+  char putCommand[96];
+  char response[AT_LINE_SIZE];
+  snprintf(putCommand, sizeof(putCommand), "+CFTPSPUTFILE=\"/%s\",3", fileName);
+  unsigned long startUs = micros();
+  boolean ok = atSendWait(putCommand, "+CFTPSPUTFILE:", 100000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+               atResultCode(response) == 0;
+  metricRecord(METRIC_FTP_PUT, micros() - startUs);
+  if (ok) {
+    ESP_LOGI(TAG, "Successfully ran FTP putfile");
+    return 0;
+  } else {
+    ESP_LOGI(TAG, "Failed to run putfile and upload file to ftp");
+    return -1;
+  }
+}
+
+// cheap round trip that fails once the server side of the session is gone
+static boolean ftpHealthy() {
+  if (ftpDropped) return false;
+  if (!ftpNeedsCheck && millis() - ftpLastUse < FTP_HEALTH_CHECK_INTERVAL) return true;
+  ftpNeedsCheck = false;
+  return atSendWait("+CFTPSPWD", "+CFTPSPWD:", 5000) == AT_RESPONSE_MATCH;
+}
+
+// reuse the current login if it is still good, else log in again
+static boolean ftpEnsureSession(boolean *reused) {
+  *reused = false;
+  if (ftpLoggedIn) {
+    if (ftpHealthy()) {
+      *reused = true;
+      return true;
+    }
+    ESP_LOGI(TAG, "FTP session dropped, logging in again");
+    ftpStats.drops++;
+    ftpSessionClose();
+  }
+
+  ftpDropped = false;
+  ftpNeedsCheck = false;
+  ftpLoggedIn = initFtp();
+  ftpLastUse = millis();
+  return ftpLoggedIn;
+}
+
+boolean ftpSessionPut(const char *fileName) {
+  for (int retries = FTP_PUT_RETRIES; retries >= 0; retries--) {
+    boolean reused;
+    if (!ftpEnsureSession(&reused)) {
+      ESP_LOGI(TAG, "Error while conecting to FTP");
+      return false;
+    }
+
+    int ftpResult = sendFileToFtp(fileName);
+    ftpLastUse = millis();
+    if (ftpResult == 0) {
+      ftpStats.puts++;
+      if (reused) ftpStats.reusedPuts++;
+      return true;
+    }
+
+    // a failed put often means the login went away, check before retrying
+    ftpStats.failedPuts++;
+    ftpNeedsCheck = true;
+    ESP_LOGI(TAG, "Error sending file to FTP, retrying, number of retires left : %d", retries);
+  }
+
+  ESP_LOGI(TAG, "Cannot send file to FTP");
+  return false;
+}
+
+void ftpSessionIdle() {
+  if (ftpLoggedIn && millis() - ftpLastUse >= FTP_IDLE_TIMEOUT) {
+    ESP_LOGI(TAG, "FTP session idle, closing");
+    ftpSessionClose();
+    ftpSessionLogStats();
+  }
+}
+
+void ftpSessionClose() {
+  if (ftpLoggedIn) {
+    stopFtp();
+  }
+  ftpLoggedIn = false;
+}
+
+void ftpSessionUrc(const AtEvent &event) {
+  if (event.urc == AT_URC_CFTPSNOTIFY && ftpLoggedIn) {
+    ESP_LOGI(TAG, "FTP session notification: %s", event.args);
+    ftpDropped = true;
+  }
+}
+
+const FtpSessionStats &ftpSessionStats() {
+  return ftpStats;
+}
+
+void ftpSessionLogStats() {
+  uint32_t reuseRate = ftpStats.puts ? ftpStats.reusedPuts * 100 / ftpStats.puts : 0;
+  uint32_t setupPerLogin = ftpStats.logins ? ftpStats.setupMs / ftpStats.logins : 0;
+  ESP_LOGI(TAG, "FTP sessions: %u logins, %u puts, %u%% reused, %u drops, %u failed puts, ~%u ms setup saved per reused put",
+           ftpStats.logins, ftpStats.puts, reuseRate, ftpStats.drops, ftpStats.failedPuts, setupPerLogin);
+}
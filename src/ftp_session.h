@@ -0,0 +1,33 @@
+#ifndef __FTP_SESSION_H__
+#define __FTP_SESSION_H__
+
+#include <Arduino.h>
+#include "at_parser.h"
+
+// keeps the modem FTP(S) session logged in across uploads. the session is
+// torn down after FTP_IDLE_TIMEOUT without uploads, health checked before
+// reuse, and only re-established when a URC or failed command shows it dropped
+
+struct FtpSessionStats {
+  uint32_t logins;
+  uint32_t puts;
+  uint32_t reusedPuts;   // puts that rode on an existing login
+  uint32_t failedPuts;
+  uint32_t drops;        // sessions lost to +CFTPSNOTIFY or failed health checks
+  uint32_t setupMs;      // total time spent in +CFTPSSTART/+CFTPSLOGIN
+};
+
+// upload one EFS file, logging in first if needed
+boolean ftpSessionPut(const char *fileName);
+
+// call periodically, closes the session once it has been idle too long
+void ftpSessionIdle();
+void ftpSessionClose();
+
+// feed URCs seen outside of an FTP exchange
+void ftpSessionUrc(const AtEvent &event);
+
+const FtpSessionStats &ftpSessionStats();
+void ftpSessionLogStats();
+
+#endif
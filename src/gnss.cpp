@@ -0,0 +1,153 @@
+#include "gnss.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wall_clock.h"
+
+size_t gnssSplitFields(char *text, char **fields, size_t maxFields) {
+  size_t count = 0;
+  if (maxFields == 0) return 0;
+  fields[count++] = text;
+  for (char *p = text; *p; p++) {
+    if (*p == ',') {
+      *p = '\0';
+      if (count == maxFields) break;
+      fields[count++] = p + 1;
+    }
+  }
+  return count;
+}
+
+bool gnssParseCoordinate(const char *text, char hemisphere, int32_t *degreesE7) {
+  // ddmm.mmmm, degrees are whatever comes before the last two integer digits
+  const char *dot = strchr(text, '.');
+  size_t integerDigits = dot ? (size_t)(dot - text) : strlen(text);
+  if (integerDigits < 3 || integerDigits > 5) return false;
+  for (const char *p = text; *p; p++) {
+    if ((*p < '0' || *p > '9') && p != dot) return false;
+  }
+
+  int degrees = 0;
+  for (size_t i = 0; i < integerDigits - 2; i++) degrees = degrees * 10 + (text[i] - '0');
+  double minutes = strtod(text + integerDigits - 2, NULL);
+  if (minutes >= 60.0) return false;
+
+  int64_t value = (int64_t)degrees * 10000000 + (int64_t)(minutes * 10000000.0 / 60.0 + 0.5);
+  if (hemisphere == 'S' || hemisphere == 'W') value = -value;
+  else if (hemisphere != 'N' && hemisphere != 'E') return false;
+  if (value > 1800000000 || value < -1800000000) return false;
+  *degreesE7 = (int32_t)value;
+  return true;
+}
+
+static bool isHemisphere(const char *field, char a, char b) {
+  return (field[0] == a || field[0] == b) && field[1] == '\0';
+}
+
+bool gnssParseInfo(const char *line, int64_t monoUs, GnssFix *fix) {
+  memset(fix, 0, sizeof(*fix));
+  fix->monoUs = monoUs;
+
+  const char *colon = strchr(line, ':');
+  if (colon && strncmp(line, "+CGNSSINFO", 10) == 0) line = colon + 1;
+  while (*line == ' ') line++;
+
+  char text[256];
+  size_t length = strlen(line);
+  while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == '\n' || line[length - 1] == ' ')) length--;
+  if (length >= sizeof(text)) return false;
+  memcpy(text, line, length);
+  text[length] = '\0';
+
+  char *fields[GNSS_MAX_FIELDS];
+  size_t count = gnssSplitFields(text, fields, GNSS_MAX_FIELDS);
+
+  bool empty = true;
+  for (size_t i = 0; i < count; i++) {
+    if (fields[i][0] != '\0') empty = false;
+  }
+  if (empty) {
+    // ",,,,,,,,,,,,,,," while the receiver is searching
+    return count >= 8;
+  }
+
+  // mode, then one satellite count per constellation (three, or four with
+  // Galileo), then lat,N/S,lon,E/W,date,time,alt,speed,course,PDOP,HDOP,VDOP
+  size_t hemisphere = 0;
+  for (size_t i = 5; i <= 6 && i + 2 < count; i++) {
+    if (isHemisphere(fields[i], 'N', 'S') && isHemisphere(fields[i + 2], 'E', 'W')) {
+      hemisphere = i;
+      break;
+    }
+  }
+  if (hemisphere == 0 || hemisphere + 4 >= count) return false;
+
+  if (!gnssParseCoordinate(fields[hemisphere - 1], fields[hemisphere][0], &fix->latitudeE7) ||
+      !gnssParseCoordinate(fields[hemisphere + 1], fields[hemisphere + 2][0], &fix->longitudeE7)) {
+    return false;
+  }
+
+  fix->mode = (uint8_t)atoi(fields[0]);
+  unsigned satellites = 0;
+  for (size_t i = 1; i + 1 < hemisphere; i++) satellites += (unsigned)atoi(fields[i]);
+  fix->satellites = satellites > 255 ? 255 : (uint8_t)satellites;
+
+  int64_t utcUs;
+  if (wallClockParseGnss(fields[hemisphere + 3], fields[hemisphere + 4], &utcUs)) fix->utcUs = utcUs;
+
+  float *numbers[] = {&fix->altitude, &fix->speed, &fix->course, &fix->pdop, &fix->hdop, &fix->vdop};
+  for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]) && hemisphere + 5 + i < count; i++) {
+    *numbers[i] = strtof(fields[hemisphere + 5 + i], NULL);
+  }
+
+  fix->valid = true;
+  return true;
+}
+
+size_t gnssFormatDms(char *out, size_t size, int32_t degreesE7, bool latitude) {
+  char direction = latitude ? (degreesE7 < 0 ? 'S' : 'N') : (degreesE7 < 0 ? 'W' : 'E');
+  int64_t value = degreesE7 < 0 ? -(int64_t)degreesE7 : degreesE7;
+  int64_t degrees = value / 10000000;
+  int64_t minutesE7 = value % 10000000 * 60;
+  int64_t minutes = minutesE7 / 10000000;
+  int64_t centiseconds = (minutesE7 % 10000000 * 6000 + 5000000) / 10000000;
+
+  int length = snprintf(out, size, "%c%d*%d'%d.%02d\"", direction, (int)degrees, (int)minutes,
+                        (int)(centiseconds / 100), (int)(centiseconds % 100));
+  return length > 0 && (size_t)length < size ? (size_t)length : 0;
+}
+
+GnssCache::GnssCache() {
+  memset(&_last, 0, sizeof(_last));
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool GnssCache::update(const char *line, int64_t monoUs) {
+  GnssFix fix;
+  _stats.replies++;
+  if (!gnssParseInfo(line, monoUs, &fix)) {
+    _stats.malformed++;
+    return false;
+  }
+  if (!fix.valid) {
+    // keep the old fix, fresh() decides whether it is still worth anything
+    _stats.empty++;
+    return false;
+  }
+  _stats.fixes++;
+  _last = fix;
+  return true;
+}
+
+const GnssFix *GnssCache::fresh(int64_t monoUs, int64_t maxAgeUs) const {
+  if (!_last.valid || monoUs - _last.monoUs > maxAgeUs) return NULL;
+  return &_last;
+}
+
+bool GnssCache::better(const GnssFix &a, const GnssFix &b) {
+  if (a.valid != b.valid) return a.valid;
+  if (a.mode != b.mode) return a.mode > b.mode;
+  // a missing HDOP reads as 0, don't let it win
+  if ((a.hdop > 0) != (b.hdop > 0)) return a.hdop > 0;
+  return a.hdop < b.hdop;
+}
@@ -0,0 +1,76 @@
+#ifndef __GNSS_H__
+#define __GNSS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SIM7600 +CGNSSINFO parsing and a cache of the last fix. replies are split
+// into fields by a tokenizer instead of searched for offsets, so empty
+// fields, the extra Galileo column of newer firmware and missing tails all
+// parse the same way. no Arduino dependencies so captured replies can be
+// replayed on the host
+
+#define GNSS_MAX_FIELDS 20
+
+struct GnssFix {
+  bool valid;           // false for the all-empty reply before the first fix
+  uint8_t mode;         // 2 = 2D, 3 = 3D
+  uint8_t satellites;   // summed over all constellations
+  int32_t latitudeE7;   // degrees * 1e7, negative to the south
+  int32_t longitudeE7;  // degrees * 1e7, negative to the west
+  float altitude;       // metres
+  float speed;          // knots
+  float course;         // degrees
+  float pdop;
+  float hdop;
+  float vdop;
+  int64_t utcUs;        // time of the fix, 0 when the reply had none
+  int64_t monoUs;       // monotonic time it was received
+};
+
+struct GnssStats {
+  uint32_t replies;
+  uint32_t fixes;
+  uint32_t empty;     // receiver on, no fix yet
+  uint32_t malformed;
+};
+
+// split text at commas into at most maxFields NUL terminated fields, in
+// place. returns the field count
+size_t gnssSplitFields(char *text, char **fields, size_t maxFields);
+
+// "+CGNSSINFO: ..." or just its arguments. false when the line can't be
+// read; true with fix->valid false for a well formed empty reply
+bool gnssParseInfo(const char *line, int64_t monoUs, GnssFix *fix);
+
+// ddmm.mmmm / dddmm.mmmm NMEA coordinate and hemisphere letter to degrees * 1e7
+bool gnssParseCoordinate(const char *text, char hemisphere, int32_t *degreesE7);
+
+// N12*34'56.78" style, returns the length written or 0 when out is too small
+size_t gnssFormatDms(char *out, size_t size, int32_t degreesE7, bool latitude);
+
+class GnssCache {
+public:
+  GnssCache();
+
+  // feed a +CGNSSINFO reply or URC, true when it held a fix
+  bool update(const char *line, int64_t monoUs);
+
+  bool hasFix() const { return _last.valid; }
+  const GnssFix &last() const { return _last; }
+  // age of the last fix, -1 without one
+  int64_t ageUs(int64_t monoUs) const { return _last.valid ? monoUs - _last.monoUs : -1; }
+  // the last fix if it is at most maxAgeUs old, else NULL
+  const GnssFix *fresh(int64_t monoUs, int64_t maxAgeUs) const;
+
+  // true when a is a better fix than b: 3D over 2D, then lower HDOP
+  static bool better(const GnssFix &a, const GnssFix &b);
+
+  const GnssStats &stats() const { return _stats; }
+
+private:
+  GnssFix _last;
+  GnssStats _stats;
+};
+
+#endif
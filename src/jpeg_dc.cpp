@@ -0,0 +1,296 @@
+#include "jpeg_dc.h"
+#include <limits.h>
+#include <string.h>
+
+static inline uint16_t readBe16(const uint8_t *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// build canonical code lookups from a DHT segment's counts and symbols
+static void buildHuffman(JpegHuffmanTable &table, const uint8_t *counts, const uint8_t *values, int total) {
+  memset(table.fast, 0, sizeof(table.fast));
+  memcpy(table.values, values, total);
+
+  int32_t code = 0;
+  int k = 0;
+  for (int length = 1; length <= 16; length++) {
+    table.valueOffset[length] = k - code;
+    for (int i = 0; i < counts[length - 1]; i++, k++, code++) {
+      if (length <= JPEG_DC_FAST_BITS) {
+        int shift = JPEG_DC_FAST_BITS - length;
+        for (int fill = 0; fill < (1 << shift); fill++) {
+          table.fast[(code << shift) | fill] = (uint16_t)((length << 8) | values[k]);
+        }
+      }
+    }
+    table.maxCode[length] = counts[length - 1] ? code - 1 : -1;
+    code <<= 1;
+  }
+  table.maxCode[17] = INT32_MAX;
+  table.defined = true;
+}
+
+bool JpegDcDecoder::parseHuffman(const uint8_t *segment, size_t length) {
+  while (length >= 17) {
+    uint8_t tableClass = segment[0] >> 4;
+    uint8_t tableId = segment[0] & 0x0F;
+    const uint8_t *counts = segment + 1;
+    int total = 0;
+    for (int i = 0; i < 16; i++) total += counts[i];
+    if (tableId > 3 || tableClass > 1 || total > 256 || length < 17 + (size_t)total) return false;
+
+    buildHuffman(tableClass ? _acTables[tableId] : _dcTables[tableId], counts, segment + 17, total);
+    segment += 17 + total;
+    length -= 17 + total;
+  }
+  return true;
+}
+
+void JpegDcDecoder::fill() {
+  while (_bitCount <= 24) {
+    uint32_t byte = 0;
+    if (!_marker && _in < _end) {
+      byte = *_in++;
+      if (byte == 0xFF) {
+        if (_in < _end && *_in == 0x00) {
+          _in++; // stuffed zero
+        } else {
+          // a marker ends the entropy coded data; pad with zeros and leave
+          // the input on the 0xFF so restart() can find it
+          _marker = true;
+          _in--;
+          byte = 0;
+        }
+      }
+    }
+    _bits |= byte << (24 - _bitCount);
+    _bitCount += 8;
+  }
+}
+
+int JpegDcDecoder::decodeSymbol(const JpegHuffmanTable &table) {
+  fill();
+  uint16_t entry = table.fast[_bits >> (32 - JPEG_DC_FAST_BITS)];
+  if (entry) {
+    int length = entry >> 8;
+    _bits <<= length;
+    _bitCount -= length;
+    return entry & 0xFF;
+  }
+  for (int length = JPEG_DC_FAST_BITS + 1; length <= 16; length++) {
+    int32_t code = (int32_t)(_bits >> (32 - length));
+    if (code <= table.maxCode[length]) {
+      _bits <<= length;
+      _bitCount -= length;
+      return table.values[code + table.valueOffset[length]];
+    }
+  }
+  return -1;
+}
+
+int JpegDcDecoder::receiveExtend(int size) {
+  if (size == 0) return 0;
+  fill();
+  int value = (int)(_bits >> (32 - size));
+  _bits <<= size;
+  _bitCount -= size;
+  if (value < (1 << (size - 1))) value -= (1 << size) - 1;
+  return value;
+}
+
+bool JpegDcDecoder::restart() {
+  // drop the partial byte and step over the RSTn marker
+  _bits = 0;
+  _bitCount = 0;
+  _marker = false;
+  while (_in + 1 < _end && !(_in[0] == 0xFF && _in[1] >= 0xD0 && _in[1] <= 0xD7)) _in++;
+  if (_in + 1 >= _end) return false;
+  _in += 2;
+  for (int i = 0; i < _componentCount; i++) _components[i].prediction = 0;
+  return true;
+}
+
+bool JpegDcDecoder::decodeScan(const uint8_t *segment, size_t segmentLength, const uint8_t *end, uint8_t *out, size_t capacity) {
+  uint8_t scanCount = segment[0];
+  if (scanCount == 0 || scanCount > _componentCount || segmentLength < 4 + 2 * (size_t)scanCount) return false;
+
+  Component *scan[4];
+  for (int i = 0; i < scanCount; i++) {
+    uint8_t id = segment[1 + 2 * i];
+    scan[i] = NULL;
+    for (int c = 0; c < _componentCount; c++) {
+      if (_components[c].id == id) scan[i] = &_components[c];
+    }
+    if (scan[i] == NULL) return false;
+    scan[i]->dcTable = segment[2 + 2 * i] >> 4;
+    scan[i]->acTable = segment[2 + 2 * i] & 0x0F;
+    scan[i]->prediction = 0;
+    if (scan[i]->dcTable > 3 || scan[i]->acTable > 3 ||
+        !_dcTables[scan[i]->dcTable].defined || !_acTables[scan[i]->acTable].defined) return false;
+  }
+
+  // luma is the first frame component; a single component scan is not interleaved
+  Component *luma = &_components[0];
+  int maxH = 1, maxV = 1;
+  for (int c = 0; c < _componentCount; c++) {
+    if (_components[c].h > maxH) maxH = _components[c].h;
+    if (_components[c].v > maxV) maxV = _components[c].v;
+  }
+  bool interleaved = scanCount > 1;
+  if (!interleaved && scan[0] != luma) return false;
+  int mcuWidth = interleaved ? 8 * maxH : 8 * maxH / luma->h;
+  int mcuHeight = interleaved ? 8 * maxV : 8 * maxV / luma->v;
+  int mcusX = (_width + mcuWidth - 1) / mcuWidth;
+  int mcusY = (_height + mcuHeight - 1) / mcuHeight;
+
+  int outW = outWidth();
+  int outH = outHeight();
+  if ((size_t)outW * outH > capacity) return false;
+  int quant = _quantDc[luma->quantTable];
+
+  _in = segment + segmentLength;
+  _end = end;
+  _bits = 0;
+  _bitCount = 0;
+  _marker = false;
+
+  int restartsLeft = _restartInterval;
+  for (int mcuY = 0; mcuY < mcusY; mcuY++) {
+    for (int mcuX = 0; mcuX < mcusX; mcuX++) {
+      if (_restartInterval) {
+        if (restartsLeft == 0) {
+          if (!restart()) return false;
+          restartsLeft = _restartInterval;
+        }
+        restartsLeft--;
+      }
+
+      for (int i = 0; i < scanCount; i++) {
+        Component *component = scan[i];
+        int blocksH = interleaved ? component->h : 1;
+        int blocksV = interleaved ? component->v : 1;
+        const JpegHuffmanTable &dc = _dcTables[component->dcTable];
+        const JpegHuffmanTable &ac = _acTables[component->acTable];
+
+        for (int v = 0; v < blocksV; v++) {
+          for (int h = 0; h < blocksH; h++) {
+            int size = decodeSymbol(dc);
+            if (size < 0 || size > 11) return false;
+            component->prediction += receiveExtend(size);
+
+            // walk the AC run/size symbols without keeping the coefficients
+            for (int k = 1; k < 64;) {
+              int rs = decodeSymbol(ac);
+              if (rs < 0) return false;
+              int run = rs >> 4;
+              int bits = rs & 0x0F;
+              if (bits == 0) {
+                if (run != 15) break; // end of block
+                k += 16;
+                continue;
+              }
+              k += run + 1;
+              fill();
+              _bits <<= bits;
+              _bitCount -= bits;
+            }
+
+            if (component == luma) {
+              int x = mcuX * blocksH + h;
+              int y = mcuY * blocksV + v;
+              if (x < outW && y < outH) {
+                int value = component->prediction * quant / 8 + 128;
+                out[y * outW + x] = (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool JpegDcDecoder::decode(const uint8_t *jpeg, size_t length, uint8_t *out, size_t capacity) {
+  const uint8_t *p = jpeg;
+  const uint8_t *end = jpeg + length;
+  bool haveFrame = false;
+
+  memset(_dcTables, 0, sizeof(_dcTables));
+  memset(_acTables, 0, sizeof(_acTables));
+  memset(_quantDc, 0, sizeof(_quantDc));
+  _componentCount = 0;
+  _width = 0;
+  _height = 0;
+  _restartInterval = 0;
+
+  if (length < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+  p += 2;
+
+  while (p + 4 <= end) {
+    if (p[0] != 0xFF) {
+      p++;
+      continue;
+    }
+    uint8_t marker = p[1];
+    if (marker == 0xFF || marker == 0x00 || (marker >= 0xD0 && marker <= 0xD8)) {
+      p++;
+      continue;
+    }
+    if (marker == 0xD9) break;
+
+    size_t segmentLength = readBe16(p + 2);
+    const uint8_t *segment = p + 4;
+    if (segmentLength < 2 || segment + segmentLength - 2 > end) return false;
+    segmentLength -= 2;
+
+    switch (marker) {
+      case 0xC0: // baseline
+      case 0xC1: // extended sequential, huffman
+        if (segmentLength < 6 || segment[0] != 8) return false;
+        _height = readBe16(segment + 1);
+        _width = readBe16(segment + 3);
+        _componentCount = segment[5];
+        if (_componentCount == 0 || _componentCount > 4 || segmentLength < 6 + 3 * (size_t)_componentCount) return false;
+        for (int c = 0; c < _componentCount; c++) {
+          _components[c].id = segment[6 + 3 * c];
+          _components[c].h = segment[7 + 3 * c] >> 4;
+          _components[c].v = segment[7 + 3 * c] & 0x0F;
+          _components[c].quantTable = segment[8 + 3 * c] & 0x03;
+          if (_components[c].h == 0 || _components[c].v == 0) return false;
+        }
+        haveFrame = true;
+        break;
+      case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+      case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+        return false; // progressive, lossless or arithmetic coded
+      case 0xC4:
+        if (!parseHuffman(segment, segmentLength)) return false;
+        break;
+      case 0xDB: {
+        // only the DC entry of each table is needed
+        size_t offset = 0;
+        while (offset < segmentLength) {
+          uint8_t precision = segment[offset] >> 4;
+          uint8_t tableId = segment[offset] & 0x03;
+          size_t tableLength = precision ? 128 : 64;
+          if (offset + 1 + tableLength > segmentLength) return false;
+          _quantDc[tableId] = precision ? readBe16(segment + offset + 1) : segment[offset + 1];
+          offset += 1 + tableLength;
+        }
+        break;
+      }
+      case 0xDD:
+        if (segmentLength < 2) return false;
+        _restartInterval = readBe16(segment);
+        break;
+      case 0xDA:
+        if (!haveFrame) return false;
+        return decodeScan(segment, segmentLength, end, out, capacity);
+      default:
+        break; // APPn, COM and friends
+    }
+    p = segment + segmentLength;
+  }
+  return false;
+}
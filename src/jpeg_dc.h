@@ -0,0 +1,73 @@
+#ifndef __JPEG_DC_H__
+#define __JPEG_DC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// partial baseline JPEG decoder that only recovers the DC coefficient of each
+// luma 8x8 block. AC coefficients are entropy decoded and skipped, with no
+// dequantisation or IDCT, giving a 1/8 scale (1/64 area) luma image straight
+// from the camera's JPEG buffer. tables live in the object, nothing is
+// allocated. no Arduino dependencies
+
+#define JPEG_DC_FAST_BITS 9
+
+// output size in pixels for a width x height JPEG
+#define JPEG_DC_SIZE(width, height) ((size_t)(((width) + 7) / 8) * (((height) + 7) / 8))
+
+struct JpegHuffmanTable {
+  uint16_t fast[1 << JPEG_DC_FAST_BITS]; // (length << 8) | symbol, 0 for longer codes
+  int32_t maxCode[18];                   // largest code of each length, -1 if none
+  int32_t valueOffset[17];
+  uint8_t values[256];
+  bool defined;
+};
+
+class JpegDcDecoder {
+public:
+  // decode fb-sized JPEG into out (capacity bytes), false when the image is
+  // corrupt, progressive or larger than capacity
+  bool decode(const uint8_t *jpeg, size_t length, uint8_t *out, size_t capacity);
+
+  uint16_t width() const { return _width; }       // source image size
+  uint16_t height() const { return _height; }
+  uint16_t outWidth() const { return (_width + 7) / 8; }
+  uint16_t outHeight() const { return (_height + 7) / 8; }
+
+private:
+  struct Component {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t quantTable;
+    uint8_t dcTable;
+    uint8_t acTable;
+    int32_t prediction;
+  };
+
+  bool parseHuffman(const uint8_t *segment, size_t length);
+  bool decodeScan(const uint8_t *segment, size_t segmentLength, const uint8_t *end, uint8_t *out, size_t capacity);
+
+  void fill();
+  int decodeSymbol(const JpegHuffmanTable &table);
+  int receiveExtend(int size);
+  bool restart();
+
+  JpegHuffmanTable _dcTables[4];
+  JpegHuffmanTable _acTables[4];
+  uint16_t _quantDc[4];
+  Component _components[4];
+  uint8_t _componentCount;
+  uint16_t _width;
+  uint16_t _height;
+  uint16_t _restartInterval;
+
+  // entropy coded segment bit reader
+  const uint8_t *_in;
+  const uint8_t *_end;
+  uint32_t _bits;
+  int _bitCount;
+  bool _marker;
+};
+
+#endif
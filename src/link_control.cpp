@@ -0,0 +1,141 @@
+#include "link_control.h"
+#include <stdlib.h>
+#include <string.h>
+
+int linkParseCsq(const char *line) {
+  const char *colon = strchr(line, ':');
+  const char *p = colon ? colon + 1 : line;
+  while (*p == ' ') p++;
+  if (*p < '0' || *p > '9') return LINK_CSQ_UNKNOWN;
+  int csq = atoi(p);
+  return csq <= 31 ? csq : LINK_CSQ_UNKNOWN;
+}
+
+bool linkParseCpsi(const char *line, LinkSignal *signal) {
+  const char *colon = strchr(line, ':');
+  if (!colon) return false;
+  const char *field = colon + 1;
+  while (*field == ' ') field++;
+
+  // fields are read in place, each one ends at the next comma
+  const char *fields[14];
+  size_t count = 0;
+  fields[count++] = field;
+  for (const char *p = field; *p && count < 14; p++) {
+    if (*p == ',') fields[count++] = p + 1;
+  }
+
+  size_t modeLength = strcspn(fields[0], ",\r\n");
+  if (modeLength == 0 || modeLength >= sizeof(signal->mode)) return false;
+  memcpy(signal->mode, fields[0], modeLength);
+  signal->mode[modeLength] = '\0';
+  signal->rsrpDbm = 0;
+  signal->snrDb = 0;
+
+  // LTE,Online,MCC-MNC,TAC,SCellID,PCellID,band,EARFCN,DL bw,UL bw,RSRQ,RSRP,RSSI,RSSNR
+  // with RSRQ, RSRP and RSSI in tenths of a dB
+  if (strcmp(signal->mode, "LTE") == 0 && count == 14) {
+    signal->rsrpDbm = (int16_t)(atoi(fields[11]) / 10);
+    signal->snrDb = (int16_t)atoi(fields[13]);
+  }
+  return true;
+}
+
+LinkController::LinkController() : _level(0), _throughputBps(0), _sampleCsq(LINK_CSQ_UNKNOWN), _bytesPerCost(0),
+                                   _roomyEvents(0) {
+  memset(&_config, 0, sizeof(_config));
+  memset(&_signal, 0, sizeof(_signal));
+  memset(&_stats, 0, sizeof(_stats));
+  _signal.csq = LINK_CSQ_UNKNOWN;
+}
+
+void LinkController::begin(const LinkConfig &config, uint8_t level) {
+  _config = config;
+  if (_config.levels > LINK_MAX_LEVELS) _config.levels = LINK_MAX_LEVELS;
+  _level = level < _config.levels ? level : _config.levels - 1;
+  _throughputBps = 0;
+  _sampleCsq = LINK_CSQ_UNKNOWN;
+  _bytesPerCost = 0;
+  _roomyEvents = 0;
+}
+
+uint32_t LinkController::throughputBps() const {
+  if (_throughputBps) return _throughputBps;
+  // registered but no reading yet counts as a weak signal
+  int csq = _signal.csq > 0 ? _signal.csq : 1;
+  return (uint32_t)csq * _config.priorBpsPerCsq;
+}
+
+uint32_t LinkController::predictMs(uint8_t level) const {
+  if (_bytesPerCost == 0 || level >= _config.levels) return 0;
+  uint64_t bytes = ((uint64_t)_bytesPerCost * _config.cost[level]) >> 8;
+  uint32_t bps = throughputBps();
+  return (uint32_t)(bytes * 1000 / (bps ? bps : 1));
+}
+
+bool LinkController::stepDown() {
+  uint8_t level = _level;
+  while (level > 0 && predictMs(level) > _config.targetMs) level--;
+  if (level == _level) return false;
+  _level = level;
+  _roomyEvents = 0;
+  _stats.stepsDown++;
+  return true;
+}
+
+bool LinkController::signal(const LinkSignal &signal) {
+  // throughput measured on a much stronger signal won't hold any more
+  if (_throughputBps && _sampleCsq > 0 && signal.csq != LINK_CSQ_UNKNOWN &&
+      signal.csq + _config.csqDrop <= _sampleCsq) {
+    uint32_t scaled = (uint32_t)((uint64_t)_throughputBps * (signal.csq > 0 ? signal.csq : 1) / _sampleCsq);
+    _throughputBps = scaled ? scaled : 1;
+    _sampleCsq = signal.csq;
+  }
+  _signal = signal;
+  return stepDown();
+}
+
+bool LinkController::eventUploaded(uint32_t sentBytes, uint32_t frameBytes, uint32_t ms, bool ok) {
+  _stats.events++;
+  if (!ok) {
+    // a failed event says the link is worse than we think, by how much is unknown
+    _stats.failures++;
+    uint32_t halved = throughputBps() / 2;
+    _throughputBps = halved ? halved : 1;
+    _sampleCsq = _signal.csq;
+    _roomyEvents = 0;
+    if (_bytesPerCost == 0 && _level > 0) {
+      // nothing to predict with yet, back off one level
+      _level--;
+      _stats.stepsDown++;
+      return true;
+    }
+    return stepDown();
+  }
+
+  _stats.lastEventBytes = sentBytes;
+  _stats.lastFrameBytes = frameBytes;
+  _stats.lastEventMs = ms;
+  uint32_t bps = (uint32_t)((uint64_t)sentBytes * 1000 / (ms ? ms : 1));
+  // believe a slower link straight away, a faster one gradually
+  _throughputBps = _throughputBps && bps > _throughputBps ? (3 * _throughputBps + bps) / 4 : bps;
+  if (_throughputBps == 0) _throughputBps = 1;
+  _sampleCsq = _signal.csq;
+  // the level only changes what is captured, learn its cost from that
+  uint32_t bytesPerCost = (uint32_t)(((uint64_t)frameBytes << 8) / (_config.cost[_level] ? _config.cost[_level] : 1));
+  _bytesPerCost = _bytesPerCost ? (3 * _bytesPerCost + bytesPerCost) / 4 : bytesPerCost;
+
+  if (stepDown()) return true;
+  if (_level + 1 < _config.levels &&
+      (uint64_t)predictMs(_level + 1) * 100 <= (uint64_t)_config.targetMs * _config.headroomPercent) {
+    if (++_roomyEvents >= _config.stepUpEvents) {
+      _level++;
+      _roomyEvents = 0;
+      _stats.stepsUp++;
+      return true;
+    }
+  } else {
+    _roomyEvents = 0;
+  }
+  return false;
+}
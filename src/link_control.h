@@ -0,0 +1,88 @@
+#ifndef __LINK_CONTROL_H__
+#define __LINK_CONTROL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// picks the capture level (frame size and JPEG quality) so an event uploads
+// within a target time on the link as it is. throughput is learned from
+// past uploads, a slowdown at once and a speedup gradually, with signal
+// quality as the prior before the first upload and to discount throughput
+// measured on a much stronger signal. levels are ordered cheapest first,
+// each with a relative byte cost; bytes per unit of cost are learned at
+// whatever level is current. stepping down is immediate, stepping up waits
+// for a run of events with room to spare so the camera isn't reconfigured
+// on every event. no Arduino dependencies so throughput traces can be
+// replayed on the host
+
+#define LINK_MAX_LEVELS 8
+#define LINK_CSQ_UNKNOWN -1
+
+struct LinkConfig {
+  uint32_t targetMs;          // upload time per event to stay under
+  uint8_t levels;
+  uint16_t cost[LINK_MAX_LEVELS];
+  uint8_t stepUpEvents;       // events in a row with headroom before stepping up
+  uint8_t headroomPercent;    // the next level must predict under this share of targetMs
+  uint16_t priorBpsPerCsq;    // throughput guess per CSQ step before any upload
+  uint8_t csqDrop;            // a signal this much weaker discounts the learned throughput
+};
+
+struct LinkSignal {
+  int8_t csq;                 // 0-31, LINK_CSQ_UNKNOWN when the modem doesn't know
+  char mode[12];              // +CPSI system mode, "LTE", "GSM", "NO SERVICE"...
+  int16_t rsrpDbm;            // LTE only, 0 when unknown
+  int16_t snrDb;
+};
+
+struct LinkStats {
+  uint32_t events;
+  uint32_t failures;
+  uint32_t stepsUp;
+  uint32_t stepsDown;
+  uint32_t lastEventBytes;    // sent
+  uint32_t lastFrameBytes;    // captured
+  uint32_t lastEventMs;
+};
+
+// "+CSQ: 18,99" to 18, LINK_CSQ_UNKNOWN for 99 or a line that can't be read
+int linkParseCsq(const char *line);
+// "+CPSI: LTE,Online,..." into mode, rsrpDbm and snrDb, false when unreadable
+bool linkParseCpsi(const char *line, LinkSignal *signal);
+
+class LinkController {
+public:
+  LinkController();
+
+  void begin(const LinkConfig &config, uint8_t level);
+
+  // a fresh signal reading, true when it made the level step down
+  bool signal(const LinkSignal &signal);
+  // one event's upload, true when the level changed. sentBytes went over the
+  // link in ms, frameBytes is what the event captured at the current level.
+  // they differ when a thumbnail or crop goes up in place of the frames
+  bool eventUploaded(uint32_t sentBytes, uint32_t frameBytes, uint32_t ms, bool ok);
+
+  uint8_t level() const { return _level; }
+  const LinkSignal &lastSignal() const { return _signal; }
+  // bytes per second, learned or guessed from the signal
+  uint32_t throughputBps() const;
+  // expected upload time of an event at level, 0 before anything was learned
+  uint32_t predictMs(uint8_t level) const;
+
+  const LinkStats &stats() const { return _stats; }
+
+private:
+  bool stepDown();
+
+  LinkConfig _config;
+  LinkSignal _signal;
+  uint8_t _level;
+  uint32_t _throughputBps;    // 0 until the first upload
+  int8_t _sampleCsq;          // signal when _throughputBps was last measured
+  uint32_t _bytesPerCost;     // 8.8 fixed point, 0 until the first upload
+  uint8_t _roomyEvents;
+  LinkStats _stats;
+};
+
+#endif
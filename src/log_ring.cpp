@@ -0,0 +1,135 @@
+#include "log_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// header word: commit bit plus payload length, payload padded to a word so
+// the next header stays aligned
+#define LOG_RECORD_COMMITTED 0x80000000UL
+#define LOG_RECORD_LENGTH 0x0000FFFFUL
+
+static inline uint32_t recordSize(size_t length) {
+  return 4 + (((uint32_t)length + 3) & ~3UL);
+}
+
+LogRing::LogRing() : _data(NULL), _size(0), _head(0), _tail(0), _droppedUnreported(0) {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool LogRing::begin(uint32_t *buffer, size_t size) {
+  if (buffer == NULL || size < 2 * recordSize(LOG_RING_MAX_RECORD) || (size & (size - 1)) != 0) return false;
+  memset(buffer, 0, size);
+  memset(&_stats, 0, sizeof(_stats));
+  _data = (uint8_t *)buffer;
+  _size = size;
+  _head = 0;
+  _tail = 0;
+  _droppedUnreported = 0;
+  return true;
+}
+
+bool LogRing::writeRecord(const char *text, size_t length) {
+  uint32_t need = recordSize(length);
+  uint32_t head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+  do {
+    uint32_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+    if (head - tail + need > _size) {
+      __atomic_fetch_add(&_stats.dropped, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&_droppedUnreported, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+  } while (!__atomic_compare_exchange_n(&_head, &head, head + need, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+  // the claimed space is ours alone; the payload may wrap, the header can't
+  size_t offset = (head + 4) & (_size - 1);
+  size_t first = length < _size - offset ? length : _size - offset;
+  memcpy(_data + offset, text, first);
+  memcpy(_data, text + first, length - first);
+  __atomic_store_n((uint32_t *)(_data + (head & (_size - 1))), LOG_RECORD_COMMITTED | (uint32_t)length, __ATOMIC_RELEASE);
+
+  // the consumer may already be past this record, then used wraps over _size
+  uint32_t used = head + need - __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+  uint32_t highWater = __atomic_load_n(&_stats.highWater, __ATOMIC_RELAXED);
+  while (used <= _size && used > highWater &&
+         !__atomic_compare_exchange_n(&_stats.highWater, &highWater, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+  __atomic_fetch_add(&_stats.bytes, (uint32_t)length, __ATOMIC_RELAXED);
+  return true;
+}
+
+bool LogRing::write(const char *text, size_t length) {
+  if (_data == NULL) return false;
+  __atomic_fetch_add(&_stats.messages, 1, __ATOMIC_RELAXED);
+  while (length > 0) {
+    size_t count = length < LOG_RING_MAX_RECORD ? length : LOG_RING_MAX_RECORD;
+    if (!writeRecord(text, count)) return false;
+    text += count;
+    length -= count;
+  }
+  return true;
+}
+
+int LogRing::vprintf(const char *format, va_list args) {
+  char line[LOG_RING_LINE_SIZE];
+  va_list copy;
+  va_copy(copy, args);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  if (length < 0) {
+    va_end(copy);
+    return length;
+  }
+
+  if ((size_t)length < sizeof(line)) {
+    write(line, length);
+  } else {
+    char *longLine = (char *)malloc(length + 1);
+    if (longLine) {
+      vsnprintf(longLine, length + 1, format, copy);
+      write(longLine, length);
+      free(longLine);
+    } else {
+      __atomic_fetch_add(&_stats.truncated, 1, __ATOMIC_RELAXED);
+      write(line, sizeof(line) - 1);
+    }
+  }
+  va_end(copy);
+  return length;
+}
+
+size_t LogRing::read(uint8_t *out, size_t max) {
+  if (_data == NULL) return 0;
+  uint32_t tail = _tail;
+  size_t copied = 0;
+  while (true) {
+    uint32_t *header = (uint32_t *)(_data + (tail & (_size - 1)));
+    uint32_t word = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+    if (!(word & LOG_RECORD_COMMITTED)) break;
+    size_t length = word & LOG_RECORD_LENGTH;
+    if (copied + length > max) break;
+
+    size_t offset = (tail + 4) & (_size - 1);
+    size_t first = length < _size - offset ? length : _size - offset;
+    memcpy(out + copied, _data + offset, first);
+    memcpy(out + copied + first, _data, length - first);
+    copied += length;
+
+    // zero the whole record so stale bytes never look like a committed
+    // header when a producer claims this space on the next lap
+    uint32_t size = recordSize(length);
+    size_t start = tail & (_size - 1);
+    size_t clear = size < _size - start ? size : _size - start;
+    memset(_data + start, 0, clear);
+    memset(_data, 0, size - clear);
+    tail += size;
+  }
+  __atomic_store_n(&_tail, tail, __ATOMIC_RELEASE);
+  return copied;
+}
+
+uint32_t LogRing::takeDropped() {
+  return __atomic_exchange_n(&_droppedUnreported, 0, __ATOMIC_RELAXED);
+}
+
+size_t LogRing::used() const {
+  return __atomic_load_n(&_head, __ATOMIC_RELAXED) - __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+}
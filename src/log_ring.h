@@ -0,0 +1,59 @@
+#ifndef __LOG_RING_H__
+#define __LOG_RING_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// lock-free multi-producer, single-consumer byte ring for log output.
+// producers claim space with a compare-and-swap on the head, copy their text
+// in and publish it by setting a commit bit in the record header, so a
+// logging call never waits on a lock or on the SD card. the consumer copies
+// committed records out in order and hands the space back. when the ring is
+// full the message is dropped and counted. no Arduino dependencies
+
+#define LOG_RING_LINE_SIZE 256    // formatted on the stack, longer lines go through the heap
+#define LOG_RING_MAX_RECORD 1024  // longer writes are split into several records
+
+struct LogRingStats {
+  uint32_t messages;
+  uint32_t bytes;
+  uint32_t dropped;        // messages lost because the ring was full
+  uint32_t truncated;      // long lines cut short when the heap was exhausted
+  uint32_t highWater;      // most bytes ever waiting in the ring
+};
+
+class LogRing {
+public:
+  LogRing();
+
+  // size must be a power of two and buffer word aligned
+  bool begin(uint32_t *buffer, size_t size);
+
+  // append text, false when it was dropped
+  bool write(const char *text, size_t length);
+  // format and append, any length. returns the formatted length like vprintf
+  int vprintf(const char *format, va_list args);
+
+  // copy committed text out in order, up to max bytes (at least
+  // LOG_RING_MAX_RECORD). single consumer only
+  size_t read(uint8_t *out, size_t max);
+
+  // drops since the last call, for the consumer to report
+  uint32_t takeDropped();
+
+  size_t used() const;
+  const LogRingStats &stats() const { return _stats; }
+
+private:
+  bool writeRecord(const char *text, size_t length);
+
+  uint8_t *_data;
+  size_t _size;
+  uint32_t _head;           // next byte to claim, shared by producers
+  uint32_t _tail;           // next byte to read, owned by the consumer
+  uint32_t _droppedUnreported;
+  LogRingStats _stats;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "lzss.h"
+#include <string.h>
+#include "crc32.h"
+
+#define LZSS_NIL 0xFFFF
+
+static uint32_t hash(const uint8_t *in) {
+  uint32_t key = (in[0] << 16) | (in[1] << 8) | in[2];
+  return (key * 2654435761u) >> (32 - LZSS_HASH_BITS);
+}
+
+static void put32(uint8_t *out, uint32_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  out[2] = (value >> 16) & 0xFF;
+  out[3] = (value >> 24) & 0xFF;
+}
+
+LzssEncoder::LzssEncoder()
+    : _windowBits(LZSS_WINDOW_BITS), _lengthBits(LZSS_LENGTH_BITS), _windowSize(LZSS_WINDOW_SIZE),
+      _maxMatch(LZSS_MAX_MATCH), _windowBuffer(2 * LZSS_WINDOW_SIZE + LZSS_MAX_MATCH), _head(NULL), _prev(NULL),
+      _window(NULL), _fill(0), _position(0), _hashed(0), _bits(0), _bitCount(0),
+      _outputLength(0), _crc(0), _inputBytes(0), _outputBytes(0), _sink(NULL), _context(NULL), _ok(false) {}
+
+void LzssEncoder::begin(uint8_t *work, LzssSink sink, void *context, uint8_t windowBits, uint8_t lengthBits) {
+  _windowBits = windowBits < 8 ? 8 : windowBits > LZSS_MAX_WINDOW_BITS ? LZSS_MAX_WINDOW_BITS : windowBits;
+  _lengthBits = lengthBits < 2 ? 2 : lengthBits > LZSS_MAX_LENGTH_BITS ? LZSS_MAX_LENGTH_BITS : lengthBits;
+  _windowSize = 1 << _windowBits;
+  _maxMatch = LZSS_MIN_MATCH + (1 << _lengthBits) - 1;
+  _windowBuffer = 2 * _windowSize + _maxMatch;
+  _head = (uint16_t *)work;
+  _prev = _head + (1 << LZSS_HASH_BITS);
+  _window = (uint8_t *)(_prev + _windowSize);
+  memset(_head, 0xFF, (1 << LZSS_HASH_BITS) * sizeof(uint16_t));
+  _fill = 0;
+  _position = 0;
+  _hashed = 0;
+  _bits = 0;
+  _bitCount = 0;
+  _crc = 0;
+  _inputBytes = 0;
+  _outputBytes = 0;
+  _sink = sink;
+  _context = context;
+  _ok = true;
+
+  memcpy(_output, LZSS_MAGIC, 4);
+  _output[4] = _windowBits;
+  _output[5] = _lengthBits;
+  _outputLength = LZSS_HEADER_SIZE;
+}
+
+// drop the oldest window's worth. the encode position is past two
+// windows here, so nothing dropped is still in reach
+void LzssEncoder::slide() {
+  memmove(_window, _window + _windowSize, _fill - _windowSize);
+  _fill -= _windowSize;
+  _position -= _windowSize;
+  _hashed -= _windowSize;
+  // chain links are indexed by position modulo the window, which a slide
+  // by exactly one window leaves alone
+  for (int i = 0; i < (1 << LZSS_HASH_BITS); i++) {
+    _head[i] = _head[i] != LZSS_NIL && _head[i] >= _windowSize ? _head[i] - _windowSize : LZSS_NIL;
+  }
+  for (uint32_t i = 0; i < _windowSize; i++) {
+    _prev[i] = _prev[i] != LZSS_NIL && _prev[i] >= _windowSize ? _prev[i] - _windowSize : LZSS_NIL;
+  }
+}
+
+void LzssEncoder::insert(uint32_t position) {
+  uint32_t key = hash(_window + position);
+  _prev[position & (_windowSize - 1)] = _head[key];
+  _head[key] = (uint16_t)position;
+}
+
+// longest earlier match for the bytes at _position, 0 when there is none
+// worth a token
+uint32_t LzssEncoder::longestMatch(uint32_t *distance) {
+  uint32_t limit = _fill - _position;
+  if (limit > _maxMatch) limit = _maxMatch;
+  if (limit < LZSS_MIN_MATCH) return 0;
+
+  const uint8_t *current = _window + _position;
+  uint32_t best = 0;
+  uint32_t candidate = _head[hash(current)];
+  for (int depth = 0; depth < LZSS_CHAIN_DEPTH && candidate != LZSS_NIL; depth++) {
+    if (candidate >= _position || _position - candidate > _windowSize) break;
+    const uint8_t *earlier = _window + candidate;
+    // the byte that would make the match longer than the best so far
+    // rules out most candidates with one compare
+    if (earlier[best] == current[best]) {
+      uint32_t length = 0;
+      while (length < limit && earlier[length] == current[length]) length++;
+      if (length > best) {
+        best = length;
+        *distance = _position - candidate;
+        if (best == limit) break;
+      }
+    }
+    uint32_t older = _prev[candidate & (_windowSize - 1)];
+    if (older != LZSS_NIL && older >= candidate) break;
+    candidate = older;
+  }
+  return best >= LZSS_MIN_MATCH ? best : 0;
+}
+
+// tokens for everything but the lookahead, or everything when final
+void LzssEncoder::encode(bool final) {
+  while (_ok && _position < _fill && (final || _fill - _position >= _maxMatch)) {
+    // bring the chains up to here, every position that has three bytes
+    for (; _hashed < _position && _hashed + LZSS_MIN_MATCH <= _fill; _hashed++) {
+      insert(_hashed);
+    }
+    uint32_t distance = 0;
+    uint32_t length = longestMatch(&distance);
+    if (length == 0) {
+      putBits(0x100 | _window[_position], 9);
+      _position++;
+    } else {
+      putBits(((distance - 1) << _lengthBits) | (length - LZSS_MIN_MATCH), 1 + _windowBits + _lengthBits);
+      _position += length;
+    }
+  }
+}
+
+void LzssEncoder::putBits(uint32_t value, int count) {
+  _bits = (_bits << count) | value;
+  _bitCount += count;
+  while (_bitCount >= 8) {
+    _bitCount -= 8;
+    putByte((_bits >> _bitCount) & 0xFF);
+  }
+}
+
+void LzssEncoder::putByte(uint8_t value) {
+  _output[_outputLength++] = value;
+  if (_outputLength == sizeof(_output)) flushOutput();
+}
+
+void LzssEncoder::flushOutput() {
+  if (_ok && _outputLength > 0) {
+    _ok = _sink(_output, _outputLength, _context);
+    _outputBytes += _outputLength;
+  }
+  _outputLength = 0;
+}
+
+bool LzssEncoder::write(const uint8_t *data, size_t length) {
+  if (!_ok) return false;
+  _crc = crc32Update(_crc, data, length);
+  _inputBytes += length;
+  while (length > 0 && _ok) {
+    if (_fill == _windowBuffer) slide();
+    size_t count = _windowBuffer - _fill;
+    if (count > length) count = length;
+    memcpy(_window + _fill, data, count);
+    _fill += count;
+    data += count;
+    length -= count;
+    encode(false);
+  }
+  // whole bytes go out with the call that made them, so a single write
+  // never hands the sink more than LZSS_MAX_OUTPUT
+  flushOutput();
+  return _ok;
+}
+
+bool LzssEncoder::finish() {
+  if (!_ok) return false;
+  encode(true);
+  if (_bitCount > 0) putBits(0, 8 - _bitCount);
+  uint8_t trailer[LZSS_TRAILER_SIZE];
+  put32(trailer, (uint32_t)_inputBytes);
+  put32(trailer + 4, _crc);
+  for (int i = 0; i < LZSS_TRAILER_SIZE; i++) putByte(trailer[i]);
+  flushOutput();
+  // the stream is over, begin() again for the next one
+  bool ok = _ok;
+  _ok = false;
+  return ok;
+}
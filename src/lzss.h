@@ -0,0 +1,101 @@
+#ifndef __LZSS_H__
+#define __LZSS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// streaming LZSS compressor for text going up over the modem (reports, log
+// segments), in the style of heatshrink: a sliding window of
+// LZSS_WINDOW_SIZE bytes, hash chains to find matches and a bit packed
+// output, so RAM use is LZSS_WORK_SIZE whatever the input length. the
+// window and match length bits are in the stream header, begin() can pick
+// others with a work area of LZSS_WORK_SIZE_FOR them. input can
+// be fed in pieces of any size and the output only depends on the bytes,
+// not on how they were split up. output goes out through a sink in small
+// pieces. no Arduino dependencies, tools/lzss_decompress.py unpacks the
+// streams on the host
+//
+// stream:
+//   "SCZ1" | u8 window bits | u8 length bits | tokens, MSB first, zero
+//   padded to a byte | u32 input length | u32 crc32 of the input
+// tokens:
+//   1, 8 bit literal
+//   0, window bits distance - 1, length bits length - LZSS_MIN_MATCH
+
+#define LZSS_MAGIC "SCZ1"  // bump the digit when the token layout changes
+#define LZSS_WINDOW_BITS 12
+#define LZSS_LENGTH_BITS 5
+#define LZSS_MIN_MATCH 3
+#define LZSS_WINDOW_SIZE (1 << LZSS_WINDOW_BITS)
+#define LZSS_MAX_MATCH (LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1)
+#define LZSS_HASH_BITS 10
+#define LZSS_CHAIN_DEPTH 16        // candidates tried per position, bounds the CPU time
+#define LZSS_MAX_WINDOW_BITS 14    // chain links are 16 bit positions in twice the window
+#define LZSS_MAX_LENGTH_BITS 8
+#define LZSS_HEADER_SIZE 6
+#define LZSS_TRAILER_SIZE 8
+// hash heads, chain links and the window with room for a full lookahead
+#define LZSS_WORK_SIZE_FOR(windowBits, lengthBits) \
+  ((1 << LZSS_HASH_BITS) * 2 + (1 << (windowBits)) * 4 + LZSS_MIN_MATCH + (1 << (lengthBits)) - 1)
+#define LZSS_WORK_SIZE LZSS_WORK_SIZE_FOR(LZSS_WINDOW_BITS, LZSS_LENGTH_BITS)
+// most output write() or finish() can produce for length bytes of input,
+// counting the header, the held back lookahead and the trailer, with the
+// default window and length bits
+#define LZSS_MAX_OUTPUT(length) \
+  (LZSS_HEADER_SIZE + ((length) + LZSS_MAX_MATCH) * 9 / 8 + 2 + LZSS_TRAILER_SIZE)
+
+// takes the next piece of the stream, false stops the encoder
+typedef bool (*LzssSink)(const uint8_t *data, size_t length, void *context);
+
+class LzssEncoder {
+public:
+  LzssEncoder();
+
+  // work is LZSS_WORK_SIZE_FOR(windowBits, lengthBits) bytes, 2 byte
+  // aligned, owned by the caller. bits outside 8..LZSS_MAX_WINDOW_BITS and
+  // 2..LZSS_MAX_LENGTH_BITS are clamped
+  void begin(uint8_t *work, LzssSink sink, void *context, uint8_t windowBits = LZSS_WINDOW_BITS,
+             uint8_t lengthBits = LZSS_LENGTH_BITS);
+
+  // compress length bytes. up to LZSS_MAX_MATCH of them are held back until
+  // more input or finish(). false once the sink failed
+  bool write(const uint8_t *data, size_t length);
+  // compress what is held back and end the stream
+  bool finish();
+
+  size_t inputBytes() const { return _inputBytes; }
+  size_t outputBytes() const { return _outputBytes; }
+
+private:
+  void slide();
+  void insert(uint32_t position);
+  uint32_t longestMatch(uint32_t *distance);
+  void encode(bool final);
+  void putBits(uint32_t value, int count);
+  void putByte(uint8_t value);
+  void flushOutput();
+
+  uint8_t _windowBits;
+  uint8_t _lengthBits;
+  uint32_t _windowSize;
+  uint32_t _maxMatch;
+  uint32_t _windowBuffer;     // two windows and a lookahead
+  uint16_t *_head;            // newest position per hash, LZSS_NIL when none
+  uint16_t *_prev;            // next older position with the same hash
+  uint8_t *_window;
+  uint32_t _fill;             // bytes in the window
+  uint32_t _position;         // next byte to encode
+  uint32_t _hashed;           // positions before this are in the chains
+  uint32_t _bits;
+  int _bitCount;
+  uint8_t _output[64];
+  size_t _outputLength;
+  uint32_t _crc;
+  size_t _inputBytes;
+  size_t _outputBytes;
+  LzssSink _sink;
+  void *_context;
+  bool _ok;
+};
+
+#endif
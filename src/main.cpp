@@ -7,6 +7,7 @@
 #include "secrets.h"
 #include <esp_sntp.h>
 #include <esp_log.h>
+#include <driver/gpio.h>
 #include <esp32-hal-log.h>
 #include <HardwareSerial.h>
 #include <StreamDebugger.h>
@@ -17,6 +18,30 @@
 #include <FS.h>
 #include <Preferences.h>
 #include <Update.h>
+#include <atomic>
+#include "modem_at.h"
+#include "efs_transfer.h"
+#include "tcp_upload.h"
+#include "ftp_session.h"
+#include "motion.h"
+#include "thumbnail.h"
+#include "frame_ring.h"
+#include "pipeline.h"
+#include "outbox.h"
+#include "sd_log.h"
+#include "ota_download.h"
+#include "ota_delta.h"
+#include "sha256.h"
+#include "wall_clock.h"
+#include "gnss.h"
+#include "power_schedule.h"
+#include "boot.h"
+#include "roi.h"
+#include "frame_crop.h"
+#include "link_control.h"
+#include "metrics.h"
+#include "telemetry.h"
+#include "report.h"
 
 // globals
 #ifdef DUMP_AT_COMMANDS
@@ -30,110 +55,166 @@
 
 TinyGsmClient client(modem);
 HttpClient http(client, OTA_UPDATE_URL, OTA_UPDATE_PORT);
-File log_file;
 
 String IMEI = "";
 String GPSPosition = "";
 String LogContent = "";
 String newFirmwareVersion = "";
 Preferences preferences;
+MotionDetector motion;
+FrameRing frameRing;
+PortMutex *frameRingMutex = NULL;
+Outbox outbox; // upload and housekeeping tasks only touch it with the modem lock held
+Outbox fullFrames; // full resolution frames of thumbnail-first uploads, same locking
+TelemetryRing telemetry; // same locking
+String fullFrameRequests = ""; // names the server asked for, one per line
+WallClock wallClock; // synced under the modem lock, read anywhere
+GnssCache gnss;      // fed by +CGNSSINFO replies and URCs
+PowerScheduler power;
+int64_t lastIdleEndMs = 0;
+BootSequence boot;
+boolean warmBoot = false;       // power schedule carried over a deep sleep
+boolean modemResumed = false;   // and the modem was still registered
+std::atomic<bool> bootComplete(false); // uploads and housekeeping wait for the modem stage
+std::atomic<bool> storageReady(false); // SD card mounted; without it outbox, full frames and SD log stay off
+
+// carried across deep sleep
+RTC_NOINIT_ATTR PowerRtcState powerRtc; // checked by magic, also counts restarts
+RTC_DATA_ATTR WallClockSnapshot clockSnapshot;
+RTC_DATA_ATTR int64_t sleepStartRtcUs = 0;
+RTC_DATA_ATTR char rtcImei[16] = "";
+
+const PowerConfig powerConfig = {
+  POWER_LIGHT_SLEEP_MIN_MS,
+  POWER_DEEP_SLEEP_MIN_MS,
+  POWER_MODEM_PSM_MIN_MS,
+  POWER_DEEP_WAKE_MS,
+  {POWER_ACTIVE_MA, POWER_LIGHT_SLEEP_MA, POWER_DEEP_SLEEP_MA},
+  POWER_MODEM_ON_MA,
+  POWER_MODEM_PSM_MA
+};
+uint8_t *outboxBuffer = NULL;
+LinkController linkControl; // fed by the upload and housekeeping tasks under the modem lock
+std::atomic<uint8_t> captureLevel(0); // level the link controller wants
+uint8_t cameraLevel = 0;              // level the sensor is set to, capture task only
+RoiFinder roiFinder;
+const RoiConfig roiConfig = {
+  ROI_MIN_BLOCKS,
+  ROI_MARGIN,
+  ROI_MIN_SIZE,
+  ROI_MAX_SIDE
+};
+// capture levels for the link controller, cheapest first. costs are rough
+// relative JPEG sizes, pixel count times a factor for the quality
+const framesize_t linkFrameSizes[] = {FRAMESIZE_VGA, FRAMESIZE_SVGA, FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA, FRAMESIZE_UXGA};
+const uint8_t linkQualities[] = {14, 12, 12, 12, 14, 10};
+const LinkConfig linkConfig = {
+  LINK_TARGET_EVENT_MS,
+  6,
+  {30, 55, 90, 150, 170, 220},
+  LINK_STEP_UP_EVENTS,
+  LINK_HEADROOM_PERCENT,
+  LINK_PRIOR_BPS_PER_CSQ,
+  LINK_CSQ_DROP
+};
+const MotionConfig motionConfig = {
+  MOTION_NOISE_FLOOR,
+  MOTION_THRESHOLD_K,
+  MOTION_TRIGGER_PERMILLE,
+  MOTION_GLOBAL_PERMILLE,
+  MOTION_LEARN_SHIFT,
+  MOTION_WARMUP_FRAMES
+};
 
 // function prototypes
-String getCurrentDateTime();
-String getFormattedDateTime();
+size_t formatDateTime(char *out, size_t size, WallClockFormat format);
 String getFormattedImageName();
 String getFormattedReportName();
-String getSDCardInfo();
-void takePhoto();
+boolean takePhoto(PipelineJob *job);
+boolean frameHasMotion(camera_fb_t * fb, RoiRect *region);
+size_t reduceFrame(const StoredFrame *frame, const RoiRect &region, String *name, uint32_t timestamp, uint8_t **reduced);
+void checkFullFrameRequests();
+bool fullFrameDue(const OutboxItem &item, void *context);
+void drainFullFrames();
+boolean saveFullFrame(const String &name, const uint8_t *buf, size_t len);
 void sendLogFile();
+void recordTelemetry();
+void sendTelemetry();
+void sendLogSegments();
 void initializeConnectionWifi();
-void initializeCamera();
-String convertToDMS(String coord, String direction);
+boolean initializeCamera();
+void gnssBegin();
+bool gnssReceived(const char *line, bool polled);
+bool gnssGoodFix(const GnssFix &fix);
+bool getGnssFix(GnssFix *fix, uint32_t budgetMs);
 void getGPSPosition();
 void getIMEI();
 int syncTime();
-void initializeModem();
-void initializeSDCard();
-int sdCardLogOutput(const char *format, va_list args);
+bool syncClock();
+void sampleSignal();
+bool initializeModem();
+void modemFailureSleep();
+bool resumeModem();
+bool waitForNetwork(uint32_t timeoutMs);
+int64_t powerNow();
+int64_t rtcTimeUs();
+void enterDeepSleep(const PowerPlan &plan);
+boolean initializeSDCard();
 void clearEFS();
-void stopFtp(void);
-boolean initFtp(void);
-int sendFileToFtp(String imageFileName);
-boolean sendFileToEFS(String imageFileName, camera_fb_t * fb);
-boolean sendPhoto(camera_fb_t * fb);
-
-// datetime as string of numbers
-String getCurrentDateTime() {
-  String time;
-  modem.sendAT("+CCLK?");
-  if (modem.waitResponse(10000, time) != 1) {
-    ESP_LOGI(TAG, "Failed to get time");
-    return "";
-  }
-  time = time.substring(time.indexOf('"') + 1, time.lastIndexOf('"'));
-  int year = time.substring(0, 2).toInt();
-  int month = time.substring(3, 5).toInt();
-  int day = time.substring(6, 8).toInt();
-  int hour = time.substring(9, 11).toInt();
-  int minute = time.substring(12, 14).toInt();
-  int second = time.substring(15, 17).toInt();
-
-  char result[20];
-  snprintf(result, sizeof(result), "%02d%02d20%02d%02d%02d%02d", day, month, year, hour, minute, second);
-  return String(result);
-}
-
-// datetime as human readable string
-String getFormattedDateTime() {
-  String time;
-  modem.sendAT("+CCLK?");
-  if (modem.waitResponse(10000, time) != 1) {
-    ESP_LOGI(TAG, "Failed to get time");
-    return "";
+boolean sendFileToEFS(String imageFileName, const uint8_t *buf, size_t len);
+boolean sendPhoto(const uint8_t *buf, size_t len, String imageFileName, uint32_t timestamp);
+boolean sendPhotoTcp(const uint8_t *buf, size_t len, String imageFileName, uint32_t timestamp);
+boolean uploadFrame(const uint8_t *buf, size_t len, String imageFileName, uint32_t timestamp);
+bool uploadJob(PipelineJob *job);
+void releaseJob(PipelineJob *job);
+void housekeeping();
+void drainOutbox();
+boolean allocateOutboxBuffer();
+bool sendQueued(const OutboxItem &item, const uint8_t *data, size_t length, void *context);
+void idleBetweenFrames(uint32_t ms, bool busy);
+uint32_t getUnixTime();
+bool bootStorage();
+bool bootCamera();
+bool bootPipeline();
+bool bootModem();
+bool bootHousekeeping();
+
+// datetime in the given format into out, empty when the clock was never set
+size_t formatDateTime(char *out, size_t size, WallClockFormat format) {
+  if (!wallClock.valid()) {
+    syncClock();
+  }
+  size_t length = wallClock.format(out, size, esp_timer_get_time(), format);
+  if (length == 0 && size > 0) {
+    out[0] = '\0';
   }
-  time = time.substring(time.indexOf("\"") + 1, time.indexOf("\""));
-  int year = time.substring(0, 2).toInt();
-  int month = time.substring(3, 5).toInt();
-  int day = time.substring(6, 8).toInt();
-  int hour = time.substring(9, 11).toInt();
-  int minute = time.substring(12, 14).toInt();
-  int second = time.substring(15, 17).toInt();
+  return length;
+}
 
-  char result[20];
-  snprintf(result, sizeof(result), "%02d/%02d/20%02d %02d:%02d:%02d", day, month, year, hour, minute, second);
-  return String(result);
+// datetime as unix seconds, 0 when the clock was never set
+uint32_t getUnixTime() {
+  if (!wallClock.valid()) {
+    syncClock();
+  }
+  return wallClock.valid() ? (uint32_t)wallClock.utcSeconds(esp_timer_get_time()) : 0;
 }
 
 // formatted filename for image upload
 String getFormattedImageName() {
-  return String(DEVICENAME) + "-" + getCurrentDateTime() + ".jpg";
+  char dateTime[20];
+  formatDateTime(dateTime, sizeof(dateTime), WALL_CLOCK_COMPACT);
+  char name[64];
+  imageName(name, sizeof(name), dateTime, ".jpg");
+  return String(name);
 }
 
 // formatted filename for daily report upload
 String getFormattedReportName() {
-  String dateTime = getCurrentDateTime();
-  return dateTime + "-" + String(DEVICENAME) + "-DailyReport.txt";
-}
-
-// return the SD card information for logging
-String getSDCardInfo() {
-  uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-  uint64_t usedSpace = cardSize - (SD.totalBytes() / (1024 * 1024));
-  String sdInfo = "SD:" + String(usedSpace) + "/" + String(cardSize) + "M";
-  return sdInfo;
-}
-
-String sendATCommand(String command, String desiredResponse, unsigned long timeout) {
-  modem.sendAT(command);
-  String result;
-  unsigned long startTime = millis();
-  boolean ok = false;
-  while (!ok && millis() - startTime < timeout) {
-    String s = modem.stream.readStringUntil('\n');
-    ok = s.indexOf(desiredResponse) >= 0;
-    result += s;
-  }
-  return result;
+  char dateTime[20];
+  formatDateTime(dateTime, sizeof(dateTime), WALL_CLOCK_COMPACT);
+  char name[64];
+  reportName(name, sizeof(name), dateTime, "-DailyReport.txt");
+  return String(name);
 }
 
 // delete all files in sim7600 EFS to prevent clutter of images
@@ -141,19 +222,16 @@ void clearEFS() {
   ESP_LOGI(TAG, "Clearing EFS...");
 
   // directory for storing all images
-  modem.sendAT("+FSCD=E:");
-  if (modem.waitResponse(10000) != 1) {
+  if (atSendOnce("+FSCD=E:", NULL, 10000) != AT_RESPONSE_MATCH) {
       ESP_LOGI(TAG, "Failed to change directory to E:");
       return;
   }
 
-  modem.sendAT("+FSLS");
-  if (modem.waitResponse(5000) != 1) {
+  if (atSendWait("+FSLS", NULL, 5000) != AT_RESPONSE_MATCH) {
     ESP_LOGI(TAG, "Failed to check EFS file listing");
   }
 
-  modem.sendAT("+FSDEL=*.*");
-  if (modem.waitResponse(10000) != 1) {
+  if (atSendWait("+FSDEL=*.*", NULL, 10000) != AT_RESPONSE_MATCH) {
     ESP_LOGI(TAG, "Failed to delete image files");
   } else {
     ESP_LOGI(TAG, "Successfully cleared EFS");
@@ -161,222 +239,147 @@ void clearEFS() {
 }
 
 
-// start FTP service on modem and login
-boolean initFtp(void) {
-  String response = sendATCommand("+CFTPSSTART", "+CFTPSSTART:", 10000);
-  if (response.indexOf("ERROR") > 0) {
-    ESP_LOGI(TAG, "Failed to start FTP service on modem");
-    stopFtp();
-    sendATCommand("+CFTPSSTART", "OK", 5000);
-  } else {
-    ESP_LOGI(TAG, "Started FTP service on modem");
-  }
-
-  String loginCommand = String("+CFTPSLOGIN=\"") + FTP_SERVER + "\"," + String(FTP_PORT) + ",\"" + FTP_USER + "\",\"" + FTP_PASS + "\",0";
-  response = sendATCommand(loginCommand, "+CFTPSLOGIN:", 20000);
-  if (response.indexOf("CFTPSLOGIN: 0") > 0) {
-    ESP_LOGI(TAG, "Logged in FTP");
-  } else {
-    ESP_LOGI(TAG, "Failed to login FTP");
-    return false;
-  }
-
-  // modem.sendAT("+CFTPTYPE=I");
-  // // modem.waitResponse(2000, result);
-  // if (modem.waitResponse(5000) != 1) {
-  //   ESP_LOGI(TAG, "Failed to set FTP type");
-  // }
-
-  // modem.sendAT("+CFTPSCWD=\"/\"");
-  // // modem.waitResponse(2000, result);
-  // if (modem.waitResponse(5000) != 1) {
-  //   ESP_LOGI(TAG, "Failed to set FTP folder");
-  // }
+// copy camera data to modem EFS sd card
+boolean sendFileToEFS(String imageFileName, const uint8_t *buf, size_t len) {
+  return efsTransferBuffer(imageFileName.c_str(), buf, len);
+}
 
-  return true;
+// compressed on the way to the modem, the name should end in COMPRESSED_SUFFIX
+boolean sendLogToEFS(String logFileName, String logFileContents) {
+  return efsTransferCompressed(logFileName.c_str(), (const uint8_t *)logFileContents.c_str(), logFileContents.length());
 }
 
-// logout and stop FTP service on modem
-void stopFtp(void) {
-  String response = sendATCommand("+CFTPSLOGOUT", "+CTFPSLOGOUT:", 2000);
-  if (response.indexOf("+CFTPSLOGOUT: 0") >= 0) {
-    ESP_LOGI(TAG, "Logged out FTP");
-  } else {
-    ESP_LOGI(TAG, "Failed to log out FTP");
+// stream the frame straight to the upload receiver over a modem TCP socket
+boolean sendPhotoTcp(const uint8_t *buf, size_t len, String imageFileName, uint32_t timestamp) {
+  if (!modem.isGprsConnected() && !modem.gprsConnect(apn, gprsUser, gprsPass)) {
+    ESP_LOGI(TAG, "Failed to bring up data connection");
+    return false;
   }
-
-  response = sendATCommand("+CFTPSSTOP", "+CFTPSSTOP:", 2000);
-  if (response.indexOf("+CFTPSSTOP: 0") >= 0) {
-    ESP_LOGI(TAG, "Stopped FTP service on modem");
-  } else {
-    ESP_LOGI(TAG, "Failed to stop FTP service on modem");
+  if (!client.connect(TCP_UPLOAD_HOST, TCP_UPLOAD_PORT)) {
+    ESP_LOGI(TAG, "Failed to connect to upload receiver");
+    return false;
   }
+  boolean ok = tcpSendFrame(client, imageFileName.c_str(), timestamp, buf, len);
+  client.stop();
+  return ok;
 }
 
-// send file to FTP server (must be logged in first)
-int sendFileToFtp(String fileName) {
-  String putCommand = String("+CFTPSPUTFILE=") + "\"/" + fileName + "\"," + "3";
-  String response = sendATCommand(putCommand, "+CFTPSPUTFILE:", 100000);
-  if (response.indexOf("+CFTPSPUTFILE: 0") >= 0) {
-    ESP_LOGI(TAG, "Successfully ran FTP putfile");
-    return 0;
-  } else {
-    ESP_LOGI(TAG, "Failed to run putfile and upload file to ftp");
-    return -1;
+// copy file to modem and send it to FTP server
+boolean sendPhoto(const uint8_t *buf, size_t len, String imageFileName, uint32_t timestamp) {
+#ifdef TCP_UPLOAD_ENABLED
+  if (sendPhotoTcp(buf, len, imageFileName, timestamp)) {
+    return true;
   }
+  ESP_LOGI(TAG, "TCP upload failed, falling back to EFS and FTP");
+#endif
+
+  if (!sendFileToEFS(imageFileName, buf, len)){
+    ESP_LOGI(TAG, "Error while sending file to EFS. Is SD card ok ?");
+    return false;
+  };
+  return ftpSessionPut(imageFileName.c_str());
 }
 
-// copy camera data to modem EFS sd card
-boolean sendFileToEFS(String imageFileName, camera_fb_t * fb) {
-  uint8_t *fbBuf = fb->buf;
-  size_t len = fb->len;
+boolean sendLogFile(String logFileName, String logFileContents) {
+  String uploadName = logFileName + COMPRESSED_SUFFIX;
+  if (!sendLogToEFS(uploadName, logFileContents)){
+    ESP_LOGI(TAG, "Error while sending file to EFS. Is SD card ok ?");
+    return false;
+  };
+  return ftpSessionPut(uploadName.c_str());
+}
 
-  modem.sendAT("+FSCD=E:");
-  if (modem.waitResponse(20000) != 1) {
-    ESP_LOGI(TAG, "Failed to switch EFS directory");
+// one delivery attempt for an item waiting on the SD card
+bool sendQueued(const OutboxItem &item, const uint8_t *data, size_t length, void *context) {
+  if (item.kind == OUTBOX_REPORT) {
+    String uploadName = String(item.name) + COMPRESSED_SUFFIX;
+    return efsTransferCompressed(uploadName.c_str(), data, length) && ftpSessionPut(uploadName.c_str());
   }
+  return sendPhoto(data, length, item.name, item.timestamp);
+}
 
-  ESP_LOGI(TAG, "File length: %d", len);
-  String uploadCommand = "+CFTRANRX=";
-  uploadCommand = uploadCommand + "\"e:/" + imageFileName + "\"," + len;
-  ESP_LOGI(TAG, "upload command: %s", uploadCommand.c_str());
-  modem.sendAT(uploadCommand);
-  if (modem.waitResponse(2000) != 0) { // TODO: fix waiting for the '>' start
-    ESP_LOGI(TAG, "Failed to start file upload to EFS");
+// fetch the list of full frames the server wants, one image name per line
+// or "*" for all of them. the server drops names once the frames arrive
+void checkFullFrameRequests() {
+  char url[160];
+  char requests[512];
+  snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (FULL_FRAME_REQUEST_ENDPOINT).c_str());
+  if (!otaFetchText(url, requests, sizeof(requests))) {
+    // no request file is the normal case
+    fullFrameRequests = "";
+    return;
   }
+  fullFrameRequests = String("\n") + requests + "\n";
+  fullFrameRequests.replace("\r", "");
+}
 
-  modem.stream.write(fbBuf, len);
-  modem.stream.flush();
-  // wait for the OK response
-  unsigned long startTime = millis();
-  while (millis() - startTime < 25000) { // timeout for file transfer to EFS
-    if (modem.stream.available()) {
-      String response = modem.stream.readStringUntil('\n');
-      // ESP_LOGI(TAG, "Response: %s", response.c_str());
-      if (response.indexOf("OK") != -1) {
-        ESP_LOGI(TAG, "File successfully written to EFS");
-
-        // manual check that file was written
-        // modem.sendAT("+FSLS");
-        // if (modem.waitResponse(20000) != 1) {
-        //   ESP_LOGI(TAG, "Failed to check EFS directory");
-        // }
-
-        return true;
-      }
-    }
+// a kept full frame goes up once the server asks for it or it is old enough
+bool fullFrameDue(const OutboxItem &item, void *context) {
+  if (fullFrameRequests.indexOf("\n*\n") >= 0 || fullFrameRequests.indexOf(String("\n") + item.name + "\n") >= 0) {
+    return true;
   }
-
-  ESP_LOGI(TAG, "Failed to write file to EFS");
-  return false;
+  uint32_t now = wallClock.valid() ? (uint32_t)wallClock.utcSeconds(esp_timer_get_time()) : 0;
+  return FULL_FRAME_UPLOAD_AFTER_S > 0 && now > item.timestamp && now - item.timestamp >= FULL_FRAME_UPLOAD_AFTER_S;
 }
 
-boolean sendLogToEFS(String logFileName, String logFileContents) {
-  size_t len = logFileContents.length();
-
-  modem.sendAT("+FSCD=E:");
-  if (modem.waitResponse(20000) != 1) {
-    ESP_LOGI(TAG, "Failed to switch EFS directory");
+// send the full frames that are due, after anything still waiting in the
+// outbox so thumbnails never queue behind them
+void drainFullFrames() {
+  if (fullFrames.pending() == 0 || outbox.pending() > 0 || !allocateOutboxBuffer()) {
+    return;
   }
-
-  ESP_LOGI(TAG, "File length: %d", len);
-  String uploadCommand = "+CFTRANRX=";
-  uploadCommand = uploadCommand + "\"e:/" + logFileName + "\"," + len;
-  ESP_LOGI(TAG, "upload command: %s", uploadCommand.c_str());
-  modem.sendAT(uploadCommand);
-  if (modem.waitResponse(2000) != 0) { // TODO: fix waiting for the '>' start
-    ESP_LOGI(TAG, "Failed to start file upload to EFS");
+  size_t sent = fullFrames.drain(millis(), sendQueued, NULL, outboxBuffer, FRAME_RING_SLOT_SIZE, fullFrameDue);
+  if (sent > 0) {
+    ESP_LOGI(TAG, "Full frames: %u sent, %u kept", (unsigned)sent, (unsigned)fullFrames.pending());
   }
+}
 
-  modem.stream.write(logFileContents.c_str(), len);
-  modem.stream.flush();
-  // wait for the OK response
-  unsigned long startTime = millis();
-  while (millis() - startTime < 25000) { // timeout for file transfer to EFS
-    if (modem.stream.available()) {
-      String response = modem.stream.readStringUntil('\n');
-      // ESP_LOGI(TAG, "Response: %s", response.c_str());
-      if (response.indexOf("OK") != -1) {
-        ESP_LOGI(TAG, "File successfully written to EFS");
-
-        // manual check that file was written
-        // modem.sendAT("+FSLS");
-        // if (modem.waitResponse(20000) != 1) {
-        //   ESP_LOGI(TAG, "Failed to check EFS directory");
-        // }
-
-        return true;
-      }
+// payload buffer shared by both SD queues, allocated the first time one has work
+boolean allocateOutboxBuffer() {
+  if (!outboxBuffer) {
+    outboxBuffer = (uint8_t *)ps_malloc(FRAME_RING_SLOT_SIZE);
+    if (!outboxBuffer) {
+      ESP_LOGE(TAG, "Failed to allocate outbox buffer");
+      return false;
     }
   }
-
-  ESP_LOGI(TAG, "Failed to write file to EFS");
-  return false;
+  return true;
 }
 
-// copy file to modem and send it to FTP server
-boolean sendPhoto(camera_fb_t * fb) {
-  String imageFileName = getFormattedImageName();
-  if (!sendFileToEFS(imageFileName, fb)){
-    ESP_LOGI(TAG, "Error while sending file to EFS. Is SD card ok ?");
-    return false;
-  };
-  if (!initFtp()) {
-    ESP_LOGI(TAG, "Error while conecting to FTP");
-    return false;
-  };
-  int ftpResult = -1;
-  int retries = 3;
-  while (ftpResult != 0 && retries >= 0) {
-    ftpResult = sendFileToFtp(imageFileName);
-    retries--;
-    if(ftpResult != 0){
-      ESP_LOGI(TAG, "Error sending file to FTP, retrying, number of retires left : %d", retries);
-    }
-  }
-  stopFtp();
-  if (ftpResult == 0){
-    return true;
-  } else {
-    ESP_LOGI(TAG, "Cannot send file to FTP");
-    return false;
+// retry whatever earlier uploads left on the SD card
+void drainOutbox() {
+  if (outbox.pending() == 0 || !allocateOutboxBuffer()) {
+    return;
   }
+  size_t sent = outbox.drain(millis(), sendQueued, NULL, outboxBuffer, FRAME_RING_SLOT_SIZE);
+  const OutboxStats &stats = outbox.stats();
+  ESP_LOGI(TAG, "Outbox: %u sent now, %u pending, %u sent, %u failed attempts, %u corrupt, %u full",
+           (unsigned)sent, (unsigned)outbox.pending(), stats.sent, stats.failures, stats.corrupt, stats.full);
 }
 
-boolean sendLogFile(String logFileContents) {
-  String logFileName = getFormattedImageName();
-  if (!sendLogToEFS(logFileName, logFileContents)){
-    ESP_LOGI(TAG, "Error while sending file to EFS. Is SD card ok ?");
-    return false;
-  };
-  if (!initFtp()) {
-    ESP_LOGI(TAG, "Error while conecting to FTP");
-    return false;
-  };
-  int ftpResult = -1;
-  int retries = 3;
-  while (ftpResult != 0 && retries >= 0) {
-    ftpResult = sendFileToFtp(logFileName);
-    retries--;
-    if(ftpResult != 0){
-      ESP_LOGI(TAG, "Error sending file to FTP, retrying, number of retires left : %d", retries);
+// take photo, keep it in the history and hand it to the uploader if needed
+boolean takePhoto(PipelineJob *job) {
+  static boolean firstFrame = true;
+  // the sensor is only reconfigured from the capture task
+  uint8_t level = captureLevel;
+  if (level != cameraLevel) {
+    sensor_t *s = esp_camera_sensor_get();
+    if (s && s->set_framesize(s, linkFrameSizes[level]) == 0 && s->set_quality(s, linkQualities[level]) == 0) {
+      ESP_LOGI(TAG, "Capture level %u -> %u (framesize %d, quality %u)", cameraLevel, level, linkFrameSizes[level],
+               linkQualities[level]);
+      cameraLevel = level;
     }
   }
-  stopFtp();
-  if (ftpResult == 0){
-    return true;
-  } else {
-    ESP_LOGI(TAG, "Cannot send file to FTP");
-    return false;
-  }
-}
-
-// take photo, process it, and send to server if needed
-void takePhoto() {
+  unsigned long grabUs = micros();
   camera_fb_t *fb = esp_camera_fb_get();
+  metricRecord(METRIC_CAMERA_GRAB, micros() - grabUs);
   if (!fb) {
     ESP_LOGI(TAG, "Camera capture failed");
-    return;
+    return false;
+  }
+  if (firstFrame) {
+    firstFrame = false;
+    ESP_LOGI(TAG, "First frame %lu ms after power-on", millis());
   }
   //   unsigned int totalPictures = preferences.getUInt("totalPictures", 0);
   //   totalPictures++;
@@ -394,58 +397,286 @@ void takePhoto() {
   // ftp.CloseFile();
   // ftp.CloseConnection();
 
-  // send image over 4G if interesting
-  int chance = random(200);
-  // ESP_LOGI(TAG, "random number generated: %d", chance);
-  if(chance == 1) {
-    boolean sendPhotoOk = false;
-    for (int i=0; i<3; i++) {
-      sendPhotoOk = sendPhoto(fb);
-      if (sendPhotoOk) {
-        break;
+  // send image over 4G if something moved in the scene
+  boolean hasMotion = frameHasMotion(fb, &job->region);
+
+  // keep a copy in the PSRAM history so the driver buffer goes straight back
+  portMutexLock(frameRingMutex);
+  StoredFrame *frame = frameRing.push(fb->buf, fb->len, fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec,
+                                      fb->width, fb->height);
+  if (hasMotion && frame) {
+    // pre-trigger frames that earlier events haven't sent yet, oldest first
+    uint16_t count = frameRing.count();
+    uint16_t first = count > FRAME_PRE_TRIGGER + 1 ? count - FRAME_PRE_TRIGGER - 1 : 0;
+    for (uint16_t i = first; i + 1 < count && job->count < PIPELINE_MAX_JOB_FRAMES - 1; i++) {
+      StoredFrame *earlier = frameRing.at(i);
+      if (!earlier->uploaded) {
+        frameRing.retain(earlier);
+        job->frames[job->count++] = earlier;
       }
     }
+    frameRing.retain(frame);
+    job->frames[job->count++] = frame;
+  }
+  portMutexUnlock(frameRingMutex);
 
-    if (!sendPhotoOk) {
-      esp_camera_fb_return(fb);
-      ESP_LOGI(TAG, "Time: %s", String(esp_timer_get_time()));
-      ESP_LOGI(TAG, "Failed to upload photo successfully");
-      return;
-    } else {
-      // return the frame buffer back to the driver for reuse
-      esp_camera_fb_return(fb);
+  // return the frame buffer back to the driver for reuse
+  esp_camera_fb_return(fb);
+
+  if (hasMotion && !frame) {
+    ESP_LOGI(TAG, "No room in frame history, dropping event");
+  }
+  return hasMotion && frame;
+}
+
+// upload with retries, returns false once they are used up
+boolean uploadFrame(const uint8_t *buf, size_t len, String imageFileName, uint32_t timestamp) {
+  for (int i=0; i<3; i++) {
+    if (sendPhoto(buf, len, imageFileName, timestamp)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// upload an event: the frames leading up to it, then the trigger frame
+bool uploadJob(PipelineJob *job) {
+  // capture starts before the modem is up, hold the first events until it
+  // is. a modem stage that takes too long sends them to the SD card instead
+  while (!bootComplete && millis() < BOOT_UPLOAD_WAIT_MS) {
+    delay(100);
+  }
+  boolean linkReady = bootComplete;
+  StoredFrame *trigger = job->frames[job->count - 1];
+  // stamp the event with when it was captured, not when its upload started
+  if (linkReady && !wallClock.valid()) {
+    syncClock();
+  }
+  uint32_t eventTime = wallClock.valid() ? (uint32_t)wallClock.utcSeconds(trigger->captureUs) : 0;
+  char dateTime[20] = "";
+  wallClock.format(dateTime, sizeof(dateTime), trigger->captureUs, WALL_CLOCK_COMPACT);
+  char baseName[48];
+  imageName(baseName, sizeof(baseName), dateTime, "");
+
+  // bytes and time on the link and bytes captured, for the link controller
+  uint32_t eventBytes = 0;
+  uint32_t eventMs = 0;
+  uint32_t frameBytes = 0;
+
+  // the same crop applies to the frames leading up to the event
+  for (uint8_t i = 0; i + 1 < job->count; i++) {
+    StoredFrame *earlier = job->frames[i];
+    uint32_t age = (uint32_t)((trigger->captureUs - earlier->captureUs) / 1000000LL);
+    // without a clock the event time is 0, keep the frame at 0 as well
+    uint32_t frameTime = eventTime > age ? eventTime - age : 0;
+    String name = String(baseName) + "-p" + String(job->count - 1 - i) + ".jpg";
+    uint8_t *reduced = NULL;
+    size_t length = reduceFrame(earlier, job->region, &name, frameTime, &reduced);
+    const uint8_t *data = reduced ? reduced : earlier->data;
+    unsigned long startTime = millis();
+    earlier->uploaded = linkReady && uploadFrame(data, length, name, frameTime);
+    eventMs += millis() - startTime;
+    eventBytes += length;
+    frameBytes += earlier->length;
+    if (!earlier->uploaded) {
+      ESP_LOGI(TAG, "Failed to upload pre-trigger frame %s", name.c_str());
+      earlier->uploaded = outbox.add(OUTBOX_IMAGE, name.c_str(), frameTime, data, length);
+    }
+    free(reduced);
+  }
 
-      ESP_LOGI(TAG, "Time: %s", String(esp_timer_get_time()));
-      ESP_LOGI(TAG, "Photo taken and uploaded successfully");
+  String name = String(baseName) + ".jpg";
+  uint8_t *reduced = NULL;
+  size_t length = reduceFrame(trigger, job->region, &name, eventTime, &reduced);
+  const uint8_t *data = reduced ? reduced : trigger->data;
+  unsigned long startTime = millis();
+  boolean sendPhotoOk = linkReady && uploadFrame(data, length, name, eventTime);
+  eventMs += millis() - startTime;
+  eventBytes += length;
+  frameBytes += trigger->length;
+  trigger->uploaded = sendPhotoOk;
+
+  // nothing was tried without a modem, the link model learns nothing from it
+  if (linkReady && linkControl.eventUploaded(eventBytes, frameBytes, eventMs, sendPhotoOk)) {
+    captureLevel = linkControl.level();
+    ESP_LOGI(TAG, "Link at %u B/s, capture level now %u (predicted %u ms per event)", linkControl.throughputBps(),
+             linkControl.level(), linkControl.predictMs(linkControl.level()));
+  }
 
-      unsigned int sendTimes = preferences.getUInt("sendTimes", 0);
-      sendTimes++;
-      preferences.putUInt("sendTimes", sendTimes);
+  if (!sendPhotoOk) {
+    ESP_LOGI(TAG, "Time: %lld", esp_timer_get_time());
+    ESP_LOGI(TAG, "Failed to upload photo successfully");
 
-      ESP_LOGI(TAG, "Send Times: %d", sendTimes);
+    // keep it on the SD card until the link comes back
+    trigger->uploaded = outbox.add(OUTBOX_IMAGE, name.c_str(), eventTime, data, length);
+    if (!trigger->uploaded) {
+      ESP_LOGI(TAG, "Failed to queue photo on SD card, it is lost");
     }
+  } else {
+    // the link works, anything backed off in the outbox can go now
+    outbox.linkUp();
+
+    ESP_LOGI(TAG, "Time: %lld", esp_timer_get_time());
+    ESP_LOGI(TAG, "Photo taken and uploaded successfully");
+
+    unsigned int sendTimes = preferences.getUInt("sendTimes", 0);
+    sendTimes++;
+    preferences.putUInt("sendTimes", sendTimes);
+
+    ESP_LOGI(TAG, "Send Times: %d", sendTimes);
   }
-  esp_camera_fb_return(fb);
+  free(reduced);
+  return sendPhotoOk;
+}
+
+// what to upload in place of a frame: a thumbnail (of the changed region
+// when ROI upload is on too) with the full frame queued on the SD card
+// until later, or a crop of the changed region with the full frame kept on
+// the SD card. returns the replacement's length with
+// reduced set for the caller to free and name changed to match, or the
+// frame's length and NULL when it goes up as it is
+size_t reduceFrame(const StoredFrame *frame, const RoiRect &region, String *name, uint32_t timestamp, uint8_t **reduced) {
+  *reduced = NULL;
+  // nowhere to keep the full frame, it goes up as it is
+  if (!storageReady) {
+    return frame->length;
+  }
+  size_t length;
+  uint8_t quality;
+#if defined(UPLOAD_THUMBNAIL_FIRST)
+  RoiRect area = {0, 0, frame->width, frame->height};
+#ifdef ROI_UPLOAD_ENABLED
+  // spend the thumbnail's pixels on the part that changed
+  if (region.width > 0) {
+    area = region;
+  }
+#endif
+  uint8_t scaleShift = roiScaleShift(area, THUMBNAIL_MAX_SIDE);
+  if (!frameCrop(frameCropCameraCodec, frame->data, frame->length, area, scaleShift, THUMBNAIL_BUDGET, reduced,
+                 &length, &quality)) {
+    return frame->length;
+  }
+  if (!fullFrames.add(OUTBOX_IMAGE, name->c_str(), timestamp, frame->data, frame->length)) {
+    ESP_LOGI(TAG, "Failed to keep full frame %s, uploading it now", name->c_str());
+    free(*reduced);
+    *reduced = NULL;
+    return frame->length;
+  }
+  power.setActive(POWER_JOB_FULL_FRAMES, true);
+  ESP_LOGI(TAG, "Thumbnail of %s: %ux%u at %u,%u to %ux%u, %u -> %u bytes at quality %u in %u ms", name->c_str(),
+           area.width, area.height, area.x, area.y, area.width >> scaleShift, area.height >> scaleShift,
+           frame->length, length, quality, frameCropStats().lastDecodeMs + frameCropStats().lastEncodeMs);
+  *name = name->substring(0, name->length() - 4) + "-t.jpg";
+  return length;
+#elif defined(ROI_UPLOAD_ENABLED)
+  if (region.width == 0) {
+    return frame->length;
+  }
+  uint8_t scaleShift = roiScaleShift(region, ROI_MAX_SIDE);
+  if (!frameCrop(frameCropCameraCodec, frame->data, frame->length, region, scaleShift, ROI_BUDGET, reduced, &length,
+                 &quality)) {
+    return frame->length;
+  }
+  // a busy scene at full size can come out larger than the original
+  if (length >= frame->length || !saveFullFrame(*name, frame->data, frame->length)) {
+    free(*reduced);
+    *reduced = NULL;
+    return frame->length;
+  }
+  const FrameCropStats &stats = frameCropStats();
+  ESP_LOGI(TAG, "Cropped %s to %ux%u/%u, %u -> %u bytes at quality %u, decode %u ms, encode %u ms", name->c_str(),
+           region.width, region.height, 1 << scaleShift, frame->length, length, quality, stats.lastDecodeMs,
+           stats.lastEncodeMs);
+  return length;
+#else
+  return frame->length;
+#endif
+}
+
+// keep a frame whose upload was cropped on the SD card at full size
+boolean saveFullFrame(const String &name, const uint8_t *buf, size_t len) {
+  File file = SD.open(String(FULL_FRAME_DIR) + "/" + name, FILE_WRITE);
+  if (!file) {
+    ESP_LOGI(TAG, "Failed to open %s on SD card", name.c_str());
+    return false;
+  }
+  size_t written = file.write(buf, len);
+  file.close();
+  if (written != len) {
+    ESP_LOGI(TAG, "Failed to save full frame %s, SD card full?", name.c_str());
+    return false;
+  }
+  return true;
+}
+
+// let go of the frames an event was holding in the history
+void releaseJob(PipelineJob *job) {
+  portMutexLock(frameRingMutex);
+  for (uint8_t i = 0; i < job->count; i++) {
+    frameRing.release(job->frames[i]);
+  }
+  job->count = 0;
+  portMutexUnlock(frameRingMutex);
+}
+
+// score the frame against the background model, true when it's worth
+// uploading. region is set to the part of the frame that changed
+boolean frameHasMotion(camera_fb_t * fb, RoiRect *region) {
+  int64_t startTime = esp_timer_get_time();
+  uint16_t width, height;
+  const uint8_t *luma = lumaThumbnail(fb, &width, &height);
+  if (!luma) {
+    return false;
+  }
+
+  if (motion.width() != width || motion.height() != height / 8 * 8) {
+    if (!motion.begin(width, height, motionConfig)) {
+      ESP_LOGE(TAG, "Failed to allocate motion background model");
+      return false;
+    }
+  }
+
+  MotionResult result = motion.update(luma);
+  ESP_LOGI(TAG, "Motion score %u (%u blocks over %u)%s in %lld us", result.score, result.changedBlocks, result.threshold,
+           result.lightingChange ? ", lighting change" : "", esp_timer_get_time() - startTime);
+
+#ifdef ROI_UPLOAD_ENABLED
+  if (result.triggered) {
+    // each thumbnail pixel is an 8x8 block of the frame
+    uint16_t blockPixels = 8 * motion.width() / motion.blocksWide();
+    uint8_t regions = roiFinder.find(motion.blockMask(), motion.blocksWide(), motion.blocksHigh(), blockPixels,
+                                     fb->width, fb->height, roiConfig, region);
+    ESP_LOGI(TAG, "Changed region %ux%u at %u,%u from %u regions", region->width, region->height, region->x,
+             region->y, regions);
+  }
+#endif
+  return result.triggered;
 }
 
 // send formatted logfile with sensor information
 void sendLogFile() {
-  String formattedDateTime = getFormattedDateTime();
+  char formattedDateTime[20];
+  formatDateTime(formattedDateTime, sizeof(formattedDateTime), WALL_CLOCK_READABLE);
   getGPSPosition(); // update GPS position data
 
-  unsigned int sendTimes = preferences.getUInt("sendTimes", 0);
   // unsigned int totalPictures = preferences.getUInt("totalPictures", 0);
 
-  LogContent = "IMEI:" + IMEI + "\n";
-  LogContent += "CSQ:12\n";
-  LogContent += "CamID:" + String(DEVICENAME) + "\n";
-  LogContent += "Temp:9C\n";
-  LogContent += "Date:" + formattedDateTime + "\n";
-  LogContent += "Bat:100%\n";
-  LogContent += getSDCardInfo() + "\n";
-  LogContent += "Total:" + String("0") + "\n";
-  LogContent += "Send:" + String(sendTimes) + "\n";
-  LogContent += "GPS:" + GPSPosition + "\n";
+  ReportInfo info;
+  info.imei = IMEI.c_str();
+  info.csq = linkControl.lastSignal().csq;
+  info.temperatureC = (int)lroundf(temperatureRead());
+  info.dateTime = formattedDateTime;
+  GaugeSummary battery = gaugeSummary(GAUGE_BATTERY);
+  info.batterySet = battery.set;
+  info.batteryMv = battery.last;
+  info.sdReady = storageReady;
+  info.sdSizeMb = storageReady ? (uint32_t)(SD.cardSize() / (1024 * 1024)) : 0;
+  info.sdUsedMb = storageReady ? info.sdSizeMb - (uint32_t)(SD.totalBytes() / (1024 * 1024)) : 0;
+  info.sendTimes = preferences.getUInt("sendTimes", 0);
+  info.gps = GPSPosition.c_str();
+  char reportText[REPORT_SIZE];
+  reportFormat(reportText, sizeof(reportText), info);
+  LogContent = reportText;
 
   ESP_LOGI(TAG, "Log Content:\n%s", LogContent.c_str());
 
@@ -460,13 +691,140 @@ void sendLogFile() {
   // ftp.CloseFile();
   // ftp.CloseConnection();
 
-  // send logfile over 4G
-
+  // send logfile over 4G, queue it on the SD card if that fails
+  String reportName = getFormattedReportName();
+  if (!sendLogFile(reportName, LogContent) &&
+      !outbox.add(OUTBOX_REPORT, reportName.c_str(), getUnixTime(), (const uint8_t *)LogContent.c_str(), LogContent.length())) {
+    // the metrics carry on into the next report
+    ESP_LOGI(TAG, "Failed to send or queue daily report");
+    return;
+  }
+  // with the telemetry ring running its records own the metrics intervals,
+  // the report is a snapshot of the current one
+  if (!telemetry.ready()) {
+    metricsReset();
+  }
 
-  ESP_LOGI(TAG, "Time: %s", String(esp_timer_get_time()).c_str());
+  ESP_LOGI(TAG, "Time: %lld", esp_timer_get_time());
   ESP_LOGI(TAG, "Daily report generated and uploaded successfully");
 }
 
+// append one telemetry record to the SD ring, metrics start a new interval
+// once it is stored
+void recordTelemetry() {
+  TelemetryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.timestamp = getUnixTime();
+  record.uptimeS = (uint32_t)(esp_timer_get_time() / 1000000);
+  record.coldBoots = power.coldBoots();
+  record.deepWakes = power.deepWakes();
+  const PipelineStats &pipeline = pipelineStats();
+  record.captured = pipeline.captured;
+  record.events = pipeline.events;
+  record.uploaded = pipeline.uploaded;
+  record.uploadFailures = pipeline.uploadFailures;
+  record.outboxPending = (uint16_t)outbox.pending();
+  record.fullFramesPending = (uint16_t)fullFrames.pending();
+  record.milliampHours = power.milliampHours();
+  record.sdUsedMb = storageReady ? (uint32_t)(SD.usedBytes() / (1024 * 1024)) : 0;
+  record.sdTotalMb = storageReady ? (uint32_t)(SD.totalBytes() / (1024 * 1024)) : 0;
+
+  // whatever fix the GNSS reports left behind, no waiting for a new one
+  record.fixAgeS = TELEMETRY_NO_FIX;
+  if (gnss.hasFix()) {
+    const GnssFix &fix = gnss.last();
+    record.latitudeE7 = fix.latitudeE7;
+    record.longitudeE7 = fix.longitudeE7;
+    record.fixAgeS = (uint32_t)(gnss.ageUs(esp_timer_get_time()) / 1000000);
+    record.hdopX10 = (uint16_t)lroundf(fix.hdop * 10);
+    record.fixMode = fix.mode;
+    record.satellites = fix.satellites;
+  }
+
+  const LinkSignal &signal = linkControl.lastSignal();
+  record.csq = signal.csq;
+  record.captureLevel = captureLevel;
+  record.rsrpDbm = signal.rsrpDbm;
+  record.snrDb = (int8_t)signal.snrDb;
+  strlcpy(record.linkMode, signal.mode, sizeof(record.linkMode));
+
+  for (int i = 0; i < METRIC_COUNT; i++) record.metrics[i] = metricSummary((MetricId)i);
+  for (int i = 0; i < GAUGE_COUNT; i++) record.gauges[i] = gaugeSummary((GaugeId)i);
+
+  // an interval that wasn't stored carries on into the next record
+  if (telemetry.append(record)) {
+    metricsReset();
+    ESP_LOGI(TAG, "Telemetry record %u stored, %u unsent", record.sequence, telemetry.pending());
+  } else {
+    ESP_LOGI(TAG, "Failed to store telemetry record");
+  }
+}
+
+// upload the records the server doesn't have yet, a batch per file. what
+// doesn't go through stays in the ring for the next report
+void sendTelemetry() {
+  recordTelemetry();
+  if (telemetry.pending() == 0 || !allocateOutboxBuffer()) {
+    return;
+  }
+  while (telemetry.pending() > 0) {
+    uint32_t pending = telemetry.pending();
+    uint32_t last;
+    size_t length = telemetry.unsent(outboxBuffer, FRAME_RING_SLOT_SIZE, &last);
+    if (length > 0) {
+      char dateTime[20];
+      formatDateTime(dateTime, sizeof(dateTime), WALL_CLOCK_COMPACT);
+      char suffix[16];
+      snprintf(suffix, sizeof(suffix), "-%lu.tlm", (unsigned long)last);
+      char name[64];
+      reportName(name, sizeof(name), dateTime, suffix);
+      if (!efsTransferBuffer(name, outboxBuffer, length) || !ftpSessionPut(name)) {
+        ESP_LOGI(TAG, "Failed to send telemetry, %u records kept", telemetry.pending());
+        return;
+      }
+      ESP_LOGI(TAG, "Telemetry: sent %u bytes up to record %u", (unsigned)length, last);
+    }
+    if (!telemetry.markSent(last)) {
+      ESP_LOGI(TAG, "Failed to mark telemetry sent");
+      return;
+    }
+    // nothing read back, e.g. the ring file didn't open. try again next report
+    if (telemetry.pending() >= pending) {
+      ESP_LOGI(TAG, "Failed to read telemetry ring, %u records kept", pending);
+      return;
+    }
+  }
+}
+
+// rotated log files go up compressed with the report and are deleted once
+// the server has them. one that doesn't go through waits for the next report
+void sendLogSegments() {
+  char path[48];
+  while (sdLogTakeSegment(path, sizeof(path))) {
+    File segment = SD.open(path, FILE_READ);
+    if (!segment) {
+      ESP_LOGI(TAG, "Failed to open log segment %s", path);
+      return;
+    }
+    char dateTime[20];
+    formatDateTime(dateTime, sizeof(dateTime), WALL_CLOCK_COMPACT);
+    char name[64];
+    reportName(name, sizeof(name), dateTime, "-log.txt" COMPRESSED_SUFFIX);
+    EfsTransferStats stats;
+    boolean sent = efsTransferCompressedFile(name, segment, &stats) && ftpSessionPut(name);
+    segment.close();
+    if (!sent) {
+      ESP_LOGI(TAG, "Failed to send log segment, kept for the next report");
+      return;
+    }
+    ESP_LOGI(TAG, "Log segment sent: %u bytes as %u", (unsigned)stats.inputBytes, (unsigned)stats.bytes);
+    if (!SD.remove(path)) {
+      ESP_LOGI(TAG, "Failed to remove sent log segment %s", path);
+      return;
+    }
+  }
+}
+
 // connect to WiFi
 // void initializeConnectionWifi() {
 //   ESP_LOGI(TAG, "Connecting to WiFi...");
@@ -479,7 +837,7 @@ void sendLogFile() {
 // }
 
 // initialize the camera
-void initializeCamera() {
+boolean initializeCamera() {
   ESP_LOGI(TAG, "Initializing camera...");
 
   // camera settings
@@ -527,7 +885,7 @@ void initializeCamera() {
   esp_err_t err = esp_camera_init(&config);
   if (err != ESP_OK) {
     ESP_LOGI(TAG, "Camera init failed with error 0x%x", err);
-    return;
+    return false;
   }
 
   sensor_t *s = esp_camera_sensor_get();
@@ -542,100 +900,130 @@ void initializeCamera() {
   pinMode(CAM_IR_PIN, OUTPUT);
   digitalWrite(CAM_IR_PIN, HIGH);
 
+  // frame history for pre-trigger uploads, one PSRAM allocation for good
+  if (psramFound()) {
+    size_t arenaSize = FRAME_RING_SLOTS * FRAME_RING_SLOT_SIZE;
+    uint8_t *arena = (uint8_t *)ps_malloc(arenaSize);
+    if (!arena || !frameRing.begin(arena, arenaSize, FRAME_RING_SLOT_SIZE, FRAME_RING_HISTORY)) {
+      ESP_LOGE(TAG, "Failed to allocate frame history");
+    }
+  }
+
   ESP_LOGI(TAG, "Camera initialized");
+  return true;
 }
 
-// convert ddmm.mmmmmm GPS position to DMS
-String convertToDMS(String coord, String direction) {
-  // latitude is in ddmm.mmmmmm format while longitude is in dddmm.mmmmmm format while
-  int degLength = (coord.length() > 11) ? 3 : 2;
-  int degrees = coord.substring(0, degLength).toInt();
-  float minutes = coord.substring(degLength).toFloat();
+// enable the receiver and have it report on its own, no-ops once it does
+void gnssBegin() {
+  if (atSendOnce("+CGPS=1", NULL, 10000) != AT_RESPONSE_MATCH) {
+    // the receiver answers ERROR when it is already running, e.g. after a deep sleep
+    char response[24];
+    if (atSendWait("+CGPS?", "+CGPS:", 5000, response, sizeof(response)) != AT_RESPONSE_MATCH ||
+        atResultCode(response) != 1) {
+      ESP_LOGI(TAG, "Failed to enable GPS");
+      return;
+    }
+  }
+  char command[24];
+  snprintf(command, sizeof(command), "+CGNSSINFO=%d", GNSS_REPORT_INTERVAL);
+  if (atSendOnce(command, NULL, 5000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to start GNSS reports");
+  }
+}
 
-  int wholeMinutes = int(minutes);
-  float fractionalMinutes = minutes - wholeMinutes;
-  float seconds = fractionalMinutes * 60;
+// cache a +CGNSSINFO line. only polled replies set the clock, a URC may
+// have waited in the UART buffer for a while before anyone read it
+bool gnssReceived(const char *line, bool polled) {
+  if (!gnss.update(line, esp_timer_get_time())) {
+    return false;
+  }
+  const GnssFix &fix = gnss.last();
+  if (polled && fix.utcUs != 0) {
+    wallClock.sync(fix.utcUs, fix.monoUs, WALL_CLOCK_GNSS);
+  }
+  return true;
+}
 
-  return direction + String(degrees) + "*" + String(wholeMinutes) + "'" + String(seconds, 2) + "\"";
+bool gnssGoodFix(const GnssFix &fix) {
+  return fix.valid && fix.hdop > 0 && fix.hdop <= GNSS_GOOD_HDOP;
 }
 
-// enables GNSS and gathers position data
-void getGPSPosition() {
-    ESP_LOGI(TAG, "Enabling GPS/GNSS/GLONASS and gathering position data");
+// best fix available within budgetMs: a recent good cached fix right away,
+// else poll until a good one turns up or the budget runs out
+bool getGnssFix(GnssFix *fix, uint32_t budgetMs) {
+  GnssFix best;
+  memset(&best, 0, sizeof(best));
+  const GnssFix *cached = gnss.fresh(esp_timer_get_time(), (int64_t)GNSS_MAX_FIX_AGE_MS * 1000);
+  if (cached) {
+    best = *cached;
+  }
 
-    modem.sendAT("+CGPS=1"); // enable GPS
-    if (modem.waitResponse(10000) != 1) {
-        ESP_LOGI(TAG, "Failed to enable GPS");
-        return;
+  gnssBegin();
+  char response[AT_LINE_SIZE];
+  unsigned long startTime = millis();
+  while (!gnssGoodFix(best) && millis() - startTime < budgetMs) {
+    if (atSendWait("+CGNSSINFO", "+CGNSSINFO:", 5000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+        gnssReceived(response, true) && GnssCache::better(gnss.last(), best)) {
+      best = gnss.last();
     }
+    if (!gnssGoodFix(best)) {
+      delay(GNSS_POLL_INTERVAL_MS);
+    }
+  }
 
-    String gps_latitude = "";
-    String gps_longitude = "";
-    while (true) {
-        ESP_LOGI(TAG, "Requesting GPS info");
-
-        modem.sendAT("+CGNSSINFO");
-        String response = modem.stream.readStringUntil('\n');
-        ESP_LOGI(TAG, "%s", response.c_str());
-
-        if (response.indexOf(",N,") != -1 || response.indexOf(",S,") != -1) {
-            int latStart = response.indexOf(",", 22) + 1;
-            int latEnd = response.indexOf(",", latStart);
-            gps_latitude = response.substring(latStart, latEnd);
-
-            int latDirEnd = response.indexOf(",", latEnd + 1);
-            String latDir = response.substring(latEnd + 1, latDirEnd);
-
-            int lonStart = response.indexOf(",", latDirEnd) + 1;
-            int lonEnd = response.indexOf(",", lonStart);
-            gps_longitude = response.substring(lonStart, lonEnd);
-
-            int lonDirEnd = response.indexOf(",", lonEnd + 1);
-            String lonDir = response.substring(lonEnd + 1, lonDirEnd);
+  *fix = best;
+  return best.valid;
+}
 
-            String latitudeDMS = convertToDMS(gps_latitude, latDir);
-            String longitudeDMS = convertToDMS(gps_longitude, lonDir);
+// refresh GPSPosition for the daily report, keeps the old one without a fix
+void getGPSPosition() {
+  GnssFix fix;
+  if (!getGnssFix(&fix, GNSS_FIX_BUDGET_MS)) {
+    ESP_LOGI(TAG, "No GPS fix within %u ms (%u replies, %u without a fix)", GNSS_FIX_BUDGET_MS,
+             gnss.stats().replies, gnss.stats().empty);
+    return;
+  }
 
-            GPSPosition = latitudeDMS + " " + longitudeDMS;
-            ESP_LOGI(TAG, "GPS Position: %s", GPSPosition.c_str());
-            break;
-        } else {
-            ESP_LOGI(TAG, "Couldn't get GPS info, retrying in 10s.");
-            delay(15000);
-        }
-    }
+  char latitude[24];
+  char longitude[24];
+  gnssFormatDms(latitude, sizeof(latitude), fix.latitudeE7, true);
+  gnssFormatDms(longitude, sizeof(longitude), fix.longitudeE7, false);
+  GPSPosition = String(latitude) + " " + longitude;
+  ESP_LOGI(TAG, "GPS Position: %s (%dD, %u satellites, HDOP %.1f, %lld s old)", GPSPosition.c_str(), fix.mode,
+           fix.satellites, fix.hdop, (esp_timer_get_time() - fix.monoUs) / 1000000);
 }
 
-// get IMEI number from GSM module
+// get IMEI number from GSM module, signal quality rides along on the same line
 void getIMEI() {
   ESP_LOGI(TAG, "Updating IMEI");
-  modem.sendAT("+CGSN");
-  String IMEI_buf = "";
-  if (modem.waitResponse(10000, IMEI_buf) != 1) {
+  char imei[32];
+  char csq[32];
+  AtQuery queries[] = {
+    {"+CGSN", "", imei, sizeof(imei), false, false},
+    {"+CSQ", "+CSQ:", csq, sizeof(csq), false, false},
+  };
+  atSendBatch(queries, 2, 10000);
+  if (!queries[0].answered) {
     ESP_LOGI(TAG, "Failed to get IMEI");
     return;
   }
-  IMEI = IMEI_buf.substring(2, 17); // parse AT command response
-  ESP_LOGI(TAG, "IMEI: %s", IMEI.c_str());
+  IMEI = String(imei).substring(0, 15);
+  ESP_LOGI(TAG, "IMEI: %s, %s", IMEI.c_str(), queries[1].answered ? csq : "no signal report");
 }
 
 // ensure time is set
 int syncTime() {
   ESP_LOGI(TAG, "Syncing Time...");
 
-  modem.sendAT("+CTZU=1");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to enable automatic time update");
-  }
-
-  modem.sendAT("+CNTP=\"pool.ntp.org\",8");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to set NTP server");
-    return -1;
-  }
-  modem.sendAT("+CNTP");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to sync time");
+  // one line for all three, the settings are skipped once the modem has them
+  AtQuery queries[] = {
+    {"+CTZU=1", NULL, NULL, 0, true, false},
+    {"+CNTP=\"pool.ntp.org\",8", NULL, NULL, 0, true, false},
+    {"+CNTP", NULL, NULL, 0, false, false},
+  };
+  if (atSendBatch(queries, 3, 10000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to sync time (time zone update %s, NTP server %s)", queries[0].answered ? "on" : "failed",
+             queries[1].answered ? "set" : "failed");
     return -1;
   }
 
@@ -643,77 +1031,187 @@ int syncTime() {
   setenv("TZ", "UTC-2", 1);
   tzset();
 
-  String response = "";
-  modem.sendAT("+CCLK?");
-  if (modem.waitResponse(10000, response) != 1) {
+  if (!syncClock()) {
+    return -1;
+  }
+  int year;
+  unsigned month, day;
+  wallClockCivilFromDays(wallClock.localSeconds(esp_timer_get_time()) / 86400, &year, &month, &day);
+  return year % 100;
+}
+
+// read +CCLK once into the local wall clock and the system time, everything
+// else formats from there without asking the modem
+bool syncClock() {
+  char response[64];
+  int64_t utcSeconds;
+  int zone;
+  if (atSendWait("+CCLK?", "+CCLK:", 10000, response, sizeof(response)) != AT_RESPONSE_MATCH ||
+      !wallClockParseCclk(response, &utcSeconds, &zone)) {
     ESP_LOGI(TAG, "Failed to get time");
+    return false;
+  }
+  // the reply is read some time within the second it reports, call it the middle
+  int64_t monoUs = esp_timer_get_time();
+  wallClock.setZone(zone);
+  wallClock.sync(utcSeconds * 1000000LL + 500000, monoUs, WALL_CLOCK_MODEM);
+
+  struct timeval now = {(time_t)wallClock.utcSeconds(monoUs), 0};
+  settimeofday(&now, NULL);
+
+  char dateTime[20];
+  wallClock.format(dateTime, sizeof(dateTime), monoUs, WALL_CLOCK_ISO);
+  const WallClockStats &stats = wallClock.stats();
+  ESP_LOGI(TAG, "Time synced: %s (UTC%+d:%02d), off by %lld ms, drift %ld ppb", dateTime, zone / 4,
+           abs(zone % 4) * 15, stats.lastErrorUs / 1000, (long)stats.driftPpb);
+  return true;
+}
+
+// read signal quality and the serving cell for the link controller
+void sampleSignal() {
+  char csq[32];
+  char cpsi[AT_LINE_SIZE];
+  char cbc[32];
+  AtQuery queries[] = {
+    {"+CSQ", "+CSQ:", csq, sizeof(csq), false, false},
+    {"+CPSI?", "+CPSI:", cpsi, sizeof(cpsi), false, false},
+    {"+CBC", "+CBC:", cbc, sizeof(cbc), false, false},
+  };
+  atSendBatch(queries, 3, 5000);
+
+  // "+CBC: 3.950V", the supply the modem sees, there is no battery divider
+  if (queries[2].answered) {
+    const char *volts = strchr(cbc, ':');
+    if (volts) gaugeSet(GAUGE_BATTERY, (int32_t)lroundf(strtof(volts + 1, NULL) * 1000));
   }
 
-  String time = response.substring(response.indexOf('"') + 1, response.lastIndexOf('"'));
-  int year = time.substring(0,2).toInt();
-  ESP_LOGI(TAG, "Time synced. Current datetime in yy/MM/dd,hh:mm:ss+zz is %s", time.c_str());
-  return year;
+  LinkSignal signal;
+  memset(&signal, 0, sizeof(signal));
+  signal.csq = queries[0].answered ? linkParseCsq(csq) : LINK_CSQ_UNKNOWN;
+  if (!queries[1].answered || !linkParseCpsi(cpsi, &signal)) {
+    strlcpy(signal.mode, "unknown", sizeof(signal.mode));
+  }
+  ESP_LOGI(TAG, "Signal: CSQ %d, %s, RSRP %d dBm, SNR %d dB", signal.csq, signal.mode, signal.rsrpDbm, signal.snrDb);
+  if (signal.csq != LINK_CSQ_UNKNOWN) gaugeSet(GAUGE_CSQ, signal.csq);
+  if (linkControl.signal(signal)) {
+    captureLevel = linkControl.level();
+    ESP_LOGI(TAG, "Weaker signal, capture level now %u", linkControl.level());
+  }
+}
+
+// route URCs that arrive outside of the exchange waiting for them
+void handleModemUrc(const AtEvent &event) {
+  ftpSessionUrc(event);
+  if (event.urc == AT_URC_CGNSSINFO) {
+    gnssReceived(event.line, false);
+  }
 }
 
-// initiale the T-PCIE modem
-void initializeModem() {
+// initiale the T-PCIE modem, false when it doesn't come up or find a
+// network within the attempts in config.h
+bool initializeModem() {
   ESP_LOGI(TAG, "Initializing modem...");
   pinMode(PCIE_PWR_PIN, OUTPUT);
   digitalWrite(PCIE_PWR_PIN, HIGH);
   delay(300);
   digitalWrite(PCIE_PWR_PIN, LOW);
-  delay(3000);
-  SerialAT.begin(115200, SERIAL_8N1, PCIE_RX_PIN, PCIE_TX_PIN);
+  SerialAT.setRxBufferSize(MODEM_RX_BUFFER);
+  SerialAT.begin(MODEM_UART_BAUD, SERIAL_8N1, PCIE_RX_PIN, PCIE_TX_PIN);
+  atBegin(modem.stream);
+  atSetUrcHandler(handleModemUrc);
+  // poll until it boots instead of waiting out the worst case
+  if (!modem.testAT(MODEM_BOOT_TIMEOUT_MS)) {
+    ESP_LOGI(TAG, "Modem not answering after %u ms", MODEM_BOOT_TIMEOUT_MS);
+  }
+  int attempts = 0;
   while(!modem.init()) {
+    if (++attempts >= MODEM_INIT_ATTEMPTS) {
+      ESP_LOGE(TAG, "Failed to restart modem %u times", attempts);
+      return false;
+    }
     ESP_LOGI(TAG, "Failed to restart modem, delaying 3s and retrying");
     delay(3000);
   }
   ESP_LOGI(TAG, "Initialized modem");
 
-  // register network
-  String result;
-  while(true) {
-    Serial.println("Waiting for network...");
-    modem.sendAT("+CREG?");
-    if (modem.waitResponse(5000, result) == 1) {
-      if (result.indexOf("+CREG: 0,1") > 0 || result.indexOf("+CREG: 0,5") > 0) {
-        break;
-      }
+  // register with the network mode that worked last time, automatic if it doesn't any more
+  uint8_t networkMode = preferences.getUChar("netMode", MODEM_NETWORK_MODE);
+  char command[16];
+  snprintf(command, sizeof(command), "+CNMP=%u", networkMode);
+  if (atSendOnce(command, NULL, 10000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "setNetworkMode to %u failed", networkMode);
+  }
+  if (!waitForNetwork(MODEM_REGISTER_TIMEOUT_MS) && networkMode != MODEM_NETWORK_AUTO) {
+    ESP_LOGI(TAG, "No network in mode %u after %u ms, trying automatic", networkMode, MODEM_REGISTER_TIMEOUT_MS);
+    networkMode = MODEM_NETWORK_AUTO;
+    snprintf(command, sizeof(command), "+CNMP=%u", networkMode);
+    atSendOnce(command, NULL, 10000);
+  }
+  attempts = 0;
+  while (!waitForNetwork(MODEM_REGISTER_TIMEOUT_MS)) {
+    if (++attempts >= MODEM_REGISTER_ATTEMPTS) {
+      ESP_LOGE(TAG, "No network after %u ms", attempts * MODEM_REGISTER_TIMEOUT_MS);
+      return false;
     }
-    delay(2000);
+    ESP_LOGI(TAG, "Still waiting for network...");
   }
-
-  // set to GSM mode
-  modem.sendAT("+CNMP=38");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "setNetworkMode to GSM failed");
-    return;
+  if (preferences.getUChar("netMode", MODEM_NETWORK_MODE) != networkMode) {
+    preferences.putUChar("netMode", networkMode);
   }
+  return true;
+}
+
+// poll +CREG? until registered at home or roaming, false after timeoutMs
+bool waitForNetwork(uint32_t timeoutMs) {
+  ESP_LOGI(TAG, "Waiting for network...");
+  char response[32];
+  unsigned long startTime = millis();
+  do {
+    if (atSendWait("+CREG?", "+CREG:", 5000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+        (strstr(response, ",1") != NULL || strstr(response, ",5") != NULL)) {
+      return true;
+    }
+    delay(1000);
+  } while (millis() - startTime < timeoutMs);
+  return false;
 }
 
-// log messages to SD card
-int sdCardLogOutput(const char *format, va_list args) {
-	char buf[128];
-	int ret = vsnprintf(buf, sizeof(buf), format, args);
-  if (log_file) {
-    Serial.println(buf);
-    log_file.print(buf);
-    log_file.flush();
+// pick the modem up where a deep sleep left it, still registered. false
+// when it doesn't answer or lost the network, initializeModem() then
+// starts from scratch
+bool resumeModem() {
+  ESP_LOGI(TAG, "Resuming modem...");
+  SerialAT.setRxBufferSize(MODEM_RX_BUFFER);
+  SerialAT.begin(MODEM_UART_BAUD, SERIAL_8N1, PCIE_RX_PIN, PCIE_TX_PIN);
+  atBegin(modem.stream);
+  atSetUrcHandler(handleModemUrc);
+
+  boolean answered = false;
+  for (int i = 0; i < 10 && !answered; i++) {
+    answered = atSendWait("", NULL, 500) == AT_RESPONSE_MATCH;
   }
-	return ret;
+  char response[32];
+  if (!answered || atSendOnce("+CPSMS=0", NULL, 5000) != AT_RESPONSE_MATCH ||
+      atSendWait("+CREG?", "+CREG:", 5000, response, sizeof(response)) != AT_RESPONSE_MATCH ||
+      (strstr(response, ",1") == NULL && strstr(response, ",5") == NULL)) {
+    ESP_LOGI(TAG, "Modem didn't resume, initializing it again");
+    return false;
+  }
+  ESP_LOGI(TAG, "Resumed modem");
+  return true;
 }
 
 // initialize the SD card
-void initializeSDCard() {
+boolean initializeSDCard() {
   SPI.begin(SD_SCLK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
   if (!SD.begin(SD_CS_PIN)) {
     ESP_LOGE(TAG, "Card Mount Failed");
-    return;
+    return false;
   }
   uint8_t cardType = SD.cardType();
   if (cardType == CARD_NONE) {
     ESP_LOGE(TAG, "No SD card attached");
-    return;
+    return false;
   }
 
   ESP_LOGI(TAG, "Initialized SD Card Type: ");
@@ -727,45 +1225,61 @@ void initializeSDCard() {
     ESP_LOGI(TAG, "UNKNOWN");
   }
 
-  log_file = SD.open(LOG_FILE_NAME, FILE_APPEND);
-  if (!log_file) {
+  if (!sdLogBegin(SD, LOG_FILE_NAME)) {
     ESP_LOGE(TAG, "Failed to open log file");
   } else {
     ESP_LOGI(TAG, "Using SD card callback for logging");
-    esp_log_set_vprintf(sdCardLogOutput);
   }
-}
 
-// check if firmware update is necessary
-bool checkForUpdate() {
-  modem.sendAT("+HTTPINIT");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to initialize HTTP");
-    return false;
+  if (!SD.exists(FULL_FRAME_DIR)) {
+    SD.mkdir(FULL_FRAME_DIR);
   }
 
-  modem.sendAT(String("+HTTPPARA=\"URL\",\"") + OTA_UPDATE_URL + OTA_VERSION_ENDPOINT + "\"");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to set URL");
-    return false;
+  // recover uploads that were still waiting when we last lost power
+  if (!outbox.begin(OUTBOX_DIR, esp_random())) {
+    ESP_LOGE(TAG, "Failed to open outbox on SD card");
+  } else {
+    const OutboxStats &stats = outbox.stats();
+    ESP_LOGI(TAG, "Outbox: %u pending, %u torn records, %u corrupt, %u orphans removed",
+             (unsigned)outbox.pending(), stats.tornRecords, stats.corrupt, stats.orphans);
   }
+  if (!fullFrames.begin(FULL_FRAME_QUEUE_DIR, esp_random())) {
+    ESP_LOGE(TAG, "Failed to open full frame queue on SD card");
+  } else {
+    ESP_LOGI(TAG, "Full frames: %u kept for later", (unsigned)fullFrames.pending());
+  }
+  if (!telemetry.begin(TELEMETRY_FILE, TELEMETRY_SLOTS)) {
+    ESP_LOGE(TAG, "Failed to open telemetry ring on SD card");
+  } else {
+    ESP_LOGI(TAG, "Telemetry: %u records found, %u unsent", telemetry.stats().recovered, telemetry.pending());
+  }
+  return true;
+}
 
-  String response = sendATCommand("+HTTPACTION=0", "+HTTPACTION: 0,200", 20000);
-
-  response = sendATCommand("+HTTPREAD=99", "+HTTPREAD: 0", 20000);
-  response = response.substring(22, 28); // splice out the version number
-
-  modem.sendAT("+HTTPTERM");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to disable HTTP service");
+// check if firmware update is necessary
+bool checkForUpdate() {
+  char url[160];
+  char version[32];
+  snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (OTA_VERSION_ENDPOINT).c_str());
+  unsigned long startUs = micros();
+  bool fetched = otaFetchText(url, version, sizeof(version));
+  metricRecord(METRIC_OTA_CHECK, micros() - startUs);
+  if (!fetched) {
+    ESP_LOGI(TAG, "Version request failed");
   }
 
-  ESP_LOGI(TAG, "Response: %s", response.c_str());
+  // strip surrounding whitespace from the version number
+  char *versionText = version;
+  while (*versionText && isspace((unsigned char)*versionText)) versionText++;
+  size_t versionLength = strlen(versionText);
+  while (versionLength > 0 && isspace((unsigned char)versionText[versionLength - 1])) versionText[--versionLength] = '\0';
+
+  ESP_LOGI(TAG, "Response: %s", versionText);
 
   String currentVersion = preferences.getString("firmwareVersion", "");
-  if (response != currentVersion) {
+  if (versionLength > 0 && currentVersion != versionText) {
     ESP_LOGI(TAG, "New firmware version available");
-    newFirmwareVersion = response;
+    newFirmwareVersion = versionText;
     return true;
   }
 
@@ -773,132 +1287,102 @@ bool checkForUpdate() {
   return false;
 }
 
-// download firmware file from remote server to SD card
-bool downloadFirmware() {
-  const int chunkSize = 1024;
-
-  modem.sendAT("+HTTPINIT");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to initialize HTTP");
-    return false;
+struct FirmwareTarget {
+  bool started;
+  File staging;
+};
+
+// feed the download straight into the inactive app partition
+static bool writeFirmware(const uint8_t *data, size_t length, size_t offset, size_t total, void *context) {
+  FirmwareTarget *target = (FirmwareTarget *)context;
+  if (offset == 0) {
+    if (!Update.begin(total)) {
+      ESP_LOGI(TAG, "Failed to start update: %d", Update.getError());
+      return false;
+    }
+    target->started = true;
   }
-
-  modem.sendAT(String("+HTTPPARA=\"URL\",\"") + OTA_UPDATE_URL + OTA_UPDATE_ENDPOINT + "\"");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to set URL");
+  if (Update.write((uint8_t *)data, length) != length) {
+    ESP_LOGI(TAG, "Failed to write update at %u: %d", (unsigned)offset, Update.getError());
     return false;
   }
+  if (target->staging) {
+    target->staging.write(data, length);
+  }
+  return true;
+}
 
-  // GET request
-  String response = sendATCommand("+HTTPACTION=0", "+HTTPACTION: 0,200", 20000);
-
-  // int fileLength = response.substring(24, response.length() - 1).toInt(); // parse out the length returned after code 200
-  // ESP_LOGI(TAG, "File Length To Download: %d", fileLength);
-
-  File firmware = SD.open(FIRMWARE_FILE_NAME, FILE_WRITE);
-  if (!firmware) {
-    ESP_LOGI(TAG, "Failed to open file for writing");
+// stream the firmware into the update partition, verified against the published digest
+bool downloadFirmware() {
+  char url[160];
+  char digestText[128];
+  uint8_t expected[SHA256_SIZE];
+  uint8_t digest[SHA256_SIZE];
+
+  snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (OTA_DIGEST_ENDPOINT).c_str());
+  if (!otaFetchText(url, digestText, sizeof(digestText)) || !sha256FromHex(digestText, expected)) {
+    ESP_LOGI(TAG, "No firmware digest published, refusing to update");
     return false;
   }
 
-  // read the firmware file in chunks
-  int bytesRead = 0;
-  while (true) {
-    String readCommand = String("+HTTPREAD=") + bytesRead + "," + chunkSize;
-    // String response = sendATCommand(readCommand, "+HTTPREAD: 0", 10000);
-
-    // modified sendATCommand to prevent newline stripping
-    modem.sendAT(readCommand);
-    String response;
-    unsigned long startTime = millis();
-    boolean ok = false;
-    while (!ok && millis() - startTime < 10000) {
-      String s = modem.stream.readStringUntil('\n');
-      ok = s.indexOf("+HTTPREAD: 0") >= 0;
-      response += s + '\n';
-    }
-    response.remove(response.length() - 1, 1);
-
-    if (response.indexOf("ERROR") != -1) {
-      break;
-    }
-
-    if (response.indexOf("+HTTPREAD:") == -1) {
-      ESP_LOGI(TAG, "Failed to read HTTP chunk");
-      firmware.close();
-      return false;
+  // a patch against the running version is a fraction of the full image
+  String currentVersion = preferences.getString("firmwareVersion", "");
+  if (currentVersion.length() > 0) {
+    snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (OTA_DELTA_ENDPOINT(currentVersion)).c_str());
+    if (otaDeltaDownload(url, expected)) {
+      ESP_LOGI(TAG, "Firmware patched and verified");
+      return true;
     }
+    ESP_LOGI(TAG, "Delta update unavailable, downloading the full image");
+  }
 
-    // extract the data part from the response
-    int startIndex = response.indexOf('\r', response.indexOf("+HTTPREAD:")) + 2;
-    int endIndex = response.length() - 15; // parse out the +HTTPREAD: 0 at end
-    String chunk = response.substring(startIndex, endIndex);
-    firmware.print(chunk);
-    firmware.flush();
-    bytesRead += chunk.length();
-
-    // // if returned data is shorter than chunk size then finished
-    // String dataSize = response.substring(response.indexOf("DATA,") + 5);
-    // int dataSizeInt = dataSize.substring(0, dataSize.indexOf('\r')).toInt();
+  FirmwareTarget target;
+  target.started = false;
+#ifdef OTA_STAGE_TO_SD
+  target.staging = SD.open(FIRMWARE_FILE_NAME, FILE_WRITE);
+#endif
 
-    // // Check if we have read all the data
-    // if (dataSizeInt < chunkSize) {
-    //   break;
-    // }
+  snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (OTA_UPDATE_ENDPOINT).c_str());
+  boolean ok = otaDownload(url, writeFirmware, &target, digest);
+  if (target.staging) {
+    target.staging.close();
   }
 
-  // Close the file
-  firmware.flush();
-  firmware.close();
+  if (ok && memcmp(digest, expected, SHA256_SIZE) != 0) {
+    char actual[2 * SHA256_SIZE + 1];
+    sha256ToHex(digest, actual);
+    ESP_LOGI(TAG, "Firmware digest mismatch, got %s", actual);
+    ok = false;
+  }
 
-  modem.sendAT("+HTTPTERM");
-  if (modem.waitResponse(10000) != 1) {
-    ESP_LOGI(TAG, "Failed to disable HTTP service");
+  if (!ok) {
+    if (target.started) {
+      Update.abort();
+    }
+    return false;
   }
 
-  ESP_LOGI(TAG, "Firmware downloaded successfully");
+  if (!Update.end()) {
+    ESP_LOGI(TAG, "Error #: %d", Update.getError());
+    return false;
+  }
+  ESP_LOGI(TAG, "Firmware downloaded and verified");
   return true;
 }
 
-// flash new firmware from SD card
+// boot into the verified firmware
 void applyFirmware() {
-  File firmware = SD.open(FIRMWARE_FILE_NAME, FILE_READ);
-  if (!firmware) {
-    ESP_LOGI(TAG, "Failed to open firmware file");
+  if (!Update.isFinished()) {
+    ESP_LOGI(TAG, "Update not finished? Something went wrong!");
     return;
   }
-
-  size_t firmwareSize = firmware.size();
-
-  if (!Update.begin(firmwareSize)) {
-    ESP_LOGI(TAG, "Failed to start update");
-    return;
-  }
-
-  size_t written = Update.writeStream(firmware);
-  if (written == firmwareSize) {
-    ESP_LOGI(TAG, "Written : %d successfully", written);
-  } else {
-    ESP_LOGI(TAG, "Written only : %d/%d", written, firmwareSize);
-  }
-
-  if (Update.end()) {
-    ESP_LOGI(TAG, "OTA done!");
-    if (Update.isFinished()) {
-      ESP_LOGI(TAG, "Update successfully completed. Rebooting.");
-      preferences.putString("firmwareVersion", newFirmwareVersion);
-      ESP.restart();
-    } else {
-      ESP_LOGI(TAG, "Update not finished? Something went wrong!");
-    }
-  } else {
-    ESP_LOGI(TAG, "Error #: %d", Update.getError());
-  }
-
-  firmware.close();
+  ESP_LOGI(TAG, "Update successfully completed. Rebooting.");
+  preferences.putString("firmwareVersion", newFirmwareVersion);
+  ESP.restart();
 }
 
 void setup() {
+  gpio_hold_dis((gpio_num_t)PWR_ON_PIN); // held through the last deep sleep
   pinMode(PWR_ON_PIN, OUTPUT);
   digitalWrite(PWR_ON_PIN, HIGH);
   delay(100);
@@ -908,8 +1392,6 @@ void setup() {
   esp_log_level_set("*", ESP_LOG_VERBOSE);
   esp_log_level_set(TAG, ESP_LOG_VERBOSE);
 
-  initializeSDCard();
-
   ESP_LOGI(TAG, "Starting camera sensor %s...", DEVICENAME);
 
   // disable WiFi and bluetooth for power consumption
@@ -921,50 +1403,163 @@ void setup() {
 
   // initializeConnectionWifi();
 
-  initializeModem();
+  // a timer wake from our own deep sleep carries the schedule, the clock
+  // and a registered modem over in RTC memory
+  int64_t sleptMs = -1;
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && powerRtc.magic == POWER_STATE_MAGIC) {
+    sleptMs = (rtcTimeUs() - sleepStartRtcUs) / 1000;
+  }
+  warmBoot = power.begin(&powerRtc, powerConfig, sleptMs);
+  if (warmBoot) {
+    wallClock.restore(clockSnapshot, sleptMs * 1000, esp_timer_get_time());
+  }
+  lastIdleEndMs = powerNow();
 
-  getIMEI();
+  // start at the camera's initial setting, SVGA is the largest without PSRAM
+  LinkConfig link = linkConfig;
+  if (!psramFound()) {
+    link.levels = 2;
+  }
+  linkControl.begin(link, link.levels - 1);
+  captureLevel = link.levels - 1;
+  cameraLevel = link.levels - 1;
+
+  // capture starts as soon as the camera is up, the modem registers
+  // alongside. housekeeping (OTA, reports) only needs the modem, so a dead
+  // camera or SD card still leaves a way to update the unit. without the
+  // SD card capture runs with the outbox, full frames and SD log left off
+  boot.add("boot-sd", bootStorage, 0, PIPELINE_UPLOAD_CORE);
+  uint32_t camera = boot.add("boot-camera", bootCamera, 0, PIPELINE_CAPTURE_CORE);
+  boot.add("boot-pipeline", bootPipeline, camera, PIPELINE_CAPTURE_CORE);
+  uint32_t modemStage = boot.add("boot-modem", bootModem, 0, PIPELINE_UPLOAD_CORE);
+  boot.add("boot-housekeeping", bootHousekeeping, modemStage, PIPELINE_UPLOAD_CORE);
+  if (!boot.run(BOOT_STACK_SIZE)) {
+    ESP_LOGE(TAG, "Boot incomplete");
+  }
+  for (size_t i = 0; i < boot.count(); i++) {
+    const BootStage &stage = boot.stage(i);
+    ESP_LOGI(TAG, "Boot %s: %u..%u ms, %s", stage.name, stage.startMs, stage.endMs,
+             stage.skipped ? "skipped" : stage.ok ? "ok" : "failed");
+  }
+  ESP_LOGI(TAG, "%s boot: %u cold boots, %u deep sleep wakes", modemResumed ? "Warm" : "Cold", power.coldBoots(),
+           power.deepWakes());
+
+  int64_t now = powerNow();
+  power.every(POWER_JOB_REPORT, REPORT_INTERVAL_MS, now);
+  power.every(POWER_JOB_OTA, OTA_CHECK_INTERVAL_MS, now);
+  power.every(POWER_JOB_CLOCK, CLOCK_RESYNC_INTERVAL_MS, now);
+  power.every(POWER_JOB_OUTBOX, OUTBOX_RETRY_INTERVAL_MS, now);
+  power.setActive(POWER_JOB_OUTBOX, outbox.pending() > 0);
+  power.every(POWER_JOB_FULL_FRAMES, FULL_FRAME_POLL_INTERVAL_MS, now);
+  power.setActive(POWER_JOB_FULL_FRAMES, fullFrames.pending() > 0);
+  power.every(POWER_JOB_TELEMETRY, TELEMETRY_INTERVAL_MS, now);
+  if (!modemResumed) {
+    // the OTA check and EFS cleanup run from the first housekeeping pass,
+    // off the path to the first frame
+    power.dueIn(POWER_JOB_OTA, now, 0);
+  }
+  if (warmBoot) {
+    // the deep sleep ended early by the warm boot allowance, this is what it really took
+    metricRecord(METRIC_WAKE, (uint32_t)esp_timer_get_time());
+  }
+  bootComplete = true;
+}
 
-  clearEFS();
+bool bootStorage() {
+  storageReady = initializeSDCard();
+  return storageReady;
+}
 
-  // OTA updates
-  if (checkForUpdate()) {
-    for (int retries = 0; retries < 5; ++retries) {
-      if (downloadFirmware()) {
-        applyFirmware();
-      }
-      delay(10000);
-    }
+bool bootCamera() {
+  return initializeCamera();
+}
+
+const PipelineBackend pipelineBackend = {takePhoto, uploadJob, releaseJob, housekeeping, idleBetweenFrames};
+const PipelineConfig pipelineConfig = {
+  PIPELINE_CAPTURE_INTERVAL_MS,
+  PIPELINE_HOUSEKEEPING_MS,
+  PIPELINE_QUEUE_DEPTH,
+  PIPELINE_DROP_POLICY,
+  PIPELINE_BLOCK_TIMEOUT_MS,
+  PIPELINE_CAPTURE_CORE,
+  PIPELINE_UPLOAD_CORE,
+  PIPELINE_STACK_SIZE
+};
+
+bool bootPipeline() {
+  frameRingMutex = portMutexCreate();
+  if (!pipelineStart(pipelineBackend, pipelineConfig)) {
+    ESP_LOGE(TAG, "Failed to start capture pipeline");
+    return false;
   }
+  return true;
+}
 
-  initializeCamera();
+// OTA checks, EFS cleanup, reports and telemetry, whether or not capture runs
+bool bootHousekeeping() {
+  if (!pipelineStartHousekeeping(pipelineBackend, pipelineConfig)) {
+    ESP_LOGE(TAG, "Failed to start housekeeping");
+    return false;
+  }
+  return true;
+}
 
-  int year = syncTime();
-  while (year < 24) {
-    year = syncTime();
+// registered modem, IMEI, GPS and clock. the IMEI never changes, so it is
+// only asked for when the flash doesn't have it yet
+bool bootModem() {
+  modemResumed = warmBoot && resumeModem();
+  if (!modemResumed && !initializeModem()) {
+    modemFailureSleep();
   }
 
-  // sendLogFile();
-  // takePhoto();
-}
+  IMEI = warmBoot ? rtcImei : preferences.getString("imei", "");
+  if (IMEI.length() == 0) {
+    getIMEI();
+    if (IMEI.length() > 0) {
+      preferences.putString("imei", IMEI);
+    }
+  }
+  strlcpy(rtcImei, IMEI.c_str(), sizeof(rtcImei));
 
-void loop() {
-  // unsigned long lastReportTime = preferences.getULong("lastReportTime", 0);
-  // unsigned long currentTime = getCurrentTime();
-  static unsigned long lastReportTime = 0;
-  static unsigned long lastOTACheckTime = 0;
-  unsigned long currentTime = millis();
+  gnssBegin();
+  sampleSignal();
 
-  takePhoto();
+  boolean clockSet = modemResumed;
+  for (int retries = 0; retries < 5 && !clockSet; retries++) {
+    clockSet = syncTime() >= 24;
+  }
+  if (!clockSet) {
+    ESP_LOGI(TAG, "Clock not set, retrying from housekeeping");
+  }
+  if (IMEI.length() == 0) {
+    ESP_LOGE(TAG, "No IMEI from the modem");
+  }
+  // registered is enough for housekeeping, which retries the clock
+  return true;
+}
 
-  if (currentTime - lastReportTime >= 86400000) { // 24 hours = 86400 seconds = 86400000 millis
-    lastReportTime = currentTime;
-    // preferences.putULong("lastReportTime", lastReportTime);
-    // sendLogFile();
+// periodic reports, OTA checks and EFS cleanup, run with the modem lock held
+void housekeeping() {
+  if (!bootComplete) {
+    return;
+  }
+  // deadlines live in RTC memory with the power schedule, so they survive deep sleep
+  if (power.due(POWER_JOB_TELEMETRY, powerNow())) {
+    power.done(POWER_JOB_TELEMETRY, powerNow());
+    recordTelemetry();
+  }
+
+  if (power.due(POWER_JOB_REPORT, powerNow())) {
+    power.done(POWER_JOB_REPORT, powerNow());
+    sendLogFile();
+    sendTelemetry();
+#ifdef LOG_UPLOAD_ENABLED
+    sendLogSegments();
+#endif
   }
 
-  if (currentTime - lastOTACheckTime >= 1800000) {
-    lastOTACheckTime = currentTime;
+  if (power.due(POWER_JOB_OTA, powerNow())) {
+    power.done(POWER_JOB_OTA, powerNow());
     if (checkForUpdate()) {
       for (int retries = 0; retries < 5; ++retries) {
         if (downloadFirmware()) {
@@ -977,10 +1572,147 @@ void loop() {
     clearEFS();
   }
 
+  if (power.due(POWER_JOB_CLOCK, powerNow()) ||
+      wallClock.syncDue(esp_timer_get_time(), (int64_t)CLOCK_RESYNC_INTERVAL_MS * 1000)) {
+    syncClock();
+    power.done(POWER_JOB_CLOCK, powerNow());
+  }
+
+  drainOutbox();
+  if (power.due(POWER_JOB_OUTBOX, powerNow())) {
+    power.done(POWER_JOB_OUTBOX, powerNow());
+  }
+  power.setActive(POWER_JOB_OUTBOX, outbox.pending() > 0);
+
+  if (power.due(POWER_JOB_FULL_FRAMES, powerNow())) {
+    power.done(POWER_JOB_FULL_FRAMES, powerNow());
+    checkFullFrameRequests();
+  }
+  drainFullFrames();
+  power.setActive(POWER_JOB_FULL_FRAMES, fullFrames.pending() > 0);
+  ftpSessionIdle();
+
+  static unsigned long lastSignalMs = 0;
+  if (millis() - lastSignalMs >= LINK_SIGNAL_INTERVAL_MS) {
+    lastSignalMs = millis();
+    sampleSignal();
+  }
+
+  gaugeSet(GAUGE_HEAP_FREE, ESP.getMinFreeHeap());
+  gaugeSet(GAUGE_PSRAM_FREE, ESP.getMinFreePsram());
+  gaugeSet(GAUGE_TEMPERATURE, (int32_t)lroundf(temperatureRead() * 10));
   ESP_LOGI(TAG, "Heap: %d/%d, PSRAM: %d/%d", (ESP.getHeapSize() - ESP.getFreeHeap()), ESP.getHeapSize(), (ESP.getPsramSize() - ESP.getFreePsram()), ESP.getPsramSize());
+  const FramePoolStats &frameStats = frameRing.stats();
+  ESP_LOGI(TAG, "Frame history: %u/%u slots (peak %u), %u KB held (peak %u KB), %u%% slack, %u oversize, %u exhausted",
+           frameStats.slotsInUse, frameStats.slots, frameStats.peakSlotsInUse, frameStats.bytesInUse / 1024,
+           frameStats.peakBytesInUse / 1024, frameRing.fragmentationPercent(), frameStats.oversize, frameStats.exhausted);
+  const LogRingStats &logStats = sdLogRingStats();
+  ESP_LOGI(TAG, "Log: %u messages, %u dropped, %u truncated, ring peak %u bytes, %u batches, slowest write %u ms, %u rotations",
+           logStats.messages, logStats.dropped, logStats.truncated, logStats.highWater, sdLogStats().batches,
+           sdLogStats().maxWriteMs, sdLogStats().rotations);
+  const AtStats &atStatistics = atStats();
+  ESP_LOGI(TAG, "AT: %u lines, %u commands, %u round trips saved (%u skipped, %u batched)", atStatistics.lines,
+           atStatistics.commands, atStatistics.skipped + atStatistics.batched, atStatistics.skipped, atStatistics.batched);
+  const FrameCropStats &cropStats = frameCropStats();
+  ESP_LOGI(TAG, "Crops: %u uploaded, %u failed, %u over budget, %llu KB of frames sent as %llu KB",
+           cropStats.crops, cropStats.failures, cropStats.overBudget, cropStats.bytesIn / 1024, cropStats.bytesOut / 1024);
+  const LinkStats &linkStats = linkControl.stats();
+  ESP_LOGI(TAG, "Link: level %u, %u B/s, last event %u bytes (of %u captured) in %u ms, %u events, %u failed, "
+           "%u steps up, %u down", linkControl.level(), linkControl.throughputBps(), linkStats.lastEventBytes,
+           linkStats.lastFrameBytes, linkStats.lastEventMs, linkStats.events, linkStats.failures, linkStats.stepsUp,
+           linkStats.stepsDown);
+  PowerAccount powerTotals = power.totals();
+  ESP_LOGI(TAG, "Power: active %llu s, light sleep %llu s, deep sleep %llu s, modem PSM %llu s, ~%u mAh used",
+           powerTotals.stateMs[POWER_ACTIVE] / 1000, powerTotals.stateMs[POWER_LIGHT_SLEEP] / 1000,
+           powerTotals.stateMs[POWER_DEEP_SLEEP] / 1000, powerTotals.modemPsmMs / 1000, power.milliampHours());
+  const PipelineStats &stats = pipelineStats();
+  ESP_LOGI(TAG, "Pipeline: %u captured, %u events, %u uploaded, %u failed, %u dropped, %u backpressure, queue peak %u, last upload %u ms",
+           stats.captured, stats.events, stats.uploaded, stats.uploadFailures, stats.dropped, stats.backpressureWaits,
+           stats.queueHighWater, stats.lastUploadMs);
+}
 
-  // delay(10000);
-  esp_sleep_enable_timer_wakeup(10 * uS_TO_S_FACTOR); //light sleep between photos
-  delay(100);
-  esp_light_sleep_start();
+// scheduler time in ms, continues across deep sleeps
+int64_t powerNow() {
+  return power.now(esp_timer_get_time() / 1000);
+}
+
+// RTC timer based system time, the one clock that keeps counting in deep sleep
+int64_t rtcTimeUs() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+// park the modem and everything the next boot needs in RTC memory, then sleep
+void enterDeepSleep(const PowerPlan &plan) {
+  pipelineLockModem();
+  ftpSessionClose();
+  boolean psm = plan.modemPsm && atSendOnce("+CPSMS=1", NULL, 5000) == AT_RESPONSE_MATCH;
+  // keep the peripheral supply up so the modem stays registered
+  gpio_hold_en((gpio_num_t)PWR_ON_PIN);
+  gpio_deep_sleep_hold_en();
+
+  int64_t now = powerNow();
+  power.account(POWER_ACTIVE, false, now - lastIdleEndMs);
+  power.sleeping(now, psm);
+  clockSnapshot = wallClock.snapshot(esp_timer_get_time());
+  sleepStartRtcUs = rtcTimeUs();
+  ESP_LOGI(TAG, "Deep sleep for %u ms%s", plan.sleepMs, psm ? ", modem in PSM" : "");
+  sdLogFlush(1000);
+  esp_deep_sleep((uint64_t)plan.sleepMs * 1000);
+}
+
+// the modem didn't come up. cut the peripheral supply for a deep sleep so
+// it powers up from scratch, the wake then initializes it again
+void modemFailureSleep() {
+  digitalWrite(PWR_ON_PIN, LOW);
+  gpio_hold_en((gpio_num_t)PWR_ON_PIN);
+  gpio_deep_sleep_hold_en();
+
+  int64_t now = powerNow();
+  power.account(POWER_ACTIVE, false, now - lastIdleEndMs);
+  power.sleeping(now, false);
+  clockSnapshot = wallClock.snapshot(esp_timer_get_time());
+  sleepStartRtcUs = rtcTimeUs();
+  ESP_LOGE(TAG, "Modem failed, power cycling it for %lu ms", MODEM_FAIL_SLEEP_MS);
+  sdLogFlush(1000);
+  esp_deep_sleep((uint64_t)MODEM_FAIL_SLEEP_MS * 1000);
+}
+
+// wait for the next capture, sleeping as deep as the schedule allows
+void idleBetweenFrames(uint32_t ms, bool busy) {
+  // light or deep sleep would stall the modem stage still booting on the other core
+  busy = busy || !bootComplete;
+  int64_t now = powerNow();
+  int64_t end = now + ms;
+  power.account(POWER_ACTIVE, false, now - lastIdleEndMs);
+  power.dueIn(POWER_JOB_CAPTURE, now, ms);
+
+  while (now < end) {
+    PowerPlan plan = power.plan(now, busy);
+    uint32_t waitMs = (uint32_t)min((int64_t)plan.sleepMs, end - now);
+    if (plan.state == POWER_DEEP_SLEEP) {
+      enterDeepSleep(plan);
+    } else if (plan.state == POWER_LIGHT_SLEEP) {
+      esp_sleep_enable_timer_wakeup((uint64_t)waitMs * 1000); //light sleep between photos
+      delay(100);
+      int64_t sleepUs = esp_timer_get_time();
+      esp_light_sleep_start();
+      // how late the wakeup came back compared to the timer that was set
+      int64_t lateUs = esp_timer_get_time() - sleepUs - (int64_t)waitMs * 1000;
+      metricRecord(METRIC_WAKE, lateUs > 0 ? (uint32_t)lateUs : 0);
+    } else {
+      delay(waitMs);
+    }
+    int64_t woke = powerNow();
+    power.account(plan.state, false, woke - now);
+    now = woke;
+    busy = pipelineBusy() || !bootComplete;
+  }
+  lastIdleEndMs = now;
+}
+
+void loop() {
+  // capture, upload and housekeeping run in their own pipeline tasks
+  vTaskDelete(NULL);
 }
@@ -0,0 +1,150 @@
+#include "metrics.h"
+#include <limits.h>
+#include <stdio.h>
+
+static const char *const metricNames[METRIC_COUNT] = {"cam", "efs", "ftplogin", "ftpput", "at", "ota", "wake"};
+static const char *const gaugeNames[GAUGE_COUNT] = {"heap", "psram", "csq", "temp", "bat"};
+
+static LatencyHistogram histograms[METRIC_COUNT];
+
+struct Gauge {
+  std::atomic<bool> set;
+  std::atomic<int32_t> last;
+  std::atomic<int32_t> min;
+  std::atomic<int32_t> max;
+};
+static Gauge gauges[GAUGE_COUNT];
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+uint8_t LatencyHistogram::bucket(uint32_t us) {
+  if (us < 4) return (uint8_t)us;
+  int log = 31 - __builtin_clz(us);
+  return (uint8_t)((log - 1) * 4 + ((us >> (log - 2)) & 3));
+}
+
+uint32_t LatencyHistogram::bucketLimit(uint8_t index) {
+  if (index < 4) return index;
+  int log = index / 4 + 1;
+  uint64_t low = (uint64_t)(4 + index % 4) << (log - 2);
+  uint64_t limit = low + ((uint64_t)1 << (log - 2)) - 1;
+  return limit > UINT32_MAX ? UINT32_MAX : (uint32_t)limit;
+}
+
+void LatencyHistogram::record(uint32_t us) {
+  _buckets[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+  _count.fetch_add(1, std::memory_order_relaxed);
+  uint32_t max = _max.load(std::memory_order_relaxed);
+  while (us > max && !_max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::reset() {
+  for (int i = 0; i < METRIC_BUCKETS; i++) _buckets[i].store(0, std::memory_order_relaxed);
+  _count.store(0, std::memory_order_relaxed);
+  _max.store(0, std::memory_order_relaxed);
+}
+
+uint32_t LatencyHistogram::percentile(uint32_t count, uint32_t permille) const {
+  uint64_t rank = ((uint64_t)count * permille + 999) / 1000;
+  uint64_t seen = 0;
+  for (int i = 0; i < METRIC_BUCKETS; i++) {
+    seen += _buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank && seen > 0) return bucketLimit((uint8_t)i);
+  }
+  return _max.load(std::memory_order_relaxed);
+}
+
+MetricSummary LatencyHistogram::summary() const {
+  MetricSummary summary;
+  summary.count = _count.load(std::memory_order_relaxed);
+  summary.maxUs = _max.load(std::memory_order_relaxed);
+  summary.p50Us = percentile(summary.count, 500);
+  summary.p90Us = percentile(summary.count, 900);
+  summary.p99Us = percentile(summary.count, 990);
+  // a bucket's limit can overshoot the largest value actually seen
+  if (summary.p50Us > summary.maxUs) summary.p50Us = summary.maxUs;
+  if (summary.p90Us > summary.maxUs) summary.p90Us = summary.maxUs;
+  if (summary.p99Us > summary.maxUs) summary.p99Us = summary.maxUs;
+  return summary;
+}
+
+void metricRecord(MetricId id, uint32_t us) {
+  histograms[id].record(us);
+}
+
+MetricSummary metricSummary(MetricId id) {
+  return histograms[id].summary();
+}
+
+const char *metricName(MetricId id) {
+  return metricNames[id];
+}
+
+void gaugeSet(GaugeId id, int32_t value) {
+  Gauge &gauge = gauges[id];
+  gauge.last.store(value, std::memory_order_relaxed);
+  if (!gauge.set.exchange(true, std::memory_order_relaxed)) {
+    gauge.min.store(value, std::memory_order_relaxed);
+    gauge.max.store(value, std::memory_order_relaxed);
+    return;
+  }
+  int32_t min = gauge.min.load(std::memory_order_relaxed);
+  while (value < min && !gauge.min.compare_exchange_weak(min, value, std::memory_order_relaxed)) {
+  }
+  int32_t max = gauge.max.load(std::memory_order_relaxed);
+  while (value > max && !gauge.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+GaugeSummary gaugeSummary(GaugeId id) {
+  const Gauge &gauge = gauges[id];
+  GaugeSummary summary;
+  summary.set = gauge.set.load(std::memory_order_relaxed);
+  summary.last = gauge.last.load(std::memory_order_relaxed);
+  summary.min = gauge.min.load(std::memory_order_relaxed);
+  summary.max = gauge.max.load(std::memory_order_relaxed);
+  return summary;
+}
+
+const char *gaugeName(GaugeId id) {
+  return gaugeNames[id];
+}
+
+// append one line, false and nothing written when it doesn't fit
+static bool appendLine(char *out, size_t size, size_t *length, const char *line, int lineLength) {
+  if (lineLength < 0 || *length + lineLength >= size) return false;
+  for (int i = 0; i <= lineLength; i++) out[*length + i] = line[i];
+  *length += lineLength;
+  return true;
+}
+
+size_t metricsFormat(char *out, size_t size) {
+  size_t length = 0;
+  if (size == 0) return 0;
+  out[0] = '\0';
+  char line[80];
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    MetricSummary summary = histograms[i].summary();
+    if (summary.count == 0) continue;
+    int lineLength = snprintf(line, sizeof(line), "%s %u %u/%u/%u/%u ms\n", metricNames[i], (unsigned)summary.count,
+                              (unsigned)(summary.p50Us / 1000), (unsigned)(summary.p90Us / 1000),
+                              (unsigned)(summary.p99Us / 1000), (unsigned)(summary.maxUs / 1000));
+    if (!appendLine(out, size, &length, line, lineLength)) return length;
+  }
+  for (int i = 0; i < GAUGE_COUNT; i++) {
+    GaugeSummary summary = gaugeSummary((GaugeId)i);
+    if (!summary.set) continue;
+    int lineLength = snprintf(line, sizeof(line), "%s %ld %ld..%ld\n", gaugeNames[i], (long)summary.last,
+                              (long)summary.min, (long)summary.max);
+    if (!appendLine(out, size, &length, line, lineLength)) return length;
+  }
+  return length;
+}
+
+void metricsReset() {
+  for (int i = 0; i < METRIC_COUNT; i++) histograms[i].reset();
+  for (int i = 0; i < GAUGE_COUNT; i++) gauges[i].set.store(false, std::memory_order_relaxed);
+}
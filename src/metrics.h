@@ -0,0 +1,87 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// fixed memory latency histograms and gauges for the hot paths. buckets are
+// log scale with four steps per power of two (under 19% error), counters
+// are relaxed atomics so any task can record without a lock, and a record
+// is a count leading zeros and three atomic ops. readers see counts that
+// may be a record or two apart, which a summary can live with. no Arduino
+// dependencies, callers pass durations in, so recording cost can be
+// measured on the host
+
+#define METRIC_BUCKETS 124 // 0 us up to 2^32 us
+
+enum MetricId {
+  METRIC_CAMERA_GRAB,
+  METRIC_EFS_TRANSFER,
+  METRIC_FTP_LOGIN,
+  METRIC_FTP_PUT,
+  METRIC_AT_ROUND_TRIP,
+  METRIC_OTA_CHECK,
+  METRIC_WAKE,          // time past a planned wake until running again
+  METRIC_COUNT
+};
+
+enum GaugeId {
+  GAUGE_HEAP_FREE,      // bytes
+  GAUGE_PSRAM_FREE,
+  GAUGE_CSQ,
+  GAUGE_TEMPERATURE,    // tenths of a degree C
+  GAUGE_BATTERY,        // millivolts
+  GAUGE_COUNT
+};
+
+struct MetricSummary {
+  uint32_t count;
+  uint32_t p50Us;       // bucket upper bounds
+  uint32_t p90Us;
+  uint32_t p99Us;
+  uint32_t maxUs;
+};
+
+struct GaugeSummary {
+  bool set;
+  int32_t last;
+  int32_t min;
+  int32_t max;
+};
+
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  void record(uint32_t us);
+  void reset();
+  MetricSummary summary() const;
+
+  // bucket index of a value and the largest value a bucket holds
+  static uint8_t bucket(uint32_t us);
+  static uint32_t bucketLimit(uint8_t index);
+
+private:
+  uint32_t percentile(uint32_t count, uint32_t permille) const;
+
+  std::atomic<uint32_t> _buckets[METRIC_BUCKETS];
+  std::atomic<uint32_t> _count;
+  std::atomic<uint32_t> _max;
+};
+
+void metricRecord(MetricId id, uint32_t us);
+MetricSummary metricSummary(MetricId id);
+const char *metricName(MetricId id);
+
+void gaugeSet(GaugeId id, int32_t value);
+GaugeSummary gaugeSummary(GaugeId id);
+const char *gaugeName(GaugeId id);
+
+// one line per metric that has samples and per gauge that was set, "name
+// count p50/p90/p99/max ms" and "name last min..max". returns the length
+// written, output is cut at a line boundary when out is too small
+size_t metricsFormat(char *out, size_t size);
+void metricsReset();
+
+#endif
@@ -0,0 +1,335 @@
+#include "modem_at.h"
+#include <esp_log.h>
+#include "config.h"
+#include "metrics.h"
+
+AtParser atParser;
+
+static Stream *atModemStream = NULL;
+static AtUrcHandler atUrcHandler = NULL;
+static AtDataHandler atDataHandler = NULL;
+static void *atDataContext = NULL;
+
+struct AtState {
+  char key[16];
+  char command[AT_STATE_SIZE];
+};
+
+static AtState atState[AT_STATE_SLOTS];
+static size_t atStateNext = 0;
+static AtStats atStatistics;
+
+// commands that undo each other share the first one's key, everything else
+// is keyed by the name before '='
+static const char *const atServicePairs[][2] = {
+  {"+HTTPINIT", "+HTTPTERM"},
+  {"+CFTPSSTART", "+CFTPSSTOP"},
+};
+
+// false for queries, actions without arguments and commands too long to remember
+static bool atStateKey(const char *command, char *key, size_t size) {
+  for (size_t i = 0; i < sizeof(atServicePairs) / sizeof(atServicePairs[0]); i++) {
+    if (strcmp(command, atServicePairs[i][0]) == 0 || strcmp(command, atServicePairs[i][1]) == 0) {
+      strlcpy(key, atServicePairs[i][0], size);
+      return true;
+    }
+  }
+  const char *equals = strchr(command, '=');
+  if (equals == NULL || equals[1] == '?' || equals[1] == '\0') return false;
+  size_t length = equals - command;
+  if (length >= size || strlen(command) >= AT_STATE_SIZE) return false;
+  memcpy(key, command, length);
+  key[length] = '\0';
+  return true;
+}
+
+static AtState *atFindState(const char *key) {
+  for (size_t i = 0; i < AT_STATE_SLOTS; i++) {
+    if (strcmp(atState[i].key, key) == 0) return &atState[i];
+  }
+  return NULL;
+}
+
+// remember command as what key is set to, or forget key when command is NULL
+static void atRemember(const char *key, const char *command) {
+  AtState *state = atFindState(key);
+  if (command == NULL) {
+    if (state) memset(state, 0, sizeof(*state));
+    return;
+  }
+  if (state == NULL) state = atFindState("");
+  if (state == NULL) {
+    // full, overwrite the slots in turn
+    state = &atState[atStateNext];
+    atStateNext = (atStateNext + 1) % AT_STATE_SLOTS;
+  }
+  strlcpy(state->key, key, sizeof(state->key));
+  strlcpy(state->command, command, sizeof(state->command));
+}
+
+void atBegin(Stream &stream) {
+  atModemStream = &stream;
+  atParser.clear();
+  atForget(NULL);
+}
+
+Stream &atStream() {
+  return *atModemStream;
+}
+
+void atSetUrcHandler(AtUrcHandler handler) {
+  atUrcHandler = handler;
+}
+
+void atSetDataHandler(AtDataHandler handler, void *context) {
+  atDataHandler = handler;
+  atDataContext = context;
+}
+
+void atSend(const char *command) {
+  // drop leftovers of earlier exchanges so they can't satisfy this one
+  AtEvent event;
+  atParser.pump(*atModemStream);
+  while (atParser.next(event)) {
+    if (event.type == AT_EVENT_URC && atUrcHandler) atUrcHandler(event);
+    atParser.pump(*atModemStream);
+  }
+
+  atStatistics.lines++;
+  atStatistics.commands++;
+  atModemStream->write("AT", 2);
+  atModemStream->write(command, strlen(command));
+  atModemStream->write("\r\n", 2);
+  atModemStream->flush();
+}
+
+int atWaitFor(const char *prefix, unsigned long timeout, char *response, size_t responseLength) {
+  size_t prefixLength = prefix ? strlen(prefix) : 0;
+  unsigned long startTime = millis();
+  AtEvent event;
+
+  while (millis() - startTime < timeout) {
+    atParser.pump(*atModemStream);
+    if (!atParser.next(event)) {
+      delay(1);
+      continue;
+    }
+
+    switch (event.type) {
+      case AT_EVENT_OK:
+        if (prefix == NULL) return AT_RESPONSE_MATCH;
+        break;
+      case AT_EVENT_ERROR:
+      case AT_EVENT_CME_ERROR:
+        if (response && responseLength > 0) {
+          strlcpy(response, event.line, responseLength);
+        }
+        return AT_RESPONSE_ERROR;
+      case AT_EVENT_DATA:
+        if (atDataHandler) atDataHandler(event.data, event.length, atDataContext);
+        break;
+      case AT_EVENT_URC:
+      case AT_EVENT_LINE:
+        if (prefix && strncmp(event.line, prefix, prefixLength) == 0) {
+          if (response && responseLength > 0) {
+            strlcpy(response, event.line, responseLength);
+          }
+          return AT_RESPONSE_MATCH;
+        }
+        if (event.type == AT_EVENT_URC && atUrcHandler) atUrcHandler(event);
+        break;
+      default:
+        break;
+    }
+  }
+  return AT_RESPONSE_TIMEOUT;
+}
+
+int atSendWait(const char *command, const char *prefix, unsigned long timeout, char *response, size_t responseLength) {
+  unsigned long startUs = micros();
+  atSend(command);
+  int status = atWaitFor(prefix, timeout, response, responseLength);
+  metricRecord(METRIC_AT_ROUND_TRIP, micros() - startUs);
+  return status;
+}
+
+int atWaitPrompt(unsigned long timeout) {
+  unsigned long startTime = millis();
+  AtEvent event;
+
+  while (millis() - startTime < timeout) {
+    atParser.pump(*atModemStream);
+    if (!atParser.next(event)) {
+      delay(1);
+      continue;
+    }
+    if (event.type == AT_EVENT_PROMPT) return AT_RESPONSE_MATCH;
+    if (event.type == AT_EVENT_ERROR || event.type == AT_EVENT_CME_ERROR) return AT_RESPONSE_ERROR;
+    if (event.type == AT_EVENT_URC && atUrcHandler) atUrcHandler(event);
+  }
+  return AT_RESPONSE_TIMEOUT;
+}
+
+int atPoll() {
+  AtEvent event;
+  atParser.pump(*atModemStream);
+  while (atParser.next(event)) {
+    if (event.type == AT_EVENT_OK) return AT_RESPONSE_MATCH;
+    if (event.type == AT_EVENT_ERROR || event.type == AT_EVENT_CME_ERROR) return AT_RESPONSE_ERROR;
+    if (event.type == AT_EVENT_URC && atUrcHandler) atUrcHandler(event);
+    atParser.pump(*atModemStream);
+  }
+  return AT_RESPONSE_TIMEOUT;
+}
+
+int atSendOnce(const char *command, const char *prefix, unsigned long timeout, char *response, size_t responseLength) {
+  char key[16];
+  if (!atStateKey(command, key, sizeof(key))) {
+    return atSendWait(command, prefix, timeout, response, responseLength);
+  }
+  if (atKnown(command)) {
+    atStatistics.skipped++;
+    if (response && responseLength > 0) response[0] = '\0';
+    return AT_RESPONSE_MATCH;
+  }
+  int result = atSendWait(command, prefix, timeout, response, responseLength);
+  atRemember(key, result == AT_RESPONSE_MATCH ? command : NULL);
+  return result;
+}
+
+void atForget(const char *command) {
+  if (command == NULL) {
+    memset(atState, 0, sizeof(atState));
+    atStateNext = 0;
+    return;
+  }
+  char key[16];
+  if (atStateKey(command, key, sizeof(key))) atRemember(key, NULL);
+}
+
+bool atKnown(const char *command) {
+  char key[16];
+  if (!atStateKey(command, key, sizeof(key))) return false;
+  AtState *state = atFindState(key);
+  return state && strcmp(state->command, command) == 0;
+}
+
+// the unanswered query a reply line belongs to: a matching prefix first,
+// then a query waiting for a bare line. echoed commands are ignored
+static AtQuery *atMatchQuery(AtQuery *queries, size_t count, const AtEvent &event) {
+  if (strncmp(event.line, "AT", 2) == 0) return NULL;
+  for (size_t i = 0; i < count; i++) {
+    const char *prefix = queries[i].prefix;
+    if (!queries[i].answered && prefix && prefix[0] && strncmp(event.line, prefix, strlen(prefix)) == 0) {
+      return &queries[i];
+    }
+  }
+  if (event.type != AT_EVENT_LINE) return NULL;
+  for (size_t i = 0; i < count; i++) {
+    if (!queries[i].answered && queries[i].prefix && queries[i].prefix[0] == '\0') return &queries[i];
+  }
+  return NULL;
+}
+
+static int atWaitBatch(AtQuery *queries, size_t count, unsigned long timeout) {
+  unsigned long startTime = millis();
+  AtEvent event;
+
+  while (millis() - startTime < timeout) {
+    atParser.pump(*atModemStream);
+    if (!atParser.next(event)) {
+      delay(1);
+      continue;
+    }
+
+    switch (event.type) {
+      case AT_EVENT_OK:
+        return AT_RESPONSE_MATCH;
+      case AT_EVENT_ERROR:
+      case AT_EVENT_CME_ERROR:
+        return AT_RESPONSE_ERROR;
+      case AT_EVENT_DATA:
+        if (atDataHandler) atDataHandler(event.data, event.length, atDataContext);
+        break;
+      case AT_EVENT_URC:
+      case AT_EVENT_LINE: {
+        AtQuery *query = atMatchQuery(queries, count, event);
+        if (query) {
+          query->answered = true;
+          if (query->response && query->responseLength > 0) {
+            strlcpy(query->response, event.line, query->responseLength);
+          }
+        } else if (event.type == AT_EVENT_URC && atUrcHandler) {
+          atUrcHandler(event);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return AT_RESPONSE_TIMEOUT;
+}
+
+int atSendBatch(AtQuery *queries, size_t count, unsigned long timeout) {
+  size_t first = 0;
+  while (first < count) {
+    char line[AT_BATCH_LINE];
+    const char *text = line;
+    size_t length = 0;
+    size_t last = first;
+    for (; last < count; last++) {
+      AtQuery &query = queries[last];
+      query.answered = false;
+      if (query.response && query.responseLength > 0) query.response[0] = '\0';
+      if (query.once && atKnown(query.command)) {
+        query.answered = true;
+        atStatistics.skipped++;
+        continue;
+      }
+      size_t commandLength = strlen(query.command);
+      if (length + 1 + commandLength >= sizeof(line)) {
+        if (length > 0) break;
+        // too long to share a line, goes out on its own
+        text = query.command;
+        last++;
+        break;
+      }
+      if (length > 0) {
+        // later commands keep their '+', only the leading "AT" is shared
+        line[length++] = ';';
+        atStatistics.commands++;
+        atStatistics.batched++;
+      }
+      length += strlcpy(line + length, query.command, sizeof(line) - length);
+    }
+    if (text == line && length == 0) {
+      first = last;
+      continue;
+    }
+
+    atSend(text);
+    int result = atWaitBatch(queries + first, last - first, timeout);
+    for (size_t i = first; i < last; i++) {
+      AtQuery &query = queries[i];
+      char key[16];
+      if (result == AT_RESPONSE_MATCH && query.prefix == NULL) query.answered = true;
+      if (query.once && atStateKey(query.command, key, sizeof(key)) && !atKnown(query.command)) {
+        atRemember(key, result == AT_RESPONSE_MATCH ? query.command : NULL);
+      }
+    }
+    if (result != AT_RESPONSE_MATCH) return result;
+    first = last;
+  }
+  return AT_RESPONSE_MATCH;
+}
+
+const AtStats &atStats() {
+  return atStatistics;
+}
+
+int atResultCode(const char *line) {
+  const char *colon = strchr(line, ':');
+  if (colon == NULL) return -1;
+  return atoi(colon + 1);
+}
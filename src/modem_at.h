@@ -0,0 +1,80 @@
+#ifndef __MODEM_AT_H__
+#define __MODEM_AT_H__
+
+#include <Arduino.h>
+#include "at_parser.h"
+
+// return codes, matching TinyGsm waitResponse()
+#define AT_RESPONSE_TIMEOUT 0
+#define AT_RESPONSE_MATCH   1
+#define AT_RESPONSE_ERROR   2
+
+#define AT_STATE_SLOTS 12  // settings and services remembered by atSendOnce
+#define AT_STATE_SIZE 48   // longest setting command that is remembered
+#define AT_BATCH_LINE 160  // longest concatenated command line atSendBatch builds
+
+struct AtStats {
+  uint32_t lines;    // command lines written to the modem
+  uint32_t commands; // commands in them
+  uint32_t skipped;  // commands not sent because the modem was already in that state
+  uint32_t batched;  // commands that shared a line with an earlier one
+};
+
+// one command of a batch. prefix selects the reply line copied into
+// response: "+CSQ:" style, "" for a bare line such as the +CGSN IMEI, or
+// NULL when only OK is expected. once makes it behave like atSendOnce
+struct AtQuery {
+  const char *command;
+  const char *prefix;
+  char *response;
+  size_t responseLength;
+  bool once;
+  bool answered;
+};
+
+typedef void (*AtUrcHandler)(const AtEvent &event);
+typedef void (*AtDataHandler)(const uint8_t *data, size_t length, void *context);
+
+extern AtParser atParser;
+
+void atBegin(Stream &stream);
+Stream &atStream();
+
+// route URCs nobody is waiting for, e.g. +CFTPSNOTIFY
+void atSetUrcHandler(AtUrcHandler handler);
+// route payload windows seen while waiting; payload is discarded without one
+void atSetDataHandler(AtDataHandler handler, void *context);
+
+// send "AT<command>\r\n"
+void atSend(const char *command);
+// wait for a line starting with prefix (or OK when prefix is NULL), a final
+// error or a timeout. the matching line is copied into response if given
+int atWaitFor(const char *prefix, unsigned long timeout, char *response = NULL, size_t responseLength = 0);
+int atSendWait(const char *command, const char *prefix, unsigned long timeout, char *response = NULL, size_t responseLength = 0);
+// wait for the '>' data prompt
+int atWaitPrompt(unsigned long timeout);
+// drain buffered events without blocking, reporting a final OK or error
+int atPoll();
+
+// send a setting ("+FSCD=E:", "+CGPS=1") or service command ("+HTTPINIT",
+// "+HTTPTERM") only if the modem isn't known to be in that state already.
+// the state is learned from replies and forgotten on errors and atBegin()
+int atSendOnce(const char *command, const char *prefix, unsigned long timeout, char *response = NULL, size_t responseLength = 0);
+// forget the state command set, e.g. when a service was lost behind our back.
+// NULL forgets everything
+void atForget(const char *command);
+// true when command is known to be in effect
+bool atKnown(const char *command);
+
+// send independent commands concatenated as "AT<a>;<b>;..." lines, skipping
+// settings already in effect. the modem stops a line at its first failing
+// command, so the result is that of the first line that didn't end in OK
+int atSendBatch(AtQuery *queries, size_t count, unsigned long timeout);
+
+// round trips saved are stats().skipped + stats().batched
+const AtStats &atStats();
+
+// integer result after the ':' of a URC line, -1 if there is none
+int atResultCode(const char *line);
+
+#endif
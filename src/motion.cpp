@@ -0,0 +1,155 @@
+#include "motion.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MOTION_BLOCK 8
+
+uint32_t motionSad(const uint8_t *__restrict a, const uint8_t *__restrict b, size_t length) {
+  // plain loop over independent lanes; gcc turns this into psadbw/uabd on
+  // hosts and an unrolled loop on xtensa
+  uint32_t sum = 0;
+  for (size_t i = 0; i < length; i++) {
+    int d = (int)a[i] - (int)b[i];
+    sum += d < 0 ? -d : d;
+  }
+  return sum;
+}
+
+MotionDetector::MotionDetector()
+  : _width(0), _height(0), _blocksWide(0), _blocksHigh(0),
+    _background(NULL), _background8(NULL), _blockDiff(NULL), _blockMask(NULL),
+    _frames(0), _quietMean(0), _quietDeviation(0) {
+  memset(&_config, 0, sizeof(_config));
+}
+
+MotionDetector::~MotionDetector() {
+  end();
+}
+
+bool MotionDetector::begin(uint16_t width, uint16_t height, const MotionConfig &config) {
+  end();
+  _config = config;
+  _blocksWide = width / MOTION_BLOCK;
+  _blocksHigh = height / MOTION_BLOCK;
+  _width = width;
+  _height = _blocksHigh * MOTION_BLOCK;
+
+  size_t pixels = (size_t)_width * _height;
+  size_t blocks = (size_t)_blocksWide * _blocksHigh;
+  _background = (uint16_t *)malloc(pixels * sizeof(uint16_t));
+  _background8 = (uint8_t *)malloc(pixels);
+  _blockDiff = (uint16_t *)malloc(blocks * sizeof(uint16_t));
+  _blockMask = (uint8_t *)malloc(blocks);
+  if (!_background || !_background8 || !_blockDiff || !_blockMask) {
+    end();
+    return false;
+  }
+  reset();
+  return true;
+}
+
+void MotionDetector::end() {
+  free(_background);
+  free(_background8);
+  free(_blockDiff);
+  free(_blockMask);
+  _background = NULL;
+  _background8 = NULL;
+  _blockDiff = NULL;
+  _blockMask = NULL;
+}
+
+void MotionDetector::reset() {
+  _frames = 0;
+  _quietMean = 0;
+  _quietDeviation = 0;
+  if (_blockMask) memset(_blockMask, 0, (size_t)_blocksWide * _blocksHigh);
+}
+
+void MotionDetector::learn(const uint8_t *luma, uint8_t shift) {
+  size_t pixels = (size_t)_width * _height;
+  for (size_t i = 0; i < pixels; i++) {
+    int32_t target = (int32_t)luma[i] << 8;
+    int32_t current = _background[i];
+    current += (target - current) >> shift;
+    _background[i] = (uint16_t)current;
+    _background8[i] = (uint8_t)(current >> 8);
+  }
+}
+
+MotionResult MotionDetector::update(const uint8_t *luma) {
+  MotionResult result;
+  memset(&result, 0, sizeof(result));
+  size_t blocks = (size_t)_blocksWide * _blocksHigh;
+  if (blocks == 0) return result;
+
+  // seed the background with the first frame, then average in the warmup frames
+  if (_frames < _config.warmupFrames || _frames == 0) {
+    if (_frames == 0) {
+      size_t pixels = (size_t)_width * _height;
+      for (size_t i = 0; i < pixels; i++) {
+        _background[i] = (uint16_t)luma[i] << 8;
+        _background8[i] = luma[i];
+      }
+    } else {
+      learn(luma, 1);
+    }
+    _frames++;
+    return result;
+  }
+  _frames++;
+
+  // per block mean absolute difference against the background
+  uint32_t diffSum = 0;
+  for (uint16_t by = 0; by < _blocksHigh; by++) {
+    for (uint16_t bx = 0; bx < _blocksWide; bx++) {
+      size_t origin = (size_t)by * MOTION_BLOCK * _width + (size_t)bx * MOTION_BLOCK;
+      uint32_t sad = 0;
+      for (int row = 0; row < MOTION_BLOCK; row++) {
+        size_t offset = origin + (size_t)row * _width;
+        sad += motionSad(luma + offset, _background8 + offset, MOTION_BLOCK);
+      }
+      uint16_t diff = (uint16_t)(sad / (MOTION_BLOCK * MOTION_BLOCK));
+      _blockDiff[(size_t)by * _blocksWide + bx] = diff;
+      diffSum += diff;
+    }
+  }
+
+  // threshold adapts to the spread of block diffs seen in quiet frames
+  int32_t deviation = _quietDeviation > 256 ? _quietDeviation : 256;
+  uint32_t threshold = (uint32_t)(_quietMean + _config.thresholdK * deviation) >> 8;
+  if (threshold < _config.noiseFloor) threshold = _config.noiseFloor;
+
+  uint16_t changed = 0;
+  for (size_t i = 0; i < blocks; i++) {
+    _blockMask[i] = _blockDiff[i] > threshold;
+    changed += _blockMask[i];
+  }
+
+  result.changedBlocks = changed;
+  result.threshold = (uint16_t)threshold;
+  result.score = (uint16_t)(changed * 1000 / blocks);
+  result.lightingChange = result.score >= _config.globalPermille;
+  result.triggered = !result.lightingChange && result.score >= _config.triggerPermille;
+
+  if (result.triggered) {
+    // learn slowly so a subject that stops moving still fades into the background
+    learn(luma, _config.learnShift + 2);
+    return result;
+  }
+
+  // quiet or lighting change: track noise statistics and learn at full rate
+  int32_t frameMean = (int32_t)((diffSum << 8) / blocks);
+  uint32_t deviationSum = 0;
+  for (size_t i = 0; i < blocks; i++) {
+    int32_t d = ((int32_t)_blockDiff[i] << 8) - frameMean;
+    deviationSum += d < 0 ? -d : d;
+  }
+  int32_t frameDeviation = (int32_t)(deviationSum / blocks);
+  if (!result.lightingChange) {
+    _quietMean += (frameMean - _quietMean) / 8;
+    _quietDeviation += (frameDeviation - _quietDeviation) / 8;
+  }
+  learn(luma, result.lightingChange ? 1 : _config.learnShift);
+  return result;
+}
@@ -0,0 +1,70 @@
+#ifndef __MOTION_H__
+#define __MOTION_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// frame-difference motion detector over a small 8-bit luma thumbnail. each
+// frame is compared block by block against a running background model; a
+// block counts as changed when its mean absolute difference clears both the
+// noise floor and an adaptive threshold learned from quiet frames. no
+// Arduino dependencies, so it can be replayed over image sequences on the host
+
+struct MotionConfig {
+  uint8_t noiseFloor;       // mean abs diff per pixel treated as sensor noise
+  uint8_t thresholdK;       // changed above quiet mean + K * quiet deviation
+  uint16_t triggerPermille; // changed blocks per thousand that make an event
+  uint16_t globalPermille;  // above this much change it's lighting, not motion
+  uint8_t learnShift;       // background learns 1/2^shift of each quiet frame
+  uint8_t warmupFrames;     // frames used to seed the background
+};
+
+struct MotionResult {
+  bool triggered;
+  uint16_t score;           // changed blocks per thousand
+  uint16_t changedBlocks;
+  uint16_t threshold;       // per block mean abs diff used for this frame
+  bool lightingChange;
+};
+
+// sum of absolute differences of two byte runs
+uint32_t motionSad(const uint8_t *a, const uint8_t *b, size_t length);
+
+class MotionDetector {
+public:
+  MotionDetector();
+  ~MotionDetector();
+
+  // allocates the background model; width and height are cropped to whole blocks
+  bool begin(uint16_t width, uint16_t height, const MotionConfig &config);
+  void end();
+  void reset();
+
+  // score one luma thumbnail (width * height bytes, row major) and learn from it
+  MotionResult update(const uint8_t *luma);
+
+  uint16_t width() const { return _width; }
+  uint16_t height() const { return _height; }
+  uint16_t blocksWide() const { return _blocksWide; }
+  uint16_t blocksHigh() const { return _blocksHigh; }
+  // one byte per block, non-zero where the last frame changed
+  const uint8_t *blockMask() const { return _blockMask; }
+
+private:
+  void learn(const uint8_t *luma, uint8_t shift);
+
+  MotionConfig _config;
+  uint16_t _width;
+  uint16_t _height;
+  uint16_t _blocksWide;
+  uint16_t _blocksHigh;
+  uint16_t *_background;   // 8.8 fixed point so slow drifts still converge
+  uint8_t *_background8;   // integer part, compared against each frame
+  uint16_t *_blockDiff;
+  uint8_t *_blockMask;
+  uint32_t _frames;
+  int32_t _quietMean;      // 8.8 fixed point EMA of block diffs in quiet frames
+  int32_t _quietDeviation;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "ota_delta.h"
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <Update.h>
+#include "esp32s3/rom/miniz.h"
+#include "config.h"
+#include "delta_patch.h"
+
+struct DeltaContext {
+  const esp_partition_t *running;
+  tinfl_decompressor *inflator;
+  uint8_t *window;       // TINFL_LZ_DICT_SIZE circular output window
+  size_t windowOffset;
+  bool inflated;         // zlib stream ended
+  bool updateStarted;
+  DeltaPatcher patcher;
+  Sha256 sha;            // of the rebuilt image
+};
+
+// the patch only fits the image it was made from
+static bool deltaBegin(const DeltaHeader &header, void *context) {
+  DeltaContext *delta = (DeltaContext *)context;
+  if (header.oldSize > delta->running->size) {
+    ESP_LOGI(TAG, "Patch base is larger than the running partition");
+    return false;
+  }
+
+  Sha256 sha;
+  uint8_t buffer[1024];
+  uint8_t digest[SHA256_SIZE];
+  sha256Begin(sha);
+  for (uint32_t offset = 0; offset < header.oldSize; offset += sizeof(buffer)) {
+    size_t count = min((size_t)(header.oldSize - offset), sizeof(buffer));
+    if (esp_partition_read(delta->running, offset, buffer, count) != ESP_OK) {
+      return false;
+    }
+    sha256Update(sha, buffer, count);
+  }
+  sha256Finish(sha, digest);
+  if (memcmp(digest, header.oldDigest, SHA256_SIZE) != 0) {
+    ESP_LOGI(TAG, "Patch was made against a different firmware");
+    return false;
+  }
+
+  if (!Update.begin(header.newSize)) {
+    ESP_LOGI(TAG, "Failed to start update: %d", Update.getError());
+    return false;
+  }
+  delta->updateStarted = true;
+  sha256Begin(delta->sha);
+  return true;
+}
+
+static bool deltaReadOld(uint32_t offset, uint8_t *out, size_t length, void *context) {
+  DeltaContext *delta = (DeltaContext *)context;
+  return esp_partition_read(delta->running, offset, out, length) == ESP_OK;
+}
+
+static bool deltaWrite(const uint8_t *data, size_t length, void *context) {
+  DeltaContext *delta = (DeltaContext *)context;
+  sha256Update(delta->sha, data, length);
+  return Update.write((uint8_t *)data, length) == length;
+}
+
+// inflate each downloaded window and hand the output to the patcher
+static bool inflatePatch(const uint8_t *data, size_t length, size_t offset, size_t total, void *context) {
+  (void)offset;
+  (void)total;
+  DeltaContext *delta = (DeltaContext *)context;
+  while (!delta->inflated) {
+    size_t inBytes = length;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - delta->windowOffset;
+    tinfl_status status = tinfl_decompress(delta->inflator, data, &inBytes, delta->window,
+                                           delta->window + delta->windowOffset, &outBytes,
+                                           TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+    data += inBytes;
+    length -= inBytes;
+    if (outBytes > 0 && !delta->patcher.feed(delta->window + delta->windowOffset, outBytes)) {
+      return false;
+    }
+    delta->windowOffset = (delta->windowOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if (status < TINFL_STATUS_DONE) {
+      ESP_LOGI(TAG, "Corrupt patch stream (%d)", status);
+      return false;
+    }
+    if (status == TINFL_STATUS_DONE) {
+      delta->inflated = true;
+    } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0) {
+      break;
+    }
+  }
+  return true;
+}
+
+boolean otaDeltaDownload(const char *url, const uint8_t expected[SHA256_SIZE], OtaDeltaStats *stats) {
+  OtaDeltaStats localStats;
+  if (stats == NULL) stats = &localStats;
+  memset(stats, 0, sizeof(*stats));
+
+  DeltaContext *delta = new DeltaContext();
+  delta->running = esp_ota_get_running_partition();
+  delta->inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+  delta->window = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+  delta->windowOffset = 0;
+  delta->inflated = false;
+  delta->updateStarted = false;
+  if (!delta->running || !delta->inflator || !delta->window) {
+    ESP_LOGE(TAG, "Failed to allocate delta OTA buffers");
+    free(delta->inflator);
+    free(delta->window);
+    delete delta;
+    return false;
+  }
+  tinfl_init(delta->inflator);
+  DeltaTarget target = {deltaBegin, deltaReadOld, deltaWrite, delta};
+  delta->patcher.begin(target);
+
+  boolean ok = otaDownload(url, inflatePatch, delta, NULL, &stats->download) && delta->inflated &&
+               delta->patcher.finished();
+  stats->imageBytes = delta->patcher.written();
+  stats->copiedBytes = delta->patcher.copiedBytes();
+  stats->literalBytes = delta->patcher.literalBytes();
+
+  if (ok) {
+    uint8_t digest[SHA256_SIZE];
+    sha256Finish(delta->sha, digest);
+    if (memcmp(digest, expected, SHA256_SIZE) != 0 || memcmp(digest, delta->patcher.header().newDigest, SHA256_SIZE) != 0) {
+      ESP_LOGI(TAG, "Patched firmware digest mismatch");
+      ok = false;
+    }
+  }
+
+  if (ok && !Update.end()) {
+    ESP_LOGI(TAG, "Error #: %d", Update.getError());
+    ok = false;
+  } else if (!ok && delta->updateStarted) {
+    Update.abort();
+  }
+
+  ESP_LOGI(TAG, "Delta OTA %s: %u byte patch rebuilt %u bytes (%u copied, %u literal)", ok ? "applied" : "failed",
+           (unsigned)stats->download.bytes, stats->imageBytes, stats->copiedBytes, stats->literalBytes);
+  free(delta->inflator);
+  free(delta->window);
+  delete delta;
+  return ok;
+}
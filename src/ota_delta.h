@@ -0,0 +1,24 @@
+#ifndef __OTA_DELTA_H__
+#define __OTA_DELTA_H__
+
+#include <Arduino.h>
+#include "ota_download.h"
+
+// delta OTA: downloads a zlib compressed SCD1 patch (see delta_patch.h),
+// inflates it with the ROM's tinfl and rebuilds the new image into the
+// update partition from the running one. RAM use is the 32 KB inflate
+// window plus the decompressor state, whatever the image size
+
+struct OtaDeltaStats {
+  OtaDownloadStats download;
+  uint32_t imageBytes;   // size of the rebuilt image
+  uint32_t copiedBytes;  // taken from the running image
+  uint32_t literalBytes; // carried in the patch
+};
+
+// fetch the patch at url and apply it. on success Update has been ended
+// with an image whose SHA-256 is expected; on failure it has been aborted
+// and the caller can fall back to the full image
+boolean otaDeltaDownload(const char *url, const uint8_t expected[SHA256_SIZE], OtaDeltaStats *stats = NULL);
+
+#endif
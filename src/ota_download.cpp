@@ -0,0 +1,144 @@
+#include "ota_download.h"
+#include <esp_log.h>
+#include "config.h"
+#include "modem_at.h"
+
+struct OtaWindow {
+  OtaSink sink;
+  void *context;
+  Sha256 sha;
+  size_t offset;     // body bytes delivered so far
+  size_t total;
+  bool aborted;
+};
+
+// payload slices of the current +HTTPREAD window, in order
+static void collectWindow(const uint8_t *data, size_t length, void *context) {
+  OtaWindow *window = (OtaWindow *)context;
+  if (window->aborted) return;
+  if (length > window->total - window->offset) length = window->total - window->offset;
+  sha256Update(window->sha, data, length);
+  if (!window->sink(data, length, window->offset, window->total, window->context)) {
+    window->aborted = true;
+  }
+  window->offset += length;
+}
+
+// +HTTPINIT, URL and GET; total gets the Content-Length of a 200 response
+static boolean httpGet(const char *url, size_t *total) {
+  char command[160];
+  char response[AT_LINE_SIZE] = "";
+
+  // a session left over from an aborted download makes +HTTPINIT fail
+  atSendOnce("+HTTPTERM", NULL, 5000);
+  if (atSendOnce("+HTTPINIT", NULL, 10000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to initialize HTTP");
+    return false;
+  }
+
+  snprintf(command, sizeof(command), "+HTTPPARA=\"URL\",\"%s\"", url);
+  if (atSendWait(command, NULL, 10000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to set URL");
+    return false;
+  }
+
+  // +HTTPACTION: <method>,<status>,<length>
+  if (atSendWait("+HTTPACTION=0", "+HTTPACTION:", OTA_ACTION_TIMEOUT, response, sizeof(response)) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "GET %s failed: %s", url, response);
+    return false;
+  }
+  int method = 0, status = 0;
+  unsigned long length = 0;
+  if (sscanf(response, "+HTTPACTION: %d,%d,%lu", &method, &status, &length) != 3 || status != 200) {
+    ESP_LOGI(TAG, "GET %s returned %s", url, response);
+    return false;
+  }
+  *total = length;
+  return true;
+}
+
+static void httpEnd() {
+  if (atSendOnce("+HTTPTERM", NULL, 10000) != AT_RESPONSE_MATCH) {
+    ESP_LOGI(TAG, "Failed to disable HTTP service");
+  }
+}
+
+boolean otaDownload(const char *url, OtaSink sink, void *context, uint8_t digest[SHA256_SIZE], OtaDownloadStats *stats) {
+  OtaDownloadStats localStats;
+  if (stats == NULL) stats = &localStats;
+  memset(stats, 0, sizeof(*stats));
+
+  size_t total = 0;
+  if (!httpGet(url, &total)) {
+    httpEnd();
+    return false;
+  }
+  ESP_LOGI(TAG, "Downloading %u bytes from %s", (unsigned)total, url);
+
+  OtaWindow window;
+  window.sink = sink;
+  window.context = context;
+  window.offset = 0;
+  window.total = total;
+  window.aborted = false;
+  sha256Begin(window.sha);
+  stats->total = total;
+
+  unsigned long startTime = millis();
+  int retries = 0;
+  atSetDataHandler(collectWindow, &window);
+  while (window.offset < total && !window.aborted) {
+    char command[48];
+    size_t offset = window.offset;
+    size_t count = min((size_t)OTA_READ_WINDOW, total - offset);
+    snprintf(command, sizeof(command), "+HTTPREAD=%u,%u", (unsigned)offset, (unsigned)count);
+
+    int result = atSendWait(command, "+HTTPREAD: 0", OTA_READ_TIMEOUT);
+    stats->reads++;
+    if (window.offset - offset < count) {
+      // carry on from wherever the window stopped
+      stats->shortReads++;
+    }
+    if (window.offset == offset) {
+      if (++retries > OTA_READ_RETRIES) {
+        ESP_LOGI(TAG, "HTTP read at %u failed (%d)", (unsigned)offset, result);
+        break;
+      }
+    } else {
+      retries = 0;
+    }
+  }
+  atSetDataHandler(NULL, NULL);
+  httpEnd();
+
+  stats->bytes = window.offset;
+  stats->elapsedMs = millis() - startTime;
+  stats->bytesPerSecond = stats->elapsedMs ? (uint32_t)((uint64_t)stats->bytes * 1000 / stats->elapsedMs) : 0;
+  uint8_t localDigest[SHA256_SIZE];
+  sha256Finish(window.sha, digest ? digest : localDigest);
+  ESP_LOGI(TAG, "Downloaded %u/%u bytes in %lu ms (%u B/s), %u reads, %u short", (unsigned)stats->bytes,
+           (unsigned)total, stats->elapsedMs, stats->bytesPerSecond, stats->reads, stats->shortReads);
+  return !window.aborted && window.offset == total;
+}
+
+struct OtaText {
+  char *text;
+  size_t size;
+};
+
+static bool collectText(const uint8_t *data, size_t length, size_t offset, size_t total, void *context) {
+  (void)total;
+  OtaText *text = (OtaText *)context;
+  if (offset < text->size - 1) {
+    size_t count = min(length, text->size - 1 - offset);
+    memcpy(text->text + offset, data, count);
+    text->text[offset + count] = '\0';
+  }
+  return true;
+}
+
+boolean otaFetchText(const char *url, char *text, size_t size) {
+  OtaText target = {text, size};
+  text[0] = '\0';
+  return otaDownload(url, collectText, &target, NULL);
+}
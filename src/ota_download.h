@@ -0,0 +1,33 @@
+#ifndef __OTA_DOWNLOAD_H__
+#define __OTA_DOWNLOAD_H__
+
+#include <Arduino.h>
+#include "sha256.h"
+
+// HTTP GET through the SIM7600 stack. the body is pulled with +HTTPREAD in
+// OTA_READ_WINDOW sized windows; each "+HTTPREAD: DATA,<n>" header opens a
+// binary window in the AT parser, so exactly n raw bytes reach the sink
+// and NULs or stray "OK" text in the payload are harmless. the body is
+// hashed as it streams
+
+// receives the body in order. offset is where data starts, total the
+// Content-Length; return false to abort the download
+typedef bool (*OtaSink)(const uint8_t *data, size_t length, size_t offset, size_t total, void *context);
+
+struct OtaDownloadStats {
+  size_t bytes;
+  size_t total;
+  unsigned long elapsedMs;
+  uint32_t bytesPerSecond;
+  uint32_t reads;
+  uint32_t shortReads;   // windows that came back with fewer bytes than asked
+};
+
+// download url into sink, filling digest (if given) with the SHA-256 of the body
+boolean otaDownload(const char *url, OtaSink sink, void *context, uint8_t digest[SHA256_SIZE],
+                    OtaDownloadStats *stats = NULL);
+
+// download a small text body, NUL terminated and cut to size
+boolean otaFetchText(const char *url, char *text, size_t size);
+
+#endif
@@ -0,0 +1,346 @@
+#include "outbox.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "crc32.h"
+
+#define OUTBOX_RECORD_ADD 1
+#define OUTBOX_RECORD_DONE 2
+#define OUTBOX_RECORD_HEADER 20
+#define OUTBOX_BACKOFF_BASE_MS 30000    // first retry after a failed send
+#define OUTBOX_BACKOFF_MAX_MS 3600000   // retries never wait longer than this
+#define OUTBOX_COMPACT_BYTES 16384      // rewrite the journal once it grows past this
+
+static void putLe32(uint8_t *out, uint32_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  out[2] = (value >> 16) & 0xFF;
+  out[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t getLe32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// flush stdio and the filesystem so the bytes survive a power cut
+static bool syncClose(FILE *file) {
+  bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  return fclose(file) == 0 && ok;
+}
+
+// record: type, kind, name length, 0, sequence, timestamp, length, payload
+// crc, name, then a crc over everything before it. all little endian
+static size_t encodeRecord(uint8_t *out, uint8_t type, const OutboxItem &item) {
+  size_t nameLength = type == OUTBOX_RECORD_ADD ? strlen(item.name) : 0;
+  out[0] = type;
+  out[1] = item.kind;
+  out[2] = (uint8_t)nameLength;
+  out[3] = 0;
+  putLe32(out + 4, item.sequence);
+  putLe32(out + 8, item.timestamp);
+  putLe32(out + 12, item.length);
+  putLe32(out + 16, item.crc);
+  memcpy(out + OUTBOX_RECORD_HEADER, item.name, nameLength);
+  putLe32(out + OUTBOX_RECORD_HEADER + nameLength, crc32Update(0, out, OUTBOX_RECORD_HEADER + nameLength));
+  return OUTBOX_RECORD_HEADER + nameLength + 4;
+}
+
+Outbox::Outbox() : _count(0), _nextSequence(1), _journalSize(0), _random(1), _ready(false) {
+  _dir[0] = '\0';
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool Outbox::begin(const char *dir, uint32_t seed) {
+  _count = 0;
+  _nextSequence = 1;
+  _journalSize = 0;
+  _random = seed ? seed : 1;
+  _ready = false;
+  memset(&_stats, 0, sizeof(_stats));
+  if (strlen(dir) >= sizeof(_dir)) return false;
+  strcpy(_dir, dir);
+
+  struct stat info;
+  if (stat(_dir, &info) != 0 && mkdir(_dir, 0755) != 0) return false;
+
+  _ready = recover();
+  return _ready;
+}
+
+void Outbox::payloadPath(uint32_t sequence, char *path) const {
+  snprintf(path, OUTBOX_PATH_SIZE, "%s/%08lx.dat", _dir, (unsigned long)sequence);
+}
+
+void Outbox::journalPath(char *path, const char *suffix) const {
+  snprintf(path, OUTBOX_PATH_SIZE, "%s/journal%s", _dir, suffix);
+}
+
+bool Outbox::recover() {
+  char path[OUTBOX_PATH_SIZE];
+  char tempPath[OUTBOX_PATH_SIZE];
+  journalPath(path, "");
+  journalPath(tempPath, ".tmp");
+
+  // a compaction cut short either left its temp file behind (journal still
+  // authoritative) or got as far as deleting the old journal
+  struct stat info;
+  if (stat(tempPath, &info) == 0) {
+    if (stat(path, &info) == 0) {
+      remove(tempPath);
+    } else {
+      rename(tempPath, path);
+    }
+  }
+
+  bool rewrite = false;
+  uint32_t lastSequence = 0;
+  FILE *journal = fopen(path, "rb");
+  if (journal) {
+    uint8_t record[OUTBOX_RECORD_HEADER + OUTBOX_NAME_SIZE + 4];
+    while (true) {
+      size_t count = fread(record, 1, OUTBOX_RECORD_HEADER, journal);
+      if (count == 0) break;
+      size_t nameLength = count == OUTBOX_RECORD_HEADER ? record[2] : 0;
+      bool valid = count == OUTBOX_RECORD_HEADER && nameLength < OUTBOX_NAME_SIZE &&
+                   (record[0] == OUTBOX_RECORD_ADD || record[0] == OUTBOX_RECORD_DONE) &&
+                   fread(record + count, 1, nameLength + 4, journal) == nameLength + 4 &&
+                   getLe32(record + count + nameLength) == crc32Update(0, record, count + nameLength);
+      if (!valid) {
+        // everything after a bad record is untrusted, only the tail can tear
+        _stats.tornRecords++;
+        rewrite = true;
+        break;
+      }
+
+      uint32_t sequence = getLe32(record + 4);
+      if (sequence > lastSequence) lastSequence = sequence;
+      if (record[0] == OUTBOX_RECORD_ADD && _count < OUTBOX_MAX_ITEMS) {
+        OutboxItem &item = _items[_count++];
+        memset(&item, 0, sizeof(item));
+        item.sequence = sequence;
+        item.kind = record[1];
+        item.timestamp = getLe32(record + 8);
+        item.length = getLe32(record + 12);
+        item.crc = getLe32(record + 16);
+        memcpy(item.name, record + OUTBOX_RECORD_HEADER, nameLength);
+        item.name[nameLength] = '\0';
+      } else if (record[0] == OUTBOX_RECORD_DONE) {
+        for (size_t i = 0; i < _count; i++) {
+          if (_items[i].sequence == sequence) {
+            memmove(&_items[i], &_items[i + 1], (_count - i - 1) * sizeof(OutboxItem));
+            _count--;
+            break;
+          }
+        }
+      }
+    }
+    _journalSize = ftell(journal);
+    fclose(journal);
+  }
+  _nextSequence = lastSequence + 1;
+
+  // payload written but its size doesn't match means the ADD outlived the file
+  for (size_t i = 0; i < _count;) {
+    char payload[OUTBOX_PATH_SIZE];
+    payloadPath(_items[i].sequence, payload);
+    if (stat(payload, &info) != 0 || (uint32_t)info.st_size != _items[i].length) {
+      _stats.corrupt++;
+      remove(payload);
+      memmove(&_items[i], &_items[i + 1], (_count - i - 1) * sizeof(OutboxItem));
+      _count--;
+      rewrite = true;
+    } else {
+      i++;
+    }
+  }
+  _stats.recovered = _count;
+
+  removeOrphans();
+  return rewrite ? compact() : true;
+}
+
+// payloads whose ADD never made it to the journal
+void Outbox::removeOrphans() {
+  DIR *dir = opendir(_dir);
+  if (!dir) return;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *dot = strrchr(entry->d_name, '.');
+    if (!dot || dot - entry->d_name != 8 || strcmp(dot, ".dat") != 0) continue;
+    uint32_t sequence = (uint32_t)strtoul(entry->d_name, NULL, 16);
+    bool known = false;
+    for (size_t i = 0; i < _count && !known; i++) known = _items[i].sequence == sequence;
+    if (!known) {
+      char path[OUTBOX_PATH_SIZE];
+      payloadPath(sequence, path);
+      remove(path);
+      _stats.orphans++;
+    }
+  }
+  closedir(dir);
+}
+
+bool Outbox::appendRecord(uint8_t type, const OutboxItem &item) {
+  char path[OUTBOX_PATH_SIZE];
+  uint8_t record[OUTBOX_RECORD_HEADER + OUTBOX_NAME_SIZE + 4];
+  size_t length = encodeRecord(record, type, item);
+
+  journalPath(path, "");
+  FILE *journal = fopen(path, "ab");
+  if (!journal) return false;
+  bool ok = fwrite(record, 1, length, journal) == length;
+  ok = syncClose(journal) && ok;
+  if (ok) _journalSize += length;
+  return ok;
+}
+
+// rewrite the journal with only the pending items, via a temp file so a
+// power cut leaves either the old or the new journal whole
+bool Outbox::compact() {
+  char path[OUTBOX_PATH_SIZE];
+  char tempPath[OUTBOX_PATH_SIZE];
+  journalPath(path, "");
+  journalPath(tempPath, ".tmp");
+  _stats.compactions++;
+
+  if (_count == 0) {
+    remove(path);
+    _journalSize = 0;
+    return true;
+  }
+
+  FILE *temp = fopen(tempPath, "wb");
+  if (!temp) return false;
+  long size = 0;
+  bool ok = true;
+  for (size_t i = 0; i < _count && ok; i++) {
+    uint8_t record[OUTBOX_RECORD_HEADER + OUTBOX_NAME_SIZE + 4];
+    size_t length = encodeRecord(record, OUTBOX_RECORD_ADD, _items[i]);
+    ok = fwrite(record, 1, length, temp) == length;
+    size += length;
+  }
+  ok = syncClose(temp) && ok;
+  if (!ok) {
+    remove(tempPath);
+    return false;
+  }
+
+  // FAT can't rename over an existing file
+  remove(path);
+  if (rename(tempPath, path) != 0) return false;
+  _journalSize = size;
+  return true;
+}
+
+bool Outbox::add(OutboxKind kind, const char *name, uint32_t timestamp, const uint8_t *data, size_t length) {
+  if (!_ready) return false;
+  if (_count == OUTBOX_MAX_ITEMS) {
+    _stats.full++;
+    return false;
+  }
+
+  OutboxItem &item = _items[_count];
+  memset(&item, 0, sizeof(item));
+  item.sequence = _nextSequence++;
+  item.kind = (uint8_t)kind;
+  item.timestamp = timestamp;
+  item.length = (uint32_t)length;
+  item.crc = crc32Update(0, data, length);
+  strncpy(item.name, name, OUTBOX_NAME_SIZE - 1);
+
+  // payload first, then the record that makes it visible
+  char path[OUTBOX_PATH_SIZE];
+  payloadPath(item.sequence, path);
+  FILE *payload = fopen(path, "wb");
+  if (!payload) return false;
+  bool ok = fwrite(data, 1, length, payload) == length;
+  ok = syncClose(payload) && ok;
+  if (!ok || !appendRecord(OUTBOX_RECORD_ADD, item)) {
+    remove(path);
+    return false;
+  }
+
+  _count++;
+  _stats.added++;
+  return true;
+}
+
+void Outbox::retire(size_t index) {
+  char path[OUTBOX_PATH_SIZE];
+  payloadPath(_items[index].sequence, path);
+  remove(path);
+  memmove(&_items[index], &_items[index + 1], (_count - index - 1) * sizeof(OutboxItem));
+  _count--;
+}
+
+// xorshift32, only used to spread retries out
+uint32_t Outbox::random() {
+  _random ^= _random << 13;
+  _random ^= _random >> 17;
+  _random ^= _random << 5;
+  return _random;
+}
+
+void Outbox::backOff(OutboxItem &item, uint32_t nowMs) {
+  uint32_t delay = OUTBOX_BACKOFF_BASE_MS;
+  for (uint16_t i = 0; i < item.attempts && delay < OUTBOX_BACKOFF_MAX_MS; i++) delay *= 2;
+  if (delay > OUTBOX_BACKOFF_MAX_MS) delay = OUTBOX_BACKOFF_MAX_MS;
+
+  // anywhere between half and the full delay so a fleet doesn't retry in step
+  item.nextAttemptMs = nowMs + delay / 2 + random() % (delay / 2 + 1);
+  item.attempts++;
+}
+
+size_t Outbox::drain(uint32_t nowMs, OutboxSender send, void *context, uint8_t *buffer, size_t capacity,
+                     OutboxFilter ready) {
+  if (!_ready) return 0;
+
+  size_t sent = 0;
+  for (size_t i = 0; i < _count;) {
+    OutboxItem &item = _items[i];
+    if ((item.attempts > 0 && (int32_t)(nowMs - item.nextAttemptMs) < 0) || (ready && !ready(item, context))) {
+      i++;
+      continue;
+    }
+
+    char path[OUTBOX_PATH_SIZE];
+    payloadPath(item.sequence, path);
+    FILE *payload = fopen(path, "rb");
+    size_t length = 0;
+    if (payload) {
+      if (item.length <= capacity) length = fread(buffer, 1, item.length, payload);
+      fclose(payload);
+    }
+    if (!payload || length != item.length || crc32Update(0, buffer, length) != item.crc) {
+      // can't be sent as it was stored, don't let it block the queue
+      _stats.corrupt++;
+      appendRecord(OUTBOX_RECORD_DONE, item);
+      retire(i);
+      continue;
+    }
+
+    if (!send(item, buffer, length, context)) {
+      _stats.failures++;
+      backOff(item, nowMs);
+      break;
+    }
+
+    // a power cut before the DONE lands means a duplicate upload, not a lost one
+    appendRecord(OUTBOX_RECORD_DONE, item);
+    retire(i);
+    _stats.sent++;
+    sent++;
+  }
+
+  if (_journalSize > OUTBOX_COMPACT_BYTES || (_count == 0 && _journalSize > 0)) {
+    compact();
+  }
+  return sent;
+}
+
+void Outbox::linkUp() {
+  for (size_t i = 0; i < _count; i++) _items[i].attempts = 0;
+}
@@ -0,0 +1,97 @@
+#ifndef __OUTBOX_H__
+#define __OUTBOX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// persistent store-and-forward queue for uploads that failed. each item's
+// payload goes to its own file, then an ADD record is appended to an
+// append-only journal; a DONE record retires it once sent. records carry a
+// CRC so a write torn by power loss is detected and dropped on the next
+// begin(), which rebuilds the queue from the journal. delivery is at least
+// once: a send that completes just before power loss goes out again.
+// plain stdio, so it runs against the SD card's VFS mount and on the host
+
+#define OUTBOX_MAX_ITEMS 64
+#define OUTBOX_NAME_SIZE 64
+#define OUTBOX_PATH_SIZE 96
+
+enum OutboxKind {
+  OUTBOX_IMAGE = 1,
+  OUTBOX_REPORT = 2
+};
+
+struct OutboxItem {
+  uint32_t sequence;
+  uint8_t kind;
+  uint32_t timestamp;      // unix seconds the payload was produced
+  uint32_t length;
+  uint32_t crc;            // payload checksum
+  uint16_t attempts;
+  uint32_t nextAttemptMs;
+  char name[OUTBOX_NAME_SIZE];
+};
+
+struct OutboxStats {
+  uint32_t added;
+  uint32_t sent;
+  uint32_t failures;     // send attempts that failed and were backed off
+  uint32_t recovered;    // items found pending in the journal by begin()
+  uint32_t tornRecords;  // journal tails dropped for a short or bad record
+  uint32_t corrupt;      // payloads missing or failing their checksum
+  uint32_t orphans;      // payload files without a journal record
+  uint32_t full;         // adds refused because the queue was full
+  uint32_t compactions;
+};
+
+// send one queued item, true once the server has it
+typedef bool (*OutboxSender)(const OutboxItem &item, const uint8_t *data, size_t length, void *context);
+// false keeps an item back without counting it as a failed attempt
+typedef bool (*OutboxFilter)(const OutboxItem &item, void *context);
+
+class Outbox {
+public:
+  Outbox();
+
+  // open or create the queue in dir and recover anything left pending.
+  // seed feeds the backoff jitter
+  bool begin(const char *dir, uint32_t seed);
+
+  // persist a payload for later delivery, due straight away
+  bool add(OutboxKind kind, const char *name, uint32_t timestamp, const uint8_t *data, size_t length);
+
+  // send the items that are due, oldest first. stops at the first failure,
+  // which is backed off exponentially with jitter. buffer must hold the
+  // largest payload. with a filter only the items it accepts are sent.
+  // returns the number of items sent
+  size_t drain(uint32_t nowMs, OutboxSender send, void *context, uint8_t *buffer, size_t capacity,
+               OutboxFilter ready = NULL);
+
+  // the link is known to work again, make every item due now
+  void linkUp();
+
+  size_t pending() const { return _count; }
+  const OutboxStats &stats() const { return _stats; }
+
+private:
+  bool recover();
+  bool appendRecord(uint8_t type, const OutboxItem &item);
+  bool compact();
+  void retire(size_t index);
+  void backOff(OutboxItem &item, uint32_t nowMs);
+  void payloadPath(uint32_t sequence, char *path) const;
+  void journalPath(char *path, const char *suffix) const;
+  void removeOrphans();
+  uint32_t random();
+
+  char _dir[OUTBOX_PATH_SIZE - 16];
+  OutboxItem _items[OUTBOX_MAX_ITEMS]; // pending, oldest first
+  size_t _count;
+  uint32_t _nextSequence;
+  long _journalSize;
+  uint32_t _random;
+  bool _ready;
+  OutboxStats _stats;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "pipeline.h"
+#include <atomic>
+#include <string.h>
+
+static PipelineBackend pipelineBackend;
+static PipelineConfig pipelineConfig;
+static PipelineStats stats;
+static PortQueue *uploadQueue = NULL;
+static PortMutex *modemMutex = NULL;
+static std::atomic<bool> uploadActive(false);
+static std::atomic<bool> housekeepingActive(false);
+// set once when the housekeeping task starts, never rewritten under it
+static void (*housekeepingRun)() = NULL;
+static uint32_t housekeepingIntervalMs = 0;
+
+// hand an event to the uploader according to the drop policy
+static void enqueue(PipelineJob *job) {
+  stats.events++;
+  if (portQueueSend(uploadQueue, job, 0)) {
+    stats.queued++;
+  } else {
+    stats.backpressureWaits++;
+    bool sent = false;
+    if (pipelineConfig.dropPolicy == PIPELINE_BLOCK) {
+      sent = portQueueSend(uploadQueue, job, pipelineConfig.blockTimeoutMs);
+    } else if (pipelineConfig.dropPolicy == PIPELINE_DROP_OLDEST) {
+      PipelineJob oldest;
+      if (portQueueReceive(uploadQueue, &oldest, 0)) {
+        pipelineBackend.release(&oldest);
+        stats.dropped++;
+      }
+      sent = portQueueSend(uploadQueue, job, 0);
+    }
+
+    if (sent) {
+      stats.queued++;
+    } else {
+      pipelineBackend.release(job);
+      stats.dropped++;
+    }
+  }
+
+  uint8_t depth = (uint8_t)portQueueCount(uploadQueue);
+  if (depth > stats.queueHighWater) stats.queueHighWater = depth;
+}
+
+static void captureTask(void *arg) {
+  (void)arg;
+  while (true) {
+    uint32_t startTime = portMillis();
+    PipelineJob job;
+    memset(&job, 0, sizeof(job));
+    if (pipelineBackend.capture(&job)) {
+      enqueue(&job);
+    }
+    stats.captured++;
+
+    uint32_t elapsed = portMillis() - startTime;
+    uint32_t remaining = elapsed < pipelineConfig.captureIntervalMs ? pipelineConfig.captureIntervalMs - elapsed : 0;
+    pipelineBackend.idle(remaining, pipelineBusy());
+  }
+}
+
+static void uploadTask(void *arg) {
+  (void)arg;
+  PipelineJob job;
+  while (true) {
+    if (!portQueueReceive(uploadQueue, &job, PORT_WAIT_FOREVER)) continue;
+
+    uploadActive = true;
+    uint32_t startTime = portMillis();
+    portMutexLock(modemMutex);
+    bool ok = pipelineBackend.upload(&job);
+    portMutexUnlock(modemMutex);
+    pipelineBackend.release(&job);
+    stats.lastUploadMs = portMillis() - startTime;
+    if (ok) {
+      stats.uploaded++;
+    } else {
+      stats.uploadFailures++;
+    }
+    uploadActive = false;
+  }
+}
+
+static void housekeepingTask(void *arg) {
+  (void)arg;
+  while (true) {
+    housekeepingActive = true;
+    portMutexLock(modemMutex);
+    housekeepingRun();
+    portMutexUnlock(modemMutex);
+    housekeepingActive = false;
+    portDelay(housekeepingIntervalMs);
+  }
+}
+
+bool pipelineStart(const PipelineBackend &backend, const PipelineConfig &config) {
+  pipelineBackend = backend;
+  pipelineConfig = config;
+  memset(&stats, 0, sizeof(stats));
+
+  uploadQueue = portQueueCreate(config.queueDepth, sizeof(PipelineJob));
+  if (uploadQueue == NULL || !pipelineStartHousekeeping(backend, config)) return false;
+
+  // uploads and housekeeping wait on the modem, capture keeps the other core to itself
+  return portTaskCreate(uploadTask, "upload", config.stackSize, NULL, 2, config.uploadCore) &&
+         portTaskCreate(captureTask, "capture", config.stackSize, NULL, 3, config.captureCore);
+}
+
+bool pipelineStartHousekeeping(const PipelineBackend &backend, const PipelineConfig &config) {
+  if (housekeepingRun != NULL) return true;
+  if (modemMutex == NULL) modemMutex = portMutexCreate();
+  if (modemMutex == NULL || backend.housekeeping == NULL) return false;
+  housekeepingRun = backend.housekeeping;
+  housekeepingIntervalMs = config.housekeepingIntervalMs;
+  if (!portTaskCreate(housekeepingTask, "housekeeping", config.stackSize, NULL, 1, config.uploadCore)) {
+    housekeepingRun = NULL;
+    return false;
+  }
+  return true;
+}
+
+const PipelineStats &pipelineStats() {
+  return stats;
+}
+
+bool pipelineBusy() {
+  return uploadActive || housekeepingActive || (uploadQueue && portQueueCount(uploadQueue) > 0);
+}
+
+void pipelineLockModem() {
+  if (modemMutex == NULL) modemMutex = portMutexCreate();
+  portMutexLock(modemMutex);
+}
+
+void pipelineUnlockModem() {
+  portMutexUnlock(modemMutex);
+}
@@ -0,0 +1,82 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_ring.h"
+#include "port.h"
+#include "roi.h"
+
+// capture/upload pipeline. a capture task on one core grabs and scores
+// frames and hands events to an upload task on the other core through a
+// bounded queue; a housekeeping task runs OTA checks, EFS cleanup and
+// reports. upload and housekeeping share the modem under one mutex. all
+// hardware access goes through the backend, so the same pipeline runs on the
+// host with fake camera and modem back-ends
+
+#define PIPELINE_MAX_JOB_FRAMES 4
+
+// what happens when an event arrives and the upload queue is full
+enum PipelineDropPolicy {
+  PIPELINE_DROP_NEWEST, // discard the new event
+  PIPELINE_DROP_OLDEST, // discard the oldest queued event to make room
+  PIPELINE_BLOCK        // stall capture until the uploader catches up
+};
+
+// one event: pre-trigger frames oldest first, trigger frame last. every
+// frame is retained for the job and released after upload or drop
+struct PipelineJob {
+  StoredFrame *frames[PIPELINE_MAX_JOB_FRAMES];
+  uint8_t count;
+  RoiRect region;   // what changed in the trigger frame, empty for the whole frame
+};
+
+struct PipelineBackend {
+  // grab and score one frame; fill job and return true when it's an event
+  bool (*capture)(PipelineJob *job);
+  // upload a job, called with the modem lock held
+  bool (*upload)(PipelineJob *job);
+  // drop the job's frame references
+  void (*release)(PipelineJob *job);
+  // periodic OTA/EFS/report work, called with the modem lock held
+  void (*housekeeping)();
+  // wait out the rest of a capture interval; busy when uploads or
+  // housekeeping are in flight so deep power saving has to wait
+  void (*idle)(uint32_t ms, bool busy);
+};
+
+struct PipelineConfig {
+  uint32_t captureIntervalMs;
+  uint32_t housekeepingIntervalMs;
+  uint8_t queueDepth;
+  PipelineDropPolicy dropPolicy;
+  uint32_t blockTimeoutMs;    // PIPELINE_BLOCK gives up and drops after this
+  int captureCore;
+  int uploadCore;
+  uint32_t stackSize;
+};
+
+struct PipelineStats {
+  uint32_t captured;
+  uint32_t events;
+  uint32_t queued;
+  uint32_t dropped;
+  uint32_t uploaded;
+  uint32_t uploadFailures;
+  uint32_t backpressureWaits; // events that found the queue full
+  uint8_t queueHighWater;
+  uint32_t lastUploadMs;
+};
+
+// capture and upload tasks, and housekeeping unless it is already running
+bool pipelineStart(const PipelineBackend &backend, const PipelineConfig &config);
+// only the housekeeping task, so OTA and reports run without a camera
+bool pipelineStartHousekeeping(const PipelineBackend &backend, const PipelineConfig &config);
+const PipelineStats &pipelineStats();
+bool pipelineBusy();
+
+// serialise other modem users against the upload and housekeeping tasks
+void pipelineLockModem();
+void pipelineUnlockModem();
+
+#endif
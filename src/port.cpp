@@ -0,0 +1,154 @@
+#include "port.h"
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+static TickType_t toTicks(uint32_t ms) {
+  return ms == PORT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(ms);
+}
+
+PortQueue *portQueueCreate(size_t depth, size_t itemSize) {
+  return (PortQueue *)xQueueCreate(depth, itemSize);
+}
+
+bool portQueueSend(PortQueue *queue, const void *item, uint32_t timeoutMs) {
+  return xQueueSend((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdTRUE;
+}
+
+bool portQueueReceive(PortQueue *queue, void *item, uint32_t timeoutMs) {
+  return xQueueReceive((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdTRUE;
+}
+
+size_t portQueueCount(PortQueue *queue) {
+  return uxQueueMessagesWaiting((QueueHandle_t)queue);
+}
+
+PortMutex *portMutexCreate() {
+  return (PortMutex *)xSemaphoreCreateMutex();
+}
+
+void portMutexLock(PortMutex *mutex) {
+  xSemaphoreTake((SemaphoreHandle_t)mutex, portMAX_DELAY);
+}
+
+void portMutexUnlock(PortMutex *mutex) {
+  xSemaphoreGive((SemaphoreHandle_t)mutex);
+}
+
+bool portTaskCreate(void (*task)(void *), const char *name, uint32_t stackSize, void *arg, int priority, int core) {
+  return xTaskCreatePinnedToCore(task, name, stackSize, arg, priority, NULL, core) == pdPASS;
+}
+
+void portTaskExit() {
+  vTaskDelete(NULL);
+}
+
+uint32_t portMillis() {
+  return millis();
+}
+
+void portDelay(uint32_t ms) {
+  vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+#else
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+struct PortQueue {
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t> > items;
+  size_t depth;
+  size_t itemSize;
+};
+
+struct PortMutex {
+  std::mutex lock;
+};
+
+template <typename Predicate>
+static bool waitFor(PortQueue *queue, std::unique_lock<std::mutex> &guard, uint32_t timeoutMs, Predicate ready) {
+  if (timeoutMs == PORT_WAIT_FOREVER) {
+    queue->changed.wait(guard, ready);
+    return true;
+  }
+  return queue->changed.wait_for(guard, std::chrono::milliseconds(timeoutMs), ready);
+}
+
+PortQueue *portQueueCreate(size_t depth, size_t itemSize) {
+  PortQueue *queue = new PortQueue();
+  queue->depth = depth;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+bool portQueueSend(PortQueue *queue, const void *item, uint32_t timeoutMs) {
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!waitFor(queue, guard, timeoutMs, [queue] { return queue->items.size() < queue->depth; })) return false;
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->itemSize));
+  queue->changed.notify_all();
+  return true;
+}
+
+bool portQueueReceive(PortQueue *queue, void *item, uint32_t timeoutMs) {
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!waitFor(queue, guard, timeoutMs, [queue] { return !queue->items.empty(); })) return false;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return true;
+}
+
+size_t portQueueCount(PortQueue *queue) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  return queue->items.size();
+}
+
+PortMutex *portMutexCreate() {
+  return new PortMutex();
+}
+
+void portMutexLock(PortMutex *mutex) {
+  mutex->lock.lock();
+}
+
+void portMutexUnlock(PortMutex *mutex) {
+  mutex->lock.unlock();
+}
+
+bool portTaskCreate(void (*task)(void *), const char *name, uint32_t stackSize, void *arg, int priority, int core) {
+  (void)name;
+  (void)stackSize;
+  (void)priority;
+  (void)core;
+  std::thread(task, arg).detach();
+  return true;
+}
+
+void portTaskExit() {
+  // the thread ends when the task function returns
+}
+
+uint32_t portMillis() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void portDelay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __PORT_H__
+#define __PORT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// thin task/queue/mutex layer so the pipeline runs on FreeRTOS on the device
+// and on std::thread on the host
+
+#define PORT_WAIT_FOREVER 0xFFFFFFFFUL
+
+struct PortQueue;
+struct PortMutex;
+
+PortQueue *portQueueCreate(size_t depth, size_t itemSize);
+bool portQueueSend(PortQueue *queue, const void *item, uint32_t timeoutMs);
+bool portQueueReceive(PortQueue *queue, void *item, uint32_t timeoutMs);
+size_t portQueueCount(PortQueue *queue);
+
+PortMutex *portMutexCreate();
+void portMutexLock(PortMutex *mutex);
+void portMutexUnlock(PortMutex *mutex);
+
+// core is ignored on the host
+bool portTaskCreate(void (*task)(void *), const char *name, uint32_t stackSize, void *arg, int priority, int core);
+// end the calling task; FreeRTOS tasks must not return from their function
+void portTaskExit();
+
+uint32_t portMillis();
+void portDelay(uint32_t ms);
+
+#endif
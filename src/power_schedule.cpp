@@ -0,0 +1,151 @@
+#include "power_schedule.h"
+#include <string.h>
+#include "port.h"
+
+// one lock for every scheduler, the device has just the one
+static PortMutex *scheduleLock = NULL;
+
+// holds scheduleLock for the enclosing scope
+struct ScheduleGuard {
+  ScheduleGuard() { portMutexLock(scheduleLock); }
+  ~ScheduleGuard() { portMutexUnlock(scheduleLock); }
+};
+
+PowerScheduler::PowerScheduler() : _state(&_fallback), _offsetMs(0) {
+  if (scheduleLock == NULL) scheduleLock = portMutexCreate();
+  memset(&_fallback, 0, sizeof(_fallback));
+  memset(&_config, 0, sizeof(_config));
+}
+
+bool PowerScheduler::begin(PowerRtcState *state, const PowerConfig &config, int64_t sleptMs) {
+  ScheduleGuard guard;
+  _state = state;
+  _config = config;
+  bool warm = sleptMs >= 0 && state->magic == POWER_STATE_MAGIC;
+  if (!warm) {
+    uint32_t coldBoots = state->magic == POWER_STATE_MAGIC ? state->coldBoots : 0;
+    memset(state, 0, sizeof(*state));
+    state->magic = POWER_STATE_MAGIC;
+    state->coldBoots = coldBoots + 1;
+    _offsetMs = 0;
+    return false;
+  }
+
+  // the timeline carries on from where the sleep started
+  _offsetMs = state->sleepAtMs + sleptMs;
+  state->deepWakes++;
+  charge(POWER_DEEP_SLEEP, state->sleptModemPsm, (uint64_t)sleptMs);
+  return true;
+}
+
+void PowerScheduler::every(PowerJob job, uint32_t intervalMs, int64_t nowMs) {
+  ScheduleGuard guard;
+  bool scheduled = _state->intervalMs[job] != 0;
+  _state->intervalMs[job] = intervalMs;
+  _state->active[job] = intervalMs != 0;
+  if (!scheduled || _state->dueMs[job] > nowMs + intervalMs) {
+    _state->dueMs[job] = nowMs + intervalMs;
+  }
+}
+
+void PowerScheduler::setActive(PowerJob job, bool active) {
+  ScheduleGuard guard;
+  _state->active[job] = active;
+}
+
+bool PowerScheduler::due(PowerJob job, int64_t nowMs) const {
+  ScheduleGuard guard;
+  return _state->active[job] && nowMs >= _state->dueMs[job];
+}
+
+void PowerScheduler::done(PowerJob job, int64_t nowMs) {
+  ScheduleGuard guard;
+  _state->dueMs[job] = nowMs + _state->intervalMs[job];
+}
+
+void PowerScheduler::dueIn(PowerJob job, int64_t nowMs, uint32_t delayMs) {
+  ScheduleGuard guard;
+  _state->dueMs[job] = nowMs + delayMs;
+  _state->active[job] = true;
+}
+
+int64_t PowerScheduler::nextDue(PowerJob *job) const {
+  ScheduleGuard guard;
+  return earliest(job);
+}
+
+int64_t PowerScheduler::earliest(PowerJob *job) const {
+  int64_t next = INT64_MAX;
+  for (int i = 0; i < POWER_JOB_COUNT; i++) {
+    if (_state->active[i] && _state->dueMs[i] < next) {
+      next = _state->dueMs[i];
+      if (job) *job = (PowerJob)i;
+    }
+  }
+  return next;
+}
+
+PowerPlan PowerScheduler::plan(int64_t nowMs, bool busy) const {
+  ScheduleGuard guard;
+  PowerPlan plan;
+  plan.next = POWER_JOB_CAPTURE;
+  plan.modemPsm = false;
+  int64_t next = earliest(&plan.next);
+  int64_t gap = next == INT64_MAX ? (int64_t)_config.deepSleepMinMs : next - nowMs;
+
+  if (gap <= 0) {
+    // something is overdue, stay up and give it a moment to run
+    plan.state = POWER_ACTIVE;
+    plan.sleepMs = _config.lightSleepMinMs;
+  } else if (busy || gap < _config.lightSleepMinMs) {
+    plan.state = POWER_ACTIVE;
+    plan.sleepMs = (uint32_t)(gap < _config.lightSleepMinMs ? gap : _config.lightSleepMinMs);
+  } else if (gap < _config.deepSleepMinMs || gap <= _config.deepWakeMs) {
+    plan.state = POWER_LIGHT_SLEEP;
+    plan.sleepMs = gap > UINT32_MAX ? UINT32_MAX : (uint32_t)gap;
+  } else {
+    plan.state = POWER_DEEP_SLEEP;
+    int64_t sleepMs = gap - _config.deepWakeMs;
+    plan.sleepMs = sleepMs > UINT32_MAX ? UINT32_MAX : (uint32_t)sleepMs;
+    plan.modemPsm = gap >= _config.modemPsmMinMs;
+  }
+  return plan;
+}
+
+void PowerScheduler::account(PowerState state, bool modemPsm, uint64_t ms) {
+  ScheduleGuard guard;
+  charge(state, modemPsm, ms);
+}
+
+void PowerScheduler::charge(PowerState state, bool modemPsm, uint64_t ms) {
+  PowerAccount &account = _state->account;
+  account.stateMs[state] += ms;
+  if (modemPsm) account.modemPsmMs += ms;
+  account.chargeMaMs += ms * (_config.currentMa[state] + (modemPsm ? _config.modemPsmMa : _config.modemOnMa));
+}
+
+void PowerScheduler::sleeping(int64_t nowMs, bool modemPsm) {
+  ScheduleGuard guard;
+  _state->sleepAtMs = nowMs;
+  _state->sleptModemPsm = modemPsm;
+}
+
+PowerAccount PowerScheduler::totals() const {
+  ScheduleGuard guard;
+  return _state->account;
+}
+
+uint32_t PowerScheduler::milliampHours() const {
+  ScheduleGuard guard;
+  return (uint32_t)(_state->account.chargeMaMs / 3600000);
+}
+
+uint32_t PowerScheduler::coldBoots() const {
+  ScheduleGuard guard;
+  return _state->coldBoots;
+}
+
+uint32_t PowerScheduler::deepWakes() const {
+  ScheduleGuard guard;
+  return _state->deepWakes;
+}
@@ -0,0 +1,118 @@
+#ifndef __POWER_SCHEDULE_H__
+#define __POWER_SCHEDULE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// decides how to spend the time until the next scheduled job (awake, light
+// sleep or deep sleep, and whether the modem can drop into PSM) and keeps
+// time and charge totals per state. everything that has to outlive a deep
+// sleep is in PowerRtcState, a plain struct the device keeps in RTC memory.
+// times are on a millisecond timeline that carries on across deep sleeps.
+// the capture, upload and housekeeping tasks all use it, every call takes
+// a lock so the 64-bit deadlines and totals never tear. no Arduino
+// dependencies so schedules can be simulated on the host
+
+#define POWER_STATE_MAGIC 0x33525750 // "PWR3", bump when PowerRtcState changes
+
+enum PowerJob {
+  POWER_JOB_CAPTURE,
+  POWER_JOB_REPORT,
+  POWER_JOB_OTA,
+  POWER_JOB_CLOCK,
+  POWER_JOB_OUTBOX,
+  POWER_JOB_FULL_FRAMES,
+  POWER_JOB_TELEMETRY,
+  POWER_JOB_COUNT
+};
+
+enum PowerState {
+  POWER_ACTIVE,
+  POWER_LIGHT_SLEEP,
+  POWER_DEEP_SLEEP,
+  POWER_STATE_COUNT
+};
+
+struct PowerConfig {
+  uint32_t lightSleepMinMs; // shorter gaps are waited out awake
+  uint32_t deepSleepMinMs;  // gaps at least this long sleep deep
+  uint32_t modemPsmMinMs;   // deep sleeps at least this long put the modem in PSM
+  uint32_t deepWakeMs;      // warm boot time, a deep sleep ends this much early
+  uint16_t currentMa[POWER_STATE_COUNT];
+  uint16_t modemOnMa;       // registered and idle
+  uint16_t modemPsmMa;
+};
+
+struct PowerPlan {
+  PowerState state;
+  bool modemPsm;
+  uint32_t sleepMs;
+  PowerJob next;            // job that ends the wait
+};
+
+struct PowerAccount {
+  uint64_t stateMs[POWER_STATE_COUNT];
+  uint64_t modemPsmMs;
+  uint64_t chargeMaMs;      // ESP32 and modem together
+};
+
+struct PowerRtcState {
+  uint32_t magic;
+  uint32_t coldBoots;
+  uint32_t deepWakes;
+  int64_t sleepAtMs;        // timeline when the last deep sleep began
+  bool sleptModemPsm;
+  int64_t dueMs[POWER_JOB_COUNT];
+  uint32_t intervalMs[POWER_JOB_COUNT];
+  bool active[POWER_JOB_COUNT];
+  PowerAccount account;
+};
+
+class PowerScheduler {
+public:
+  PowerScheduler();
+
+  // state is the RTC copy. sleptMs is how long the deep sleep that ended
+  // this boot lasted, or -1 for any other boot, which resets state. true
+  // when the schedule was carried over
+  bool begin(PowerRtcState *state, const PowerConfig &config, int64_t sleptMs);
+
+  // timeline time for a monotonic reading taken since this boot
+  int64_t now(int64_t uptimeMs) const { return _offsetMs + uptimeMs; }
+
+  // run job every intervalMs. a deadline carried over a deep sleep is kept
+  void every(PowerJob job, uint32_t intervalMs, int64_t nowMs);
+  // inactive jobs never wake the device, e.g. the outbox while it is empty
+  void setActive(PowerJob job, bool active);
+  bool due(PowerJob job, int64_t nowMs) const;
+  // ran, next due one interval from now
+  void done(PowerJob job, int64_t nowMs);
+  // one-off deadline, also activates the job
+  void dueIn(PowerJob job, int64_t nowMs, uint32_t delayMs);
+  // earliest deadline among active jobs, INT64_MAX when there is none
+  int64_t nextDue(PowerJob *job) const;
+
+  // how to wait for the next job. busy keeps the device awake
+  PowerPlan plan(int64_t nowMs, bool busy) const;
+
+  void account(PowerState state, bool modemPsm, uint64_t ms);
+  // record the deep sleep that is about to start
+  void sleeping(int64_t nowMs, bool modemPsm);
+
+  // a copy, taken under the lock
+  PowerAccount totals() const;
+  uint32_t milliampHours() const;
+  uint32_t coldBoots() const;
+  uint32_t deepWakes() const;
+
+private:
+  int64_t earliest(PowerJob *job) const;
+  void charge(PowerState state, bool modemPsm, uint64_t ms);
+
+  PowerRtcState *_state;
+  PowerRtcState _fallback;
+  PowerConfig _config;
+  int64_t _offsetMs;
+};
+
+#endif
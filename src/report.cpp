@@ -0,0 +1,78 @@
+#include "report.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include "config.h"
+#include "metrics.h"
+
+static size_t name(char *out, size_t size, const char *first, const char *second, const char *suffix) {
+  if (size == 0) return 0;
+  int length = snprintf(out, size, "%s-%s%s", first, second, suffix);
+  if (length < 0 || (size_t)length >= size) {
+    out[0] = '\0';
+    return 0;
+  }
+  return length;
+}
+
+size_t imageName(char *out, size_t size, const char *dateTime, const char *suffix) {
+  return name(out, size, DEVICENAME, dateTime, suffix);
+}
+
+size_t reportName(char *out, size_t size, const char *dateTime, const char *suffix) {
+  return name(out, size, dateTime, DEVICENAME, suffix);
+}
+
+// append one formatted line, false and nothing written when it doesn't fit
+static bool appendLine(char *out, size_t size, size_t *length, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static bool appendLine(char *out, size_t size, size_t *length, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int lineLength = vsnprintf(out + *length, size - *length, format, args);
+  va_end(args);
+  if (lineLength < 0 || *length + lineLength >= size) {
+    out[*length] = '\0';
+    return false;
+  }
+  *length += lineLength;
+  return true;
+}
+
+size_t reportFormat(char *out, size_t size, const ReportInfo &info) {
+  size_t length = 0;
+  if (size == 0) return 0;
+  out[0] = '\0';
+  if (!appendLine(out, size, &length, "IMEI:%s\n", info.imei)) return length;
+  if (!appendLine(out, size, &length, "CSQ:%d\n", info.csq)) return length;
+  if (!appendLine(out, size, &length, "CamID:%s\n", DEVICENAME)) return length;
+  if (!appendLine(out, size, &length, "Temp:%dC\n", info.temperatureC)) return length;
+  if (!appendLine(out, size, &length, "Date:%s\n", info.dateTime)) return length;
+  if (info.batterySet) {
+    int32_t percent = (info.batteryMv - BAT_EMPTY_MV) * 100 / (BAT_FULL_MV - BAT_EMPTY_MV);
+    percent = percent < 0 ? 0 : percent > 100 ? 100 : percent;
+    if (!appendLine(out, size, &length, "Bat:%ld%% %ldmV\n", (long)percent, (long)info.batteryMv)) return length;
+  } else if (!appendLine(out, size, &length, "Bat:unknown\n")) {
+    return length;
+  }
+  if (info.sdReady) {
+    if (!appendLine(out, size, &length, "SD:%lu/%luM\n", (unsigned long)info.sdUsedMb, (unsigned long)info.sdSizeMb)) {
+      return length;
+    }
+  } else if (!appendLine(out, size, &length, "SD:none\n")) {
+    return length;
+  }
+  if (!appendLine(out, size, &length, "Total:0\n")) return length;
+  if (!appendLine(out, size, &length, "Send:%lu\n", (unsigned long)info.sendTimes)) return length;
+  if (!appendLine(out, size, &length, "GPS:%s\n", info.gps)) return length;
+
+  // the header only goes out with at least one metrics line under it
+  size_t header = length;
+  if (!appendLine(out, size, &length, "Metrics:\n")) return length;
+  size_t metrics = metricsFormat(out + length, size - length);
+  if (metrics == 0) {
+    out[header] = '\0';
+    return header;
+  }
+  return length + metrics;
+}
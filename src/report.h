@@ -0,0 +1,39 @@
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// names of the files the camera uploads and the body of the daily report,
+// written into caller buffers. the device fills in ReportInfo from its
+// sensors, the formatting has no Arduino dependencies so it can be tested
+// and benchmarked on the host
+
+struct ReportInfo {
+  const char *imei;
+  int csq;
+  int temperatureC;
+  const char *dateTime;     // WALL_CLOCK_READABLE
+  bool batterySet;          // no reading yet gives "Bat:unknown"
+  int32_t batteryMv;
+  bool sdReady;             // no card gives "SD:none"
+  uint32_t sdSizeMb;
+  uint32_t sdUsedMb;
+  uint32_t sendTimes;
+  const char *gps;
+};
+
+// "<device>-<dateTime><suffix>", images: ".jpg", "-p1.jpg" for the frames
+// before an event. returns the length, 0 and an empty string when out is
+// too small
+size_t imageName(char *out, size_t size, const char *dateTime, const char *suffix);
+// "<dateTime>-<device><suffix>", reports, telemetry and log segments
+size_t reportName(char *out, size_t size, const char *dateTime, const char *suffix);
+
+// the daily report: IMEI, signal, temperature, date, battery, SD card,
+// send count and position, one "Key:value" line each, then the metrics
+// when any were recorded. REPORT_SIZE in config.h holds all of it. returns
+// the length written, output is cut at a line boundary when out is too small
+size_t reportFormat(char *out, size_t size, const ReportInfo &info);
+
+#endif
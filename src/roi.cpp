@@ -0,0 +1,108 @@
+#include "roi.h"
+#include <string.h>
+
+RoiFinder::RoiFinder() {
+  memset(_visited, 0, sizeof(_visited));
+}
+
+// grow [start, end) to at least size, centred, inside [0, limit)
+static void growSpan(int32_t *start, int32_t *end, int32_t size, int32_t limit) {
+  if (size > limit) size = limit;
+  if (*end - *start < size) {
+    int32_t grow = size - (*end - *start);
+    *start -= grow / 2;
+    *end += grow - grow / 2;
+  }
+  if (*start < 0) {
+    *end -= *start;
+    *start = 0;
+  }
+  if (*end > limit) {
+    *start -= *end - limit;
+    *end = limit;
+  }
+  if (*start < 0) *start = 0;
+}
+
+static void alignSpan(int32_t *start, int32_t *end, int32_t limit) {
+  *start = *start / ROI_ALIGN * ROI_ALIGN;
+  *end = (*end + ROI_ALIGN - 1) / ROI_ALIGN * ROI_ALIGN;
+  if (*end > limit) *end = limit;
+}
+
+uint8_t RoiFinder::find(const uint8_t *mask, uint16_t blocksWide, uint16_t blocksHigh, uint16_t blockPixels,
+                        uint16_t frameWidth, uint16_t frameHeight, const RoiConfig &config, RoiRect *rect) {
+  memset(rect, 0, sizeof(*rect));
+  size_t blocks = (size_t)blocksWide * blocksHigh;
+  if (!mask || blocks == 0 || blocks > ROI_MAX_BLOCKS) return 0;
+  memset(_visited, 0, blocks);
+
+  uint8_t regions = 0;
+  int32_t left = INT32_MAX, top = INT32_MAX, right = -1, bottom = -1;
+  for (size_t seed = 0; seed < blocks; seed++) {
+    if (!mask[seed] || _visited[seed]) continue;
+
+    // flood fill one region, each block is pushed once
+    int32_t regionLeft = blocksWide, regionTop = blocksHigh, regionRight = -1, regionBottom = -1;
+    size_t size = 0;
+    size_t depth = 0;
+    _stack[depth++] = (uint16_t)seed;
+    _visited[seed] = 1;
+    while (depth > 0) {
+      uint16_t block = _stack[--depth];
+      int32_t bx = block % blocksWide;
+      int32_t by = block / blocksWide;
+      size++;
+      if (bx < regionLeft) regionLeft = bx;
+      if (bx > regionRight) regionRight = bx;
+      if (by < regionTop) regionTop = by;
+      if (by > regionBottom) regionBottom = by;
+
+      int32_t neighbours[4][2] = {{bx - 1, by}, {bx + 1, by}, {bx, by - 1}, {bx, by + 1}};
+      for (int i = 0; i < 4; i++) {
+        int32_t nx = neighbours[i][0];
+        int32_t ny = neighbours[i][1];
+        if (nx < 0 || ny < 0 || nx >= blocksWide || ny >= blocksHigh) continue;
+        size_t next = (size_t)ny * blocksWide + nx;
+        if (mask[next] && !_visited[next]) {
+          _visited[next] = 1;
+          _stack[depth++] = (uint16_t)next;
+        }
+      }
+    }
+
+    if (size < config.minBlocks) continue;
+    regions++;
+    if (regionLeft < left) left = regionLeft;
+    if (regionTop < top) top = regionTop;
+    if (regionRight > right) right = regionRight;
+    if (regionBottom > bottom) bottom = regionBottom;
+  }
+  if (regions == 0) return 0;
+
+  int32_t x0 = left * blockPixels - config.margin;
+  int32_t y0 = top * blockPixels - config.margin;
+  int32_t x1 = (right + 1) * blockPixels + config.margin;
+  int32_t y1 = (bottom + 1) * blockPixels + config.margin;
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > frameWidth) x1 = frameWidth;
+  if (y1 > frameHeight) y1 = frameHeight;
+  growSpan(&x0, &x1, config.minSize, frameWidth);
+  growSpan(&y0, &y1, config.minSize, frameHeight);
+  alignSpan(&x0, &x1, frameWidth);
+  alignSpan(&y0, &y1, frameHeight);
+
+  rect->x = (uint16_t)x0;
+  rect->y = (uint16_t)y0;
+  rect->width = (uint16_t)(x1 - x0);
+  rect->height = (uint16_t)(y1 - y0);
+  return regions;
+}
+
+uint8_t roiScaleShift(const RoiRect &rect, uint16_t maxSide) {
+  uint16_t side = rect.width > rect.height ? rect.width : rect.height;
+  uint8_t shift = 0;
+  while (shift < 3 && maxSide > 0 && (side >> shift) > maxSide) shift++;
+  return shift;
+}
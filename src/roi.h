@@ -0,0 +1,49 @@
+#ifndef __ROI_H__
+#define __ROI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// region of interest from the motion detector's changed block mask. changed
+// blocks are grouped into 4-connected regions, regions too small to be more
+// than noise are dropped and the rest are merged into one padded crop
+// rectangle in frame pixels. no Arduino dependencies so masks can be
+// replayed on the host
+
+#define ROI_MAX_BLOCKS 1024 // 25x18 blocks for UXGA
+#define ROI_ALIGN 16        // crops start and end on JPEG MCU boundaries
+
+struct RoiRect {
+  uint16_t x;
+  uint16_t y;
+  uint16_t width;   // 0 for none
+  uint16_t height;
+};
+
+struct RoiConfig {
+  uint8_t minBlocks;  // smaller regions are ignored
+  uint16_t margin;    // pixels added on every side
+  uint16_t minSize;   // smallest crop side in pixels
+  uint16_t maxSide;   // crops are downscaled by halves until the longer side fits
+};
+
+class RoiFinder {
+public:
+  RoiFinder();
+
+  // mask is one byte per block, non-zero where it changed; each block covers
+  // blockPixels square frame pixels. returns how many regions went into
+  // rect, 0 and an empty rect when none was large enough
+  uint8_t find(const uint8_t *mask, uint16_t blocksWide, uint16_t blocksHigh, uint16_t blockPixels,
+               uint16_t frameWidth, uint16_t frameHeight, const RoiConfig &config, RoiRect *rect);
+
+private:
+  uint8_t _visited[ROI_MAX_BLOCKS];
+  uint16_t _stack[ROI_MAX_BLOCKS];
+};
+
+// how many halvings bring rect's longer side down to maxSide, at most 3 (1/8
+// scale, the most a baseline JPEG decoder can skip)
+uint8_t roiScaleShift(const RoiRect &rect, uint16_t maxSide);
+
+#endif
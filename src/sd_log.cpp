@@ -0,0 +1,144 @@
+#include "sd_log.h"
+#include <esp_log.h>
+#include "config.h"
+#include "port.h"
+#include <atomic>
+
+static uint32_t ringBuffer[LOG_RING_SIZE / 4];
+static uint8_t staging[LOG_BATCH_SIZE + LOG_RING_MAX_RECORD];
+static LogRing logRing;
+static SdLogStats stats;
+static fs::FS *logFs = NULL;
+static const char *logPath = NULL;
+static File logFile;
+static PortMutex *rotateLock = NULL;  // rotation against segments taken for upload
+static std::atomic<bool> flushRequested(false);
+
+// the esp_log hook; only formats and copies into the ring
+static int sdLogOutput(const char *format, va_list args) {
+  return logRing.vprintf(format, args);
+}
+
+// log.txt -> log.txt.1 -> ... -> log.txt.LOG_ROTATE_KEEP, oldest dropped
+static void rotate() {
+  char from[48];
+  char to[48];
+  portMutexLock(rotateLock);
+  logFile.close();
+  snprintf(to, sizeof(to), "%s.%d", logPath, LOG_ROTATE_KEEP);
+  logFs->remove(to);
+  for (int i = LOG_ROTATE_KEEP - 1; i >= 1; i--) {
+    snprintf(from, sizeof(from), "%s.%d", logPath, i);
+    snprintf(to, sizeof(to), "%s.%d", logPath, i + 1);
+    if (logFs->exists(from)) logFs->rename(from, to);
+  }
+  snprintf(to, sizeof(to), "%s.1", logPath);
+  logFs->rename(logPath, to);
+  logFile = logFs->open(logPath, FILE_APPEND);
+  portMutexUnlock(rotateLock);
+  stats.rotations++;
+}
+
+static void writeBatch(size_t length) {
+  unsigned long startTime = millis();
+  if (!logFile || logFile.write(staging, length) != length) {
+    stats.writeErrors++;
+  }
+  logFile.flush();
+  uint32_t elapsed = millis() - startTime;
+  if (elapsed > stats.maxWriteMs) stats.maxWriteMs = elapsed;
+  stats.batches++;
+
+  if (logFile && logFile.size() >= LOG_MAX_FILE_SIZE) {
+    rotate();
+  }
+}
+
+static void logTask(void *arg) {
+  (void)arg;
+  size_t staged = 0;
+  unsigned long lastWrite = millis();
+  while (true) {
+    size_t count = logRing.read(staging + staged, sizeof(staging) - staged);
+    if (count > 0) {
+      Serial.write(staging + staged, count);
+      staged += count;
+    }
+
+    uint32_t dropped = logRing.takeDropped();
+    if (dropped > 0 && sizeof(staging) - staged >= 48) {
+      int length = snprintf((char *)staging + staged, 48, "[%u log messages dropped]\n", (unsigned)dropped);
+      Serial.write(staging + staged, length);
+      staged += length;
+    }
+
+    // whole sectors go out as soon as they fill, the tail waits for more
+    size_t sectors = staged / LOG_SECTOR_SIZE * LOG_SECTOR_SIZE;
+    if (sectors > LOG_BATCH_SIZE) sectors = LOG_BATCH_SIZE;
+    if (sectors == 0 && staged > 0 && (flushRequested || millis() - lastWrite >= LOG_FLUSH_MS)) {
+      sectors = staged;
+    }
+    if (sectors > 0) {
+      writeBatch(sectors);
+      memmove(staging, staging + sectors, staged - sectors);
+      staged -= sectors;
+      lastWrite = millis();
+    }
+
+    if (count == 0) {
+      if (staged == 0 && logRing.used() == 0) flushRequested = false;
+      portDelay(LOG_DRAIN_INTERVAL_MS);
+    }
+  }
+}
+
+bool sdLogBegin(fs::FS &fs, const char *path) {
+  logFs = &fs;
+  logPath = path;
+  logFile = fs.open(path, FILE_APPEND);
+  if (!logFile) {
+    return false;
+  }
+  logRing.begin(ringBuffer, sizeof(ringBuffer));
+  rotateLock = portMutexCreate();
+  if (!portTaskCreate(logTask, "sdlog", 4096, NULL, 1, PIPELINE_UPLOAD_CORE)) {
+    logFile.close();
+    return false;
+  }
+  esp_log_set_vprintf(sdLogOutput);
+  return true;
+}
+
+bool sdLogTakeSegment(char *out, size_t size) {
+  if (!rotateLock) return false;
+  snprintf(out, size, "%s.up", logPath);
+  if (logFs->exists(out)) return true;
+
+  char from[48];
+  bool taken = false;
+  portMutexLock(rotateLock);
+  for (int i = LOG_ROTATE_KEEP; i >= 1 && !taken; i--) {
+    snprintf(from, sizeof(from), "%s.%d", logPath, i);
+    taken = logFs->exists(from) && logFs->rename(from, out);
+  }
+  portMutexUnlock(rotateLock);
+  return taken;
+}
+
+bool sdLogFlush(uint32_t timeoutMs) {
+  if (!logFile) return false;
+  flushRequested = true;
+  unsigned long startTime = millis();
+  while (flushRequested && millis() - startTime < timeoutMs) {
+    portDelay(LOG_DRAIN_INTERVAL_MS);
+  }
+  return !flushRequested;
+}
+
+const LogRingStats &sdLogRingStats() {
+  return logRing.stats();
+}
+
+const SdLogStats &sdLogStats() {
+  return stats;
+}
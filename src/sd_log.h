@@ -0,0 +1,36 @@
+#ifndef __SD_LOG_H__
+#define __SD_LOG_H__
+
+#include <Arduino.h>
+#include <FS.h>
+#include "log_ring.h"
+
+// esp_log output goes into a LogRing and a low priority task copies it to
+// Serial and to the log file on the SD card in sector sized batches. the
+// file is rotated to path.1 .. path.LOG_ROTATE_KEEP once it reaches
+// LOG_MAX_FILE_SIZE
+
+struct SdLogStats {
+  uint32_t batches;      // file writes
+  uint32_t rotations;
+  uint32_t writeErrors;
+  uint32_t maxWriteMs;   // slowest SD write seen by the task
+};
+
+// open the log file and take over esp_log output, false when the file can't be opened
+bool sdLogBegin(fs::FS &fs, const char *path);
+
+// hand the oldest rotated file over for upload: it moves out of the
+// rotation to path.up and that name goes into out (at least 48 bytes). a
+// segment still there from an upload that failed comes first. the caller
+// deletes it once it is sent. false when there is none
+bool sdLogTakeSegment(char *out, size_t size);
+
+// write out everything logged so far, e.g. before a deep sleep. false
+// when the task didn't get there within timeoutMs
+bool sdLogFlush(uint32_t timeoutMs);
+
+const LogRingStats &sdLogRingStats();
+const SdLogStats &sdLogStats();
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// incremental SHA-256. on the device this wraps mbedtls, which uses the
+// ESP32's SHA accelerator; on the host it falls back to plain C
+
+#define SHA256_SIZE 32
+
+#ifdef ARDUINO
+#include <mbedtls/sha256.h>
+struct Sha256 {
+  mbedtls_sha256_context context;
+};
+#else
+struct Sha256 {
+  uint32_t state[8];
+  uint64_t length;
+  uint8_t block[64];
+  size_t blockLength;
+};
+#endif
+
+void sha256Begin(Sha256 &sha);
+void sha256Update(Sha256 &sha, const void *data, size_t length);
+void sha256Finish(Sha256 &sha, uint8_t digest[SHA256_SIZE]);
+
+// parse 64 hex digits (surrounding whitespace and a trailing file name are
+// ignored, as in sha256sum output), false when there aren't 64 of them
+bool sha256FromHex(const char *text, uint8_t digest[SHA256_SIZE]);
+void sha256ToHex(const uint8_t digest[SHA256_SIZE], char text[2 * SHA256_SIZE + 1]);
+
+#endif
@@ -0,0 +1,95 @@
+#include "tcp_upload.h"
+#include <esp_log.h>
+#include "config.h"
+#include "crc32.h"
+
+static void putLe32(uint8_t *out, uint32_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  out[2] = (value >> 16) & 0xFF;
+  out[3] = (value >> 24) & 0xFF;
+}
+
+// write everything or give up once the socket stops taking data
+static boolean writeAll(Client &client, const uint8_t *data, size_t length) {
+  unsigned long lastProgress = millis();
+  while (length > 0) {
+    size_t count = client.write(data, min(length, (size_t)TCP_UPLOAD_CHUNK));
+    if (count > 0) {
+      data += count;
+      length -= count;
+      lastProgress = millis();
+    } else if (!client.connected() || millis() - lastProgress > TCP_UPLOAD_STALL_TIMEOUT) {
+      return false;
+    } else {
+      delay(1);
+    }
+  }
+  return true;
+}
+
+boolean tcpSendFrame(Client &client, const char *name, uint32_t timestamp, const uint8_t *payload, size_t length) {
+  uint8_t header[4 + 1 + 255 + 4 + 4];
+  size_t nameLength = min(strlen(name), (size_t)255);
+  size_t headerLength = 0;
+
+  memcpy(header, TCP_FRAME_MAGIC, 4);
+  headerLength += 4;
+  header[headerLength++] = (uint8_t)nameLength;
+  memcpy(header + headerLength, name, nameLength);
+  headerLength += nameLength;
+  putLe32(header + headerLength, timestamp);
+  headerLength += 4;
+  putLe32(header + headerLength, (uint32_t)length);
+  headerLength += 4;
+
+  uint32_t crc = crc32Update(0, header, headerLength);
+  unsigned long startTime = millis();
+  if (!writeAll(client, header, headerLength)) {
+    ESP_LOGI(TAG, "Failed to send frame header");
+    return false;
+  }
+
+  // checksum each chunk just before it goes out so the payload is only read once
+  size_t sent = 0;
+  while (sent < length) {
+    size_t count = min(length - sent, (size_t)TCP_UPLOAD_CHUNK);
+    crc = crc32Update(crc, payload + sent, count);
+    if (!writeAll(client, payload + sent, count)) {
+      ESP_LOGI(TAG, "TCP upload stalled after %u of %u bytes", (unsigned)sent, (unsigned)length);
+      return false;
+    }
+    sent += count;
+  }
+
+  uint8_t trailer[4];
+  putLe32(trailer, crc);
+  if (!writeAll(client, trailer, sizeof(trailer))) {
+    ESP_LOGI(TAG, "Failed to send frame trailer");
+    return false;
+  }
+  client.flush();
+
+  // wait for the receiver to confirm it stored the frame
+  char ack[3];
+  size_t ackLength = 0;
+  unsigned long ackStart = millis();
+  while (ackLength < sizeof(ack) && millis() - ackStart < TCP_UPLOAD_ACK_TIMEOUT) {
+    int c = client.read();
+    if (c < 0) {
+      if (!client.connected()) break;
+      delay(10);
+      continue;
+    }
+    ack[ackLength++] = (char)c;
+  }
+
+  if (ackLength < 2 || ack[0] != 'O' || ack[1] != 'K') {
+    ESP_LOGI(TAG, "Receiver did not acknowledge frame");
+    return false;
+  }
+
+  unsigned long elapsed = millis() - startTime;
+  ESP_LOGI(TAG, "Sent %u byte frame over TCP in %lu ms", (unsigned)length, elapsed);
+  return true;
+}
@@ -0,0 +1,23 @@
+#ifndef __TCP_UPLOAD_H__
+#define __TCP_UPLOAD_H__
+
+#include <Arduino.h>
+#include <Client.h>
+
+// direct photo upload over a modem TCP socket, skipping EFS staging and the
+// modem FTP client. frame layout, little endian:
+//   "SCF1"  magic
+//   u8      name length, then the name: the image file name, or just the
+//           device name from older firmware
+//   u32     capture time, unix seconds
+//   u32     payload length, then the JPEG payload
+//   u32     CRC-32 of everything above
+// the receiver answers "OK\n" once the frame is stored, "ER\n" otherwise.
+// tools/photo_receiver.py is a reference receiver
+
+#define TCP_FRAME_MAGIC "SCF1"
+
+// send one frame on an already connected client and wait for the ack
+boolean tcpSendFrame(Client &client, const char *name, uint32_t timestamp, const uint8_t *payload, size_t length);
+
+#endif
@@ -0,0 +1,267 @@
+#include "telemetry.h"
+#include <string.h>
+#include <unistd.h>
+#include "crc32.h"
+
+#define TELEMETRY_RING_MAGIC 0x52544353 // "SCTR"
+#define TELEMETRY_RING_HEADER 16        // magic, slots, last sent sequence, crc
+
+static void put16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+static void put32(uint8_t *out, uint32_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  out[2] = (value >> 16) & 0xFF;
+  out[3] = (value >> 24) & 0xFF;
+}
+
+static uint16_t get16(const uint8_t *in) {
+  return in[0] | (in[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static bool syncClose(FILE *file) {
+  bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  return fclose(file) == 0 && ok;
+}
+
+size_t telemetryEncode(const TelemetryRecord &record, uint8_t *out, size_t size) {
+  if (size < TELEMETRY_RECORD_SIZE) return 0;
+  memset(out, 0, TELEMETRY_RECORD_SIZE);
+  put32(out, TELEMETRY_MAGIC);
+  put16(out + 4, TELEMETRY_RECORD_SIZE);
+  out[6] = METRIC_COUNT;
+  out[7] = GAUGE_COUNT;
+  put32(out + 8, record.sequence);
+  put32(out + 12, record.timestamp);
+  put32(out + 16, record.uptimeS);
+  put32(out + 20, record.coldBoots);
+  put32(out + 24, record.deepWakes);
+  put32(out + 28, record.captured);
+  put32(out + 32, record.events);
+  put32(out + 36, record.uploaded);
+  put32(out + 40, record.uploadFailures);
+  put16(out + 44, record.outboxPending);
+  put16(out + 46, record.fullFramesPending);
+  put32(out + 48, record.milliampHours);
+  put32(out + 52, record.sdUsedMb);
+  put32(out + 56, record.sdTotalMb);
+  put32(out + 60, (uint32_t)record.latitudeE7);
+  put32(out + 64, (uint32_t)record.longitudeE7);
+  put32(out + 68, record.fixAgeS);
+  put16(out + 72, record.hdopX10);
+  out[74] = record.fixMode;
+  out[75] = record.satellites;
+  out[76] = (uint8_t)record.csq;
+  out[77] = record.captureLevel;
+  put16(out + 78, (uint16_t)record.rsrpDbm);
+  out[80] = (uint8_t)record.snrDb;
+  // zero padded by the memset, the last byte always stays 0
+  memcpy(out + 81, record.linkMode, strnlen(record.linkMode, TELEMETRY_LINK_MODE_SIZE - 1));
+  // 93..95 spare
+
+  uint8_t *p = out + TELEMETRY_HEADER_SIZE;
+  for (int i = 0; i < METRIC_COUNT; i++, p += TELEMETRY_METRIC_SIZE) {
+    const MetricSummary &metric = record.metrics[i];
+    put32(p, metric.count);
+    put32(p + 4, metric.p50Us);
+    put32(p + 8, metric.p90Us);
+    put32(p + 12, metric.p99Us);
+    put32(p + 16, metric.maxUs);
+  }
+  for (int i = 0; i < GAUGE_COUNT; i++, p += TELEMETRY_GAUGE_SIZE) {
+    const GaugeSummary &gauge = record.gauges[i];
+    p[0] = gauge.set;
+    put32(p + 4, (uint32_t)gauge.last);
+    put32(p + 8, (uint32_t)gauge.min);
+    put32(p + 12, (uint32_t)gauge.max);
+  }
+  put32(p, crc32Update(0, out, p - out));
+  return TELEMETRY_RECORD_SIZE;
+}
+
+bool telemetryDecode(const uint8_t *in, size_t length, TelemetryRecord *record) {
+  if (length < TELEMETRY_HEADER_SIZE + 4 || get32(in) != TELEMETRY_MAGIC) return false;
+  size_t recordLength = get16(in + 4);
+  size_t metrics = in[6];
+  size_t gauges = in[7];
+  if (recordLength > length ||
+      recordLength != TELEMETRY_HEADER_SIZE + metrics * TELEMETRY_METRIC_SIZE + gauges * TELEMETRY_GAUGE_SIZE + 4 ||
+      get32(in + recordLength - 4) != crc32Update(0, in, recordLength - 4)) {
+    return false;
+  }
+
+  memset(record, 0, sizeof(*record));
+  record->sequence = get32(in + 8);
+  record->timestamp = get32(in + 12);
+  record->uptimeS = get32(in + 16);
+  record->coldBoots = get32(in + 20);
+  record->deepWakes = get32(in + 24);
+  record->captured = get32(in + 28);
+  record->events = get32(in + 32);
+  record->uploaded = get32(in + 36);
+  record->uploadFailures = get32(in + 40);
+  record->outboxPending = get16(in + 44);
+  record->fullFramesPending = get16(in + 46);
+  record->milliampHours = get32(in + 48);
+  record->sdUsedMb = get32(in + 52);
+  record->sdTotalMb = get32(in + 56);
+  record->latitudeE7 = (int32_t)get32(in + 60);
+  record->longitudeE7 = (int32_t)get32(in + 64);
+  record->fixAgeS = get32(in + 68);
+  record->hdopX10 = get16(in + 72);
+  record->fixMode = in[74];
+  record->satellites = in[75];
+  record->csq = (int8_t)in[76];
+  record->captureLevel = in[77];
+  record->rsrpDbm = (int16_t)get16(in + 78);
+  record->snrDb = (int8_t)in[80];
+  memcpy(record->linkMode, in + 81, TELEMETRY_LINK_MODE_SIZE - 1);
+
+  const uint8_t *p = in + TELEMETRY_HEADER_SIZE;
+  for (size_t i = 0; i < metrics; i++, p += TELEMETRY_METRIC_SIZE) {
+    if (i >= METRIC_COUNT) continue;
+    MetricSummary &metric = record->metrics[i];
+    metric.count = get32(p);
+    metric.p50Us = get32(p + 4);
+    metric.p90Us = get32(p + 8);
+    metric.p99Us = get32(p + 12);
+    metric.maxUs = get32(p + 16);
+  }
+  for (size_t i = 0; i < gauges; i++, p += TELEMETRY_GAUGE_SIZE) {
+    if (i >= GAUGE_COUNT) continue;
+    GaugeSummary &gauge = record->gauges[i];
+    gauge.set = p[0] != 0;
+    gauge.last = (int32_t)get32(p + 4);
+    gauge.min = (int32_t)get32(p + 8);
+    gauge.max = (int32_t)get32(p + 12);
+  }
+  return true;
+}
+
+TelemetryRing::TelemetryRing() : _slots(0), _next(1), _sent(0), _ready(false) {
+  _path[0] = '\0';
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool TelemetryRing::begin(const char *path, uint32_t slots) {
+  _ready = false;
+  _slots = slots;
+  _next = 1;
+  _sent = 0;
+  memset(&_stats, 0, sizeof(_stats));
+  if (slots == 0 || strlen(path) >= sizeof(_path)) return false;
+  strcpy(_path, path);
+
+  FILE *file = fopen(_path, "rb");
+  uint8_t header[TELEMETRY_RING_HEADER];
+  bool valid = file && fread(header, 1, sizeof(header), file) == sizeof(header) &&
+               get32(header) == TELEMETRY_RING_MAGIC && get32(header + 4) == slots &&
+               get32(header + 12) == crc32Update(0, header, 12);
+  if (!valid) {
+    // new card, other slot count or a torn header: start over
+    if (file) fclose(file);
+    _ready = writeHeader();
+    return _ready;
+  }
+  _sent = get32(header + 8);
+
+  // the newest valid record says where appends carry on
+  uint8_t slot[TELEMETRY_SLOT_SIZE];
+  TelemetryRecord record;
+  uint32_t last = 0;
+  for (uint32_t i = 0; i < _slots; i++) {
+    if (readSlot(file, i, slot) && telemetryDecode(slot, sizeof(slot), &record) && record.sequence % _slots == i) {
+      _stats.recovered++;
+      if (record.sequence > last) last = record.sequence;
+    }
+  }
+  fclose(file);
+  _next = (last > _sent ? last : _sent) + 1;
+  _ready = true;
+  return true;
+}
+
+bool TelemetryRing::writeHeader() {
+  uint8_t header[TELEMETRY_RING_HEADER];
+  put32(header, TELEMETRY_RING_MAGIC);
+  put32(header + 4, _slots);
+  put32(header + 8, _sent);
+  put32(header + 12, crc32Update(0, header, 12));
+
+  // "r+b" keeps the slots, "wb" only for a new ring
+  FILE *file = _ready ? fopen(_path, "r+b") : fopen(_path, "wb");
+  if (!file) return false;
+  bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+  return syncClose(file) && ok;
+}
+
+bool TelemetryRing::readSlot(FILE *file, uint32_t index, uint8_t *slot) {
+  return fseek(file, TELEMETRY_RING_HEADER + (long)index * TELEMETRY_SLOT_SIZE, SEEK_SET) == 0 &&
+         fread(slot, 1, TELEMETRY_SLOT_SIZE, file) == TELEMETRY_SLOT_SIZE;
+}
+
+bool TelemetryRing::append(TelemetryRecord &record) {
+  if (!_ready) return false;
+  record.sequence = _next;
+  uint8_t slot[TELEMETRY_SLOT_SIZE];
+  memset(slot, 0, sizeof(slot));
+  telemetryEncode(record, slot, sizeof(slot));
+
+  FILE *file = fopen(_path, "r+b");
+  bool ok = file && fseek(file, TELEMETRY_RING_HEADER + (long)(_next % _slots) * TELEMETRY_SLOT_SIZE, SEEK_SET) == 0 &&
+            fwrite(slot, 1, sizeof(slot), file) == sizeof(slot);
+  if (file) ok = syncClose(file) && ok;
+  if (!ok) {
+    _stats.writeFailures++;
+    return false;
+  }
+  _next++;
+  _stats.appended++;
+  return true;
+}
+
+uint32_t TelemetryRing::pending() const {
+  uint32_t oldest = _next > _slots ? _next - _slots : 1;
+  uint32_t first = _sent + 1 > oldest ? _sent + 1 : oldest;
+  return _next > first ? _next - first : 0;
+}
+
+size_t TelemetryRing::unsent(uint8_t *out, size_t capacity, uint32_t *last) {
+  *last = _sent;
+  if (!_ready || pending() == 0) return 0;
+  FILE *file = fopen(_path, "rb");
+  if (!file) return 0;
+
+  size_t length = 0;
+  uint8_t slot[TELEMETRY_SLOT_SIZE];
+  TelemetryRecord record;
+  for (uint32_t sequence = _next - pending(); sequence < _next; sequence++) {
+    if (!readSlot(file, sequence % _slots, slot) || !telemetryDecode(slot, sizeof(slot), &record) ||
+        record.sequence != sequence) {
+      // skipped, marking a later record sent retires it anyway
+      _stats.corrupt++;
+      *last = sequence;
+      continue;
+    }
+    size_t recordLength = get16(slot + 4);
+    if (length + recordLength > capacity) break;
+    memcpy(out + length, slot, recordLength);
+    length += recordLength;
+    *last = sequence;
+  }
+  fclose(file);
+  return length;
+}
+
+bool TelemetryRing::markSent(uint32_t sequence) {
+  if (!_ready || sequence <= _sent) return _ready;
+  _sent = sequence < _next ? sequence : _next - 1;
+  return writeHeader();
+}
@@ -0,0 +1,111 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "metrics.h"
+
+// fixed layout binary telemetry records and an SD ring file holding the
+// last TELEMETRY_SLOTS of them. a record is a snapshot of counters, the
+// metrics histograms and gauges, the last fix, signal and storage, about
+// 300 bytes against several hundred for the text report. records after
+// the last one marked sent go up as one batch, so the server gets a time
+// series. plain stdio and no Arduino dependencies, tools/telemetry_decode.py
+// reads the batches on the host
+//
+// record, little endian:
+//   "SCT1" | u16 length | u8 metric count | u8 gauge count | header fields
+//   (see telemetryEncode) | per metric u32 count, p50, p90, p99, max us |
+//   per gauge u8 set, 3 x 0, i32 last, min, max | u32 crc32 of the rest
+
+#define TELEMETRY_MAGIC 0x32544353 // "SCT2", bump the digit when the layout changes
+#define TELEMETRY_HEADER_SIZE 96
+#define TELEMETRY_METRIC_SIZE 20
+#define TELEMETRY_GAUGE_SIZE 16
+#define TELEMETRY_RECORD_SIZE \
+  (TELEMETRY_HEADER_SIZE + METRIC_COUNT * TELEMETRY_METRIC_SIZE + GAUGE_COUNT * TELEMETRY_GAUGE_SIZE + 4)
+#define TELEMETRY_SLOT_SIZE 384    // ring slot, leaves room for more metrics
+#define TELEMETRY_NO_FIX 0xFFFFFFFF
+#define TELEMETRY_LINK_MODE_SIZE 12 // same as LinkSignal::mode
+
+struct TelemetryRecord {
+  uint32_t sequence;          // set by TelemetryRing::append
+  uint32_t timestamp;         // unix seconds
+  uint32_t uptimeS;           // since this boot
+  uint32_t coldBoots;
+  uint32_t deepWakes;
+  uint32_t captured;          // pipeline counters, since this boot
+  uint32_t events;
+  uint32_t uploaded;
+  uint32_t uploadFailures;
+  uint16_t outboxPending;
+  uint16_t fullFramesPending;
+  uint32_t milliampHours;
+  uint32_t sdUsedMb;
+  uint32_t sdTotalMb;
+  int32_t latitudeE7;
+  int32_t longitudeE7;
+  uint32_t fixAgeS;           // TELEMETRY_NO_FIX without a fix
+  uint16_t hdopX10;
+  uint8_t fixMode;
+  uint8_t satellites;
+  int8_t csq;
+  uint8_t captureLevel;
+  int16_t rsrpDbm;
+  int8_t snrDb;
+  char linkMode[TELEMETRY_LINK_MODE_SIZE]; // +CPSI system mode, NUL terminated
+  MetricSummary metrics[METRIC_COUNT];
+  GaugeSummary gauges[GAUGE_COUNT];
+};
+
+struct TelemetryRingStats {
+  uint32_t appended;
+  uint32_t writeFailures;
+  uint32_t recovered;         // valid records found by begin()
+  uint32_t corrupt;           // slots in the unsent range that didn't decode
+};
+
+// returns the encoded length, 0 when out is smaller than TELEMETRY_RECORD_SIZE
+size_t telemetryEncode(const TelemetryRecord &record, uint8_t *out, size_t size);
+// false for a short record, bad magic or checksum. metrics and gauges past
+// the ones a record carries read as empty
+bool telemetryDecode(const uint8_t *in, size_t length, TelemetryRecord *record);
+
+class TelemetryRing {
+public:
+  TelemetryRing();
+
+  // open or create the ring at path. a ring made for another slot count
+  // starts over
+  bool begin(const char *path, uint32_t slots);
+
+  // store record, overwriting the oldest once the ring is full. fills in
+  // record.sequence
+  bool append(TelemetryRecord &record);
+
+  // copy the encoded records after the last one marked sent, oldest first,
+  // as many as fit. *last gets the newest sequence copied. returns the
+  // bytes copied, 0 with *last at the sent mark when the file can't be read
+  size_t unsent(uint8_t *out, size_t capacity, uint32_t *last);
+  // everything up to sequence is on the server
+  bool markSent(uint32_t sequence);
+
+  uint32_t pending() const;
+  // begin() succeeded, appends have somewhere to go
+  bool ready() const { return _ready; }
+  const TelemetryRingStats &stats() const { return _stats; }
+
+private:
+  bool writeHeader();
+  bool readSlot(FILE *file, uint32_t index, uint8_t *slot);
+
+  char _path[64];
+  uint32_t _slots;
+  uint32_t _next;             // sequence the next append gets
+  uint32_t _sent;
+  bool _ready;
+  TelemetryRingStats _stats;
+};
+
+#endif
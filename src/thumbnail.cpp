@@ -0,0 +1,32 @@
+#include "thumbnail.h"
+#include <esp_log.h>
+#include "config.h"
+#include "jpeg_dc.h"
+
+static JpegDcDecoder dcDecoder;
+static uint8_t *lumaBuffer = NULL;
+static size_t lumaCapacity = 0;
+
+const uint8_t *lumaThumbnail(const camera_fb_t *fb, uint16_t *width, uint16_t *height) {
+  size_t pixels = JPEG_DC_SIZE(fb->width, fb->height);
+
+  // buffer lives in PSRAM and only grows when the frame size does
+  if (pixels > lumaCapacity) {
+    free(lumaBuffer);
+    lumaBuffer = (uint8_t *)ps_malloc(pixels);
+    lumaCapacity = lumaBuffer ? pixels : 0;
+    if (lumaCapacity == 0) {
+      ESP_LOGE(TAG, "Failed to allocate thumbnail buffer");
+      return NULL;
+    }
+  }
+
+  if (!dcDecoder.decode(fb->buf, fb->len, lumaBuffer, lumaCapacity)) {
+    ESP_LOGI(TAG, "Failed to decode thumbnail");
+    return NULL;
+  }
+
+  *width = dcDecoder.outWidth();
+  *height = dcDecoder.outHeight();
+  return lumaBuffer;
+}
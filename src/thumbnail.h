@@ -0,0 +1,12 @@
+#ifndef __THUMBNAIL_H__
+#define __THUMBNAIL_H__
+
+#include <Arduino.h>
+#include <esp_camera.h>
+
+// 1/8 scale 8-bit luma image of a JPEG frame for cheap scene analysis, built
+// from the DC coefficients only. returns an internal buffer that stays valid
+// until the next call
+const uint8_t *lumaThumbnail(const camera_fb_t *fb, uint16_t *width, uint16_t *height);
+
+#endif
@@ -0,0 +1,241 @@
+#include "wall_clock.h"
+#include <string.h>
+
+// read exactly count digits, -1 if any isn't one
+static int readDigits(const char *text, int count) {
+  int value = 0;
+  for (int i = 0; i < count; i++) {
+    if (text[i] < '0' || text[i] > '9') return -1;
+    value = value * 10 + (text[i] - '0');
+  }
+  return value;
+}
+
+static char *writeDigits(char *out, unsigned value, int count) {
+  for (int i = count - 1; i >= 0; i--) {
+    out[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+  return out + count;
+}
+
+bool wallClockParseCclk(const char *text, int64_t *utcSeconds, int *zoneQuarters) {
+  const char *quote = strchr(text, '"');
+  const char *p = quote ? quote + 1 : text;
+  // yy/MM/dd,hh:mm:ss then an optional +zz or -zz
+  if (strlen(p) < 17 || p[2] != '/' || p[5] != '/' || p[8] != ',' || p[11] != ':' || p[14] != ':') return false;
+  int year = readDigits(p, 2);
+  int month = readDigits(p + 3, 2);
+  int day = readDigits(p + 6, 2);
+  int hour = readDigits(p + 9, 2);
+  int minute = readDigits(p + 12, 2);
+  int second = readDigits(p + 15, 2);
+  if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || hour > 23 || minute < 0 ||
+      minute > 59 || second < 0 || second > 60) {
+    return false;
+  }
+
+  int zone = 0;
+  if (p[17] == '+' || p[17] == '-') {
+    int digits = p[19] >= '0' && p[19] <= '9' ? 2 : 1;
+    zone = readDigits(p + 18, digits);
+    if (zone < 0 || zone > 56) return false;
+    if (p[17] == '-') zone = -zone;
+  }
+
+  int64_t local = wallClockDaysFromCivil(2000 + year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  *utcSeconds = local - zone * 900;
+  if (zoneQuarters) *zoneQuarters = zone;
+  return true;
+}
+
+bool wallClockParseGnss(const char *date, const char *time, int64_t *utcUs) {
+  // empty fields before the first fix, don't read past them
+  if (strlen(date) < 6 || strlen(time) < 6) return false;
+  int day = readDigits(date, 2);
+  int month = readDigits(date + 2, 2);
+  int year = readDigits(date + 4, 2);
+  int hour = readDigits(time, 2);
+  int minute = readDigits(time + 2, 2);
+  int second = readDigits(time + 4, 2);
+  if (day < 1 || day > 31 || month < 1 || month > 12 || year < 0 || hour < 0 || hour > 23 || minute < 0 ||
+      minute > 59 || second < 0 || second > 60) {
+    return false;
+  }
+
+  // fraction of a second, as many digits as the receiver gives
+  int64_t fraction = 0;
+  int64_t scale = 1000000;
+  if (time[6] == '.') {
+    for (const char *p = time + 7; *p >= '0' && *p <= '9' && scale > 1; p++) {
+      scale /= 10;
+      fraction += (*p - '0') * scale;
+    }
+  }
+
+  int64_t seconds = wallClockDaysFromCivil(2000 + year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  *utcUs = seconds * 1000000 + fraction;
+  return true;
+}
+
+// Howard Hinnant's days_from_civil
+int64_t wallClockDaysFromCivil(int year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  unsigned yearOfEra = (unsigned)(year - era * 400);
+  unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+void wallClockCivilFromDays(int64_t days, int *year, unsigned *month, unsigned *day) {
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  unsigned dayOfEra = (unsigned)(days - era * 146097);
+  unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  unsigned monthIndex = (5 * dayOfYear + 2) / 153;
+  *day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+  *month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+  *year = (int)(yearOfEra + era * 400) + (*month <= 2);
+}
+
+size_t wallClockFormat(char *out, size_t size, int64_t seconds, WallClockFormat format) {
+  static const size_t lengths[] = {14, 19, 19};
+  size_t length = lengths[format];
+  if (size <= length) return 0;
+
+  int64_t days = seconds / 86400;
+  int64_t rest = seconds % 86400;
+  if (rest < 0) {
+    rest += 86400;
+    days--;
+  }
+  int year;
+  unsigned month, day;
+  wallClockCivilFromDays(days, &year, &month, &day);
+  unsigned hour = (unsigned)(rest / 3600);
+  unsigned minute = (unsigned)(rest / 60 % 60);
+  unsigned second = (unsigned)(rest % 60);
+
+  char *p = out;
+  switch (format) {
+    case WALL_CLOCK_COMPACT:
+      p = writeDigits(p, day, 2);
+      p = writeDigits(p, month, 2);
+      p = writeDigits(p, year, 4);
+      p = writeDigits(p, hour, 2);
+      p = writeDigits(p, minute, 2);
+      p = writeDigits(p, second, 2);
+      break;
+    case WALL_CLOCK_READABLE:
+      p = writeDigits(p, day, 2);
+      *p++ = '/';
+      p = writeDigits(p, month, 2);
+      *p++ = '/';
+      p = writeDigits(p, year, 4);
+      *p++ = ' ';
+      p = writeDigits(p, hour, 2);
+      *p++ = ':';
+      p = writeDigits(p, minute, 2);
+      *p++ = ':';
+      p = writeDigits(p, second, 2);
+      break;
+    case WALL_CLOCK_ISO:
+      p = writeDigits(p, year, 4);
+      *p++ = '-';
+      p = writeDigits(p, month, 2);
+      *p++ = '-';
+      p = writeDigits(p, day, 2);
+      *p++ = 'T';
+      p = writeDigits(p, hour, 2);
+      *p++ = ':';
+      p = writeDigits(p, minute, 2);
+      *p++ = ':';
+      p = writeDigits(p, second, 2);
+      break;
+  }
+  *p = '\0';
+  return length;
+}
+
+WallClock::WallClock()
+  : _anchorUtcUs(0), _anchorMonoUs(0), _lastSyncMonoUs(0), _driftPpb(0), _zoneQuarters(0), _source(WALL_CLOCK_NONE) {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+int64_t WallClock::utcUs(int64_t monoUs) const {
+  int64_t elapsed = monoUs - _anchorMonoUs;
+  return _anchorUtcUs + elapsed + elapsed * _driftPpb / 1000000000LL;
+}
+
+int64_t WallClock::utcSeconds(int64_t monoUs) const {
+  int64_t us = utcUs(monoUs);
+  return us >= 0 ? us / 1000000 : (us - 999999) / 1000000;
+}
+
+int64_t WallClock::localSeconds(int64_t monoUs) const {
+  return utcSeconds(monoUs) + _zoneQuarters * 900;
+}
+
+void WallClock::sync(int64_t utcUs, int64_t monoUs, WallClockSource source) {
+  _stats.syncs++;
+  _stats.source = source;
+  _lastSyncMonoUs = monoUs;
+  if (_source != WALL_CLOCK_NONE && _source != WALL_CLOCK_RTC) {
+    int64_t error = utcUs - this->utcUs(monoUs);
+    int64_t elapsed = monoUs - _anchorMonoUs;
+    _stats.lastErrorUs = error;
+
+    if (error > WALL_CLOCK_STEP_US || error < -WALL_CLOCK_STEP_US) {
+      // NTP kicked in or the zone changed, nothing to learn from this one
+      _stats.steps++;
+    } else if (elapsed >= WALL_CLOCK_DRIFT_MIN_US) {
+      // the rate that would have hit this sync exactly, folded in slowly so
+      // one-second CCLK resolution doesn't make it jitter
+      int64_t measured = _driftPpb + error * 1000000000LL / elapsed;
+      int64_t drift = _driftPpb + (measured - _driftPpb) / 4;
+      if (drift > WALL_CLOCK_MAX_DRIFT_PPB) drift = WALL_CLOCK_MAX_DRIFT_PPB;
+      if (drift < -WALL_CLOCK_MAX_DRIFT_PPB) drift = -WALL_CLOCK_MAX_DRIFT_PPB;
+      _driftPpb = (int32_t)drift;
+    } else {
+      // too soon to say anything about drift, keep extrapolating from the
+      // older anchor so the next sync measures over a longer interval
+      return;
+    }
+  }
+  _anchorUtcUs = utcUs;
+  _anchorMonoUs = monoUs;
+  _source = source;
+  _stats.driftPpb = _driftPpb;
+}
+
+bool WallClock::syncDue(int64_t monoUs, int64_t resyncIntervalUs) const {
+  return _source == WALL_CLOCK_NONE || _source == WALL_CLOCK_RTC || monoUs - _lastSyncMonoUs >= resyncIntervalUs;
+}
+
+WallClockSnapshot WallClock::snapshot(int64_t monoUs) const {
+  WallClockSnapshot snapshot;
+  snapshot.utcUs = valid() ? utcUs(monoUs) : 0;
+  snapshot.driftPpb = _driftPpb;
+  snapshot.zoneQuarters = (int16_t)_zoneQuarters;
+  snapshot.source = (uint8_t)_source;
+  return snapshot;
+}
+
+void WallClock::restore(const WallClockSnapshot &snapshot, int64_t sleptUs, int64_t monoUs) {
+  _driftPpb = snapshot.driftPpb;
+  _stats.driftPpb = _driftPpb;
+  _zoneQuarters = snapshot.zoneQuarters;
+  if (snapshot.source == WALL_CLOCK_NONE) return;
+  _anchorUtcUs = snapshot.utcUs + sleptUs;
+  _anchorMonoUs = monoUs;
+  _lastSyncMonoUs = monoUs;
+  _source = WALL_CLOCK_RTC;
+  _stats.source = WALL_CLOCK_RTC;
+}
+
+size_t WallClock::format(char *out, size_t size, int64_t monoUs, WallClockFormat format) const {
+  if (!valid()) return 0;
+  return wallClockFormat(out, size, localSeconds(monoUs), format);
+}
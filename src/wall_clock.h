@@ -0,0 +1,100 @@
+#ifndef __WALL_CLOCK_H__
+#define __WALL_CLOCK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// wall clock kept locally between modem syncs. each sync anchors UTC to a
+// monotonic microsecond counter (esp_timer on the device, which keeps
+// counting through light sleep); between syncs time is extrapolated from
+// the anchor, corrected by a drift rate learned from how far off earlier
+// predictions were. formatting writes into caller buffers. no Arduino
+// dependencies
+
+#define WALL_CLOCK_STEP_US 5000000LL          // errors above this are a time step, not drift
+#define WALL_CLOCK_DRIFT_MIN_US 3600000000LL  // shortest interval that teaches the drift rate
+#define WALL_CLOCK_MAX_DRIFT_PPB 500000       // crystal drift is clamped to +-500 ppm
+
+enum WallClockSource {
+  WALL_CLOCK_NONE,
+  WALL_CLOCK_MODEM,   // +CCLK after network or NTP time
+  WALL_CLOCK_GNSS,
+  WALL_CLOCK_RTC      // carried across deep sleep on the RTC timer, resync soon
+};
+
+enum WallClockFormat {
+  WALL_CLOCK_COMPACT,  // ddMMyyyyhhmmss, used in file names
+  WALL_CLOCK_READABLE, // dd/MM/yyyy hh:mm:ss
+  WALL_CLOCK_ISO       // yyyy-MM-ddThh:mm:ss
+};
+
+// what a deep sleep has to carry over in RTC memory
+struct WallClockSnapshot {
+  int64_t utcUs;
+  int32_t driftPpb;
+  int16_t zoneQuarters;
+  uint8_t source;
+};
+
+struct WallClockStats {
+  uint32_t syncs;
+  uint32_t steps;          // syncs that moved the clock by more than WALL_CLOCK_STEP_US
+  int64_t lastErrorUs;     // prediction error found by the latest sync
+  int32_t driftPpb;        // learned rate of the monotonic counter against UTC
+  WallClockSource source;
+};
+
+// +CCLK: "yy/MM/dd,hh:mm:ss+zz" (prefix optional) to unix seconds in UTC and
+// the zone in quarter hours. false on anything malformed
+bool wallClockParseCclk(const char *text, int64_t *utcSeconds, int *zoneQuarters);
+
+// GNSS ddmmyy date and hhmmss.s UTC time fields to unix microseconds
+bool wallClockParseGnss(const char *date, const char *time, int64_t *utcUs);
+
+// days since 1970-01-01 for a civil date and back, valid for any year
+int64_t wallClockDaysFromCivil(int year, unsigned month, unsigned day);
+void wallClockCivilFromDays(int64_t days, int *year, unsigned *month, unsigned *day);
+
+// format unix seconds (already shifted to local time if wanted), returns
+// the length written or 0 when out is too small
+size_t wallClockFormat(char *out, size_t size, int64_t seconds, WallClockFormat format);
+
+class WallClock {
+public:
+  WallClock();
+
+  // utcUs was true at monoUs
+  void sync(int64_t utcUs, int64_t monoUs, WallClockSource source);
+  void setZone(int zoneQuarters) { _zoneQuarters = zoneQuarters; }
+
+  bool valid() const { return _source != WALL_CLOCK_NONE; }
+  int64_t utcUs(int64_t monoUs) const;
+  int64_t utcSeconds(int64_t monoUs) const;
+  int64_t localSeconds(int64_t monoUs) const;
+  int zoneQuarters() const { return _zoneQuarters; }
+
+  // true once resyncIntervalUs has passed since the last sync, or never synced
+  bool syncDue(int64_t monoUs, int64_t resyncIntervalUs) const;
+
+  size_t format(char *out, size_t size, int64_t monoUs, WallClockFormat format) const;
+
+  WallClockSnapshot snapshot(int64_t monoUs) const;
+  // continue from a snapshot taken sleptUs before monoUs on a counter that
+  // restarted in between. the RTC timer is far less exact than the crystal,
+  // so the clock reports itself due for a resync and the next sync replaces
+  // the anchor without learning drift from it
+  void restore(const WallClockSnapshot &snapshot, int64_t sleptUs, int64_t monoUs);
+
+  const WallClockStats &stats() const { return _stats; }
+
+private:
+  int64_t _anchorUtcUs;
+  int64_t _anchorMonoUs;
+  int64_t _lastSyncMonoUs;
+  int32_t _driftPpb;
+  int _zoneQuarters;
+  WallClockSource _source;
+  WallClockStats _stats;
+};
+
+#endif
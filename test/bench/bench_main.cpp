@@ -0,0 +1,778 @@
+// host benchmarks for the hot paths the firmware can't be profiled on
+// without a board: AT parsing and command round trips, file name and
+// timestamp formatting, log writing, OTA download and patching, report
+// building and JPEG decoding. run from the repository root, the sample
+// files are in test/bench/data:
+//
+//   pio run -e bench && .pio/build/bench/program > bench_output.txt
+//
+// every benchmark prints one JSON line: name, ns per operation (median of
+// BENCH_REPEATS timed runs), operations per run and, where it moves data,
+// MB/s, plus peak heap where that is the point. tools/bench_compare.py
+// diffs two outputs, e.g. from the last release and the current tree, and
+// fails on regressions
+
+#include <Arduino.h>
+#include <SD.h>
+#include <Update.h>
+#include <esp_log.h>
+#include <malloc.h>
+// libjpeg's boolean is an int, Arduino's a bool
+#define boolean jpeg_boolean
+#include <jpeglib.h>
+#undef boolean
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "config.h"
+#include "at_parser.h"
+#include "crc32.h"
+#include "delta_patch.h"
+#include "efs_transfer.h"
+#include "frame_crop.h"
+#include "jpeg_dc.h"
+#include "log_ring.h"
+#include "lzss.h"
+#include "metrics.h"
+#include "mock_modem.h"
+#include "modem_at.h"
+#include "motion.h"
+#include "ota_download.h"
+#include "report.h"
+#include "roi.h"
+#include "sd_log.h"
+#include "sha256.h"
+#include "telemetry.h"
+#include "wall_clock.h"
+
+#define BENCH_REPEATS 7
+#define BENCH_RUN_NS 20000000ULL  // a timed run is sized to take about this long
+#define BENCH_DATA "test/bench/data/"
+
+static const char *benchFilter = NULL;
+
+static uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// heap high water mark of one call, counted in glibc's malloc so libjpeg's
+// and the standard library's allocations show up as well
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+extern "C" void __libc_free(void *pointer);
+
+static std::atomic<bool> heapTracking(false);
+static std::atomic<int64_t> heapInUse(0);
+static std::atomic<int64_t> heapPeak(0);
+
+static void heapCount(void *pointer, int sign) {
+  if (!pointer || !heapTracking) return;
+  int64_t now = heapInUse += sign * (int64_t)malloc_usable_size(pointer);
+  int64_t peak = heapPeak;
+  while (now > peak && !heapPeak.compare_exchange_weak(peak, now)) {}
+}
+
+extern "C" void *malloc(size_t size) {
+  void *pointer = __libc_malloc(size);
+  heapCount(pointer, 1);
+  return pointer;
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+  void *pointer = __libc_calloc(count, size);
+  heapCount(pointer, 1);
+  return pointer;
+}
+
+extern "C" void *realloc(void *pointer, size_t size) {
+  heapCount(pointer, -1);
+  void *moved = __libc_realloc(pointer, size);
+  heapCount(moved ? moved : pointer, 1);
+  return moved;
+}
+
+extern "C" void free(void *pointer) {
+  heapCount(pointer, -1);
+  __libc_free(pointer);
+}
+
+static size_t peakHeap(const std::function<void()> &op) {
+  heapInUse = 0;
+  heapPeak = 0;
+  heapTracking = true;
+  op();
+  heapTracking = false;
+  return heapPeak;
+}
+
+// time op, bytes is what one operation moves (0 for none). fields are
+// extra JSON members for the line, e.g. ", \"peak_heap_bytes\": 1024"
+static void bench(const char *name, size_t bytes, const std::function<void()> &op, const std::string &fields = "") {
+  if (benchFilter && strstr(name, benchFilter) == NULL) return;
+
+  // warm up and size the runs
+  uint64_t ops = 1;
+  while (true) {
+    uint64_t start = nowNs();
+    for (uint64_t i = 0; i < ops; i++) op();
+    uint64_t elapsed = nowNs() - start;
+    if (elapsed >= BENCH_RUN_NS / 4 || ops >= (1ULL << 24)) {
+      ops = std::max<uint64_t>(1, ops * BENCH_RUN_NS / std::max<uint64_t>(elapsed, 1));
+      break;
+    }
+    ops *= 4;
+  }
+
+  std::vector<double> runs;
+  for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+    uint64_t start = nowNs();
+    for (uint64_t i = 0; i < ops; i++) op();
+    runs.push_back((double)(nowNs() - start) / ops);
+  }
+  std::sort(runs.begin(), runs.end());
+  double median = runs[runs.size() / 2];
+
+  printf("{\"name\": \"%s\", \"ns_per_op\": %.1f, \"ops\": %llu, \"min_ns\": %.1f, \"max_ns\": %.1f", name, median,
+         (unsigned long long)ops, runs.front(), runs.back());
+  if (bytes > 0) printf(", \"mb_per_s\": %.2f", bytes * 1000.0 / median);
+  printf("%s}\n", fields.c_str());
+  fflush(stdout);
+}
+
+static std::vector<uint8_t> randomBytes(size_t length, uint32_t seed) {
+  std::vector<uint8_t> bytes(length);
+  for (size_t i = 0; i < length; i++) {
+    seed = seed * 1664525 + 1013904223;
+    bytes[i] = seed >> 24;
+  }
+  return bytes;
+}
+
+// log text the way esp_log writes it, compresses like the real segments
+static std::string logText(size_t length) {
+  std::string text;
+  unsigned long time = 1000;
+  unsigned i = 0;
+  while (text.size() < length) {
+    char line[160];
+    time += 37 + i % 11;
+    switch (i++ % 4) {
+      case 0: snprintf(line, sizeof(line), "I (%lu) SmartCamera: Picture taken, %u bytes\n", time, 90000 + i * 13 % 4000); break;
+      case 1: snprintf(line, sizeof(line), "I (%lu) SmartCamera: Successfully ran FTP putfile\n", time); break;
+      case 2: snprintf(line, sizeof(line), "I (%lu) SmartCamera: Link level %u, %u ms per event\n", time, i % 4, 8000 + i % 900); break;
+      default: snprintf(line, sizeof(line), "I (%lu) SmartCamera: File successfully written to EFS: %u bytes\n", time, 60000 + i % 5000); break;
+    }
+    text += line;
+  }
+  text.resize(length);
+  return text;
+}
+
+// AT parsing
+
+static const char atTranscript[] =
+    "\r\n+CSQ: 21,99\r\n\r\nOK\r\n"
+    "\r\n+CREG: 0,1\r\n\r\nOK\r\n"
+    "\r\n+CPSI: LTE,Online,655-01,0x1234,12345678,256,EUTRAN-BAND3,1300,5,5,-100,-700,-700,10\r\n\r\nOK\r\n"
+    "\r\n+CCLK: \"26/10/16,12:00:00+08\"\r\n\r\nOK\r\n"
+    "\r\nOK\r\n\r\n+CFTPSPUTFILE: 0\r\n"
+    "\r\n+CGNSSINFO: 3,09,05,00,3348.123456,S,01832.654321,E,161026,120000.0,152.0,0.0,0.0,1.4,0.9,1.1\r\n"
+    "\r\n+HTTPREAD: DATA,64\r\n"
+    "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+    "\r\n+HTTPREAD: 0\r\n";
+
+static void benchAtParser() {
+  static AtParser parser;
+  bench("at_parse_transcript", sizeof(atTranscript) - 1, [] {
+    AtEvent event;
+    parser.feed((const uint8_t *)atTranscript, sizeof(atTranscript) - 1);
+    while (parser.next(event)) {}
+  });
+}
+
+static MockModem modem;
+
+static void benchAtCommands() {
+  modem.reset();
+  atBegin(modem);
+  bench("at_send_wait_csq", 0, [] {
+    char response[AT_LINE_SIZE];
+    atSendWait("+CSQ", "+CSQ:", 1000, response, sizeof(response));
+  });
+
+  bench("at_send_batch_status", 0, [] {
+    char csq[32], creg[32], cpsi[AT_LINE_SIZE];
+    AtQuery queries[] = {
+      {"+CSQ", "+CSQ:", csq, sizeof(csq), false, false},
+      {"+CREG?", "+CREG:", creg, sizeof(creg), false, false},
+      {"+CPSI?", "+CPSI:", cpsi, sizeof(cpsi), false, false},
+      {"+CTZU=1", NULL, NULL, 0, true, false},
+    };
+    atSendBatch(queries, 4, 1000);
+  });
+}
+
+// names and timestamps
+
+static void benchFormatting() {
+  static const int64_t seconds = 1792152000;  // 2026-10-16
+  bench("wall_clock_format_compact", 0, [] {
+    char text[20];
+    wallClockFormat(text, sizeof(text), seconds, WALL_CLOCK_COMPACT);
+  });
+
+  bench("wall_clock_parse_cclk", 0, [] {
+    int64_t utc;
+    int zone;
+    wallClockParseCclk("+CCLK: \"26/10/16,12:00:00+08\"", &utc, &zone);
+  });
+
+  // getFormattedImageName() and getFormattedReportName()
+  bench("image_file_name", 0, [] {
+    char dateTime[20];
+    wallClockFormat(dateTime, sizeof(dateTime), seconds, WALL_CLOCK_COMPACT);
+    char name[64];
+    imageName(name, sizeof(name), dateTime, ".jpg");
+    reportName(name, sizeof(name), dateTime, "-DailyReport.txt");
+  });
+}
+
+// logging
+
+static uint32_t ringBuffer[LOG_RING_SIZE / 4];
+static LogRing ring;
+
+static int ringPrintf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = ring.vprintf(format, args);
+  va_end(args);
+  return length;
+}
+
+// the SD logger the ring replaced, as main.cpp had it: format, echo to
+// Serial, print and flush the log file, all on the task that logged.
+// against the mock File a flush is a write() per line, on the card it also
+// rewrites a sector, so this is the floor of what it cost
+static File flushPerLineLog;
+
+static int flushPerLineOutput(const char *format, va_list args) {
+  char buf[128];
+  int ret = vsnprintf(buf, sizeof(buf), format, args);
+  if (flushPerLineLog) {
+    Serial.println(buf);
+    flushPerLineLog.print(buf);
+    flushPerLineLog.flush();
+  }
+  return ret;
+}
+
+static void benchLogging(const std::string &cardDir) {
+  ring.begin(ringBuffer, sizeof(ringBuffer));
+  bench("log_ring_printf", 0, [] {
+    static uint8_t drained[LOG_RING_MAX_RECORD * 4];
+    ringPrintf("I (%lu) %s: Picture taken, %u bytes\n", 123456UL, TAG, 93211U);
+    if (ring.used() > sizeof(ringBuffer) / 2) {
+      while (ring.read(drained, sizeof(drained)) > 0) {}
+    }
+  });
+
+  // what a logging task pays with the SD log installed: format and claim
+  // ring space. the SD task writes the file behind it at its own pace
+  SD.setRoot(cardDir);
+  if (!sdLogBegin(SD, "/log.txt")) {
+    fprintf(stderr, "sd log failed to start in %s\n", cardDir.c_str());
+    return;
+  }
+  esp_log_level_set("*", ESP_LOG_INFO);
+  bench("sd_log_esp_logi", 0, [] {
+    ESP_LOGI(TAG, "Picture taken, %u bytes", 93211U);
+  });
+  esp_log_level_set("*", ESP_LOG_NONE);
+  sdLogFlush(5000);
+
+  // the same line through the old flush per line logger
+  flushPerLineLog = SD.open("/baseline.txt", FILE_APPEND);
+  vprintf_like_t ringOutput = esp_log_set_vprintf(flushPerLineOutput);
+  esp_log_level_set("*", ESP_LOG_INFO);
+  bench("sd_log_flush_per_line_baseline", 0, [] {
+    ESP_LOGI(TAG, "Picture taken, %u bytes", 93211U);
+  });
+  esp_log_level_set("*", ESP_LOG_NONE);
+  esp_log_set_vprintf(ringOutput);
+  flushPerLineLog.close();
+}
+
+// OTA
+
+static std::vector<uint8_t> firmware;
+
+static bool writeFirmware(const uint8_t *data, size_t length, size_t offset, size_t total, void *context) {
+  (void)context;
+  if (offset == 0 && !Update.begin(total)) return false;
+  return Update.write((uint8_t *)data, length) == length;
+}
+
+struct PatchImage {
+  const std::vector<uint8_t> *old;
+  std::vector<uint8_t> out;
+};
+
+static bool patchBegin(const DeltaHeader &header, void *context) {
+  (void)header;
+  (void)context;
+  return true;
+}
+
+static bool patchReadOld(uint32_t offset, uint8_t *out, size_t length, void *context) {
+  PatchImage *image = (PatchImage *)context;
+  if (offset + length > image->old->size()) return false;
+  memcpy(out, image->old->data() + offset, length);
+  return true;
+}
+
+static bool patchWrite(const uint8_t *data, size_t length, void *context) {
+  PatchImage *image = (PatchImage *)context;
+  image->out.insert(image->out.end(), data, data + length);
+  return true;
+}
+
+static void putLe32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out.push_back(value >> (8 * i));
+}
+
+// an SCD1 patch the way make_delta.py lays out a rebuilt image: long ADD
+// runs with sparse changes and a few literal blocks
+static std::vector<uint8_t> makePatch(const std::vector<uint8_t> &oldImage, std::vector<uint8_t> *newImage) {
+  *newImage = oldImage;
+  std::vector<uint8_t> patch(DELTA_MAGIC, DELTA_MAGIC + 4);
+  putLe32(patch, oldImage.size());
+  putLe32(patch, oldImage.size());
+  uint8_t digest[SHA256_SIZE];
+  Sha256 sha;
+  sha256Begin(sha);
+  sha256Update(sha, oldImage.data(), oldImage.size());
+  sha256Finish(sha, digest);
+  patch.insert(patch.end(), digest, digest + SHA256_SIZE);
+  size_t newDigestAt = patch.size();
+  patch.insert(patch.end(), SHA256_SIZE, 0);
+
+  const size_t block = 16384;
+  for (size_t offset = 0; offset < oldImage.size(); offset += block) {
+    size_t length = std::min(block, oldImage.size() - offset);
+    if (offset / block % 8 == 7) {
+      std::vector<uint8_t> literal = randomBytes(length, offset);
+      std::copy(literal.begin(), literal.end(), newImage->begin() + offset);
+      patch.push_back('D');
+      putLe32(patch, length);
+      patch.insert(patch.end(), literal.begin(), literal.end());
+      continue;
+    }
+    patch.push_back('A');
+    putLe32(patch, offset);
+    putLe32(patch, length);
+    for (size_t i = 0; i < length; i++) {
+      uint8_t add = i % 997 == 0 ? 1 : 0;
+      (*newImage)[offset + i] += add;
+      patch.push_back(add);
+    }
+  }
+  sha256Begin(sha);
+  sha256Update(sha, newImage->data(), newImage->size());
+  sha256Finish(sha, patch.data() + newDigestAt);
+  return patch;
+}
+
+static void benchOta() {
+  firmware = randomBytes(256 * 1024, 1);
+  modem.reset();
+  modem.serve("http://ota.example.com/firmware.bin", firmware.data(), firmware.size());
+  atBegin(modem);
+  bench("ota_download_256k", firmware.size(), [] {
+    uint8_t digest[SHA256_SIZE];
+    Update.reset();
+    if (!otaDownload("http://ota.example.com/firmware.bin", writeFirmware, NULL, digest) || !Update.end()) {
+      fprintf(stderr, "ota download failed\n");
+      exit(1);
+    }
+  });
+
+  bench("sha256_64k", 65536, [] {
+    Sha256 sha;
+    uint8_t digest[SHA256_SIZE];
+    sha256Begin(sha);
+    sha256Update(sha, firmware.data(), 65536);
+    sha256Finish(sha, digest);
+  });
+
+  static std::vector<uint8_t> newImage;
+  static std::vector<uint8_t> patch = makePatch(firmware, &newImage);
+  bench("delta_patch_apply_256k", firmware.size(), [] {
+    PatchImage image = {&firmware, {}};
+    image.out.reserve(firmware.size());
+    DeltaTarget target = {patchBegin, patchReadOld, patchWrite, &image};
+    DeltaPatcher patcher;
+    patcher.begin(target);
+    // in +HTTPREAD window sized pieces
+    for (size_t offset = 0; offset < patch.size(); offset += OTA_READ_WINDOW) {
+      patcher.feed(patch.data() + offset, std::min((size_t)OTA_READ_WINDOW, patch.size() - offset));
+    }
+    if (!patcher.finished() || image.out != newImage) {
+      fprintf(stderr, "delta patch failed\n");
+      exit(1);
+    }
+  });
+}
+
+// reports
+
+static void fillMetrics() {
+  metricsReset();
+  for (uint32_t i = 0; i < 500; i++) {
+    metricRecord(METRIC_CAMERA_GRAB, 80000 + i * 37 % 20000);
+    metricRecord(METRIC_EFS_TRANSFER, 900000 + i * 7919 % 400000);
+    metricRecord(METRIC_AT_ROUND_TRIP, 20000 + i * 131 % 30000);
+    metricRecord(METRIC_FTP_PUT, 3000000 + i * 7717 % 2000000);
+  }
+  gaugeSet(GAUGE_CSQ, 21);
+  gaugeSet(GAUGE_BATTERY, 3950);
+  gaugeSet(GAUGE_TEMPERATURE, 312);
+}
+
+static void benchReports() {
+  // what every instrumented call pays, values spread over many buckets
+  metricsReset();
+  static uint32_t value = 1;
+  bench("metric_record", 0, [] {
+    value = value * 1664525 + 1013904223;
+    metricRecord(METRIC_AT_ROUND_TRIP, value >> 8);
+  });
+  bench("gauge_set", 0, [] {
+    value = value * 1664525 + 1013904223;
+    gaugeSet(GAUGE_HEAP_FREE, (int32_t)(value >> 12));
+  });
+  bench("metric_summary", 0, [] {
+    metricSummary(METRIC_AT_ROUND_TRIP);
+  });
+
+  fillMetrics();
+  bench("metrics_format", 0, [] {
+    char text[METRICS_REPORT_SIZE];
+    metricsFormat(text, sizeof(text));
+  });
+
+  // the daily report body sendLogFile() builds
+  bench("daily_report_build", 0, [] {
+    char dateTime[20];
+    wallClockFormat(dateTime, sizeof(dateTime), 1792152000, WALL_CLOCK_READABLE);
+    ReportInfo info = {"864764030000001", 21, 31, dateTime, true, 3950, true, 15258, 812, 41, "-33.802058,18.544239"};
+    char text[REPORT_SIZE];
+    reportFormat(text, sizeof(text), info);
+  });
+
+  static TelemetryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.timestamp = 1792152000;
+  record.captured = 1200;
+  strlcpy(record.linkMode, "LTE", sizeof(record.linkMode));
+  for (int i = 0; i < METRIC_COUNT; i++) record.metrics[i] = metricSummary((MetricId)i);
+  for (int i = 0; i < GAUGE_COUNT; i++) record.gauges[i] = gaugeSummary((GaugeId)i);
+  bench("telemetry_encode", 0, [] {
+    uint8_t slot[TELEMETRY_SLOT_SIZE];
+    telemetryEncode(record, slot, sizeof(slot));
+  });
+  metricsReset();
+}
+
+// checked in inputs under test/bench/data
+static std::vector<uint8_t> readSample(const char *name) {
+  std::vector<uint8_t> bytes;
+  FILE *file = fopen((std::string(BENCH_DATA) + name).c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "%s%s missing, run from the repository root\n", BENCH_DATA, name);
+    exit(1);
+  }
+  uint8_t buffer[4096];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + count);
+  fclose(file);
+  return bytes;
+}
+
+// compression and upload staging. the lzss lines carry the compressed
+// size and ratio next to the speed. soak_log.txt is the firmware's own
+// log from a test/soak run against tools/sim7600_emulator.py
+
+static uint8_t lzssWork[LZSS_WORK_SIZE_FOR(LZSS_MAX_WINDOW_BITS, LZSS_MAX_LENGTH_BITS)] __attribute__((aligned(4)));
+
+static bool countSink(const uint8_t *data, size_t length, void *context) {
+  (void)data;
+  *(size_t *)context += length;
+  return true;
+}
+
+static size_t lzssCompress(const uint8_t *data, size_t length, uint8_t windowBits, uint8_t lengthBits) {
+  LzssEncoder encoder;
+  size_t out = 0;
+  encoder.begin(lzssWork, countSink, &out, windowBits, lengthBits);
+  encoder.write(data, length);
+  encoder.finish();
+  return out;
+}
+
+static void benchLzss(const char *name, const uint8_t *data, size_t length, uint8_t windowBits,
+                      uint8_t lengthBits) {
+  size_t out = lzssCompress(data, length, windowBits, lengthBits);
+  char fields[160];
+  snprintf(fields, sizeof(fields),
+           ", \"window_bits\": %u, \"length_bits\": %u, \"work_bytes\": %u, \"bytes_out\": %zu, \"ratio\": %.4f",
+           windowBits, lengthBits, (unsigned)LZSS_WORK_SIZE_FOR(windowBits, lengthBits), out, (double)out / length);
+  bench(name, length, [=] { lzssCompress(data, length, windowBits, lengthBits); }, fields);
+}
+
+static void benchUpload() {
+  static std::string text = logText(64 * 1024);
+  benchLzss("lzss_compress_log_64k", (const uint8_t *)text.data(), text.size(), LZSS_WINDOW_BITS, LZSS_LENGTH_BITS);
+
+  static std::vector<uint8_t> log = readSample("soak_log.txt");
+  benchLzss("lzss_soak_log_w12_l5", log.data(), log.size(), 12, 5);
+  benchLzss("lzss_soak_log_w10_l4", log.data(), log.size(), 10, 4);
+  benchLzss("lzss_soak_log_w14_l6", log.data(), log.size(), 14, 6);
+
+  bench("crc32_64k", text.size(), [] {
+    crc32Update(0, text.data(), text.size());
+  });
+
+  modem.reset();
+  atBegin(modem);
+  bench("efs_transfer_compressed_log_64k", text.size(), [] {
+    if (!efsTransferCompressed("log.lzs", (const uint8_t *)text.data(), text.size())) {
+      fprintf(stderr, "efs transfer failed\n");
+      exit(1);
+    }
+  });
+
+  static std::vector<uint8_t> photo = randomBytes(96 * 1024, 7);
+  bench("efs_transfer_photo_96k", photo.size(), [] {
+    efsTransferBuffer("photo.jpg", photo.data(), photo.size());
+  });
+}
+
+// JPEG decoding: the DC only thumbnail lumaThumbnail() builds against a
+// full decode of the same UXGA frame, libjpeg here standing in for
+// esp_jpg_decode. peak heap includes the output image
+
+static JpegDcDecoder dcDecoder;
+
+static void dcDecode(const std::vector<uint8_t> &jpeg) {
+  std::vector<uint8_t> luma(JPEG_DC_SIZE(1600, 1200));
+  if (!dcDecoder.decode(jpeg.data(), jpeg.size(), luma.data(), luma.size())) {
+    fprintf(stderr, "DC decode failed\n");
+    exit(1);
+  }
+}
+
+// scale 8 is libjpeg's own DC only path
+static void fullDecode(const std::vector<uint8_t> &jpeg, J_COLOR_SPACE space, unsigned scale) {
+  struct jpeg_decompress_struct info;
+  struct jpeg_error_mgr error;
+  info.err = jpeg_std_error(&error);
+  jpeg_create_decompress(&info);
+  jpeg_mem_src(&info, (unsigned char *)jpeg.data(), jpeg.size());
+  jpeg_read_header(&info, TRUE);
+  info.out_color_space = space;
+  info.scale_num = 1;
+  info.scale_denom = scale;
+  jpeg_start_decompress(&info);
+  size_t stride = (size_t)info.output_width * info.output_components;
+  std::vector<uint8_t> image(stride * info.output_height);
+  while (info.output_scanline < info.output_height) {
+    JSAMPROW row = image.data() + info.output_scanline * stride;
+    jpeg_read_scanlines(&info, &row, 1);
+  }
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+}
+
+static std::string heapFields(const std::function<void()> &op, size_t stateBytes) {
+  char fields[96];
+  snprintf(fields, sizeof(fields), ", \"peak_heap_bytes\": %zu, \"state_bytes\": %zu", peakHeap(op), stateBytes);
+  return fields;
+}
+
+static void benchDecode() {
+  static std::vector<uint8_t> jpeg = readSample("uxga.jpg");
+  bench("jpeg_dc_decode_uxga", jpeg.size(), [] { dcDecode(jpeg); },
+        heapFields([] { dcDecode(jpeg); }, sizeof(JpegDcDecoder)));
+  bench("jpeg_full_decode_gray_uxga", jpeg.size(), [] { fullDecode(jpeg, JCS_GRAYSCALE, 1); },
+        heapFields([] { fullDecode(jpeg, JCS_GRAYSCALE, 1); }, 0));
+  bench("jpeg_full_decode_rgb_uxga", jpeg.size(), [] { fullDecode(jpeg, JCS_RGB, 1); },
+        heapFields([] { fullDecode(jpeg, JCS_RGB, 1); }, 0));
+  bench("jpeg_full_decode_gray_scale8_uxga", jpeg.size(), [] { fullDecode(jpeg, JCS_GRAYSCALE, 8); },
+        heapFields([] { fullDecode(jpeg, JCS_GRAYSCALE, 8); }, 0));
+}
+
+// cropping and re-encoding frames for upload: frameCrop() over a libjpeg
+// codec, standing in for esp_jpg_decode and fmt2jpg. the codec times its
+// own calls so decode and encode show up apart
+
+static uint64_t cropDecodeNs;
+static uint64_t cropEncodeNs;
+static uint32_t cropEncodes;
+
+static bool libjpegDecode(const uint8_t *jpeg, size_t length, uint8_t scaleShift, FrameCropWriter write,
+                          void *context) {
+  uint64_t start = nowNs();
+  struct jpeg_decompress_struct info;
+  struct jpeg_error_mgr error;
+  info.err = jpeg_std_error(&error);
+  jpeg_create_decompress(&info);
+  jpeg_mem_src(&info, (unsigned char *)jpeg, length);
+  jpeg_read_header(&info, TRUE);
+  info.out_color_space = JCS_RGB;
+  info.scale_num = 1;
+  info.scale_denom = 1 << scaleShift;
+  jpeg_start_decompress(&info);
+
+  // 16 row bands, the MCU rows esp_jpg_decode hands over
+  size_t stride = (size_t)info.output_width * 3;
+  std::vector<uint8_t> band(stride * 16);
+  bool ok = write(context, 0, 0, info.output_width, info.output_height, NULL);
+  while (ok && info.output_scanline < info.output_height) {
+    uint16_t y = info.output_scanline;
+    uint16_t rows = 0;
+    while (rows < 16 && info.output_scanline < info.output_height) {
+      JSAMPROW row = band.data() + rows * stride;
+      rows += jpeg_read_scanlines(&info, &row, 1);
+    }
+    ok = write(context, 0, y, info.output_width, rows, band.data());
+  }
+  if (ok) {
+    jpeg_finish_decompress(&info);
+    write(context, 0, 0, 0, 0, NULL);
+  }
+  jpeg_destroy_decompress(&info);
+  cropDecodeNs += nowNs() - start;
+  return ok;
+}
+
+static bool libjpegEncode(const uint8_t *pixels, uint16_t width, uint16_t height, uint8_t quality, uint8_t **out,
+                          size_t *outLength) {
+  uint64_t start = nowNs();
+  struct jpeg_compress_struct info;
+  struct jpeg_error_mgr error;
+  info.err = jpeg_std_error(&error);
+  jpeg_create_compress(&info);
+  unsigned char *buffer = NULL;
+  unsigned long size = 0;
+  jpeg_mem_dest(&info, &buffer, &size);
+  info.image_width = width;
+  info.image_height = height;
+  info.input_components = 3;
+  info.in_color_space = JCS_EXT_BGR;
+  jpeg_set_defaults(&info);
+  jpeg_set_quality(&info, quality, TRUE);
+  jpeg_start_compress(&info, TRUE);
+  while (info.next_scanline < height) {
+    JSAMPROW row = (JSAMPROW)pixels + (size_t)info.next_scanline * width * 3;
+    jpeg_write_scanlines(&info, &row, 1);
+  }
+  jpeg_finish_compress(&info);
+  jpeg_destroy_compress(&info);
+  *out = buffer;
+  *outLength = size;
+  cropEncodeNs += nowNs() - start;
+  cropEncodes++;
+  return true;
+}
+
+static const FrameCropCodec libjpegCodec = {libjpegDecode, libjpegEncode};
+
+static void benchCrop(const char *name, const std::vector<uint8_t> &jpeg, const RoiRect &area, uint16_t maxSide,
+                      size_t budget) {
+  static const std::vector<uint8_t> *frame;
+  static RoiRect region;
+  static uint8_t scaleShift;
+  static size_t cropBudget, cropLength;
+  static uint8_t quality;
+  frame = &jpeg;
+  region = area;
+  scaleShift = roiScaleShift(area, maxSide);
+  cropBudget = budget;
+  auto crop = [] {
+    uint8_t *out;
+    if (!frameCrop(libjpegCodec, frame->data(), frame->size(), region, scaleShift, cropBudget, &out, &cropLength,
+                   &quality)) {
+      fprintf(stderr, "crop failed\n");
+      exit(1);
+    }
+    free(out);
+  };
+
+  // one crop on its own for the heap, the decode/encode split and the sizes
+  cropDecodeNs = cropEncodeNs = 0;
+  cropEncodes = 0;
+  size_t peak = peakHeap(crop);
+  char fields[256];
+  snprintf(fields, sizeof(fields),
+           ", \"peak_heap_bytes\": %zu, \"decode_ns\": %llu, \"encode_ns\": %llu, \"encodes\": %u, "
+           "\"quality\": %u, \"bytes_in\": %zu, \"bytes_out\": %zu, \"saved_pct\": %.1f",
+           peak, (unsigned long long)cropDecodeNs, (unsigned long long)cropEncodeNs, cropEncodes, quality,
+           frame->size(), cropLength, 100.0 * (1.0 - (double)cropLength / frame->size()));
+  bench(name, jpeg.size(), crop, fields);
+}
+
+static void benchCrops() {
+  static std::vector<uint8_t> jpeg = readSample("uxga.jpg");
+  // the person in the sample with ROI_MARGIN around them, and the whole frame
+  RoiRect person = {836, 136, 180, 348};
+  RoiRect whole = {0, 0, 1600, 1200};
+  benchCrop("frame_crop_roi_uxga", jpeg, person, ROI_MAX_SIDE, ROI_BUDGET);
+  benchCrop("frame_crop_thumbnail_uxga", jpeg, whole, THUMBNAIL_MAX_SIDE, THUMBNAIL_BUDGET);
+  // a large region against a tight budget, quality steps down to fit
+  RoiRect large = {400, 0, 1200, 1200};
+  benchCrop("frame_crop_quality_steps_uxga", jpeg, large, ROI_MAX_SIDE, 12 * 1024);
+}
+
+// image analysis, on the 1/8 scale UXGA thumbnail the camera task uses
+
+static void benchVision() {
+  static const MotionConfig config = {
+    MOTION_NOISE_FLOOR, MOTION_THRESHOLD_K, MOTION_TRIGGER_PERMILLE,
+    MOTION_GLOBAL_PERMILLE, MOTION_LEARN_SHIFT, MOTION_WARMUP_FRAMES
+  };
+  static MotionDetector detector;
+  static std::vector<uint8_t> frames[2] = {randomBytes(200 * 150, 11), randomBytes(200 * 150, 12)};
+  static int next = 0;
+  detector.begin(200, 150, config);
+  bench("motion_update_200x150", frames[0].size(), [] {
+    detector.update(frames[next].data());
+    next ^= 1;
+  });
+  detector.end();
+}
+
+int main(int argc, char **argv) {
+  // a name fragment runs only the matching benchmarks
+  if (argc > 1) benchFilter = argv[1];
+
+  std::string cardDir = mockTempDir("bench-sd");
+  printf("{\"suite\": \"native\", \"repeats\": %d, \"run_ns\": %llu}\n", BENCH_REPEATS,
+         (unsigned long long)BENCH_RUN_NS);
+  benchAtParser();
+  benchAtCommands();
+  benchFormatting();
+  benchOta();
+  benchReports();
+  benchUpload();
+  benchDecode();
+  benchCrops();
+  benchVision();
+  benchLogging(cardDir);
+  return 0;
+}
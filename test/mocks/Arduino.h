@@ -0,0 +1,139 @@
+#ifndef __MOCK_ARDUINO_H__
+#define __MOCK_ARDUINO_H__
+
+// the parts of the Arduino core the modules built under [env:native] use:
+// integer types, a clock, Print/Stream, a small String and Serial. delay()
+// doesn't sleep, it moves the mock clock on, so AT and upload timeouts run
+// out straight away in tests instead of in real time (the soak runner
+// against tools/sim7600_emulator.py turns real sleeps back on)
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+using std::max;
+using std::min;
+
+// glibc before 2.38 has no strlcpy
+static inline size_t mockStrlcpy(char *out, const char *text, size_t size) {
+  size_t length = strlen(text);
+  if (size > 0) {
+    size_t count = length < size - 1 ? length : size - 1;
+    memcpy(out, text, count);
+    out[count] = '\0';
+  }
+  return length;
+}
+#define strlcpy mockStrlcpy
+
+// real time since start plus everything delay() skipped
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+void mockClockAdvance(unsigned long ms);
+// delay() sleeps for real, for runs against a live emulator (test/soak)
+void mockClockRealTime(bool on);
+
+void *ps_malloc(size_t size);
+void *ps_calloc(size_t count, size_t size);
+bool psramFound();
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *data, size_t length);
+  size_t write(const char *text, size_t length) { return write((const uint8_t *)text, length); }
+  size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+  size_t print(const char *text) { return write(text); }
+  size_t println(const char *text) { return write(text) + write("\r\n"); }
+  size_t printf(const char *format, ...);
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  // up to length bytes that are already there, the mocks never wait
+  virtual size_t readBytes(char *buffer, size_t length);
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+protected:
+  unsigned long _timeout = 1000;
+};
+
+class String {
+public:
+  String(const char *text = "") : _text(text ? text : "") {}
+  String(const std::string &text) : _text(text) {}
+  explicit String(char c) : _text(1, c) {}
+  String(int value) : _text(std::to_string(value)) {}
+  String(unsigned int value) : _text(std::to_string(value)) {}
+  String(long value) : _text(std::to_string(value)) {}
+  String(unsigned long value) : _text(std::to_string(value)) {}
+
+  const char *c_str() const { return _text.c_str(); }
+  unsigned int length() const { return _text.size(); }
+  String substring(unsigned int from, unsigned int to = 0xFFFFFFFF) const {
+    if (from > _text.size()) return String();
+    return String(_text.substr(from, to < from ? 0 : to - from));
+  }
+  int indexOf(char c, unsigned int from = 0) const { return find(_text.find(c, from)); }
+  int indexOf(const char *text, unsigned int from = 0) const { return find(_text.find(text, from)); }
+  bool startsWith(const char *text) const { return _text.compare(0, strlen(text), text) == 0; }
+  bool endsWith(const char *text) const {
+    size_t length = strlen(text);
+    return length <= _text.size() && _text.compare(_text.size() - length, length, text) == 0;
+  }
+  long toInt() const { return atol(_text.c_str()); }
+  void trim();
+
+  String &operator+=(const String &other) { _text += other._text; return *this; }
+  String &operator+=(const char *text) { _text += text; return *this; }
+  String &operator+=(char c) { _text += c; return *this; }
+  friend String operator+(String left, const String &right) { return left += right; }
+  friend String operator+(String left, const char *right) { return left += right; }
+  bool operator==(const String &other) const { return _text == other._text; }
+  bool operator==(const char *text) const { return _text == text; }
+  bool operator!=(const String &other) const { return _text != other._text; }
+  bool operator!=(const char *text) const { return _text != text; }
+  char operator[](unsigned int index) const { return index < _text.size() ? _text[index] : '\0'; }
+
+private:
+  static int find(size_t position) { return position == std::string::npos ? -1 : (int)position; }
+
+  std::string _text;
+};
+
+// the USB console. output is dropped unless echo is on
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void echo(bool on) { _echo = on; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t length) override;
+  using Print::write;
+
+private:
+  bool _echo = false;
+};
+
+extern HardwareSerial Serial;
+
+#endif
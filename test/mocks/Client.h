@@ -0,0 +1,15 @@
+#ifndef __MOCK_CLIENT_H__
+#define __MOCK_CLIENT_H__
+
+#include <Arduino.h>
+
+// the Arduino network client interface, a TinyGsmClient on the device
+class Client : public Stream {
+public:
+  virtual int connect(const char *host, uint16_t port) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  using Print::write;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __MOCK_FS_H__
+#define __MOCK_FS_H__
+
+// fs::FS and fs::File over a directory on the host, so SD card code runs
+// against real files. paths are card paths ("/log.txt"), setRoot() picks
+// the host directory they live in
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+struct FileHandle;
+
+class File : public Stream {
+public:
+  File() {}
+  explicit File(std::shared_ptr<FileHandle> handle) : _handle(handle) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t length) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t read(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+  void flush() override;
+
+  bool seek(uint32_t position);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  operator bool() const;
+
+  const char *path() const;
+  const char *name() const;
+  bool isDirectory() const;
+  // entries of a directory in turn, an empty File after the last
+  File openNextFile();
+  void rewindDirectory();
+
+private:
+  std::shared_ptr<FileHandle> _handle;
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = FILE_READ, bool create = false);
+  File open(const String &path, const char *mode = FILE_READ, bool create = false) {
+    return open(path.c_str(), mode, create);
+  }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char *path);
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  bool rmdir(const char *path);
+
+  // mock: the host directory the card's files live in
+  void setRoot(const std::string &root) { _root = root; }
+  const std::string &root() const { return _root; }
+  std::string hostPath(const char *path) const;
+
+protected:
+  std::string _root = ".";
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+
+// a new empty directory under $TMPDIR for a test to keep files in
+std::string mockTempDir(const char *name);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __MOCK_PREFERENCES_H__
+#define __MOCK_PREFERENCES_H__
+
+// NVS preferences in memory. values outlive the Preferences object like
+// they outlive a reboot on the device, mockPreferencesErase() wipes them
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putUChar(const char *key, uint8_t value) { return put(key, &value, sizeof(value)); }
+  size_t putBool(const char *key, bool value) { return put(key, &value, sizeof(value)); }
+  size_t putInt(const char *key, int32_t value) { return put(key, &value, sizeof(value)); }
+  size_t putUInt(const char *key, uint32_t value) { return put(key, &value, sizeof(value)); }
+  size_t putULong64(const char *key, uint64_t value) { return put(key, &value, sizeof(value)); }
+  size_t putString(const char *key, const char *value) { return put(key, value, strlen(value)); }
+  size_t putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+  size_t putBytes(const char *key, const void *value, size_t length) { return put(key, value, length); }
+
+  uint8_t getUChar(const char *key, uint8_t value = 0) { return get(key, value); }
+  bool getBool(const char *key, bool value = false) { return get(key, value); }
+  int32_t getInt(const char *key, int32_t value = 0) { return get(key, value); }
+  uint32_t getUInt(const char *key, uint32_t value = 0) { return get(key, value); }
+  uint64_t getULong64(const char *key, uint64_t value = 0) { return get(key, value); }
+  String getString(const char *key, const String &value = String());
+  size_t getString(const char *key, char *value, size_t length);
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *value, size_t length);
+
+private:
+  size_t put(const char *key, const void *value, size_t length);
+  template <typename T>
+  T get(const char *key, T value) {
+    getBytes(key, &value, sizeof(value));
+    return value;
+  }
+
+  std::string _name;
+  bool _readOnly = false;
+  bool _open = false;
+};
+
+void mockPreferencesErase();
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __MOCK_SD_H__
+#define __MOCK_SD_H__
+
+// the SD card as a host directory, see FS.h. begin() fails while the card
+// is pulled with setInserted(false)
+
+#include <FS.h>
+
+typedef enum {
+  CARD_NONE,
+  CARD_MMC,
+  CARD_SD,
+  CARD_SDHC,
+  CARD_UNKNOWN
+} sdcard_type_t;
+
+class SDFS : public fs::FS {
+public:
+  bool begin(uint8_t csPin = 5) {
+    (void)csPin;
+    return _inserted;
+  }
+  void end() {}
+  sdcard_type_t cardType() { return _inserted ? CARD_SDHC : CARD_NONE; }
+  uint64_t cardSize() { return _inserted ? 16ULL << 30 : 0; }
+  uint64_t totalBytes() { return cardSize(); }
+  uint64_t usedBytes();
+
+  void setInserted(bool inserted) { _inserted = inserted; }
+
+private:
+  bool _inserted = true;
+};
+
+extern SDFS SD;
+
+#endif
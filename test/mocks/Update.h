@@ -0,0 +1,54 @@
+#ifndef __MOCK_UPDATE_H__
+#define __MOCK_UPDATE_H__
+
+// the OTA partition writer, collecting the image in memory. failAt() makes
+// a write at that offset fail the way a flash error would
+
+#include <Arduino.h>
+#include <vector>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+#define UPDATE_ERROR_OK       0
+#define UPDATE_ERROR_WRITE    1
+#define UPDATE_ERROR_SIZE     4
+#define UPDATE_ERROR_SPACE    5
+#define UPDATE_ERROR_ABORT    8
+#define UPDATE_ERROR_BAD_SIZE 13
+
+#define UPDATE_PARTITION_SIZE (6 * 1024 * 1024)  // ota_0/ota_1 in default_16MB.csv
+
+class UpdateClass {
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN);
+  size_t write(uint8_t *data, size_t length);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+
+  bool isRunning() const { return _running; }
+  bool isFinished() const { return _finished; }
+  bool hasError() const { return _error != UPDATE_ERROR_OK; }
+  uint8_t getError() const { return _error; }
+  const char *errorString() const;
+  void printError(Print &out) { out.println(errorString()); }
+  size_t size() const { return _size; }
+  size_t progress() const { return _image.size(); }
+  size_t remaining() const { return _size - _image.size(); }
+
+  // mock: what has been written so far, and the offset to fail at
+  const std::vector<uint8_t> &image() const { return _image; }
+  void failAt(size_t offset) { _failAt = offset; }
+  void reset();
+
+private:
+  std::vector<uint8_t> _image;
+  size_t _size = 0;
+  size_t _failAt = (size_t)-1;
+  uint8_t _error = UPDATE_ERROR_OK;
+  bool _running = false;
+  bool _finished = false;
+};
+
+extern UpdateClass Update;
+
+#endif
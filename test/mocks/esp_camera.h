@@ -0,0 +1,78 @@
+#ifndef __MOCK_ESP_CAMERA_H__
+#define __MOCK_ESP_CAMERA_H__
+
+// the esp32-camera driver with frames queued by the test.
+// esp_camera_fb_get() hands them out in order and NULL once they run out,
+// like a capture timeout; esp_camera_fb_return() frees them
+
+#include <Arduino.h>
+
+typedef enum {
+  PIXFORMAT_RGB565,
+  PIXFORMAT_YUV422,
+  PIXFORMAT_YUV420,
+  PIXFORMAT_GRAYSCALE,
+  PIXFORMAT_JPEG,
+  PIXFORMAT_RGB888,
+  PIXFORMAT_RAW,
+  PIXFORMAT_RGB444,
+  PIXFORMAT_RGB555,
+} pixformat_t;
+
+typedef enum {
+  FRAMESIZE_96X96,
+  FRAMESIZE_QQVGA,
+  FRAMESIZE_QCIF,
+  FRAMESIZE_HQVGA,
+  FRAMESIZE_240X240,
+  FRAMESIZE_QVGA,
+  FRAMESIZE_CIF,
+  FRAMESIZE_HVGA,
+  FRAMESIZE_VGA,
+  FRAMESIZE_SVGA,
+  FRAMESIZE_XGA,
+  FRAMESIZE_HD,
+  FRAMESIZE_SXGA,
+  FRAMESIZE_UXGA,
+  FRAMESIZE_INVALID
+} framesize_t;
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  pixformat_t format;
+  struct {
+    long tv_sec;
+    long tv_usec;
+  } timestamp;
+} camera_fb_t;
+
+typedef struct _sensor sensor_t;
+struct _sensor {
+  framesize_t framesize;
+  int quality;
+  int (*set_framesize)(sensor_t *sensor, framesize_t framesize);
+  int (*set_quality)(sensor_t *sensor, int quality);
+  int (*set_brightness)(sensor_t *sensor, int level);
+  int (*set_saturation)(sensor_t *sensor, int level);
+  int (*set_contrast)(sensor_t *sensor, int level);
+  int (*set_vflip)(sensor_t *sensor, int enable);
+  int (*set_hmirror)(sensor_t *sensor, int enable);
+};
+
+camera_fb_t *esp_camera_fb_get();
+void esp_camera_fb_return(camera_fb_t *fb);
+sensor_t *esp_camera_sensor_get();
+
+// mock: queue a copy of a JPEG frame, drop everything queued
+void mockCameraQueue(const uint8_t *jpeg, size_t length, size_t width, size_t height);
+void mockCameraClear();
+size_t mockCameraQueued();
+
+#endif
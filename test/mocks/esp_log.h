@@ -0,0 +1,37 @@
+#ifndef __MOCK_ESP_LOG_H__
+#define __MOCK_ESP_LOG_H__
+
+// esp_log on the host. messages go through the same vprintf hook the SD
+// log installs on the device, stdout by default. the level starts at
+// ESP_LOG_NONE so tests run quiet, MOCK_LOG_LEVEL=3 in the environment
+// shows ESP_LOGI and up
+
+#include <stdarg.h>
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+typedef int (*vprintf_like_t)(const char *format, va_list args);
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+unsigned long esp_log_timestamp();
+
+#define ESP_LOG_MOCK(level, letter, tag, format, ...) \
+  esp_log_write(level, tag, letter " (%lu) %s: " format "\n", esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_MOCK(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_MOCK(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_MOCK(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_MOCK(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_MOCK(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+
+#endif
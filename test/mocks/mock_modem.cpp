@@ -0,0 +1,424 @@
+#include "mock_modem.h"
+
+static const char *const IMEI = "864764030000001";
+
+#define FTP_ERROR 9          // transfer failed
+#define FTP_NOT_LOGGED_IN 13
+
+// "e:/photo.jpg", "/photo.jpg" and "photo.jpg" are the same EFS file
+static std::string efsName(std::string path) {
+  if (path.size() >= 2 && (path[0] == 'e' || path[0] == 'E') && path[1] == ':') path = path.substr(2);
+  size_t start = path.find_first_not_of('/');
+  return start == std::string::npos ? "" : path.substr(start);
+}
+
+static std::string unquote(const std::string &text) {
+  if (text.size() >= 2 && text.front() == '"' && text.back() == '"') return text.substr(1, text.size() - 2);
+  return text;
+}
+
+// "+CNMP=38,\"a,b\"" to its arguments, ',' inside quotes belongs to the argument
+static std::vector<std::string> splitArgs(const std::string &text) {
+  std::vector<std::string> args;
+  std::string current;
+  bool quoted = false;
+  for (char c : text) {
+    if (c == '"') quoted = !quoted;
+    if (c == ',' && !quoted) {
+      args.push_back(current);
+      current.clear();
+    } else {
+      current += c;
+    }
+  }
+  args.push_back(current);
+  return args;
+}
+
+MockModem::MockModem() {
+  reset();
+}
+
+void MockModem::reset() {
+  echo = false;
+  lines.clear();
+  commands.clear();
+  efs.clear();
+  puts.clear();
+  unknown = 0;
+  bytesIn = 0;
+  bytesOut = 0;
+  ftpStarted = false;
+  ftpLoggedIn = false;
+  httpStarted = false;
+  _input.clear();
+  _afterReturn = false;
+  _output.clear();
+  _outputOffset = 0;
+  _dataRemaining = 0;
+  _dataName.clear();
+  _data.clear();
+  _replies.clear();
+  _failures.clear();
+  _silences.clear();
+  _ftpResults.clear();
+  _www.clear();
+  _httpUrl.clear();
+  _httpBody = NULL;
+  _readWindowLimit = 0;
+  _readLimit = 0;
+  _writeLimit = 0;
+  _stallAfter = (size_t)-1;
+}
+
+void MockModem::reply(const char *prefix, const char *text) {
+  _replies.insert(_replies.begin(), std::make_pair(std::string(prefix), std::string(text)));
+}
+
+void MockModem::fail(const char *prefix, unsigned count) {
+  _failures.push_back({prefix, count});
+}
+
+void MockModem::silence(const char *prefix, unsigned count) {
+  _silences.push_back({prefix, count});
+}
+
+void MockModem::ftpResult(int code, unsigned count) {
+  _ftpResults.insert(_ftpResults.end(), count, code);
+}
+
+void MockModem::urc(const char *text) {
+  line(text);
+}
+
+void MockModem::rejectData() {
+  if (_dataRemaining == 0) return;
+  _dataRemaining = 0;
+  // the modem keeps the bytes that arrived as a partial file
+  efs[_dataName] = _data;
+  _data.clear();
+  line("ERROR");
+}
+
+void MockModem::serve(const char *url, const uint8_t *body, size_t length) {
+  _www[url].assign(body, body + length);
+}
+
+int MockModem::available() {
+  size_t count = _output.size() - _outputOffset;
+  if (_readLimit > 0 && count > _readLimit) count = _readLimit;
+  return (int)count;
+}
+
+int MockModem::read() {
+  if (_outputOffset == _output.size()) return -1;
+  bytesOut++;
+  return (uint8_t)_output[_outputOffset++];
+}
+
+int MockModem::peek() {
+  if (_outputOffset == _output.size()) return -1;
+  return (uint8_t)_output[_outputOffset];
+}
+
+size_t MockModem::readBytes(char *buffer, size_t length) {
+  size_t count = std::min(length, (size_t)available());
+  memcpy(buffer, _output.data() + _outputOffset, count);
+  _outputOffset += count;
+  bytesOut += count;
+  if (_outputOffset == _output.size()) {
+    _output.clear();
+    _outputOffset = 0;
+  }
+  return count;
+}
+
+size_t MockModem::write(const uint8_t *data, size_t length) {
+  if (_writeLimit > 0 && length > _writeLimit) length = _writeLimit;
+  if (bytesIn >= _stallAfter) return 0;
+  if (length > _stallAfter - bytesIn) length = _stallAfter - bytesIn;
+  bytesIn += length;
+
+  for (size_t i = 0; i < length; i++) {
+    // the '\n' after a command's '\r' isn't data even when it opened a data phase
+    bool newline = _afterReturn && data[i] == '\n';
+    _afterReturn = false;
+    if (newline) continue;
+    if (_dataRemaining > 0) {
+      // +CFTRANRX data phase, the modem answers once it has it all
+      size_t count = std::min(_dataRemaining, length - i);
+      _data.insert(_data.end(), data + i, data + i + count);
+      _dataRemaining -= count;
+      i += count - 1;
+      if (_dataRemaining == 0) {
+        efs[_dataName] = _data;
+        _data.clear();
+        line("OK");
+      }
+      continue;
+    }
+    char c = (char)data[i];
+    if (c == '\r') {
+      _afterReturn = true;
+      std::string text = _input;
+      _input.clear();
+      size_t start = text.find_first_not_of("\n ");
+      if (start != std::string::npos) commandLine(text.substr(start));
+    } else {
+      _input += c;
+    }
+  }
+  return length;
+}
+
+void MockModem::line(const std::string &text) {
+  _output += "\r\n";
+  _output += text;
+  _output += "\r\n";
+}
+
+bool MockModem::take(std::vector<Script> &scripts, const std::string &command) {
+  for (size_t i = 0; i < scripts.size(); i++) {
+    if (command.compare(0, scripts[i].prefix.size(), scripts[i].prefix) == 0) {
+      if (--scripts[i].count == 0) scripts.erase(scripts.begin() + i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void MockModem::commandLine(const std::string &input) {
+  // like the real one it skips anything before the AT prefix, and a line
+  // without one (data sent after the modem left data mode) gets no answer
+  size_t prefix = 0;
+  while (prefix + 1 < input.size() && strncasecmp(input.c_str() + prefix, "AT", 2) != 0) prefix++;
+  if (prefix + 1 >= input.size()) return;
+  std::string text = input.substr(prefix);
+  lines.push_back(text);
+  if (echo) _output += text + "\r";
+
+  // split at ';' outside quotes
+  std::vector<std::string> split;
+  std::string current;
+  bool quoted = false;
+  for (size_t i = 2; i < text.size(); i++) {
+    char c = text[i];
+    if (c == '"') quoted = !quoted;
+    if (c == ';' && !quoted) {
+      split.push_back(current);
+      current.clear();
+    } else {
+      current += c;
+    }
+  }
+  split.push_back(current);
+
+  std::vector<std::string> replies;
+  std::string later;
+  bool ok = true;
+  for (const std::string &command : split) {
+    if (command.empty() && split.size() > 1) continue;
+    commands.push_back(command);
+    if (take(_silences, command)) return;
+    if (take(_failures, command) || !execute(command, replies, later)) {
+      ok = false;
+      break;
+    }
+    // +CFTRANRX switched to data mode, nothing more on this line
+    if (_dataRemaining > 0) break;
+  }
+  for (const std::string &reply : replies) line(reply);
+  if (_dataRemaining > 0 && ok) {
+    _output += "\r\n>";
+    return;
+  }
+  line(ok ? "OK" : "ERROR");
+  if (ok) _output += later;
+}
+
+bool MockModem::execute(const std::string &command, std::vector<std::string> &replies, std::string &later) {
+  for (const auto &scripted : _replies) {
+    if (command.compare(0, scripted.first.size(), scripted.first) == 0) {
+      size_t start = 0;
+      while (start <= scripted.second.size()) {
+        size_t end = scripted.second.find('\n', start);
+        if (end == std::string::npos) end = scripted.second.size();
+        if (end > start) replies.push_back(scripted.second.substr(start, end - start));
+        start = end + 1;
+      }
+      return true;
+    }
+  }
+
+  std::string name = command;
+  std::string kind;
+  std::vector<std::string> args;
+  size_t equals = command.find('=');
+  if (!command.empty() && command.back() == '?' && (equals == std::string::npos || equals == command.size() - 2)) {
+    name = command.substr(0, equals == std::string::npos ? command.size() - 1 : equals);
+    kind = equals == std::string::npos ? "?" : "=?";
+  } else if (equals != std::string::npos) {
+    name = command.substr(0, equals);
+    kind = "=";
+    args = splitArgs(command.substr(equals + 1));
+  }
+  for (char &c : name) c = toupper((unsigned char)c);
+  char text[96];
+
+  if (name == "" || name == "Z" || name == "&W") return true;
+  if (name == "E0" || name == "E1") {
+    echo = name == "E1";
+    return true;
+  }
+  if (name == "+CGSN") {
+    replies.push_back(IMEI);
+    return true;
+  }
+  if (name == "+CSQ") {
+    replies.push_back("+CSQ: 20,99");
+    return true;
+  }
+  if (name == "+CREG") {
+    if (kind == "?") replies.push_back("+CREG: 0,1");
+    return true;
+  }
+  if (name == "+CPSI") {
+    replies.push_back("+CPSI: LTE,Online,655-01,0x1234,12345678,256,EUTRAN-BAND3,1300,5,5,-100,-700,-700,10");
+    return true;
+  }
+  if (name == "+CBC") {
+    replies.push_back("+CBC: 4.000V");
+    return true;
+  }
+  if (name == "+CCLK") {
+    if (kind == "?") replies.push_back("+CCLK: \"26/10/16,12:00:00+00\"");
+    return true;
+  }
+
+  // EFS
+  if (name == "+FSCD") {
+    replies.push_back("+FSCD: E:/");
+    return true;
+  }
+  if (name == "+FSLS") {
+    replies.push_back("+FSLS: SUBDIRECTORIES:");
+    replies.push_back("..");
+    replies.push_back("+FSLS: FILES:");
+    for (const auto &file : efs) replies.push_back(file.first);
+    return true;
+  }
+  if (name == "+FSDEL") {
+    std::string file = efsName(unquote(args.empty() ? "" : args[0]));
+    if (file == "*.*") {
+      efs.clear();
+      return true;
+    }
+    return efs.erase(file) > 0;
+  }
+  if (name == "+CFTRANRX") {
+    if (args.size() < 2) return false;
+    _dataName = efsName(unquote(args[0]));
+    _dataRemaining = strtoul(args[1].c_str(), NULL, 10);
+    _data.clear();
+    if (_dataRemaining == 0) {
+      efs[_dataName].clear();
+    }
+    return true;
+  }
+
+  // FTPS, results come as URCs after the OK
+  if (name == "+CFTPSSTART") {
+    if (ftpStarted) return false;
+    ftpStarted = true;
+    later += "\r\n+CFTPSSTART: 0\r\n";
+    return true;
+  }
+  if (name == "+CFTPSSTOP") {
+    ftpStarted = false;
+    ftpLoggedIn = false;
+    later += "\r\n+CFTPSSTOP: 0\r\n";
+    return true;
+  }
+  if (name == "+CFTPSLOGIN") {
+    if (!ftpStarted) return false;
+    ftpLoggedIn = true;
+    later += "\r\n+CFTPSLOGIN: 0\r\n";
+    return true;
+  }
+  if (name == "+CFTPSLOGOUT") {
+    snprintf(text, sizeof(text), "\r\n+CFTPSLOGOUT: %d\r\n", ftpLoggedIn ? 0 : FTP_NOT_LOGGED_IN);
+    ftpLoggedIn = false;
+    later += text;
+    return true;
+  }
+  if (name == "+CFTPSPWD") {
+    if (!ftpLoggedIn) return false;
+    replies.push_back("+CFTPSPWD: \"/\"");
+    return true;
+  }
+  if (name == "+CFTPSPUTFILE") {
+    std::string file = efsName(unquote(args.empty() ? "" : args[0]));
+    int code = 0;
+    if (!ftpLoggedIn) {
+      code = FTP_NOT_LOGGED_IN;
+    } else if (efs.find(file) == efs.end()) {
+      code = FTP_ERROR;
+    } else if (!_ftpResults.empty()) {
+      code = _ftpResults.front();
+      _ftpResults.erase(_ftpResults.begin());
+    }
+    if (code == 0) puts.push_back(file);
+    snprintf(text, sizeof(text), "\r\n+CFTPSPUTFILE: %d\r\n", code);
+    later += text;
+    return true;
+  }
+
+  // HTTP
+  if (name == "+HTTPINIT") {
+    if (httpStarted) return false;
+    httpStarted = true;
+    _httpBody = NULL;
+    return true;
+  }
+  if (name == "+HTTPTERM") {
+    if (!httpStarted) return false;
+    httpStarted = false;
+    return true;
+  }
+  if (name == "+HTTPPARA") {
+    if (!httpStarted) return false;
+    if (args.size() >= 2 && unquote(args[0]) == "URL") _httpUrl = unquote(args[1]);
+    return true;
+  }
+  if (name == "+HTTPACTION") {
+    if (!httpStarted) return false;
+    auto body = _www.find(_httpUrl);
+    _httpBody = body == _www.end() ? NULL : &body->second;
+    snprintf(text, sizeof(text), "\r\n+HTTPACTION: 0,%d,%u\r\n", _httpBody ? 200 : 404,
+             _httpBody ? (unsigned)_httpBody->size() : 0);
+    later += text;
+    return true;
+  }
+  if (name == "+HTTPREAD") {
+    if (!httpStarted) return false;
+    size_t size = _httpBody ? _httpBody->size() : 0;
+    if (kind == "?") {
+      snprintf(text, sizeof(text), "+HTTPREAD: LEN,%u", (unsigned)size);
+      replies.push_back(text);
+      return true;
+    }
+    if (args.size() < 2) return false;
+    size_t offset = std::min((size_t)strtoul(args[0].c_str(), NULL, 10), size);
+    size_t length = std::min((size_t)strtoul(args[1].c_str(), NULL, 10), size - offset);
+    if (_readWindowLimit > 0 && length > _readWindowLimit) length = _readWindowLimit;
+    // OK first, then the window
+    snprintf(text, sizeof(text), "\r\n+HTTPREAD: DATA,%u\r\n", (unsigned)length);
+    later += text;
+    if (length > 0) later.append((const char *)_httpBody->data() + offset, length);
+    later += "\r\n+HTTPREAD: 0\r\n";
+    return true;
+  }
+
+  unknown++;
+  return true;
+}
@@ -0,0 +1,104 @@
+#ifndef __MOCK_MODEM_H__
+#define __MOCK_MODEM_H__
+
+// scripted SIM7600 on the other end of the modem stream, the host side of
+// the TinyGsm SerialAT the firmware talks to. answers the AT subset the
+// modules use the way tools/sim7600_emulator.py does, without its timing:
+// commands chained with ';' get one final OK, results that arrive as URCs
+// on the modem (+CFTPSLOGIN: 0, +HTTPACTION: ...) follow straight after
+// it, +CFTRANRX takes its data phase into an in-memory EFS and +HTTPREAD
+// serves bodies registered with serve(). tests script failures on top
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class MockModem : public Stream {
+public:
+  MockModem();
+
+  // firmware side
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t length) override;
+  using Print::write;
+
+  // back to a freshly booted modem with an empty EFS and no scripting
+  void reset();
+
+  // answer commands starting with prefix ("+CSQ", "+CREG?") with these
+  // lines instead, "\n" separated, until reset()
+  void reply(const char *prefix, const char *lines);
+  // the next count commands starting with prefix answer ERROR
+  void fail(const char *prefix, unsigned count = 1);
+  // the next count commands starting with prefix are never answered
+  void silence(const char *prefix, unsigned count = 1);
+  // result code of the next count +CFTPSPUTFILE uploads
+  void ftpResult(int code, unsigned count = 1);
+  // send an unsolicited line now
+  void urc(const char *line);
+  // give up on a +CFTRANRX data phase part way: ERROR, back in command
+  // mode, with what arrived left in EFS as a partial file
+  void rejectData();
+  // body +HTTPACTION returns for url, 404 for anything not served
+  void serve(const char *url, const uint8_t *body, size_t length);
+  // most bytes one +HTTPREAD window carries, 0 for no limit
+  void setReadWindowLimit(size_t length) { _readWindowLimit = length; }
+  // most bytes readBytes() hands out per call, 0 for no limit
+  void setReadLimit(size_t length) { _readLimit = length; }
+  // most bytes write() takes per call, 0 for no limit
+  void setWriteLimit(size_t length) { _writeLimit = length; }
+  // write() takes nothing more once this many bytes came in, -1 for never
+  void stallAfter(size_t bytes) { _stallAfter = bytes; }
+
+  bool echo;                                           // E1/E0
+  bool inDataMode() const { return _dataRemaining > 0; }
+  std::vector<std::string> lines;                      // command lines as sent, "AT" included
+  std::vector<std::string> commands;                   // single commands, split at ';'
+  std::map<std::string, std::vector<uint8_t>> efs;     // EFS files by bare name
+  std::vector<std::string> puts;                       // files uploaded over FTP, in order
+  uint32_t unknown;                                    // commands answered with a plain OK
+  size_t bytesIn;
+  size_t bytesOut;
+  bool ftpStarted;
+  bool ftpLoggedIn;
+  bool httpStarted;
+
+private:
+  struct Script {
+    std::string prefix;
+    unsigned count;
+  };
+
+  void commandLine(const std::string &input);
+  // false for ERROR; immediate lines go into replies, URC style results
+  // and payload into later
+  bool execute(const std::string &command, std::vector<std::string> &replies, std::string &later);
+  bool take(std::vector<Script> &scripts, const std::string &command);
+  void line(const std::string &text);
+
+  std::string _input;
+  bool _afterReturn;
+  std::string _output;
+  size_t _outputOffset;
+  size_t _dataRemaining;
+  std::string _dataName;
+  std::vector<uint8_t> _data;
+  std::vector<std::pair<std::string, std::string>> _replies;
+  std::vector<Script> _failures;
+  std::vector<Script> _silences;
+  std::vector<int> _ftpResults;
+  std::map<std::string, std::vector<uint8_t>> _www;
+  std::string _httpUrl;
+  const std::vector<uint8_t> *_httpBody;
+  size_t _readWindowLimit;
+  size_t _readLimit;
+  size_t _writeLimit;
+  size_t _stallAfter;
+};
+
+#endif
@@ -0,0 +1,540 @@
+// host implementations behind the headers in this directory
+
+#include <Arduino.h>
+#include <FS.h>
+#include <Preferences.h>
+#include <SD.h>
+#include <Update.h>
+#include <esp_camera.h>
+#include <esp_log.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// clock
+
+static const auto clockStart = std::chrono::steady_clock::now();
+static std::atomic<unsigned long> clockSkippedMs(0);
+static std::atomic<bool> clockRealTime(false);
+
+unsigned long millis() {
+  auto elapsed = std::chrono::steady_clock::now() - clockStart;
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() + clockSkippedMs;
+}
+
+unsigned long micros() {
+  auto elapsed = std::chrono::steady_clock::now() - clockStart;
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() +
+         clockSkippedMs * 1000UL;
+}
+
+void delay(unsigned long ms) {
+  if (clockRealTime) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    return;
+  }
+  clockSkippedMs += ms;
+}
+
+void yield() {}
+
+void mockClockAdvance(unsigned long ms) {
+  clockSkippedMs += ms;
+}
+
+void mockClockRealTime(bool on) {
+  clockRealTime = on;
+}
+
+void *ps_malloc(size_t size) {
+  return malloc(size);
+}
+
+void *ps_calloc(size_t count, size_t size) {
+  return calloc(count, size);
+}
+
+bool psramFound() {
+  return true;
+}
+
+// Print, Stream, String, Serial
+
+size_t Print::write(const uint8_t *data, size_t length) {
+  size_t count = 0;
+  while (count < length && write(data[count]) == 1) count++;
+  return count;
+}
+
+size_t Print::printf(const char *format, ...) {
+  char small[128];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (length < 0) return 0;
+  if ((size_t)length < sizeof(small)) return write((const uint8_t *)small, length);
+
+  std::vector<char> large(length + 1);
+  va_start(args, format);
+  vsnprintf(large.data(), large.size(), format, args);
+  va_end(args);
+  return write((const uint8_t *)large.data(), length);
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length && available() > 0) {
+    int c = read();
+    if (c < 0) break;
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+void String::trim() {
+  size_t start = _text.find_first_not_of(" \t\r\n");
+  size_t end = _text.find_last_not_of(" \t\r\n");
+  _text = start == std::string::npos ? "" : _text.substr(start, end - start + 1);
+}
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length) {
+  if (_echo) fwrite(data, 1, length, stdout);
+  return length;
+}
+
+// files
+
+namespace fs {
+
+struct FileHandle {
+  std::string path;   // on the card
+  std::string name;   // last component
+  FILE *file = NULL;
+  DIR *dir = NULL;
+  std::string hostPath;
+  FS *fs = NULL;      // that opened it
+
+  ~FileHandle() {
+    if (file) fclose(file);
+    if (dir) closedir(dir);
+  }
+};
+
+size_t File::write(const uint8_t *data, size_t length) {
+  if (!_handle || !_handle->file) return 0;
+  return fwrite(data, 1, length, _handle->file);
+}
+
+int File::available() {
+  if (!_handle || !_handle->file) return 0;
+  return (int)(size() - position());
+}
+
+int File::read() {
+  if (!_handle || !_handle->file) return -1;
+  return fgetc(_handle->file);
+}
+
+int File::peek() {
+  if (!_handle || !_handle->file) return -1;
+  int c = fgetc(_handle->file);
+  if (c != EOF) ungetc(c, _handle->file);
+  return c;
+}
+
+size_t File::readBytes(char *buffer, size_t length) {
+  if (!_handle || !_handle->file) return 0;
+  return fread(buffer, 1, length, _handle->file);
+}
+
+void File::flush() {
+  if (_handle && _handle->file) fflush(_handle->file);
+}
+
+bool File::seek(uint32_t position) {
+  return _handle && _handle->file && fseek(_handle->file, position, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  if (!_handle || !_handle->file) return 0;
+  long position = ftell(_handle->file);
+  return position < 0 ? 0 : (size_t)position;
+}
+
+size_t File::size() const {
+  if (!_handle || !_handle->file) return 0;
+  fflush(_handle->file);
+  struct stat info;
+  return fstat(fileno(_handle->file), &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+void File::close() {
+  _handle.reset();
+}
+
+File::operator bool() const {
+  return _handle && (_handle->file || _handle->dir);
+}
+
+const char *File::path() const {
+  return _handle ? _handle->path.c_str() : "";
+}
+
+const char *File::name() const {
+  return _handle ? _handle->name.c_str() : "";
+}
+
+bool File::isDirectory() const {
+  return _handle && _handle->dir;
+}
+
+File File::openNextFile() {
+  if (!_handle || !_handle->dir) return File();
+  struct dirent *entry;
+  while ((entry = readdir(_handle->dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    std::string path = _handle->path;
+    if (path.empty() || path.back() != '/') path += '/';
+    path += entry->d_name;
+    return _handle->fs->open(path.c_str(), FILE_READ);
+  }
+  return File();
+}
+
+void File::rewindDirectory() {
+  if (_handle && _handle->dir) rewinddir(_handle->dir);
+}
+
+std::string FS::hostPath(const char *path) const {
+  std::string host = _root;
+  if (path[0] != '/') host += '/';
+  return host + path;
+}
+
+File FS::open(const char *path, const char *mode, bool create) {
+  (void)create;
+  auto handle = std::make_shared<FileHandle>();
+  handle->path = path;
+  const char *slash = strrchr(path, '/');
+  handle->name = slash ? slash + 1 : path;
+  handle->hostPath = hostPath(path);
+  handle->fs = this;
+
+  struct stat info;
+  if (strcmp(mode, FILE_READ) == 0 && stat(handle->hostPath.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+    handle->dir = opendir(handle->hostPath.c_str());
+  } else {
+    const char *hostMode = strcmp(mode, FILE_WRITE) == 0 ? "wb" : strcmp(mode, FILE_APPEND) == 0 ? "ab" : "rb";
+    handle->file = fopen(handle->hostPath.c_str(), hostMode);
+  }
+  if (!handle->file && !handle->dir) return File();
+  return File(handle);
+}
+
+bool FS::exists(const char *path) {
+  struct stat info;
+  return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char *path) {
+  return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool FS::rmdir(const char *path) {
+  return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+}  // namespace fs
+
+std::string mockTempDir(const char *name) {
+  const char *base = getenv("TMPDIR");
+  std::string pattern = std::string(base && base[0] ? base : "/tmp") + "/" + name + ".XXXXXX";
+  std::vector<char> path(pattern.begin(), pattern.end());
+  path.push_back('\0');
+  if (mkdtemp(path.data()) == NULL) return "";
+  return path.data();
+}
+
+SDFS SD;
+
+uint64_t SDFS::usedBytes() {
+  uint64_t used = 0;
+  DIR *dir = opendir(_root.c_str());
+  if (!dir) return 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    struct stat info;
+    std::string path = _root + "/" + entry->d_name;
+    if (stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) used += info.st_size;
+  }
+  closedir(dir);
+  return used;
+}
+
+// preferences
+
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>> preferenceStore;
+
+void mockPreferencesErase() {
+  preferenceStore.clear();
+}
+
+bool Preferences::begin(const char *name, bool readOnly) {
+  _name = name;
+  _readOnly = readOnly;
+  _open = true;
+  return true;
+}
+
+void Preferences::end() {
+  _open = false;
+}
+
+bool Preferences::clear() {
+  if (!_open || _readOnly) return false;
+  preferenceStore[_name].clear();
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  if (!_open || _readOnly) return false;
+  return preferenceStore[_name].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key) {
+  return _open && preferenceStore[_name].count(key) > 0;
+}
+
+size_t Preferences::put(const char *key, const void *value, size_t length) {
+  if (!_open || _readOnly) return 0;
+  const uint8_t *bytes = (const uint8_t *)value;
+  preferenceStore[_name][key].assign(bytes, bytes + length);
+  return length;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  if (!isKey(key)) return 0;
+  return preferenceStore[_name][key].size();
+}
+
+size_t Preferences::getBytes(const char *key, void *value, size_t length) {
+  if (!isKey(key)) return 0;
+  const std::vector<uint8_t> &stored = preferenceStore[_name][key];
+  // a value of another size was stored under another type, like NVS refuses it
+  if (stored.size() > length) return 0;
+  memcpy(value, stored.data(), stored.size());
+  return stored.size();
+}
+
+String Preferences::getString(const char *key, const String &value) {
+  if (!isKey(key)) return value;
+  const std::vector<uint8_t> &stored = preferenceStore[_name][key];
+  return String(std::string(stored.begin(), stored.end()));
+}
+
+size_t Preferences::getString(const char *key, char *value, size_t length) {
+  if (!isKey(key) || length == 0) return 0;
+  const std::vector<uint8_t> &stored = preferenceStore[_name][key];
+  if (stored.size() + 1 > length) return 0;
+  memcpy(value, stored.data(), stored.size());
+  value[stored.size()] = '\0';
+  return stored.size() + 1;
+}
+
+// OTA
+
+UpdateClass Update;
+
+bool UpdateClass::begin(size_t size) {
+  if (_running) {
+    _error = UPDATE_ERROR_BAD_SIZE;
+    return false;
+  }
+  _image.clear();
+  _finished = false;
+  if (size == 0) {
+    _error = UPDATE_ERROR_SIZE;
+    return false;
+  }
+  if (size != UPDATE_SIZE_UNKNOWN && size > UPDATE_PARTITION_SIZE) {
+    _error = UPDATE_ERROR_SPACE;
+    return false;
+  }
+  _size = size == UPDATE_SIZE_UNKNOWN ? UPDATE_PARTITION_SIZE : size;
+  _error = UPDATE_ERROR_OK;
+  _running = true;
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t *data, size_t length) {
+  if (!_running || hasError()) return 0;
+  if (length > remaining()) {
+    _error = UPDATE_ERROR_SPACE;
+    return 0;
+  }
+  if (_failAt >= _image.size() && _failAt < _image.size() + length) {
+    _error = UPDATE_ERROR_WRITE;
+    return 0;
+  }
+  _image.insert(_image.end(), data, data + length);
+  return length;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+  if (!_running || hasError()) return false;
+  if (!evenIfRemaining && remaining() > 0) {
+    _error = UPDATE_ERROR_SIZE;
+    return false;
+  }
+  _running = false;
+  _finished = true;
+  return true;
+}
+
+void UpdateClass::abort() {
+  _running = false;
+  _error = UPDATE_ERROR_ABORT;
+}
+
+const char *UpdateClass::errorString() const {
+  switch (_error) {
+    case UPDATE_ERROR_OK: return "No Error";
+    case UPDATE_ERROR_WRITE: return "Flash Write Failed";
+    case UPDATE_ERROR_SIZE: return "Bad Size Given";
+    case UPDATE_ERROR_SPACE: return "Not Enough Space";
+    case UPDATE_ERROR_ABORT: return "Update Aborted";
+    default: return "Unknown Error";
+  }
+}
+
+void UpdateClass::reset() {
+  _image.clear();
+  _size = 0;
+  _failAt = (size_t)-1;
+  _error = UPDATE_ERROR_OK;
+  _running = false;
+  _finished = false;
+}
+
+// camera
+
+static std::deque<camera_fb_t *> cameraFrames;
+
+static int sensorSet(sensor_t *sensor, int value) {
+  (void)sensor;
+  (void)value;
+  return 0;
+}
+
+static int sensorSetFramesize(sensor_t *sensor, framesize_t framesize) {
+  sensor->framesize = framesize;
+  return 0;
+}
+
+static int sensorSetQuality(sensor_t *sensor, int quality) {
+  sensor->quality = quality;
+  return 0;
+}
+
+static sensor_t cameraSensor = {FRAMESIZE_UXGA, 12, sensorSetFramesize, sensorSetQuality,
+                                sensorSet, sensorSet, sensorSet, sensorSet, sensorSet};
+
+camera_fb_t *esp_camera_fb_get() {
+  if (cameraFrames.empty()) return NULL;
+  camera_fb_t *fb = cameraFrames.front();
+  cameraFrames.pop_front();
+  unsigned long now = micros();
+  fb->timestamp.tv_sec = now / 1000000;
+  fb->timestamp.tv_usec = now % 1000000;
+  return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb) {
+  if (!fb) return;
+  free(fb->buf);
+  delete fb;
+}
+
+sensor_t *esp_camera_sensor_get() {
+  return &cameraSensor;
+}
+
+void mockCameraQueue(const uint8_t *jpeg, size_t length, size_t width, size_t height) {
+  camera_fb_t *fb = new camera_fb_t();
+  fb->buf = (uint8_t *)malloc(length);
+  memcpy(fb->buf, jpeg, length);
+  fb->len = length;
+  fb->width = width;
+  fb->height = height;
+  fb->format = PIXFORMAT_JPEG;
+  cameraFrames.push_back(fb);
+}
+
+void mockCameraClear() {
+  while (!cameraFrames.empty()) {
+    esp_camera_fb_return(cameraFrames.front());
+    cameraFrames.pop_front();
+  }
+}
+
+size_t mockCameraQueued() {
+  return cameraFrames.size();
+}
+
+// logging
+
+static std::atomic<vprintf_like_t> logOutput(vprintf);
+static std::mutex logLevelsLock;
+static std::map<std::string, esp_log_level_t> logLevels;
+
+static esp_log_level_t logDefaultLevel() {
+  const char *level = getenv("MOCK_LOG_LEVEL");
+  return level ? (esp_log_level_t)atoi(level) : ESP_LOG_NONE;
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+  return logOutput.exchange(func);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+  std::lock_guard<std::mutex> guard(logLevelsLock);
+  logLevels[tag] = level;
+}
+
+static esp_log_level_t logLevel(const char *tag) {
+  std::lock_guard<std::mutex> guard(logLevelsLock);
+  auto level = logLevels.find(tag);
+  if (level == logLevels.end()) level = logLevels.find("*");
+  if (level == logLevels.end()) level = logLevels.emplace("*", logDefaultLevel()).first;
+  return level->second;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+  if (level > logLevel(tag)) return;
+  va_list args;
+  va_start(args, format);
+  logOutput.load()(format, args);
+  va_end(args);
+}
+
+unsigned long esp_log_timestamp() {
+  return millis();
+}
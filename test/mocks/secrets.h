@@ -0,0 +1,10 @@
+#ifndef __MOCK_SECRETS_H__
+#define __MOCK_SECRETS_H__
+
+// stand-in for the untracked src/secrets.h so the host build links
+#define FTP_SERVER "ftp.example.com"
+#define FTP_PORT 21
+#define FTP_USER "camera"
+#define FTP_PASS "secret"
+
+#endif
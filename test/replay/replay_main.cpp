@@ -0,0 +1,289 @@
+// replays a directory of frames through the motion path frameHasMotion()
+// runs on the device: each JPEG goes through lumaThumbnail() (the DC only
+// decoder) and MotionDetector::update() with the config.h settings, a PGM
+// is taken as the thumbnail itself. frames run in file name order. with a
+// labels.txt in the directory ("<file> <0|1>" per line, 1 where something
+// moves, # comments) it reports precision and recall of the triggers, and
+// always the per frame decode and detect cost:
+//
+//   pio run -e replay && .pio/build/replay/program test/replay/sample
+//   .pio/build/replay/program --frames --min-recall 0.9 captures/2024-05-01
+//
+// tools/motion_sample.py writes the checked in test/replay/sample. exits 1
+// when a frame doesn't decode or --min-precision / --min-recall aren't met
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "motion.h"
+#include "thumbnail.h"
+
+struct Options {
+  const char *dir = NULL;
+  bool frames = false;
+  const char *json = NULL;
+  double minPrecision = 0;
+  double minRecall = 0;
+};
+
+static Options options;
+
+static const MotionConfig motionConfig = {
+  MOTION_NOISE_FLOOR,
+  MOTION_THRESHOLD_K,
+  MOTION_TRIGGER_PERMILLE,
+  MOTION_GLOBAL_PERMILLE,
+  MOTION_LEARN_SHIFT,
+  MOTION_WARMUP_FRAMES
+};
+
+static MotionDetector motion;
+
+static uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool endsWith(const std::string &text, const char *suffix) {
+  size_t length = strlen(suffix);
+  return text.size() >= length && strcasecmp(text.c_str() + text.size() - length, suffix) == 0;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> *out) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  uint8_t buffer[4096];
+  size_t count;
+  out->clear();
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) out->insert(out->end(), buffer, buffer + count);
+  fclose(file);
+  return true;
+}
+
+// frame size from the SOF segment, the camera driver fills this in on the device
+static bool jpegSize(const std::vector<uint8_t> &jpeg, size_t *width, size_t *height) {
+  size_t offset = 2;
+  while (offset + 9 < jpeg.size()) {
+    if (jpeg[offset] != 0xFF) return false;
+    uint8_t marker = jpeg[offset + 1];
+    size_t length = (jpeg[offset + 2] << 8) | jpeg[offset + 3];
+    if (marker >= 0xC0 && marker <= 0xC2) {
+      *height = (jpeg[offset + 5] << 8) | jpeg[offset + 6];
+      *width = (jpeg[offset + 7] << 8) | jpeg[offset + 8];
+      return true;
+    }
+    offset += 2 + length;
+  }
+  return false;
+}
+
+// binary PGM, 8-bit, no comments
+static const uint8_t *pgmPixels(const std::vector<uint8_t> &pgm, uint16_t *width, uint16_t *height) {
+  unsigned w, h, maxValue;
+  int header = 0;
+  if (sscanf((const char *)pgm.data(), "P5 %u %u %u%n", &w, &h, &maxValue, &header) != 3 || maxValue > 255) {
+    return NULL;
+  }
+  header++; // the one whitespace byte after maxval
+  if ((size_t)header + (size_t)w * h > pgm.size()) return NULL;
+  *width = w;
+  *height = h;
+  return pgm.data() + header;
+}
+
+static std::map<std::string, int> readLabels(const std::string &dir) {
+  std::map<std::string, int> labels;
+  FILE *file = fopen((dir + "/labels.txt").c_str(), "r");
+  if (!file) return labels;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    char name[200];
+    int label;
+    if (line[0] == '#' || sscanf(line, "%199s %d", name, &label) != 2) continue;
+    labels[name] = label ? 1 : 0;
+  }
+  fclose(file);
+  return labels;
+}
+
+static std::vector<std::string> frameNames(const std::string &dir) {
+  std::vector<std::string> names;
+  DIR *handle = opendir(dir.c_str());
+  if (!handle) return names;
+  while (struct dirent *entry = readdir(handle)) {
+    std::string name = entry->d_name;
+    if (endsWith(name, ".jpg") || endsWith(name, ".jpeg") || endsWith(name, ".pgm")) names.push_back(name);
+  }
+  closedir(handle);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+struct Cost {
+  std::vector<uint64_t> ns;
+
+  double mean() const {
+    uint64_t total = 0;
+    for (uint64_t value : ns) total += value;
+    return ns.empty() ? 0 : (double)total / ns.size();
+  }
+  uint64_t percentile(int percent) const {
+    if (ns.empty()) return 0;
+    std::vector<uint64_t> sorted = ns;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[std::min(sorted.size() - 1, sorted.size() * percent / 100)];
+  }
+};
+
+static void usage(const char *program) {
+  fprintf(stderr, "usage: %s [--frames] [--json FILE] [--min-precision P] [--min-recall R] DIR\n", program);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--frames") == 0) {
+      options.frames = true;
+      continue;
+    }
+    if (arg[0] != '-') {
+      options.dir = arg;
+      continue;
+    }
+    if (value == NULL) {
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+    if (strcmp(arg, "--json") == 0) options.json = value;
+    else if (strcmp(arg, "--min-precision") == 0) options.minPrecision = atof(value);
+    else if (strcmp(arg, "--min-recall") == 0) options.minRecall = atof(value);
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (options.dir == NULL) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::string dir = options.dir;
+  std::vector<std::string> names = frameNames(dir);
+  std::map<std::string, int> labels = readLabels(dir);
+  if (names.empty()) {
+    fprintf(stderr, "no .jpg or .pgm frames in %s\n", options.dir);
+    return 1;
+  }
+
+  Cost decodeCost, detectCost;
+  unsigned truePositives = 0, falsePositives = 0, falseNegatives = 0, trueNegatives = 0, unlabelled = 0;
+  unsigned triggers = 0, lightingChanges = 0, errors = 0;
+  std::vector<uint8_t> file;
+  for (const std::string &name : names) {
+    if (!readFile(dir + "/" + name, &file)) {
+      fprintf(stderr, "%s: can't read\n", name.c_str());
+      errors++;
+      continue;
+    }
+
+    uint16_t width = 0, height = 0;
+    const uint8_t *luma;
+    uint64_t start = nowNs();
+    if (endsWith(name, ".pgm")) {
+      file.push_back(0);
+      luma = pgmPixels(file, &width, &height);
+    } else {
+      camera_fb_t fb = {};
+      fb.buf = file.data();
+      fb.len = file.size();
+      luma = jpegSize(file, &fb.width, &fb.height) ? lumaThumbnail(&fb, &width, &height) : NULL;
+      decodeCost.ns.push_back(nowNs() - start);
+    }
+    if (!luma) {
+      fprintf(stderr, "%s: doesn't decode\n", name.c_str());
+      errors++;
+      continue;
+    }
+
+    // as frameHasMotion(), a new frame size starts a new background
+    if (motion.width() != width || motion.height() != height / 8 * 8) {
+      if (!motion.begin(width, height, motionConfig)) {
+        fprintf(stderr, "%s: %ux%u is too small for the detector\n", name.c_str(), width, height);
+        errors++;
+        continue;
+      }
+    }
+    start = nowNs();
+    MotionResult result = motion.update(luma);
+    detectCost.ns.push_back(nowNs() - start);
+    triggers += result.triggered;
+    lightingChanges += result.lightingChange;
+
+    auto label = labels.find(name);
+    const char *verdict = "";
+    if (label == labels.end()) {
+      unlabelled++;
+    } else if (label->second) {
+      verdict = result.triggered ? "" : " missed";
+      (result.triggered ? truePositives : falseNegatives)++;
+    } else {
+      verdict = result.triggered ? " false trigger" : "";
+      (result.triggered ? falsePositives : trueNegatives)++;
+    }
+    if (options.frames) {
+      printf("%s %ux%u score %u (%u blocks over %u)%s%s%s\n", name.c_str(), width, height, result.score,
+             result.changedBlocks, result.threshold, result.triggered ? " motion" : "",
+             result.lightingChange ? " lighting" : "", verdict);
+    }
+  }
+
+  unsigned labelled = truePositives + falsePositives + falseNegatives + trueNegatives;
+  double precision = truePositives + falsePositives ? (double)truePositives / (truePositives + falsePositives) : 1;
+  double recall = truePositives + falseNegatives ? (double)truePositives / (truePositives + falseNegatives) : 1;
+  printf("%zu frames, %u triggers, %u lighting changes, %u errors\n", names.size(), triggers, lightingChanges, errors);
+  if (labelled) {
+    printf("%u labelled: precision %.3f recall %.3f (%u true, %u false, %u missed, %u quiet)\n", labelled, precision,
+           recall, truePositives, falsePositives, falseNegatives, trueNegatives);
+  }
+  if (unlabelled) printf("%u frames without a label\n", unlabelled);
+  if (!decodeCost.ns.empty()) {
+    printf("decode: mean %.0f ns, p50 %llu ns, p99 %llu ns\n", decodeCost.mean(),
+           (unsigned long long)decodeCost.percentile(50), (unsigned long long)decodeCost.percentile(99));
+  }
+  printf("detect: mean %.0f ns, p50 %llu ns, p99 %llu ns\n", detectCost.mean(),
+         (unsigned long long)detectCost.percentile(50), (unsigned long long)detectCost.percentile(99));
+
+  if (options.json) {
+    FILE *out = fopen(options.json, "w");
+    if (!out) {
+      fprintf(stderr, "can't write %s\n", options.json);
+      return 1;
+    }
+    fprintf(out,
+            "{\"frames\": %zu, \"triggers\": %u, \"lighting_changes\": %u, \"errors\": %u, \"labelled\": %u,\n"
+            " \"true_positives\": %u, \"false_positives\": %u, \"false_negatives\": %u, \"true_negatives\": %u,\n"
+            " \"precision\": %.4f, \"recall\": %.4f,\n"
+            " \"decode_ns\": {\"mean\": %.0f, \"p50\": %llu, \"p99\": %llu},\n"
+            " \"detect_ns\": {\"mean\": %.0f, \"p50\": %llu, \"p99\": %llu}}\n",
+            names.size(), triggers, lightingChanges, errors, labelled, truePositives, falsePositives,
+            falseNegatives, trueNegatives, precision, recall, decodeCost.mean(),
+            (unsigned long long)decodeCost.percentile(50), (unsigned long long)decodeCost.percentile(99),
+            detectCost.mean(), (unsigned long long)detectCost.percentile(50),
+            (unsigned long long)detectCost.percentile(99));
+    fclose(out);
+  }
+
+  if (errors) return 1;
+  if (labelled && (precision < options.minPrecision || recall < options.minRecall)) {
+    printf("below --min-precision %.3f / --min-recall %.3f\n", options.minPrecision, options.minRecall);
+    return 1;
+  }
+  return 0;
+}
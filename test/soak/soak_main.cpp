@@ -0,0 +1,473 @@
+// soak runs of the firmware's modem path against tools/sim7600_emulator.py:
+// the modules main.cpp drives the modem with (modem_at, efs_transfer,
+// ftp_session, ota_download, gnss, wall_clock), in the same AT sequences,
+// over the emulator's pty with delays that really sleep. tools/soak_run.py
+// sets up the emulator and its files and runs this, or by hand:
+//
+//   python3 tools/sim7600_emulator.py --link /tmp/ttySIM7600 --www www/ --ftp-root ftp/ &
+//   pio run -e soak && .pio/build/soak/program --tty /tmp/ttySIM7600 --duration 7200
+//
+// each cycle uploads a made up frame through EFS and FTPS and polls GNSS;
+// every few cycles it also uploads a compressed report, checks for an
+// update, downloads and verifies the firmware and syncs the clock. a
+// summary (runs, failures, retries, bytes, throughput and p50/p90/p99/max
+// latency per operation, the FTP session and AT counters) is printed every
+// --report-interval seconds and at the end, --json writes the last one.
+// camera, SD card, sleep and the FreeRTOS tasks are not part of it
+
+#include <Arduino.h>
+#include <esp_log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <string>
+#include "config.h"
+#include "efs_transfer.h"
+#include "ftp_session.h"
+#include "gnss.h"
+#include "metrics.h"
+#include "modem_at.h"
+#include "ota_download.h"
+#include "sha256.h"
+#include "wall_clock.h"
+
+#define SOAK_UPLOAD_ATTEMPTS 3   // tries per file before it counts as failed, as the outbox would retry it
+#define SOAK_IDLE_STEP_MS 100    // housekeeping step between cycles
+
+// the modem UART, a pty or a serial adapter
+class TtyStream : public Stream {
+public:
+  bool open(const char *path) {
+    _fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (_fd < 0) return false;
+    struct termios settings;
+    if (tcgetattr(_fd, &settings) == 0) {
+      cfmakeraw(&settings);
+      cfsetspeed(&settings, B115200);
+      tcsetattr(_fd, TCSANOW, &settings);
+    }
+    return true;
+  }
+
+  int available() override {
+    fill();
+    return _length - _offset;
+  }
+  int read() override {
+    fill();
+    return _offset < _length ? _buffer[_offset++] : -1;
+  }
+  int peek() override {
+    fill();
+    return _offset < _length ? _buffer[_offset] : -1;
+  }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t length) override {
+    size_t count = 0;
+    while (count < length) {
+      ssize_t written = ::write(_fd, data + count, length - count);
+      if (written > 0) {
+        count += written;
+        continue;
+      }
+      if (written < 0 && errno != EAGAIN && errno != EINTR) break;
+      // the emulator reads at its own pace, give up like a full UART would
+      struct pollfd ready = {_fd, POLLOUT, 0};
+      if (poll(&ready, 1, 1000) <= 0) break;
+    }
+    return count;
+  }
+  using Print::write;
+
+private:
+  void fill() {
+    if (_offset < _length) return;
+    ssize_t count = ::read(_fd, _buffer, sizeof(_buffer));
+    _offset = 0;
+    _length = count > 0 ? count : 0;
+  }
+
+  int _fd = -1;
+  uint8_t _buffer[MODEM_RX_BUFFER];
+  size_t _offset = 0;
+  size_t _length = 0;
+};
+
+enum SoakOp {
+  SOAK_BRINGUP,
+  SOAK_PHOTO,
+  SOAK_REPORT,
+  SOAK_OTA_CHECK,
+  SOAK_OTA_DOWNLOAD,
+  SOAK_GNSS,
+  SOAK_CLOCK,
+  SOAK_OP_COUNT
+};
+
+static const char *const opNames[SOAK_OP_COUNT] = {
+  "bringup", "photo", "report", "ota_check", "ota_download", "gnss", "clock"
+};
+
+struct OpStats {
+  uint32_t runs;
+  uint32_t failures;
+  uint32_t retries;
+  uint64_t bytes;      // moved by the runs that worked
+  uint64_t busyMs;     // spent in them
+  LatencyHistogram latency;
+};
+
+struct SoakOptions {
+  const char *tty = "/tmp/ttySIM7600";
+  unsigned long durationS = 3600;
+  unsigned long intervalS = 60;
+  size_t photoBytes = 60000;
+  unsigned reportEvery = 10;
+  unsigned otaEvery = 30;
+  unsigned clockEvery = 60;
+  bool download = true;
+  unsigned long reportIntervalS = 600;
+  const char *json = NULL;
+};
+
+static SoakOptions options;
+static TtyStream modemStream;
+static OpStats ops[SOAK_OP_COUNT];
+static WallClock wallClock;
+static GnssCache gnss;
+static bool modemReady = false;
+static uint32_t cycles = 0;
+static unsigned long soakStart = 0;
+static volatile sig_atomic_t stopping = 0;
+
+static void handleModemUrc(const AtEvent &event) {
+  ftpSessionUrc(event);
+  if (event.urc == AT_URC_CGNSSINFO) {
+    gnss.update(event.line, (int64_t)micros());
+  }
+}
+
+// time one run of op, bytes counts only when it worked
+static bool timed(SoakOp op, bool ok, unsigned long startMs, size_t bytes) {
+  unsigned long elapsed = millis() - startMs;
+  OpStats &stats = ops[op];
+  stats.runs++;
+  stats.latency.record(elapsed * 1000UL);
+  if (ok) {
+    stats.bytes += bytes;
+    stats.busyMs += elapsed;
+  } else {
+    stats.failures++;
+  }
+  return ok;
+}
+
+// initializeModem() and waitForNetwork() without the power pin and TinyGSM
+static bool bringUp() {
+  unsigned long startMs = millis();
+  atBegin(modemStream);
+  atSetUrcHandler(handleModemUrc);
+  bool answered = false;
+  while (!answered && millis() - startMs < MODEM_BOOT_TIMEOUT_MS) {
+    answered = atSendWait("", NULL, 500) == AT_RESPONSE_MATCH;
+  }
+  if (!answered || atSendOnce("E0", NULL, 1000) != AT_RESPONSE_MATCH) {
+    return timed(SOAK_BRINGUP, false, startMs, 0);
+  }
+  char response[32];
+  unsigned long registerStart = millis();
+  bool registered = false;
+  while (!registered && millis() - registerStart < MODEM_REGISTER_TIMEOUT_MS) {
+    registered = atSendWait("+CREG?", "+CREG:", 5000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+                 (strstr(response, ",1") != NULL || strstr(response, ",5") != NULL);
+    if (!registered) delay(1000);
+  }
+  if (!registered) return timed(SOAK_BRINGUP, false, startMs, 0);
+
+  // clearEFS() and gnssBegin()
+  atSendOnce("+FSCD=E:", NULL, 10000);
+  atSendWait("+FSLS", NULL, 5000);
+  atSendWait("+FSDEL=*.*", NULL, 10000);
+  char command[24];
+  snprintf(command, sizeof(command), "+CGNSSINFO=%d", GNSS_REPORT_INTERVAL);
+  bool ok = atSendOnce("+CGPS=1", NULL, 10000) == AT_RESPONSE_MATCH && atSendOnce(command, NULL, 5000) == AT_RESPONSE_MATCH;
+  return timed(SOAK_BRINGUP, ok, startMs, 0);
+}
+
+static bool syncClock() {
+  unsigned long startMs = millis();
+  char response[48];
+  int64_t utcSeconds;
+  int zone;
+  int64_t monoUs = (int64_t)micros();
+  bool ok = atSendWait("+CCLK?", "+CCLK:", 10000, response, sizeof(response)) == AT_RESPONSE_MATCH &&
+            wallClockParseCclk(response, &utcSeconds, &zone);
+  if (ok) {
+    wallClock.setZone(zone);
+    wallClock.sync(utcSeconds * 1000000LL + 500000, monoUs, WALL_CLOCK_MODEM);
+  }
+  return timed(SOAK_CLOCK, ok, startMs, 0);
+}
+
+static bool pollGnss() {
+  unsigned long startMs = millis();
+  char response[160];
+  bool ok = atSendWait("+CGNSSINFO", "+CGNSSINFO:", 5000, response, sizeof(response)) == AT_RESPONSE_MATCH;
+  if (ok) gnss.update(response, (int64_t)micros());
+  return timed(SOAK_GNSS, ok, startMs, 0);
+}
+
+// sendFileToEFS()/sendLogToEFS() then ftpSessionPut(), tried again the way
+// the outbox would on the next drain
+static bool upload(SoakOp op, const char *name, const uint8_t *data, size_t length, bool compressed) {
+  unsigned long startMs = millis();
+  bool ok = false;
+  for (int attempt = 0; attempt < SOAK_UPLOAD_ATTEMPTS && !ok; attempt++) {
+    if (attempt > 0) ops[op].retries++;
+    ok = (compressed ? efsTransferCompressed(name, data, length) : efsTransferBuffer(name, data, length)) &&
+         ftpSessionPut(name);
+  }
+  return timed(op, ok, startMs, length);
+}
+
+static void photoName(char *name, size_t size, const char *suffix) {
+  char dateTime[20];
+  if (wallClock.valid()) {
+    wallClock.format(dateTime, sizeof(dateTime), (int64_t)micros(), WALL_CLOCK_COMPACT);
+  } else {
+    snprintf(dateTime, sizeof(dateTime), "boot%lu", millis());
+  }
+  snprintf(name, size, "%s-%s%s", DEVICENAME, dateTime, suffix);
+}
+
+static bool sendPhoto() {
+  static std::string frame;
+  frame.resize(options.photoBytes);
+  // a JPEG's markers around bytes that don't compress
+  uint32_t seed = cycles * 2654435761u + 1;
+  for (size_t i = 0; i < frame.size(); i++) {
+    seed = seed * 1103515245 + 12345;
+    frame[i] = (char)(seed >> 16);
+  }
+  frame[0] = (char)0xFF;
+  frame[1] = (char)0xD8;
+  char name[64];
+  photoName(name, sizeof(name), ".jpg");
+  return upload(SOAK_PHOTO, name, (const uint8_t *)frame.data(), frame.size(), false);
+}
+
+static bool sendReport() {
+  char text[2048];
+  size_t length = snprintf(text, sizeof(text), "Device: %s\nCycles: %u\n", DEVICENAME, (unsigned)cycles);
+  length += metricsFormat(text + length, sizeof(text) - length);
+  char name[80];
+  photoName(name, sizeof(name), "-DailyReport.txt.lzs");
+  return upload(SOAK_REPORT, name, (const uint8_t *)text, length, true);
+}
+
+static bool checkForUpdate() {
+  unsigned long startMs = millis();
+  char url[160];
+  char version[32];
+  snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (OTA_VERSION_ENDPOINT).c_str());
+  bool ok = otaFetchText(url, version, sizeof(version)) && version[0] != '\0';
+  metricRecord(METRIC_OTA_CHECK, (millis() - startMs) * 1000UL);
+  return timed(SOAK_OTA_CHECK, ok, startMs, strlen(version));
+}
+
+static bool discardFirmware(const uint8_t *data, size_t length, size_t offset, size_t total, void *context) {
+  (void)data;
+  (void)length;
+  (void)offset;
+  (void)total;
+  (void)context;
+  return true;
+}
+
+// downloadFirmware() without the OTA partition: fetch the digest, then the
+// image, and check one against the other
+static bool downloadFirmware() {
+  unsigned long startMs = millis();
+  char url[160];
+  char digestText[2 * SHA256_SIZE + 8];
+  uint8_t expected[SHA256_SIZE];
+  uint8_t digest[SHA256_SIZE];
+  OtaDownloadStats stats = {};
+  snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (OTA_DIGEST_ENDPOINT).c_str());
+  bool ok = otaFetchText(url, digestText, sizeof(digestText)) && sha256FromHex(digestText, expected);
+  if (ok) {
+    snprintf(url, sizeof(url), "%s%s", OTA_UPDATE_URL, (OTA_UPDATE_ENDPOINT).c_str());
+    ok = otaDownload(url, discardFirmware, NULL, digest, &stats) && memcmp(digest, expected, SHA256_SIZE) == 0;
+  }
+  return timed(SOAK_OTA_DOWNLOAD, ok, startMs, stats.bytes);
+}
+
+// one JSON object, or the same as lines for the console
+static std::string summary(bool json) {
+  std::string out;
+  char line[256];
+  unsigned long elapsedS = (millis() - soakStart) / 1000;
+  if (json) {
+    snprintf(line, sizeof(line), "{\n  \"elapsed_s\": %lu,\n  \"cycles\": %u,\n  \"operations\": {", elapsedS,
+             (unsigned)cycles);
+  } else {
+    snprintf(line, sizeof(line), "soak %lu s, %u cycles\n", elapsedS, (unsigned)cycles);
+  }
+  out += line;
+  bool first = true;
+  for (int op = 0; op < SOAK_OP_COUNT; op++) {
+    const OpStats &stats = ops[op];
+    if (stats.runs == 0) continue;
+    MetricSummary latency = stats.latency.summary();
+    uint32_t bytesPerSecond = stats.busyMs ? (uint32_t)(stats.bytes * 1000 / stats.busyMs) : 0;
+    if (json) {
+      snprintf(line, sizeof(line),
+               "%s\n    \"%s\": {\"runs\": %u, \"failures\": %u, \"retries\": %u, \"bytes\": %llu, "
+               "\"bytes_per_s\": %u, \"p50_ms\": %u, \"p90_ms\": %u, \"p99_ms\": %u, \"max_ms\": %u}",
+               first ? "" : ",", opNames[op], (unsigned)stats.runs, (unsigned)stats.failures,
+               (unsigned)stats.retries, (unsigned long long)stats.bytes, (unsigned)bytesPerSecond,
+               (unsigned)(latency.p50Us / 1000), (unsigned)(latency.p90Us / 1000), (unsigned)(latency.p99Us / 1000),
+               (unsigned)(latency.maxUs / 1000));
+    } else {
+      snprintf(line, sizeof(line), "%-12s %5u runs %4u failed %4u retries %10llu bytes %7u B/s  %u/%u/%u/%u ms\n",
+               opNames[op], (unsigned)stats.runs, (unsigned)stats.failures, (unsigned)stats.retries,
+               (unsigned long long)stats.bytes, (unsigned)bytesPerSecond, (unsigned)(latency.p50Us / 1000),
+               (unsigned)(latency.p90Us / 1000), (unsigned)(latency.p99Us / 1000), (unsigned)(latency.maxUs / 1000));
+    }
+    out += line;
+    first = false;
+  }
+
+  const FtpSessionStats &ftp = ftpSessionStats();
+  const AtStats &at = atStats();
+  if (json) {
+    snprintf(line, sizeof(line),
+             "\n  },\n  \"ftp\": {\"logins\": %u, \"puts\": %u, \"reused_puts\": %u, \"failed_puts\": %u, "
+             "\"drops\": %u, \"setup_ms\": %u},\n",
+             (unsigned)ftp.logins, (unsigned)ftp.puts, (unsigned)ftp.reusedPuts, (unsigned)ftp.failedPuts,
+             (unsigned)ftp.drops, (unsigned)ftp.setupMs);
+    out += line;
+    snprintf(line, sizeof(line),
+             "  \"at\": {\"lines\": %u, \"commands\": %u, \"skipped\": %u, \"batched\": %u}\n}\n",
+             (unsigned)at.lines, (unsigned)at.commands, (unsigned)at.skipped, (unsigned)at.batched);
+  } else {
+    snprintf(line, sizeof(line), "ftp %u logins, %u puts (%u reused), %u failed, %u drops, %u ms setup\n",
+             (unsigned)ftp.logins, (unsigned)ftp.puts, (unsigned)ftp.reusedPuts, (unsigned)ftp.failedPuts,
+             (unsigned)ftp.drops, (unsigned)ftp.setupMs);
+    out += line;
+    snprintf(line, sizeof(line), "at %u lines, %u commands, %u skipped, %u batched\n", (unsigned)at.lines,
+             (unsigned)at.commands, (unsigned)at.skipped, (unsigned)at.batched);
+  }
+  out += line;
+  return out;
+}
+
+static void cycle() {
+  if (!modemReady) {
+    modemReady = bringUp();
+    if (!modemReady) return;
+    syncClock();
+  }
+  cycles++;
+  sendPhoto();
+  pollGnss();
+  if (options.reportEvery && cycles % options.reportEvery == 0) sendReport();
+  if (options.otaEvery && cycles % options.otaEvery == 0 && checkForUpdate() && options.download) {
+    downloadFirmware();
+  }
+  if (options.clockEvery && cycles % options.clockEvery == 0) syncClock();
+  // the modem stopped answering altogether, start it over next cycle
+  char response[16];
+  if (atSendWait("", NULL, 2000, response, sizeof(response)) != AT_RESPONSE_MATCH) {
+    modemReady = false;
+  }
+}
+
+static void stop(int signal) {
+  (void)signal;
+  stopping = 1;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--tty PATH] [--duration S] [--interval S] [--photo-bytes N] [--report-every N]\n"
+          "          [--ota-every N] [--no-download] [--clock-every N] [--report-interval S] [--json FILE]\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--no-download") == 0) {
+      options.download = false;
+      continue;
+    }
+    if (value == NULL) {
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+    if (strcmp(arg, "--tty") == 0) options.tty = value;
+    else if (strcmp(arg, "--duration") == 0) options.durationS = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--interval") == 0) options.intervalS = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--photo-bytes") == 0) options.photoBytes = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--report-every") == 0) options.reportEvery = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--ota-every") == 0) options.otaEvery = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--clock-every") == 0) options.clockEvery = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--report-interval") == 0) options.reportIntervalS = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--json") == 0) options.json = value;
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (options.photoBytes < 2) options.photoBytes = 2;
+
+  if (!modemStream.open(options.tty)) {
+    fprintf(stderr, "can't open %s: %s\n", options.tty, strerror(errno));
+    return 1;
+  }
+  mockClockRealTime(true);
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  soakStart = millis();
+  unsigned long lastReport = soakStart;
+  unsigned long nextCycle = soakStart;
+  while (!stopping && millis() - soakStart < options.durationS * 1000UL) {
+    cycle();
+    // frames that fell due while a cycle ran long are skipped, not caught up
+    do {
+      nextCycle += options.intervalS * 1000UL;
+    } while (options.intervalS && (long)(millis() - nextCycle) >= 0);
+    // housekeeping() between frames: URCs and the FTP idle logout
+    while (!stopping && (long)(nextCycle - millis()) > 0 && millis() - soakStart < options.durationS * 1000UL) {
+      atPoll();
+      ftpSessionIdle();
+      delay(SOAK_IDLE_STEP_MS);
+    }
+    if (options.reportIntervalS && millis() - lastReport >= options.reportIntervalS * 1000UL) {
+      lastReport = millis();
+      fputs(summary(false).c_str(), stdout);
+      fflush(stdout);
+    }
+  }
+  ftpSessionClose();
+
+  fputs(summary(false).c_str(), stdout);
+  if (options.json) {
+    FILE *out = fopen(options.json, "w");
+    if (out == NULL) {
+      fprintf(stderr, "can't write %s: %s\n", options.json, strerror(errno));
+      return 1;
+    }
+    fputs(summary(true).c_str(), out);
+    fclose(out);
+  }
+  // a run where the modem never came up or nothing got through is a failure
+  return cycles > 0 && ops[SOAK_PHOTO].runs > ops[SOAK_PHOTO].failures ? 0 : 1;
+}
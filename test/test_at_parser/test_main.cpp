@@ -0,0 +1,209 @@
+// AtParser against captured SIM7600 replies, and the modem_at waits on top
+
+#include <unity.h>
+#include <string.h>
+#include "at_parser.h"
+#include "mock_modem.h"
+#include "modem_at.h"
+
+static AtParser parser;
+static MockModem modem;
+
+static void feed(const char *text) {
+  parser.feed((const uint8_t *)text, strlen(text));
+}
+
+void setUp(void) {
+  parser.clear();
+  modem.reset();
+  atBegin(modem);
+  atSetUrcHandler(NULL);
+  atSetDataHandler(NULL, NULL);
+}
+
+void tearDown(void) {}
+
+void test_final_results_are_classified(void) {
+  AtEvent event;
+  feed("\r\nOK\r\n\r\nERROR\r\n\r\n+CME ERROR: 13\r\n\r\n+CMS ERROR: 500\r\n");
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_OK, event.type);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_ERROR, event.type);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_CME_ERROR, event.type);
+  TEST_ASSERT_EQUAL(13, event.code);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_CME_ERROR, event.type);
+  TEST_ASSERT_EQUAL(500, event.code);
+  TEST_ASSERT_FALSE(parser.next(event));
+}
+
+void test_urcs_carry_their_id_and_arguments(void) {
+  AtEvent event;
+  feed("\r\n+CFTPSPUTFILE: 0\r\n\r\n+CSQ: 21,99\r\n\r\n+FOO: bar\r\n\r\nSIMCOM_SIM7600G-H\r\n");
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_URC, event.type);
+  TEST_ASSERT_EQUAL(AT_URC_CFTPSPUTFILE, event.urc);
+  TEST_ASSERT_EQUAL_STRING("0", event.args);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_URC_CSQ, event.urc);
+  TEST_ASSERT_EQUAL_STRING("21,99", event.args);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_URC, event.type);
+  TEST_ASSERT_EQUAL(AT_URC_UNKNOWN, event.urc);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_LINE, event.type);
+  TEST_ASSERT_EQUAL_STRING("SIMCOM_SIM7600G-H", event.line);
+}
+
+void test_prompt_needs_no_line_ending(void) {
+  AtEvent event;
+  feed("\r\n>");
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_PROMPT, event.type);
+  TEST_ASSERT_FALSE(parser.next(event));
+}
+
+void test_lines_split_across_feeds(void) {
+  AtEvent event;
+  const char *reply = "\r\n+CCLK: \"26/10/16,12:00:00+08\"\r\n\r\nOK\r\n";
+  for (size_t i = 0; reply[i]; i++) {
+    parser.feed((const uint8_t *)reply + i, 1);
+    if (reply[i] == '"' && i > 10) TEST_ASSERT_FALSE(parser.next(event));
+  }
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_URC_CCLK, event.urc);
+  TEST_ASSERT_EQUAL_STRING("\"26/10/16,12:00:00+08\"", event.args);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_OK, event.type);
+}
+
+void test_data_window_is_binary_safe(void) {
+  AtEvent event;
+  const uint8_t payload[] = {'O', 'K', '\r', '\n', 0, '>', 0xFF, '\n'};
+  feed("\r\n+HTTPREAD: DATA,8\r\n");
+  parser.feed(payload, sizeof(payload));
+  feed("\r\n+HTTPREAD: 0\r\n");
+
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_URC_HTTPREAD, event.urc);
+  uint8_t received[16];
+  size_t length = 0;
+  while (parser.next(event) && event.type == AT_EVENT_DATA) {
+    memcpy(received + length, event.data, event.length);
+    length += event.length;
+  }
+  TEST_ASSERT_EQUAL(sizeof(payload), length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, received, sizeof(payload));
+  TEST_ASSERT_EQUAL(AT_EVENT_URC, event.type);
+  TEST_ASSERT_EQUAL_STRING("0", event.args);
+}
+
+void test_data_window_wraps_the_ring(void) {
+  AtEvent event;
+  // move the ring position close to its end first
+  char filler[100];
+  memset(filler, 'x', sizeof(filler));
+  filler[sizeof(filler) - 1] = '\n';
+  for (int i = 0; i < (AT_RING_SIZE - 100) / 100; i++) {
+    parser.feed((const uint8_t *)filler, sizeof(filler));
+    TEST_ASSERT_TRUE(parser.next(event));
+  }
+
+  uint8_t payload[300];
+  for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)i;
+  feed("+HTTPREAD: DATA,300\r\n");
+  parser.feed(payload, sizeof(payload));
+  TEST_ASSERT_TRUE(parser.next(event));
+  size_t length = 0;
+  int slices = 0;
+  while (parser.next(event)) {
+    TEST_ASSERT_EQUAL(AT_EVENT_DATA, event.type);
+    TEST_ASSERT_EQUAL_MEMORY(payload + length, event.data, event.length);
+    length += event.length;
+    slices++;
+  }
+  TEST_ASSERT_EQUAL(sizeof(payload), length);
+  TEST_ASSERT_EQUAL(2, slices);
+}
+
+void test_long_lines_are_truncated_and_counted(void) {
+  AtEvent event;
+  char line[AT_LINE_SIZE + 50];
+  memset(line, 'a', sizeof(line));
+  line[sizeof(line) - 2] = '\r';
+  line[sizeof(line) - 1] = '\n';
+  uint32_t truncated = parser.truncatedLines();
+  parser.feed((const uint8_t *)line, sizeof(line));
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_LINE_SIZE - 1, event.length);
+  TEST_ASSERT_EQUAL(truncated + 1, parser.truncatedLines());
+}
+
+void test_feed_stops_when_the_ring_is_full(void) {
+  uint8_t bytes[AT_RING_SIZE + 10];
+  memset(bytes, 'a', sizeof(bytes));
+  TEST_ASSERT_EQUAL(AT_RING_SIZE, parser.feed(bytes, sizeof(bytes)));
+  TEST_ASSERT_EQUAL(0, parser.space());
+}
+
+void test_pump_reads_what_the_stream_has(void) {
+  AtEvent event;
+  modem.setReadLimit(3);
+  modem.write((const uint8_t *)"AT+CSQ\r\n", 8);
+  parser.pump(modem);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL_STRING("+CSQ: 20,99", event.line);
+  TEST_ASSERT_TRUE(parser.next(event));
+  TEST_ASSERT_EQUAL(AT_EVENT_OK, event.type);
+}
+
+void test_wait_for_copies_the_matching_line(void) {
+  char response[AT_LINE_SIZE];
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendWait("+CSQ", "+CSQ:", 1000, response, sizeof(response)));
+  TEST_ASSERT_EQUAL_STRING("+CSQ: 20,99", response);
+  modem.fail("+CREG");
+  TEST_ASSERT_EQUAL(AT_RESPONSE_ERROR, atSendWait("+CREG?", "+CREG:", 1000));
+  modem.silence("+CPSI");
+  TEST_ASSERT_EQUAL(AT_RESPONSE_TIMEOUT, atSendWait("+CPSI?", "+CPSI:", 500));
+}
+
+static int urcs = 0;
+
+static void countUrc(const AtEvent &event) {
+  if (event.urc == AT_URC_CFTPSNOTIFY) urcs++;
+}
+
+void test_stray_urcs_go_to_the_handler(void) {
+  urcs = 0;
+  atSetUrcHandler(countUrc);
+  modem.urc("+CFTPSNOTIFY: PEER CLOSED");
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendWait("+CSQ", "+CSQ:", 1000));
+  TEST_ASSERT_EQUAL(1, urcs);
+}
+
+void test_result_code_after_the_colon(void) {
+  TEST_ASSERT_EQUAL(0, atResultCode("+CFTPSLOGIN: 0"));
+  TEST_ASSERT_EQUAL(13, atResultCode("+CFTPSPUTFILE: 13"));
+  TEST_ASSERT_EQUAL(-1, atResultCode("OK"));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_final_results_are_classified);
+  RUN_TEST(test_urcs_carry_their_id_and_arguments);
+  RUN_TEST(test_prompt_needs_no_line_ending);
+  RUN_TEST(test_lines_split_across_feeds);
+  RUN_TEST(test_data_window_is_binary_safe);
+  RUN_TEST(test_data_window_wraps_the_ring);
+  RUN_TEST(test_long_lines_are_truncated_and_counted);
+  RUN_TEST(test_feed_stops_when_the_ring_is_full);
+  RUN_TEST(test_pump_reads_what_the_stream_has);
+  RUN_TEST(test_wait_for_copies_the_matching_line);
+  RUN_TEST(test_stray_urcs_go_to_the_handler);
+  RUN_TEST(test_result_code_after_the_colon);
+  return UNITY_END();
+}
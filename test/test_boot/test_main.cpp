@@ -0,0 +1,132 @@
+// the dependency driven boot on the host port (std::thread): stages run
+// after what they name, independent ones overlap, a failure skips its
+// dependants and nothing else
+
+#include <unity.h>
+#include <atomic>
+#include "boot.h"
+#include "port.h"
+
+#define STAGES 6
+
+// a logical clock, so order checks don't depend on millisecond timing
+static std::atomic<int> ticks(0);
+static std::atomic<int> started[STAGES];
+static std::atomic<int> finished[STAGES];
+static std::atomic<int> runs[STAGES];
+
+template <int id, bool ok, uint32_t ms>
+static bool stage() {
+  runs[id]++;
+  started[id] = ++ticks;
+  portDelay(ms);
+  finished[id] = ++ticks;
+  return ok;
+}
+
+void setUp(void) {
+  ticks = 0;
+  for (int i = 0; i < STAGES; i++) {
+    started[i] = 0;
+    finished[i] = 0;
+    runs[i] = 0;
+  }
+}
+
+void tearDown(void) {}
+
+void test_stages_wait_for_what_they_name(void) {
+  BootSequence boot;
+  uint32_t power = boot.add("power", stage<0, true, 20>);
+  uint32_t modem = boot.add("modem", stage<1, true, 10>, power);
+  uint32_t network = boot.add("network", stage<2, true, 0>, modem | power);
+  TEST_ASSERT_EQUAL_HEX32(1, power);
+  TEST_ASSERT_EQUAL_HEX32(2, modem);
+  TEST_ASSERT_EQUAL_HEX32(4, network);
+  TEST_ASSERT_TRUE(boot.run(4096));
+
+  TEST_ASSERT_GREATER_THAN(finished[0], started[1]);
+  TEST_ASSERT_GREATER_THAN(finished[1], started[2]);
+  for (size_t i = 0; i < boot.count(); i++) {
+    TEST_ASSERT_TRUE(boot.stage(i).ok);
+    TEST_ASSERT_FALSE(boot.stage(i).skipped);
+    TEST_ASSERT_EQUAL(1, runs[i]);
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(boot.stage(0).endMs, boot.stage(1).startMs);
+  TEST_ASSERT_GREATER_OR_EQUAL(boot.stage(1).endMs, boot.stage(2).startMs);
+}
+
+void test_dependant_added_first_waits(void) {
+  BootSequence boot;
+  // bit 2 is the stage added last
+  boot.add("report", stage<0, true, 0>, 4);
+  boot.add("camera", stage<1, true, 0>);
+  boot.add("modem", stage<2, true, 30>);
+  TEST_ASSERT_TRUE(boot.run(4096));
+  TEST_ASSERT_GREATER_THAN(finished[2], started[0]);
+}
+
+void test_independent_stages_overlap(void) {
+  BootSequence boot;
+  uint32_t camera = boot.add("camera", stage<0, true, 150>);
+  uint32_t modem = boot.add("modem", stage<1, true, 150>, 0, 1);
+  boot.add("ready", stage<2, true, 0>, camera | modem);
+  uint32_t start = portMillis();
+  TEST_ASSERT_TRUE(boot.run(4096));
+  uint32_t elapsed = portMillis() - start;
+
+  // each started before the other finished
+  TEST_ASSERT_LESS_THAN(finished[1], started[0]);
+  TEST_ASSERT_LESS_THAN(finished[0], started[1]);
+  TEST_ASSERT_GREATER_THAN(finished[0], started[2]);
+  TEST_ASSERT_GREATER_THAN(finished[1], started[2]);
+  // well under the 300 ms the two would take one after the other
+  TEST_ASSERT_LESS_THAN(270, elapsed);
+}
+
+void test_failure_skips_dependants_only(void) {
+  BootSequence boot;
+  uint32_t modem = boot.add("modem", stage<0, false, 10>);
+  uint32_t network = boot.add("network", stage<1, true, 0>, modem);
+  boot.add("clock", stage<2, true, 0>, network);
+  uint32_t sd = boot.add("sd", stage<3, true, 10>);
+  boot.add("log", stage<4, true, 0>, sd);
+  TEST_ASSERT_FALSE(boot.run(4096));
+
+  TEST_ASSERT_FALSE(boot.stage(0).ok);
+  TEST_ASSERT_FALSE(boot.stage(0).skipped);
+  // skipped through two levels, never called
+  for (int i = 1; i <= 2; i++) {
+    TEST_ASSERT_TRUE(boot.stage(i).skipped);
+    TEST_ASSERT_FALSE(boot.stage(i).ok);
+    TEST_ASSERT_EQUAL(0, runs[i]);
+  }
+  // the other branch boots as usual
+  TEST_ASSERT_TRUE(boot.stage(3).ok);
+  TEST_ASSERT_TRUE(boot.stage(4).ok);
+  TEST_ASSERT_GREATER_THAN(finished[3], started[4]);
+}
+
+void test_full_sequence_refuses_more_stages(void) {
+  BootSequence boot;
+  for (int i = 0; i < BOOT_MAX_STAGES; i++) {
+    TEST_ASSERT_EQUAL_HEX32(1UL << i, boot.add("stage", stage<0, true, 0>));
+  }
+  TEST_ASSERT_EQUAL_HEX32(0, boot.add("extra", stage<1, true, 0>));
+  TEST_ASSERT_EQUAL(BOOT_MAX_STAGES, boot.count());
+  TEST_ASSERT_TRUE(boot.run(4096));
+  TEST_ASSERT_EQUAL(BOOT_MAX_STAGES, runs[0]);
+  TEST_ASSERT_EQUAL(0, runs[1]);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_stages_wait_for_what_they_name);
+  RUN_TEST(test_dependant_added_first_waits);
+  RUN_TEST(test_independent_stages_overlap);
+  RUN_TEST(test_failure_skips_dependants_only);
+  RUN_TEST(test_full_sequence_refuses_more_stages);
+  return UNITY_END();
+}
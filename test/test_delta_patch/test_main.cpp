@@ -0,0 +1,235 @@
+// the SCD1 patch applier: patches from make_delta.py rebuild the new image
+// whatever the piece sizes, and bad patches or targets stop it cold
+
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "delta_patch.h"
+
+// decompressed make_delta.py output for the images in toolOld()/toolNew()
+static const uint8_t toolPatch[] = {
+    0x53, 0x43, 0x44, 0x31, 0x88, 0x00, 0x00, 0x00, 0x8c, 0x00, 0x00, 0x00, 0xba, 0xae, 0x5e, 0x26,
+    0x65, 0x33, 0xef, 0x4a, 0xbe, 0xb8, 0xce, 0x79, 0x9f, 0xb3, 0xa4, 0x6a, 0x44, 0x18, 0x2f, 0x7e,
+    0xa5, 0xea, 0xd6, 0x91, 0x4f, 0xa7, 0x64, 0x9f, 0x64, 0x74, 0xa2, 0xe7, 0xd9, 0xf8, 0xb9, 0x73,
+    0x38, 0x0d, 0x20, 0x86, 0x6f, 0xb3, 0x0e, 0x6d, 0x54, 0x56, 0x33, 0x15, 0x46, 0x75, 0x12, 0x6b,
+    0x15, 0xe5, 0xcd, 0xf4, 0x11, 0x1a, 0x8a, 0x36, 0xb2, 0x24, 0xf6, 0xaa, 0x41, 0x00, 0x00, 0x00,
+    0x00, 0x1e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x44, 0x06, 0x00, 0x00, 0x00, 0x4e, 0x45, 0x57, 0x21, 0x69, 0x6c, 0x41, 0x20,
+    0x00, 0x00, 0x00, 0x68, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+struct Image {
+  std::vector<uint8_t> old;
+  std::vector<uint8_t> out;
+  DeltaHeader header;
+  int begins;
+  size_t failWriteAt; // 0 for never
+};
+
+static Image image;
+static DeltaPatcher patcher;
+
+static bool imageBegin(const DeltaHeader &header, void *context) {
+  Image *target = (Image *)context;
+  target->header = header;
+  target->begins++;
+  return header.oldSize == target->old.size();
+}
+
+static bool imageReadOld(uint32_t offset, uint8_t *out, size_t length, void *context) {
+  Image *target = (Image *)context;
+  TEST_ASSERT_LESS_OR_EQUAL(DELTA_CHUNK_SIZE, length);
+  TEST_ASSERT_LESS_OR_EQUAL(target->old.size(), offset + length);
+  memcpy(out, target->old.data() + offset, length);
+  return true;
+}
+
+static bool imageWrite(const uint8_t *data, size_t length, void *context) {
+  Image *target = (Image *)context;
+  if (target->failWriteAt && target->out.size() + length > target->failWriteAt) return false;
+  target->out.insert(target->out.end(), data, data + length);
+  return true;
+}
+
+static std::vector<uint8_t> toolOld() {
+  std::string text = "SanWild camera firmware 1.3 build 0042, motion v2, upload over FTP. ";
+  text += text;
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static std::vector<uint8_t> toolNew() {
+  std::string text = "SanWild camera firmware 1.3 build 0042, motion v2, upload over FTP. ";
+  text = text.substr(0, 30) + "NEW!" + text.substr(30) + text;
+  text.replace(text.rfind("1.3"), 3, "1.4");
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static void putLe32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out.push_back(value >> (8 * i));
+}
+
+static std::vector<uint8_t> header(uint32_t oldSize, uint32_t newSize) {
+  std::vector<uint8_t> patch(DELTA_MAGIC, DELTA_MAGIC + 4);
+  putLe32(patch, oldSize);
+  putLe32(patch, newSize);
+  patch.insert(patch.end(), 2 * SHA256_SIZE, 0xA5);
+  return patch;
+}
+
+static void addOp(std::vector<uint8_t> &patch, uint32_t offset, uint32_t length, uint8_t add) {
+  patch.push_back('A');
+  putLe32(patch, offset);
+  putLe32(patch, length);
+  patch.insert(patch.end(), length, add);
+}
+
+static void dataOp(std::vector<uint8_t> &patch, const std::vector<uint8_t> &literal) {
+  patch.push_back('D');
+  putLe32(patch, literal.size());
+  patch.insert(patch.end(), literal.begin(), literal.end());
+}
+
+static bool feedInPieces(const uint8_t *patch, size_t length, size_t step) {
+  for (size_t offset = 0; offset < length; offset += step) {
+    if (!patcher.feed(patch + offset, length - offset < step ? length - offset : step)) return false;
+  }
+  return true;
+}
+
+static void start() {
+  image.out.clear();
+  image.begins = 0;
+  image.failWriteAt = 0;
+  DeltaTarget target = {imageBegin, imageReadOld, imageWrite, &image};
+  patcher.begin(target);
+}
+
+void setUp(void) {
+  image.old = toolOld();
+  start();
+}
+
+void tearDown(void) {}
+
+void test_tool_patch_rebuilds_the_new_image(void) {
+  const size_t steps[] = {sizeof(toolPatch), 1, 7, DELTA_HEADER_SIZE + 1};
+  for (size_t step : steps) {
+    start();
+    TEST_ASSERT_TRUE(feedInPieces(toolPatch, sizeof(toolPatch), step));
+    TEST_ASSERT_TRUE(patcher.finished());
+    TEST_ASSERT_TRUE(image.out == toolNew());
+    TEST_ASSERT_EQUAL(1, image.begins);
+  }
+  TEST_ASSERT_EQUAL(toolOld().size(), patcher.header().oldSize);
+  TEST_ASSERT_EQUAL(toolNew().size(), patcher.header().newSize);
+  TEST_ASSERT_EQUAL_MEMORY(toolPatch + 12, image.header.oldDigest, SHA256_SIZE);
+  TEST_ASSERT_EQUAL_MEMORY(toolPatch + 12 + SHA256_SIZE, image.header.newDigest, SHA256_SIZE);
+  TEST_ASSERT_EQUAL(toolNew().size(), patcher.written());
+  TEST_ASSERT_EQUAL(134, patcher.copiedBytes());
+  TEST_ASSERT_EQUAL(6, patcher.literalBytes());
+}
+
+void test_long_add_runs_go_through_the_chunk(void) {
+  // several chunks of old bytes, and the add wraps around 256
+  image.old.resize(3 * DELTA_CHUNK_SIZE + 100);
+  for (size_t i = 0; i < image.old.size(); i++) image.old[i] = (uint8_t)i;
+  std::vector<uint8_t> patch = header(image.old.size(), 2 * DELTA_CHUNK_SIZE + 3 + 50);
+  addOp(patch, 100, 2 * DELTA_CHUNK_SIZE + 3, 0xF0);
+  dataOp(patch, std::vector<uint8_t>(50, 'x'));
+  start();
+  TEST_ASSERT_TRUE(feedInPieces(patch.data(), patch.size(), 4096));
+  TEST_ASSERT_TRUE(patcher.finished());
+  for (size_t i = 0; i < 2 * DELTA_CHUNK_SIZE + 3; i++) {
+    TEST_ASSERT_EQUAL_HEX8((uint8_t)(i + 100 + 0xF0), image.out[i]);
+  }
+  TEST_ASSERT_EQUAL('x', image.out.back());
+  TEST_ASSERT_EQUAL(2 * DELTA_CHUNK_SIZE + 3, patcher.copiedBytes());
+}
+
+void test_bad_magic_fails_before_begin(void) {
+  std::vector<uint8_t> patch(toolPatch, toolPatch + sizeof(toolPatch));
+  patch[3] = '2';
+  TEST_ASSERT_FALSE(patcher.feed(patch.data(), patch.size()));
+  TEST_ASSERT_TRUE(patcher.failed());
+  TEST_ASSERT_EQUAL(0, image.begins);
+}
+
+void test_target_can_refuse_the_header(void) {
+  // made against some other old image
+  image.old.pop_back();
+  start();
+  TEST_ASSERT_FALSE(patcher.feed(toolPatch, sizeof(toolPatch)));
+  TEST_ASSERT_EQUAL(1, image.begins);
+  TEST_ASSERT_EQUAL(0, image.out.size());
+}
+
+void test_bad_operations_fail(void) {
+  uint32_t oldSize = image.old.size();
+  std::vector<uint8_t> unknown = header(oldSize, 10);
+  unknown.push_back('X');
+  TEST_ASSERT_FALSE(patcher.feed(unknown.data(), unknown.size()));
+
+  // an ADD reaching past the end of the old image
+  std::vector<uint8_t> pastOld = header(oldSize, 10);
+  addOp(pastOld, oldSize - 5, 10, 0);
+  start();
+  TEST_ASSERT_FALSE(patcher.feed(pastOld.data(), pastOld.size()));
+  TEST_ASSERT_EQUAL(0, image.out.size());
+
+  // more bytes than the new image holds
+  std::vector<uint8_t> pastNew = header(oldSize, 10);
+  dataOp(pastNew, std::vector<uint8_t>(11, 'x'));
+  start();
+  TEST_ASSERT_FALSE(patcher.feed(pastNew.data(), pastNew.size()));
+
+  std::vector<uint8_t> empty = header(oldSize, 10);
+  dataOp(empty, std::vector<uint8_t>());
+  start();
+  TEST_ASSERT_FALSE(patcher.feed(empty.data(), empty.size()));
+}
+
+void test_bytes_past_the_end_fail(void) {
+  std::vector<uint8_t> patch(toolPatch, toolPatch + sizeof(toolPatch));
+  patch.push_back('D');
+  TEST_ASSERT_FALSE(patcher.feed(patch.data(), patch.size()));
+  TEST_ASSERT_TRUE(patcher.failed());
+}
+
+void test_cut_patch_is_not_finished(void) {
+  TEST_ASSERT_TRUE(patcher.feed(toolPatch, sizeof(toolPatch) - 1));
+  TEST_ASSERT_FALSE(patcher.finished());
+  TEST_ASSERT_FALSE(patcher.failed());
+  TEST_ASSERT_EQUAL(toolNew().size() - 1, patcher.written());
+}
+
+void test_write_failure_stops_the_patch(void) {
+  image.failWriteAt = 40;
+  TEST_ASSERT_FALSE(feedInPieces(toolPatch, sizeof(toolPatch), 16));
+  TEST_ASSERT_TRUE(patcher.failed());
+  TEST_ASSERT_LESS_OR_EQUAL(40, image.out.size());
+  // and it stays failed
+  TEST_ASSERT_FALSE(patcher.feed(toolPatch, 1));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_tool_patch_rebuilds_the_new_image);
+  RUN_TEST(test_long_add_runs_go_through_the_chunk);
+  RUN_TEST(test_bad_magic_fails_before_begin);
+  RUN_TEST(test_target_can_refuse_the_header);
+  RUN_TEST(test_bad_operations_fail);
+  RUN_TEST(test_bytes_past_the_end_fail);
+  RUN_TEST(test_cut_patch_is_not_finished);
+  RUN_TEST(test_write_failure_stops_the_patch);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+// EFS uploads against the scripted modem: windows, short writes, and
+// leaving data mode cleanly when a transfer fails part way
+
+#include <unity.h>
+#include <vector>
+#include "config.h"
+#include "efs_transfer.h"
+#include "mock_modem.h"
+#include "modem_at.h"
+
+static MockModem modem;
+static std::vector<uint8_t> photo;
+
+struct ScriptedSource {
+  const uint8_t *data;
+  size_t length;
+  size_t offset;
+  size_t stopAt;   // source runs dry here
+  int calls;
+  void (*onCall)(ScriptedSource *source);
+};
+
+static size_t scriptedSource(const uint8_t **chunk, size_t maxLength, void *context) {
+  ScriptedSource *source = (ScriptedSource *)context;
+  source->calls++;
+  if (source->onCall) source->onCall(source);
+  size_t count = std::min(maxLength, source->stopAt - source->offset);
+  *chunk = source->data + source->offset;
+  source->offset += count;
+  return count;
+}
+
+static bool sentCommand(const char *command) {
+  for (const std::string &sent : modem.commands) {
+    if (sent == command) return true;
+  }
+  return false;
+}
+
+void setUp(void) {
+  modem.reset();
+  atBegin(modem);
+  photo.resize(5000);
+  for (size_t i = 0; i < photo.size(); i++) photo[i] = (uint8_t)(i * 7);
+}
+
+void tearDown(void) {}
+
+void test_buffer_lands_in_efs(void) {
+  EfsTransferStats stats;
+  TEST_ASSERT_TRUE(efsTransferBuffer("photo.jpg", photo.data(), photo.size(), &stats));
+  TEST_ASSERT_TRUE(modem.efs["photo.jpg"] == photo);
+  TEST_ASSERT_EQUAL(photo.size(), stats.bytes);
+  TEST_ASSERT_FALSE(modem.inDataMode());
+  TEST_ASSERT_TRUE(sentCommand("+CFTRANRX=\"e:/photo.jpg\",5000"));
+}
+
+void test_short_writes_are_retried(void) {
+  modem.setWriteLimit(100);
+  TEST_ASSERT_TRUE(efsTransferBuffer("photo.jpg", photo.data(), photo.size()));
+  TEST_ASSERT_TRUE(modem.efs["photo.jpg"] == photo);
+}
+
+void test_no_prompt_fails_without_sending(void) {
+  modem.fail("+CFTRANRX");
+  TEST_ASSERT_FALSE(efsTransferBuffer("photo.jpg", photo.data(), photo.size()));
+  TEST_ASSERT_EQUAL(0, modem.efs.count("photo.jpg"));
+}
+
+void test_source_ending_early_pads_and_deletes(void) {
+  ScriptedSource source = {photo.data(), photo.size(), 0, 1500, 0, NULL};
+  TEST_ASSERT_FALSE(efsTransfer("photo.jpg", photo.size(), scriptedSource, &source));
+  // the modem got all 5000 bytes it was promised and is back in command mode
+  TEST_ASSERT_FALSE(modem.inDataMode());
+  TEST_ASSERT_TRUE(sentCommand("+FSDEL=\"photo.jpg\""));
+  TEST_ASSERT_EQUAL(0, modem.efs.count("photo.jpg"));
+
+  // and takes the next command
+  TEST_ASSERT_TRUE(efsTransferBuffer("photo.jpg", photo.data(), photo.size()));
+}
+
+static void stallAfterFirstWindow(ScriptedSource *source) {
+  if (source->calls == 2) modem.stallAfter(modem.bytesIn + 10);
+}
+
+void test_stalled_link_gives_up(void) {
+  ScriptedSource source = {photo.data(), photo.size(), 0, photo.size(), 0, stallAfterFirstWindow};
+  unsigned long startTime = millis();
+  TEST_ASSERT_FALSE(efsTransfer("photo.jpg", photo.size(), scriptedSource, &source));
+  // the window and the padding each wait out the stall timeout, no longer
+  TEST_ASSERT_LESS_THAN(startTime + 3 * EFS_STALL_TIMEOUT, millis());
+  TEST_ASSERT_EQUAL(0, modem.efs.count("photo.jpg"));
+}
+
+static void rejectAfterFirstWindow(ScriptedSource *source) {
+  if (source->calls == 2) modem.rejectData();
+}
+
+void test_modem_error_deletes_the_partial_file(void) {
+  ScriptedSource source = {photo.data(), photo.size(), 0, photo.size(), 0, rejectAfterFirstWindow};
+  TEST_ASSERT_FALSE(efsTransfer("photo.jpg", photo.size(), scriptedSource, &source));
+  TEST_ASSERT_EQUAL(2, source.calls);
+  TEST_ASSERT_TRUE(sentCommand("+FSDEL=\"photo.jpg\""));
+  TEST_ASSERT_EQUAL(0, modem.efs.count("photo.jpg"));
+}
+
+void test_every_failed_retry_deletes_its_partial_file(void) {
+  // retries reuse the name, +FSDEL is an action and has to go out each time
+  for (int attempt = 0; attempt < 2; attempt++) {
+    ScriptedSource source = {photo.data(), photo.size(), 0, photo.size(), 0, rejectAfterFirstWindow};
+    TEST_ASSERT_FALSE(efsTransfer("photo.jpg", photo.size(), scriptedSource, &source));
+    TEST_ASSERT_EQUAL(0, modem.efs.count("photo.jpg"));
+  }
+  int deletes = 0;
+  for (const std::string &sent : modem.commands) {
+    if (sent == "+FSDEL=\"photo.jpg\"") deletes++;
+  }
+  TEST_ASSERT_EQUAL(2, deletes);
+}
+
+void test_directory_switch_is_sent_once(void) {
+  TEST_ASSERT_TRUE(efsTransferBuffer("a.jpg", photo.data(), 100));
+  TEST_ASSERT_TRUE(efsTransferBuffer("b.jpg", photo.data(), 100));
+  int switches = 0;
+  for (const std::string &sent : modem.commands) {
+    if (sent == "+FSCD=E:") switches++;
+  }
+  TEST_ASSERT_EQUAL(1, switches);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_buffer_lands_in_efs);
+  RUN_TEST(test_short_writes_are_retried);
+  RUN_TEST(test_no_prompt_fails_without_sending);
+  RUN_TEST(test_source_ending_early_pads_and_deletes);
+  RUN_TEST(test_stalled_link_gives_up);
+  RUN_TEST(test_modem_error_deletes_the_partial_file);
+  RUN_TEST(test_every_failed_retry_deletes_its_partial_file);
+  RUN_TEST(test_directory_switch_is_sent_once);
+  return UNITY_END();
+}
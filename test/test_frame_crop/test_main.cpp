@@ -0,0 +1,195 @@
+// cropping and re-encoding over a scripted codec: the region's pixels reach
+// the encoder in the camera library's order, quality steps down to the
+// budget, and decode or encode failures leave nothing behind
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "config.h"
+#include "frame_crop.h"
+
+#define WIDTH 64
+#define HEIGHT 48
+
+struct Script {
+  int failDecodeAtRow;        // -1 for never
+  bool failEncode;
+  uint8_t scaleShift;         // what decode was asked for
+  int rowsDecoded;
+  std::vector<uint8_t> encoded; // pixels of the last encode
+  uint16_t width;
+  uint16_t height;
+  std::vector<uint8_t> qualities;
+  size_t bytesPerQuality;     // encoded length is quality * this
+};
+
+static Script script;
+static const uint8_t jpeg[] = {0xFF, 0xD8, 0xFF, 0xD9};
+
+// pixel x, y of the scaled image is (x, y, x ^ y)
+static bool fakeDecode(const uint8_t *data, size_t length, uint8_t scaleShift, FrameCropWriter write, void *context) {
+  (void)data;
+  (void)length;
+  script.scaleShift = scaleShift;
+  uint16_t width = WIDTH >> scaleShift;
+  uint16_t height = HEIGHT >> scaleShift;
+  if (!write(context, 0, 0, width, height, NULL)) return false;
+  uint8_t block[8 * 8 * 3];
+  for (uint16_t y = 0; y < height; y += 8) {
+    if (script.failDecodeAtRow >= 0 && y >= script.failDecodeAtRow) return false;
+    for (uint16_t x = 0; x < width; x += 8) {
+      uint16_t w = width - x < 8 ? width - x : 8;
+      uint16_t h = height - y < 8 ? height - y : 8;
+      for (int row = 0; row < h; row++) {
+        for (int column = 0; column < w; column++) {
+          uint8_t *pixel = block + (row * w + column) * 3;
+          pixel[0] = x + column;
+          pixel[1] = y + row;
+          pixel[2] = (x + column) ^ (y + row);
+        }
+      }
+      if (!write(context, x, y, w, h, block)) return false;
+    }
+    script.rowsDecoded = y + 8;
+  }
+  return write(context, 0, 0, 0, 0, NULL);
+}
+
+static bool fakeEncode(const uint8_t *pixels, uint16_t width, uint16_t height, uint8_t quality, uint8_t **out,
+                       size_t *outLength) {
+  script.qualities.push_back(quality);
+  if (script.failEncode) return false;
+  script.encoded.assign(pixels, pixels + (size_t)width * height * 3);
+  script.width = width;
+  script.height = height;
+  *outLength = quality * script.bytesPerQuality;
+  *out = (uint8_t *)malloc(*outLength);
+  return *out != NULL;
+}
+
+static const FrameCropCodec codec = {fakeDecode, fakeEncode};
+
+void setUp(void) {
+  script = Script();
+  script.failDecodeAtRow = -1;
+  script.bytesPerQuality = 10;
+}
+
+void tearDown(void) {}
+
+void test_region_reaches_the_encoder_as_bgr(void) {
+  RoiRect rect = {10, 6, 20, 12};
+  uint8_t *out;
+  size_t length;
+  uint8_t quality;
+  TEST_ASSERT_TRUE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 0, 100000, &out, &length, &quality));
+  free(out);
+  TEST_ASSERT_EQUAL(20, script.width);
+  TEST_ASSERT_EQUAL(12, script.height);
+  for (int y = 0; y < 12; y++) {
+    for (int x = 0; x < 20; x++) {
+      const uint8_t *pixel = script.encoded.data() + (y * 20 + x) * 3;
+      TEST_ASSERT_EQUAL((10 + x) ^ (6 + y), pixel[0]);
+      TEST_ASSERT_EQUAL(6 + y, pixel[1]);
+      TEST_ASSERT_EQUAL(10 + x, pixel[2]);
+    }
+  }
+  // nothing below the crop was decoded
+  TEST_ASSERT_LESS_OR_EQUAL(24, script.rowsDecoded);
+}
+
+void test_scale_shift_scales_the_region(void) {
+  RoiRect rect = {16, 8, 32, 24};
+  uint8_t *out;
+  size_t length;
+  uint8_t quality;
+  TEST_ASSERT_TRUE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 1, 100000, &out, &length, &quality));
+  free(out);
+  TEST_ASSERT_EQUAL(1, script.scaleShift);
+  TEST_ASSERT_EQUAL(16, script.width);
+  TEST_ASSERT_EQUAL(12, script.height);
+  TEST_ASSERT_EQUAL(8, script.encoded[2]);
+  TEST_ASSERT_EQUAL(4, script.encoded[1]);
+}
+
+void test_quality_steps_down_to_the_budget(void) {
+  RoiRect rect = {0, 0, WIDTH, HEIGHT};
+  uint8_t *out;
+  size_t length;
+  uint8_t quality;
+  uint32_t overBudget = frameCropStats().overBudget;
+  // fits at the second step
+  size_t budget = (ROI_QUALITY_MAX - ROI_QUALITY_STEP) * script.bytesPerQuality;
+  TEST_ASSERT_TRUE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 0, budget, &out, &length, &quality));
+  free(out);
+  TEST_ASSERT_EQUAL(ROI_QUALITY_MAX - ROI_QUALITY_STEP, quality);
+  TEST_ASSERT_EQUAL(budget, length);
+  TEST_ASSERT_EQUAL(2, script.qualities.size());
+
+  // never fits, the lowest quality goes out anyway and is counted
+  script.qualities.clear();
+  TEST_ASSERT_TRUE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 0, 1, &out, &length, &quality));
+  free(out);
+  TEST_ASSERT_GREATER_OR_EQUAL(ROI_QUALITY_MIN, quality);
+  TEST_ASSERT_LESS_THAN(ROI_QUALITY_MIN, quality - ROI_QUALITY_STEP);
+  TEST_ASSERT_EQUAL(quality, script.qualities.back());
+  TEST_ASSERT_EQUAL(overBudget + 1, frameCropStats().overBudget);
+}
+
+void test_decode_failure_above_the_crop_fails(void) {
+  RoiRect rect = {0, 16, 32, 16};
+  uint8_t *out = (uint8_t *)1;
+  size_t length = 1;
+  uint8_t quality;
+  uint32_t failures = frameCropStats().failures;
+  script.failDecodeAtRow = 24;
+  TEST_ASSERT_FALSE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 0, 100000, &out, &length, &quality));
+  TEST_ASSERT_NULL(out);
+  TEST_ASSERT_EQUAL(0, length);
+  TEST_ASSERT_EQUAL(0, script.qualities.size());
+  TEST_ASSERT_EQUAL(failures + 1, frameCropStats().failures);
+
+  // a bad row further down is never reached, the crop stops the decode first
+  script.failDecodeAtRow = 40;
+  TEST_ASSERT_TRUE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 0, 100000, &out, &length, &quality));
+  free(out);
+}
+
+void test_encode_failure_fails(void) {
+  RoiRect rect = {0, 0, 16, 16};
+  uint8_t *out;
+  size_t length;
+  uint8_t quality;
+  uint32_t crops = frameCropStats().crops;
+  script.failEncode = true;
+  TEST_ASSERT_FALSE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 0, 100000, &out, &length, &quality));
+  TEST_ASSERT_NULL(out);
+  TEST_ASSERT_EQUAL(crops, frameCropStats().crops);
+}
+
+void test_stats_count_bytes(void) {
+  FrameCropStats before = frameCropStats();
+  RoiRect rect = {0, 0, 16, 16};
+  uint8_t *out;
+  size_t length;
+  uint8_t quality;
+  TEST_ASSERT_TRUE(frameCrop(codec, jpeg, sizeof(jpeg), rect, 0, 100000, &out, &length, &quality));
+  free(out);
+  TEST_ASSERT_EQUAL(before.crops + 1, frameCropStats().crops);
+  TEST_ASSERT_EQUAL(before.bytesIn + sizeof(jpeg), frameCropStats().bytesIn);
+  TEST_ASSERT_EQUAL(before.bytesOut + length, frameCropStats().bytesOut);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_region_reaches_the_encoder_as_bgr);
+  RUN_TEST(test_scale_shift_scales_the_region);
+  RUN_TEST(test_quality_steps_down_to_the_budget);
+  RUN_TEST(test_decode_failure_above_the_crop_fails);
+  RUN_TEST(test_encode_failure_fails);
+  RUN_TEST(test_stats_count_bytes);
+  return UNITY_END();
+}
@@ -0,0 +1,134 @@
+// the pre-trigger frame history: eviction order, references held by uploads,
+// and the pool stats
+
+#include <unity.h>
+#include <string.h>
+#include "frame_ring.h"
+
+#define SLOT_SIZE 1024
+
+static uint8_t arena[6 * SLOT_SIZE];
+static FrameRing ring;
+static uint8_t frame[SLOT_SIZE + 1];
+
+static StoredFrame *push(uint8_t fill, size_t length = 100) {
+  memset(frame, fill, length);
+  return ring.push(frame, length, fill * 1000, 1600, 1200);
+}
+
+void setUp(void) {
+  // six slots, four frames of history, two spare for uploads
+  TEST_ASSERT_TRUE(ring.begin(arena, sizeof(arena), SLOT_SIZE, 4));
+}
+
+void tearDown(void) {}
+
+void test_begin_carves_whole_slots(void) {
+  FrameRing other;
+  TEST_ASSERT_FALSE(other.begin(NULL, sizeof(arena), SLOT_SIZE, 4));
+  TEST_ASSERT_FALSE(other.begin(arena, SLOT_SIZE - 1, SLOT_SIZE, 4));
+  TEST_ASSERT_TRUE(other.begin(arena, sizeof(arena) + SLOT_SIZE / 2, SLOT_SIZE, 0));
+  TEST_ASSERT_EQUAL(6, other.stats().slots);
+  // never more than FRAME_RING_MAX_SLOTS, however big the arena
+  TEST_ASSERT_TRUE(other.begin(arena, sizeof(arena), 16, 0));
+  TEST_ASSERT_EQUAL(FRAME_RING_MAX_SLOTS, other.stats().slots);
+}
+
+void test_oldest_frame_is_evicted(void) {
+  for (uint8_t i = 1; i <= 6; i++) TEST_ASSERT_NOT_NULL(push(i));
+  TEST_ASSERT_EQUAL(4, ring.count());
+  for (uint16_t i = 0; i < 4; i++) {
+    StoredFrame *stored = ring.at(i);
+    TEST_ASSERT_EQUAL(i + 3, stored->data[0]);
+    TEST_ASSERT_EQUAL(i + 3, stored->sequence);
+    TEST_ASSERT_EQUAL((i + 3) * 1000, stored->captureUs);
+  }
+  TEST_ASSERT_EQUAL(6, ring.newest()->sequence);
+  TEST_ASSERT_NULL(ring.at(4));
+  TEST_ASSERT_EQUAL(2, ring.stats().evictions);
+  TEST_ASSERT_EQUAL(4, ring.stats().slotsInUse);
+}
+
+void test_retained_frame_survives_eviction(void) {
+  StoredFrame *uploading = push(1);
+  ring.retain(uploading);
+  for (uint8_t i = 2; i <= 9; i++) TEST_ASSERT_NOT_NULL(push(i));
+
+  // evicted from the history but its bytes are untouched
+  TEST_ASSERT_EQUAL(6, ring.at(0)->data[0]);
+  TEST_ASSERT_EQUAL(1, uploading->data[0]);
+  TEST_ASSERT_EQUAL(100, uploading->length);
+  TEST_ASSERT_EQUAL(5, ring.stats().slotsInUse);
+
+  ring.release(uploading);
+  TEST_ASSERT_EQUAL(4, ring.stats().slotsInUse);
+  TEST_ASSERT_EQUAL(0, uploading->length);
+}
+
+void test_push_fails_when_every_slot_is_held(void) {
+  StoredFrame *first = NULL;
+  for (uint8_t i = 1; i <= 6; i++) {
+    StoredFrame *stored = push(i);
+    TEST_ASSERT_NOT_NULL(stored);
+    ring.retain(stored);
+    if (i == 1) first = stored;
+  }
+  TEST_ASSERT_NULL(push(7));
+  TEST_ASSERT_EQUAL(1, ring.stats().exhausted);
+
+  // the upload holding the evicted frame lets go and the slot is free again
+  ring.release(first);
+  StoredFrame *stored = push(8);
+  TEST_ASSERT_NOT_NULL(stored);
+  TEST_ASSERT_EQUAL_PTR(first, stored);
+  TEST_ASSERT_EQUAL(8, ring.newest()->data[0]);
+}
+
+void test_oversize_frame_is_refused(void) {
+  TEST_ASSERT_NULL(push(1, SLOT_SIZE + 1));
+  TEST_ASSERT_EQUAL(1, ring.stats().oversize);
+  TEST_ASSERT_EQUAL(0, ring.count());
+  TEST_ASSERT_NOT_NULL(push(1, SLOT_SIZE));
+}
+
+void test_stats_track_peak_and_fragmentation(void) {
+  push(1, SLOT_SIZE);
+  push(2, SLOT_SIZE / 2);
+  TEST_ASSERT_EQUAL(SLOT_SIZE + SLOT_SIZE / 2, ring.stats().bytesInUse);
+  TEST_ASSERT_EQUAL(25, ring.fragmentationPercent());
+  ring.clear();
+  TEST_ASSERT_EQUAL(0, ring.count());
+  TEST_ASSERT_EQUAL(0, ring.stats().bytesInUse);
+  TEST_ASSERT_EQUAL(0, ring.fragmentationPercent());
+  TEST_ASSERT_EQUAL(SLOT_SIZE + SLOT_SIZE / 2, ring.stats().peakBytesInUse);
+  TEST_ASSERT_EQUAL(2, ring.stats().peakSlotsInUse);
+}
+
+void test_clear_keeps_retained_frames(void) {
+  StoredFrame *uploading = push(1);
+  push(2);
+  ring.retain(uploading);
+  ring.clear();
+  TEST_ASSERT_EQUAL(0, ring.count());
+  TEST_ASSERT_EQUAL(1, ring.stats().slotsInUse);
+  TEST_ASSERT_EQUAL(1, uploading->data[0]);
+  ring.release(uploading);
+  TEST_ASSERT_EQUAL(0, ring.stats().slotsInUse);
+  // a stray extra release does nothing
+  ring.release(uploading);
+  TEST_ASSERT_EQUAL(0, ring.stats().slotsInUse);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_carves_whole_slots);
+  RUN_TEST(test_oldest_frame_is_evicted);
+  RUN_TEST(test_retained_frame_survives_eviction);
+  RUN_TEST(test_push_fails_when_every_slot_is_held);
+  RUN_TEST(test_oversize_frame_is_refused);
+  RUN_TEST(test_stats_track_peak_and_fragmentation);
+  RUN_TEST(test_clear_keeps_retained_frames);
+  return UNITY_END();
+}
@@ -0,0 +1,169 @@
+// +CGNSSINFO replies as SIM7600 firmware sends them, with and without the
+// Galileo column, before the first fix and cut short, and the fix cache
+
+#include <unity.h>
+#include <string.h>
+#include "gnss.h"
+#include "wall_clock.h"
+
+// the SIM7600 AT manual example, GPS, GLONASS and BeiDou counts
+static const char *const threeSystems =
+    "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.234064,E,131117,091918.0,32.9,0.0,255.0,1.1,0.8,0.7\r\n";
+// newer firmware adds Galileo; a site in the lowveld, south and east
+static const char *const fourSystems =
+    "+CGNSSINFO: 3,10,06,02,01,2429.118200,S,03127.552800,E,161026,120000.0,412.5,1.2,87.0,1.4,0.9,1.1";
+static const char *const searching = "+CGNSSINFO: ,,,,,,,,,,,,,,,";
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_fields_split_in_place(void) {
+  char text[] = "3,,5,";
+  char *fields[GNSS_MAX_FIELDS];
+  TEST_ASSERT_EQUAL(4, gnssSplitFields(text, fields, GNSS_MAX_FIELDS));
+  TEST_ASSERT_EQUAL_STRING("3", fields[0]);
+  TEST_ASSERT_EQUAL_STRING("", fields[1]);
+  TEST_ASSERT_EQUAL_STRING("5", fields[2]);
+  TEST_ASSERT_EQUAL_STRING("", fields[3]);
+
+  char more[] = "a,b,c,d";
+  TEST_ASSERT_EQUAL(2, gnssSplitFields(more, fields, 2));
+  TEST_ASSERT_EQUAL_STRING("b", fields[1]);
+}
+
+void test_three_system_reply(void) {
+  GnssFix fix;
+  TEST_ASSERT_TRUE(gnssParseInfo(threeSystems, 1234, &fix));
+  TEST_ASSERT_TRUE(fix.valid);
+  TEST_ASSERT_EQUAL(2, fix.mode);
+  TEST_ASSERT_EQUAL(14, fix.satellites);
+  TEST_ASSERT_EQUAL(312223881, fix.latitudeE7);
+  TEST_ASSERT_EQUAL(1213539011, fix.longitudeE7);
+  TEST_ASSERT_EQUAL_FLOAT(32.9f, fix.altitude);
+  TEST_ASSERT_EQUAL_FLOAT(255.0f, fix.course);
+  TEST_ASSERT_EQUAL_FLOAT(0.8f, fix.hdop);
+  TEST_ASSERT_EQUAL_FLOAT(0.7f, fix.vdop);
+  TEST_ASSERT_EQUAL_INT64((wallClockDaysFromCivil(2017, 11, 13) * 86400 + 9 * 3600 + 19 * 60 + 18) * 1000000,
+                          fix.utcUs);
+  TEST_ASSERT_EQUAL_INT64(1234, fix.monoUs);
+}
+
+void test_galileo_column_and_southern_hemisphere(void) {
+  GnssFix fix;
+  TEST_ASSERT_TRUE(gnssParseInfo(fourSystems, 0, &fix));
+  TEST_ASSERT_EQUAL(3, fix.mode);
+  TEST_ASSERT_EQUAL(19, fix.satellites);
+  TEST_ASSERT_EQUAL(-244853033, fix.latitudeE7);
+  TEST_ASSERT_EQUAL(314592133, fix.longitudeE7);
+  TEST_ASSERT_EQUAL_FLOAT(412.5f, fix.altitude);
+  TEST_ASSERT_EQUAL_FLOAT(0.9f, fix.hdop);
+
+  // the same without the prefix, as a +CGNSSINFO=<n> URC body may come
+  GnssFix bare;
+  TEST_ASSERT_TRUE(gnssParseInfo(strchr(fourSystems, ' ') + 1, 0, &bare));
+  TEST_ASSERT_EQUAL(fix.latitudeE7, bare.latitudeE7);
+}
+
+void test_empty_reply_is_no_fix_but_not_an_error(void) {
+  GnssFix fix;
+  TEST_ASSERT_TRUE(gnssParseInfo(searching, 0, &fix));
+  TEST_ASSERT_FALSE(fix.valid);
+  TEST_ASSERT_TRUE(gnssParseInfo("+CGNSSINFO: ,,,,,,,,,,,,,,,,\r\n", 0, &fix));
+  TEST_ASSERT_FALSE(fix.valid);
+  // but a bare "+CGNSSINFO:" isn't a reply at all
+  TEST_ASSERT_FALSE(gnssParseInfo("+CGNSSINFO: ", 0, &fix));
+}
+
+void test_missing_tail_still_gives_a_position(void) {
+  GnssFix fix;
+  TEST_ASSERT_TRUE(gnssParseInfo("+CGNSSINFO: 2,04,00,00,3113.343286,N,12121.234064,E,131117,091918.0", 0, &fix));
+  TEST_ASSERT_EQUAL(312223881, fix.latitudeE7);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, fix.hdop);
+  // no time fields either, the time is left at 0
+  TEST_ASSERT_TRUE(gnssParseInfo("+CGNSSINFO: 2,04,00,00,3113.343286,N,12121.234064,E,,", 0, &fix));
+  TEST_ASSERT_EQUAL_INT64(0, fix.utcUs);
+}
+
+void test_malformed_replies_are_refused(void) {
+  GnssFix fix;
+  // cut before the longitude
+  TEST_ASSERT_FALSE(gnssParseInfo("+CGNSSINFO: 2,09,05,00,3113.343286,N", 0, &fix));
+  // garbage in a coordinate, a bad hemisphere, minutes past 60
+  TEST_ASSERT_FALSE(gnssParseInfo("+CGNSSINFO: 2,09,05,00,31x3.343286,N,12121.234064,E,131117,091918.0", 0, &fix));
+  TEST_ASSERT_FALSE(gnssParseInfo("+CGNSSINFO: 2,09,05,00,3113.343286,X,12121.234064,E,131117,091918.0", 0, &fix));
+  TEST_ASSERT_FALSE(gnssParseInfo("+CGNSSINFO: 2,09,05,00,3163.343286,N,12121.234064,E,131117,091918.0", 0, &fix));
+  TEST_ASSERT_FALSE(fix.valid);
+  // longer than any real reply
+  char huge[400];
+  memset(huge, '1', sizeof(huge) - 1);
+  huge[sizeof(huge) - 1] = '\0';
+  TEST_ASSERT_FALSE(gnssParseInfo(huge, 0, &fix));
+}
+
+void test_coordinates_format_as_dms(void) {
+  char out[32];
+  TEST_ASSERT_EQUAL(13, gnssFormatDms(out, sizeof(out), 312223881, true));
+  TEST_ASSERT_EQUAL_STRING("N31*13'20.60\"", out);
+  TEST_ASSERT_TRUE(gnssFormatDms(out, sizeof(out), -244853033, true) > 0);
+  TEST_ASSERT_EQUAL_STRING("S24*29'7.09\"", out);
+  TEST_ASSERT_TRUE(gnssFormatDms(out, sizeof(out), -1213539011, false) > 0);
+  TEST_ASSERT_EQUAL('W', out[0]);
+  TEST_ASSERT_EQUAL(0, gnssFormatDms(out, 8, 312223881, true));
+}
+
+void test_cache_keeps_the_last_fix(void) {
+  GnssCache cache;
+  TEST_ASSERT_FALSE(cache.hasFix());
+  TEST_ASSERT_EQUAL_INT64(-1, cache.ageUs(0));
+  TEST_ASSERT_NULL(cache.fresh(0, 1000000));
+
+  TEST_ASSERT_TRUE(cache.update(threeSystems, 1000000));
+  // losing the sky doesn't lose the fix, it just ages
+  TEST_ASSERT_FALSE(cache.update(searching, 5000000));
+  TEST_ASSERT_FALSE(cache.update("+CGNSSINFO: 2,09", 6000000));
+  TEST_ASSERT_TRUE(cache.hasFix());
+  TEST_ASSERT_EQUAL(312223881, cache.last().latitudeE7);
+  TEST_ASSERT_EQUAL_INT64(9000000, cache.ageUs(10000000));
+  TEST_ASSERT_NOT_NULL(cache.fresh(10000000, 9000000));
+  TEST_ASSERT_NULL(cache.fresh(10000001, 9000000));
+
+  TEST_ASSERT_EQUAL(3, cache.stats().replies);
+  TEST_ASSERT_EQUAL(1, cache.stats().fixes);
+  TEST_ASSERT_EQUAL(1, cache.stats().empty);
+  TEST_ASSERT_EQUAL(1, cache.stats().malformed);
+}
+
+void test_better_prefers_3d_then_hdop(void) {
+  GnssFix twoD, threeD, none;
+  TEST_ASSERT_TRUE(gnssParseInfo(threeSystems, 0, &twoD));
+  TEST_ASSERT_TRUE(gnssParseInfo(fourSystems, 0, &threeD));
+  TEST_ASSERT_TRUE(gnssParseInfo(searching, 0, &none));
+  TEST_ASSERT_TRUE(GnssCache::better(threeD, twoD));
+  TEST_ASSERT_FALSE(GnssCache::better(twoD, threeD));
+  TEST_ASSERT_TRUE(GnssCache::better(twoD, none));
+
+  GnssFix sharper = threeD;
+  sharper.hdop = 0.6f;
+  TEST_ASSERT_TRUE(GnssCache::better(sharper, threeD));
+  // no HDOP at all loses to any real one
+  GnssFix unknown = threeD;
+  unknown.hdop = 0;
+  TEST_ASSERT_FALSE(GnssCache::better(unknown, threeD));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_fields_split_in_place);
+  RUN_TEST(test_three_system_reply);
+  RUN_TEST(test_galileo_column_and_southern_hemisphere);
+  RUN_TEST(test_empty_reply_is_no_fix_but_not_an_error);
+  RUN_TEST(test_missing_tail_still_gives_a_position);
+  RUN_TEST(test_malformed_replies_are_refused);
+  RUN_TEST(test_coordinates_format_as_dms);
+  RUN_TEST(test_cache_keeps_the_last_fix);
+  RUN_TEST(test_better_prefers_3d_then_hdop);
+  return UNITY_END();
+}
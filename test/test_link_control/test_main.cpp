@@ -0,0 +1,197 @@
+// the link-adaptive capture controller on synthetic throughput traces: it
+// steps down at once when the link slows, back up only after a run of
+// roomy events, and reads +CSQ and +CPSI for its prior
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "link_control.h"
+
+// six levels from QVGA to UXGA, costs relative to the captured bytes
+static const LinkConfig config = {20000, 6, {30, 55, 90, 150, 170, 220}, 3, 70, 500, 5};
+// bytes one unit of cost captures, UXGA at top quality is about 220 KB
+#define BYTES_PER_COST 1000
+
+static LinkController controller;
+
+struct TraceResult {
+  int overTarget;
+  std::vector<uint8_t> levels; // level each event was captured at
+};
+
+// each entry is the link's true throughput in bytes per second for one event
+static TraceResult replay(const std::vector<uint32_t> &trace) {
+  TraceResult result = {0, {}};
+  for (uint32_t bps : trace) {
+    uint32_t bytes = BYTES_PER_COST * config.cost[controller.level()];
+    uint32_t ms = (uint32_t)((uint64_t)bytes * 1000 / bps);
+    result.levels.push_back(controller.level());
+    if (ms > config.targetMs) result.overTarget++;
+    controller.eventUploaded(bytes, bytes, ms, true);
+  }
+  return result;
+}
+
+static std::vector<uint32_t> steady(uint32_t bps, size_t events) {
+  return std::vector<uint32_t>(events, bps);
+}
+
+static LinkSignal csqSignal(int csq) {
+  LinkSignal signal;
+  memset(&signal, 0, sizeof(signal));
+  signal.csq = (int8_t)csq;
+  strcpy(signal.mode, "LTE");
+  return signal;
+}
+
+void setUp(void) {
+  controller = LinkController();
+  controller.begin(config, 5);
+}
+
+void tearDown(void) {}
+
+void test_signal_lines_are_parsed(void) {
+  TEST_ASSERT_EQUAL(18, linkParseCsq("+CSQ: 18,99"));
+  TEST_ASSERT_EQUAL(0, linkParseCsq("+CSQ: 0,0"));
+  TEST_ASSERT_EQUAL(LINK_CSQ_UNKNOWN, linkParseCsq("+CSQ: 99,99"));
+  TEST_ASSERT_EQUAL(LINK_CSQ_UNKNOWN, linkParseCsq("+CSQ: ,"));
+  TEST_ASSERT_EQUAL(LINK_CSQ_UNKNOWN, linkParseCsq("ERROR"));
+
+  LinkSignal signal;
+  TEST_ASSERT_TRUE(
+      linkParseCpsi("+CPSI: LTE,Online,655-01,0x5A1E,187214780,257,EUTRAN-BAND3,1850,5,5,-94,-850,-545,15", &signal));
+  TEST_ASSERT_EQUAL_STRING("LTE", signal.mode);
+  TEST_ASSERT_EQUAL(-85, signal.rsrpDbm);
+  TEST_ASSERT_EQUAL(15, signal.snrDb);
+  // GSM and no service carry no RSRP
+  TEST_ASSERT_TRUE(linkParseCpsi("+CPSI: GSM,Online,655-01,0x1234,5678,23,EGSM 900,-71,0,31-31", &signal));
+  TEST_ASSERT_EQUAL_STRING("GSM", signal.mode);
+  TEST_ASSERT_EQUAL(0, signal.rsrpDbm);
+  TEST_ASSERT_TRUE(linkParseCpsi("+CPSI: NO SERVICE,Online", &signal));
+  TEST_ASSERT_EQUAL_STRING("NO SERVICE", signal.mode);
+  TEST_ASSERT_FALSE(linkParseCpsi("nothing", &signal));
+  TEST_ASSERT_FALSE(linkParseCpsi("+CPSI: ,Online", &signal));
+}
+
+void test_signal_is_the_prior_before_any_upload(void) {
+  TEST_ASSERT_EQUAL(config.priorBpsPerCsq, controller.throughputBps());
+  TEST_ASSERT_EQUAL(0, controller.predictMs(5));
+  TEST_ASSERT_FALSE(controller.signal(csqSignal(20)));
+  TEST_ASSERT_EQUAL(20 * config.priorBpsPerCsq, controller.throughputBps());
+  TEST_ASSERT_EQUAL(5, controller.level());
+}
+
+void test_strong_link_stays_at_the_top(void) {
+  controller.signal(csqSignal(20));
+  TraceResult result = replay(steady(40000, 20));
+  TEST_ASSERT_EQUAL(0, result.overTarget);
+  TEST_ASSERT_EQUAL(5, controller.level());
+  TEST_ASSERT_EQUAL(0, controller.stats().stepsDown);
+}
+
+void test_slowdown_steps_down_at_once(void) {
+  controller.signal(csqSignal(20));
+  std::vector<uint32_t> trace = steady(20000, 4);
+  std::vector<uint32_t> slow = steady(5000, 6);
+  std::vector<uint32_t> crawl = steady(2000, 4);
+  trace.insert(trace.end(), slow.begin(), slow.end());
+  trace.insert(trace.end(), crawl.begin(), crawl.end());
+  TraceResult result = replay(trace);
+
+  // one event over target at each slowdown, then back under it
+  TEST_ASSERT_EQUAL(2, result.overTarget);
+  TEST_ASSERT_EQUAL(5, result.levels[4]);
+  TEST_ASSERT_LESS_THAN(5, result.levels[5]);
+  // 20 s at 2 KB/s is 40 KB, only the cheapest level fits
+  TEST_ASSERT_EQUAL(0, controller.level());
+  TEST_ASSERT_EQUAL(0, controller.stats().stepsUp);
+}
+
+void test_recovery_steps_up_gradually(void) {
+  controller.signal(csqSignal(20));
+  replay(steady(2000, 3));
+  TEST_ASSERT_EQUAL(0, controller.level());
+
+  TraceResult result = replay(steady(40000, 40));
+  TEST_ASSERT_EQUAL(0, result.overTarget);
+  TEST_ASSERT_EQUAL(5, controller.level());
+  // never more than one level per stepUpEvents events
+  for (size_t i = 1; i < result.levels.size(); i++) {
+    TEST_ASSERT_LESS_OR_EQUAL(result.levels[i - 1] + 1, result.levels[i]);
+  }
+  for (size_t i = config.stepUpEvents; i < result.levels.size(); i++) {
+    if (result.levels[i] > result.levels[i - 1]) {
+      TEST_ASSERT_EQUAL(result.levels[i - config.stepUpEvents], result.levels[i - 1]);
+    }
+  }
+  TEST_ASSERT_EQUAL(5, controller.stats().stepsUp);
+}
+
+void test_marginal_link_does_not_flap(void) {
+  // the top level would take 16 s, under target but without headroom
+  controller.begin(config, 4);
+  controller.signal(csqSignal(20));
+  TraceResult result = replay(steady(220 * BYTES_PER_COST * 1000 / 16000, 30));
+  TEST_ASSERT_EQUAL(0, result.overTarget);
+  TEST_ASSERT_EQUAL(4, controller.level());
+  TEST_ASSERT_EQUAL(0, controller.stats().stepsUp);
+}
+
+void test_signal_collapse_steps_down_before_the_next_event(void) {
+  controller.signal(csqSignal(20));
+  replay(steady(20000, 3));
+  TEST_ASSERT_EQUAL(5, controller.level());
+  // an unknown reading changes nothing
+  TEST_ASSERT_FALSE(controller.signal(csqSignal(LINK_CSQ_UNKNOWN)));
+  uint32_t before = controller.throughputBps();
+  TEST_ASSERT_TRUE(controller.signal(csqSignal(5)));
+  TEST_ASSERT_LESS_THAN(5, controller.level());
+  TEST_ASSERT_EQUAL(before * 5 / 20, controller.throughputBps());
+  TEST_ASSERT_LESS_OR_EQUAL(config.targetMs, controller.predictMs(controller.level()));
+}
+
+void test_failures_back_off(void) {
+  controller.signal(csqSignal(5));
+  // nothing learned yet, one level down per failure
+  TEST_ASSERT_TRUE(controller.eventUploaded(0, 0, 0, false));
+  TEST_ASSERT_EQUAL(4, controller.level());
+  TEST_ASSERT_EQUAL(5 * config.priorBpsPerCsq / 2, controller.throughputBps());
+  TEST_ASSERT_EQUAL(1, controller.stats().failures);
+
+  // once costs are known a failure halves the throughput and re-plans
+  replay(steady(20000, 2));
+  uint8_t level = controller.level();
+  controller.eventUploaded(0, 0, 0, false);
+  controller.eventUploaded(0, 0, 0, false);
+  TEST_ASSERT_LESS_THAN(level, controller.level());
+}
+
+void test_thumbnail_uploads_learn_the_frame_cost(void) {
+  // an 8 KB thumbnail goes up in place of the 220 KB frame
+  controller.signal(csqSignal(20));
+  TEST_ASSERT_TRUE(controller.eventUploaded(8000, 220 * BYTES_PER_COST, 800, true));
+  TEST_ASSERT_EQUAL(8000, controller.stats().lastEventBytes);
+  TEST_ASSERT_EQUAL(220 * BYTES_PER_COST, controller.stats().lastFrameBytes);
+  TEST_ASSERT_EQUAL(10000, controller.throughputBps());
+  // the frames still go up later: 220 KB at 10 KB/s is over target
+  TEST_ASSERT_EQUAL(22000, controller.predictMs(5));
+  TEST_ASSERT_EQUAL(4, controller.level());
+  TEST_ASSERT_EQUAL(17000, controller.predictMs(4));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_signal_lines_are_parsed);
+  RUN_TEST(test_signal_is_the_prior_before_any_upload);
+  RUN_TEST(test_strong_link_stays_at_the_top);
+  RUN_TEST(test_slowdown_steps_down_at_once);
+  RUN_TEST(test_recovery_steps_up_gradually);
+  RUN_TEST(test_marginal_link_does_not_flap);
+  RUN_TEST(test_signal_collapse_steps_down_before_the_next_event);
+  RUN_TEST(test_failures_back_off);
+  RUN_TEST(test_thumbnail_uploads_learn_the_frame_cost);
+  return UNITY_END();
+}
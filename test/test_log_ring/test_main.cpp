@@ -0,0 +1,155 @@
+// the lock-free log ring: records in order across the wrap, lines of any
+// length, drops when full, and several producers against one consumer
+
+#include <unity.h>
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log_ring.h"
+
+#define RING_SIZE 4096
+
+static uint32_t buffer[RING_SIZE / 4];
+static LogRing ring;
+
+static int ringPrintf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = ring.vprintf(format, args);
+  va_end(args);
+  return length;
+}
+
+static std::string readAll() {
+  std::string text;
+  uint8_t out[LOG_RING_MAX_RECORD];
+  size_t count;
+  while ((count = ring.read(out, sizeof(out))) > 0) text.append((const char *)out, count);
+  return text;
+}
+
+void setUp(void) {
+  TEST_ASSERT_TRUE(ring.begin(buffer, sizeof(buffer)));
+}
+
+void tearDown(void) {}
+
+void test_begin_wants_a_power_of_two(void) {
+  LogRing other;
+  TEST_ASSERT_FALSE(other.begin(buffer, RING_SIZE - 4));
+  TEST_ASSERT_FALSE(other.begin(buffer, 1024));
+  TEST_ASSERT_FALSE(other.begin(NULL, RING_SIZE));
+  TEST_ASSERT_FALSE(other.write("x", 1));
+}
+
+void test_records_come_out_in_order(void) {
+  TEST_ASSERT_TRUE(ring.write("one\n", 4));
+  TEST_ASSERT_EQUAL(7, ringPrintf("two %d\n", 22));
+  TEST_ASSERT_EQUAL_STRING("one\ntwo 22\n", readAll().c_str());
+  TEST_ASSERT_EQUAL(0, ring.used());
+  TEST_ASSERT_EQUAL(2, ring.stats().messages);
+  TEST_ASSERT_EQUAL(11, ring.stats().bytes);
+}
+
+void test_records_wrap_the_ring(void) {
+  // odd sizes so payloads straddle the end of the buffer
+  std::string expected;
+  for (int i = 0; i < 200; i++) {
+    char line[64];
+    int length = snprintf(line, sizeof(line), "I (%d) SmartCamera: line %d%.*s\n", i * 37, i, i % 13, "xxxxxxxxxxxxx");
+    TEST_ASSERT_TRUE(ring.write(line, length));
+    expected += line;
+    if (i % 7 == 0) {
+      TEST_ASSERT_EQUAL_STRING(expected.c_str(), readAll().c_str());
+      expected.clear();
+    }
+  }
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), readAll().c_str());
+}
+
+void test_long_lines_arrive_whole(void) {
+  // the old handler cut everything at 128 bytes
+  std::string line(3000, 'a');
+  for (size_t i = 0; i < line.size(); i += 100) line[i] = '0' + i / 100 % 10;
+  TEST_ASSERT_EQUAL(3001, ringPrintf("%s\n", line.c_str()));
+  TEST_ASSERT_EQUAL_STRING((line + "\n").c_str(), readAll().c_str());
+  TEST_ASSERT_EQUAL(1, ring.stats().messages);
+  TEST_ASSERT_EQUAL(0, ring.stats().truncated);
+}
+
+void test_full_ring_drops_and_counts(void) {
+  char line[200];
+  memset(line, 'z', sizeof(line));
+  int written = 0;
+  while (ring.write(line, sizeof(line))) written++;
+  TEST_ASSERT_GREATER_THAN(10, written);
+  TEST_ASSERT_FALSE(ring.write(line, sizeof(line)));
+  TEST_ASSERT_EQUAL(2, ring.stats().dropped);
+  TEST_ASSERT_EQUAL(2, ring.takeDropped());
+  TEST_ASSERT_EQUAL(0, ring.takeDropped());
+  TEST_ASSERT_LESS_OR_EQUAL(RING_SIZE, ring.stats().highWater);
+  TEST_ASSERT_GREATER_THAN(RING_SIZE - 256, ring.stats().highWater);
+
+  // reading frees the space again
+  TEST_ASSERT_EQUAL(written * sizeof(line), readAll().size());
+  TEST_ASSERT_TRUE(ring.write(line, sizeof(line)));
+}
+
+void test_producers_never_interleave_or_reorder(void) {
+  const int producers = 4;
+  const int messages = 5000;
+  static std::atomic<int> finished(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < producers; t++) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < messages; i++) {
+        ringPrintf("I (%d) SmartCamera: producer %d message %d\n", i, t, i);
+        if (i % 64 == 0) std::this_thread::yield();
+      }
+      finished++;
+    });
+  }
+
+  // one consumer reads while the producers run
+  std::string text;
+  while (finished < producers) text += readAll();
+  for (std::thread &thread : threads) thread.join();
+  text += readAll();
+
+  int last[producers];
+  for (int t = 0; t < producers; t++) last[t] = -1;
+  int lines = 0;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    TEST_ASSERT_TRUE(end != std::string::npos);
+    int stamp, producer, message;
+    TEST_ASSERT_EQUAL(3, sscanf(text.c_str() + start, "I (%d) SmartCamera: producer %d message %d", &stamp, &producer,
+                                &message));
+    TEST_ASSERT_EQUAL(stamp, message);
+    TEST_ASSERT_GREATER_THAN(last[producer], message);
+    last[producer] = message;
+    lines++;
+    start = end + 1;
+  }
+  // everything that wasn't counted as dropped got through
+  TEST_ASSERT_EQUAL(producers * messages, ring.stats().messages);
+  TEST_ASSERT_EQUAL(producers * messages - (int)ring.stats().dropped, lines);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_wants_a_power_of_two);
+  RUN_TEST(test_records_come_out_in_order);
+  RUN_TEST(test_records_wrap_the_ring);
+  RUN_TEST(test_long_lines_arrive_whole);
+  RUN_TEST(test_full_ring_drops_and_counts);
+  RUN_TEST(test_producers_never_interleave_or_reorder);
+  return UNITY_END();
+}
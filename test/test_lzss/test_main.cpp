@@ -0,0 +1,295 @@
+// the SCZ1 compressor: streams decode back to the input whatever the piece
+// sizes, stay inside LZSS_MAX_OUTPUT and match lzss_decompress.py byte for byte
+
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "crc32.h"
+#include "lzss.h"
+
+// lzss_decompress.py --compress on twoLines
+static const char *const twoLines = "I (1200) SmartCamera: Picture taken\nI (1250) SmartCamera: Picture sent\n";
+static const uint8_t toolStream[] = {
+    0x53, 0x43, 0x5a, 0x31, 0x0c, 0x05, 0xa4, 0xc8, 0x25, 0x13, 0x19, 0x94, 0xc2, 0x61, 0x29, 0x90,
+    0x54, 0xed, 0xb6, 0x1b, 0x95, 0xd2, 0x87, 0x61, 0xb6, 0xd9, 0x6e, 0x56, 0x19, 0xd4, 0x82, 0xa1,
+    0x69, 0xb1, 0xdd, 0x2e, 0xb7, 0x2b, 0x2c, 0x82, 0xe9, 0x61, 0xb5, 0xd9, 0x6d, 0xd0, 0xa0, 0x11,
+    0x8a, 0x6a, 0x02, 0x3a, 0xdc, 0xec, 0xb6, 0xeb, 0xa4, 0x28, 0x47, 0x00, 0x00, 0x00, 0x5f, 0x8b,
+    0xfe, 0x71,
+};
+// lzss_decompress.py --compress with a 10 bit window and 4 bit lengths
+static const uint8_t toolStream10x4[] = {
+    0x53, 0x43, 0x5a, 0x31, 0x0a, 0x04, 0xa4, 0xc8, 0x25, 0x13, 0x19, 0x94, 0xc2, 0x61, 0x29, 0x90,
+    0x54, 0xed, 0xb6, 0x1b, 0x95, 0xd2, 0x87, 0x61, 0xb6, 0xd9, 0x6e, 0x56, 0x19, 0xd4, 0x82, 0xa1,
+    0x69, 0xb1, 0xdd, 0x2e, 0xb7, 0x2b, 0x2c, 0x82, 0xe9, 0x61, 0xb5, 0xd9, 0x6d, 0xd0, 0xa0, 0x46,
+    0x53, 0x50, 0x47, 0xe0, 0x8c, 0xee, 0x76, 0x5b, 0x75, 0xd2, 0x14, 0x47, 0x00, 0x00, 0x00, 0x5f,
+    0x8b, 0xfe, 0x71,
+};
+
+static uint8_t work[LZSS_WORK_SIZE] __attribute__((aligned(4)));
+static LzssEncoder encoder;
+
+struct Sink {
+  std::vector<uint8_t> out;
+  size_t failAfter; // 0 for never
+  size_t calls;
+};
+
+static Sink sink;
+
+static bool sinkWrite(const uint8_t *data, size_t length, void *context) {
+  Sink *to = (Sink *)context;
+  to->calls++;
+  if (to->failAfter && to->out.size() + length > to->failAfter) return false;
+  to->out.insert(to->out.end(), data, data + length);
+  return true;
+}
+
+static uint32_t getLe32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// the same walk over the bits as lzss_decompress.py, false on any bad stream
+static bool decode(const std::vector<uint8_t> &stream, std::vector<uint8_t> *out) {
+  out->clear();
+  if (stream.size() < LZSS_HEADER_SIZE + LZSS_TRAILER_SIZE) return false;
+  if (memcmp(stream.data(), LZSS_MAGIC, 4) != 0) return false;
+  int windowBits = stream[4];
+  int lengthBits = stream[5];
+  size_t available = (stream.size() - LZSS_HEADER_SIZE - LZSS_TRAILER_SIZE) * 8;
+  const uint8_t *bits = stream.data() + LZSS_HEADER_SIZE;
+  size_t position = 0;
+  auto take = [&](int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++, position++) {
+      value = (value << 1) | ((bits[position >> 3] >> (7 - (position & 7))) & 1);
+    }
+    return value;
+  };
+
+  while (available - position >= 9) {
+    if (take(1)) {
+      out->push_back((uint8_t)take(8));
+      continue;
+    }
+    if (available - position < (size_t)(windowBits + lengthBits)) break;
+    size_t distance = take(windowBits) + 1;
+    size_t length = take(lengthBits) + LZSS_MIN_MATCH;
+    if (distance > out->size()) return false;
+    size_t start = out->size() - distance;
+    // overlapping matches repeat the last distance bytes
+    for (size_t i = 0; i < length; i++) out->push_back((*out)[start + i]);
+  }
+
+  const uint8_t *trailer = stream.data() + stream.size() - LZSS_TRAILER_SIZE;
+  return getLe32(trailer) == out->size() && getLe32(trailer + 4) == crc32Update(0, out->data(), out->size());
+}
+
+// compress in pieces of at most piece bytes, 0 for all at once
+static bool compress(const std::vector<uint8_t> &input, size_t piece = 0, uint8_t windowBits = LZSS_WINDOW_BITS,
+                     uint8_t lengthBits = LZSS_LENGTH_BITS) {
+  encoder.begin(work, sinkWrite, &sink, windowBits, lengthBits);
+  size_t offset = 0;
+  while (offset < input.size()) {
+    size_t length = input.size() - offset;
+    if (piece && length > piece) length = piece;
+    if (!encoder.write(input.data() + offset, length)) return false;
+    offset += length;
+  }
+  return encoder.finish();
+}
+
+static std::vector<uint8_t> bytes(const std::string &text) {
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+// a few hours of the device log, much longer than the window
+static std::vector<uint8_t> logText(size_t length) {
+  std::string text;
+  static const char *const lines[] = {
+      "I (%lu) SmartCamera: Picture taken\n",
+      "I (%lu) SmartCamera: Picture sent, %lu bytes\n",
+      "W (%lu) modem: +CSQ: %lu,99\n",
+      "I (%lu) power: deep sleep for %lu ms\n",
+  };
+  unsigned long seed = 1;
+  for (unsigned long i = 0; text.size() < length; i++) {
+    seed = seed * 1103515245 + 12345;
+    char line[96];
+    snprintf(line, sizeof(line), lines[(seed >> 16) & 3], 1200 + i * 50, (seed >> 8) % 200000);
+    text += line;
+  }
+  text.resize(length);
+  return bytes(text);
+}
+
+static std::vector<uint8_t> noise(size_t length) {
+  std::vector<uint8_t> out(length);
+  uint32_t seed = 0x12345678;
+  for (size_t i = 0; i < length; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    out[i] = (uint8_t)seed;
+  }
+  return out;
+}
+
+void setUp(void) {
+  sink.out.clear();
+  sink.failAfter = 0;
+  sink.calls = 0;
+}
+
+void tearDown(void) {}
+
+void test_stream_matches_the_host_tool(void) {
+  std::vector<uint8_t> input = bytes(twoLines);
+  TEST_ASSERT_TRUE(compress(input));
+  TEST_ASSERT_EQUAL(sizeof(toolStream), sink.out.size());
+  TEST_ASSERT_EQUAL_MEMORY(toolStream, sink.out.data(), sizeof(toolStream));
+  TEST_ASSERT_EQUAL(input.size(), encoder.inputBytes());
+  TEST_ASSERT_EQUAL(sink.out.size(), encoder.outputBytes());
+}
+
+void test_header_and_trailer(void) {
+  std::vector<uint8_t> input = bytes(twoLines);
+  TEST_ASSERT_TRUE(compress(input));
+  TEST_ASSERT_EQUAL_MEMORY(LZSS_MAGIC, sink.out.data(), 4);
+  TEST_ASSERT_EQUAL(LZSS_WINDOW_BITS, sink.out[4]);
+  TEST_ASSERT_EQUAL(LZSS_LENGTH_BITS, sink.out[5]);
+  const uint8_t *trailer = sink.out.data() + sink.out.size() - LZSS_TRAILER_SIZE;
+  TEST_ASSERT_EQUAL(input.size(), getLe32(trailer));
+  TEST_ASSERT_EQUAL_HEX32(crc32Update(0, input.data(), input.size()), getLe32(trailer + 4));
+}
+
+void test_empty_input_is_just_header_and_trailer(void) {
+  std::vector<uint8_t> decoded;
+  TEST_ASSERT_TRUE(compress(std::vector<uint8_t>()));
+  TEST_ASSERT_EQUAL(LZSS_HEADER_SIZE + LZSS_TRAILER_SIZE, sink.out.size());
+  TEST_ASSERT_TRUE(decode(sink.out, &decoded));
+  TEST_ASSERT_EQUAL(0, decoded.size());
+}
+
+void test_log_text_round_trips_and_shrinks(void) {
+  std::vector<uint8_t> input = logText(3 * LZSS_WINDOW_SIZE + 123);
+  std::vector<uint8_t> decoded;
+  TEST_ASSERT_TRUE(compress(input));
+  TEST_ASSERT_TRUE(decode(sink.out, &decoded));
+  TEST_ASSERT_TRUE(decoded == input);
+  // log lines repeat a lot, less than half goes over the modem
+  TEST_ASSERT_LESS_THAN(input.size() / 2, sink.out.size());
+  // and it reaches the sink in small pieces
+  TEST_ASSERT_GREATER_THAN(sink.out.size() / 64, sink.calls);
+}
+
+void test_pieces_give_the_same_stream(void) {
+  std::vector<uint8_t> input = logText(2 * LZSS_WINDOW_SIZE + 77);
+  TEST_ASSERT_TRUE(compress(input));
+  std::vector<uint8_t> whole = sink.out;
+  static const size_t pieces[] = {1, 7, LZSS_MAX_MATCH, 1000, LZSS_WINDOW_SIZE + 1};
+  for (size_t piece : pieces) {
+    setUp();
+    TEST_ASSERT_TRUE(compress(input, piece));
+    TEST_ASSERT_TRUE(whole == sink.out);
+  }
+}
+
+void test_random_bytes_stay_inside_the_bound(void) {
+  std::vector<uint8_t> input = noise(10000);
+  std::vector<uint8_t> decoded;
+  TEST_ASSERT_TRUE(compress(input, 333));
+  TEST_ASSERT_LESS_OR_EQUAL(LZSS_MAX_OUTPUT(input.size()), sink.out.size());
+  TEST_ASSERT_TRUE(decode(sink.out, &decoded));
+  TEST_ASSERT_TRUE(decoded == input);
+}
+
+void test_runs_use_overlapping_matches(void) {
+  std::vector<uint8_t> input(5000, 'A');
+  input.insert(input.end(), 3000, 0);
+  std::vector<uint8_t> decoded;
+  TEST_ASSERT_TRUE(compress(input, 100));
+  TEST_ASSERT_TRUE(decode(sink.out, &decoded));
+  TEST_ASSERT_TRUE(decoded == input);
+  // one literal then full length matches, 18 bits per 34 bytes
+  TEST_ASSERT_LESS_THAN(input.size() / 12, sink.out.size());
+}
+
+void test_failing_sink_stops_the_encoder(void) {
+  std::vector<uint8_t> input = logText(LZSS_WINDOW_SIZE);
+  sink.failAfter = 200;
+  encoder.begin(work, sinkWrite, &sink);
+  bool ok = true;
+  for (size_t offset = 0; offset < input.size() && ok; offset += 256) {
+    ok = encoder.write(input.data() + offset, 256);
+  }
+  TEST_ASSERT_FALSE(ok);
+  TEST_ASSERT_FALSE(encoder.write(input.data(), 1));
+  TEST_ASSERT_FALSE(encoder.finish());
+  TEST_ASSERT_LESS_OR_EQUAL(200, sink.out.size());
+
+  // a failure in the trailer still fails finish()
+  setUp();
+  sink.failAfter = sizeof(toolStream) - 1;
+  encoder.begin(work, sinkWrite, &sink);
+  TEST_ASSERT_TRUE(encoder.write((const uint8_t *)twoLines, strlen(twoLines)));
+  TEST_ASSERT_FALSE(encoder.finish());
+}
+
+void test_other_window_and_length_bits(void) {
+  std::vector<uint8_t> input = bytes(twoLines);
+  TEST_ASSERT_TRUE(compress(input, 0, 10, 4));
+  TEST_ASSERT_EQUAL(sizeof(toolStream10x4), sink.out.size());
+  TEST_ASSERT_EQUAL_MEMORY(toolStream10x4, sink.out.data(), sizeof(toolStream10x4));
+
+  // smaller and larger than the default, in pieces across many slides
+  static const uint8_t settings[][2] = {{8, 2}, {10, 4}, {11, 6}, {LZSS_MAX_WINDOW_BITS, LZSS_MAX_LENGTH_BITS}};
+  static std::vector<uint8_t> bigWork(LZSS_WORK_SIZE_FOR(LZSS_MAX_WINDOW_BITS, LZSS_MAX_LENGTH_BITS));
+  input = logText(5 * (1 << LZSS_MAX_WINDOW_BITS) + 321);
+  for (const uint8_t *bits : settings) {
+    setUp();
+    encoder.begin(bigWork.data(), sinkWrite, &sink, bits[0], bits[1]);
+    for (size_t offset = 0; offset < input.size(); offset += 777) {
+      TEST_ASSERT_TRUE(encoder.write(input.data() + offset, std::min<size_t>(777, input.size() - offset)));
+    }
+    TEST_ASSERT_TRUE(encoder.finish());
+    TEST_ASSERT_EQUAL(bits[0], sink.out[4]);
+    TEST_ASSERT_EQUAL(bits[1], sink.out[5]);
+    std::vector<uint8_t> decoded;
+    TEST_ASSERT_TRUE(decode(sink.out, &decoded));
+    TEST_ASSERT_TRUE(decoded == input);
+  }
+
+  // out of range bits are clamped to what the work area layout allows
+  setUp();
+  TEST_ASSERT_TRUE(compress(bytes(twoLines), 0, 20, 0));
+  TEST_ASSERT_EQUAL(LZSS_MAX_WINDOW_BITS, sink.out[4]);
+  TEST_ASSERT_EQUAL(2, sink.out[5]);
+}
+
+void test_begin_starts_a_fresh_stream(void) {
+  std::vector<uint8_t> input = bytes(twoLines);
+  encoder.begin(work, sinkWrite, &sink);
+  encoder.write(input.data(), input.size());
+  // abandoned half way, the next stream shares nothing with it
+  setUp();
+  TEST_ASSERT_TRUE(compress(input));
+  TEST_ASSERT_EQUAL_MEMORY(toolStream, sink.out.data(), sizeof(toolStream));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_stream_matches_the_host_tool);
+  RUN_TEST(test_header_and_trailer);
+  RUN_TEST(test_empty_input_is_just_header_and_trailer);
+  RUN_TEST(test_log_text_round_trips_and_shrinks);
+  RUN_TEST(test_pieces_give_the_same_stream);
+  RUN_TEST(test_random_bytes_stay_inside_the_bound);
+  RUN_TEST(test_runs_use_overlapping_matches);
+  RUN_TEST(test_failing_sink_stops_the_encoder);
+  RUN_TEST(test_other_window_and_length_bits);
+  RUN_TEST(test_begin_starts_a_fresh_stream);
+  return UNITY_END();
+}
@@ -0,0 +1,219 @@
+// latency histograms and gauges: bucket edges from 0 to UINT32_MAX,
+// percentiles of empty and tiny histograms, and the report lines
+
+#include <unity.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "metrics.h"
+
+static LatencyHistogram histogram;
+
+void setUp(void) {
+  histogram.reset();
+  metricsReset();
+}
+
+void tearDown(void) {}
+
+void test_small_values_have_their_own_bucket(void) {
+  for (uint32_t us = 0; us <= 3; us++) {
+    TEST_ASSERT_EQUAL(us, LatencyHistogram::bucket(us));
+    TEST_ASSERT_EQUAL(us, LatencyHistogram::bucketLimit(us));
+  }
+  // 4 starts the log scale, still exact
+  TEST_ASSERT_EQUAL(4, LatencyHistogram::bucket(4));
+  TEST_ASSERT_EQUAL(4, LatencyHistogram::bucketLimit(4));
+  TEST_ASSERT_EQUAL(8, LatencyHistogram::bucket(8));
+  TEST_ASSERT_EQUAL(9, LatencyHistogram::bucketLimit(8));
+}
+
+void test_largest_value_is_the_last_bucket(void) {
+  TEST_ASSERT_EQUAL(METRIC_BUCKETS - 1, LatencyHistogram::bucket(UINT32_MAX));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, LatencyHistogram::bucketLimit(METRIC_BUCKETS - 1));
+  TEST_ASSERT_EQUAL(METRIC_BUCKETS - 1, LatencyHistogram::bucket(0xE0000000u));
+  TEST_ASSERT_EQUAL(METRIC_BUCKETS - 2, LatencyHistogram::bucket(0xDFFFFFFFu));
+}
+
+void test_every_value_lands_in_a_bucket_that_holds_it(void) {
+  // every value up to 2^16, then powers of two and their neighbours
+  std::vector<uint32_t> values;
+  for (uint32_t us = 0; us <= 65536; us++) values.push_back(us);
+  for (int shift = 17; shift < 32; shift++) {
+    uint32_t power = (uint32_t)1 << shift;
+    values.push_back(power - 1);
+    values.push_back(power);
+    values.push_back(power + 1);
+    values.push_back(power + power / 2);
+  }
+  values.push_back(UINT32_MAX);
+
+  for (uint32_t us : values) {
+    uint8_t index = LatencyHistogram::bucket(us);
+    TEST_ASSERT_LESS_THAN(METRIC_BUCKETS, index);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(us, LatencyHistogram::bucketLimit(index));
+    if (index > 0) TEST_ASSERT_LESS_THAN_UINT32(us, LatencyHistogram::bucketLimit(index - 1));
+    // four steps per power of two, a limit is at most a quarter over
+    TEST_ASSERT_TRUE(LatencyHistogram::bucketLimit(index) <= (uint64_t)us + us / 4 + 1);
+  }
+}
+
+void test_bucket_limits_rise(void) {
+  for (int index = 1; index < METRIC_BUCKETS; index++) {
+    TEST_ASSERT_GREATER_THAN_UINT32(LatencyHistogram::bucketLimit(index - 1), LatencyHistogram::bucketLimit(index));
+  }
+}
+
+void test_empty_histogram_is_all_zero(void) {
+  MetricSummary summary = histogram.summary();
+  TEST_ASSERT_EQUAL(0, summary.count);
+  TEST_ASSERT_EQUAL(0, summary.p50Us);
+  TEST_ASSERT_EQUAL(0, summary.p90Us);
+  TEST_ASSERT_EQUAL(0, summary.p99Us);
+  TEST_ASSERT_EQUAL(0, summary.maxUs);
+}
+
+void test_single_zero_sample(void) {
+  histogram.record(0);
+  MetricSummary summary = histogram.summary();
+  TEST_ASSERT_EQUAL(1, summary.count);
+  TEST_ASSERT_EQUAL(0, summary.p50Us);
+  TEST_ASSERT_EQUAL(0, summary.p99Us);
+  TEST_ASSERT_EQUAL(0, summary.maxUs);
+}
+
+void test_edge_values_keep_their_percentiles(void) {
+  histogram.record(3);
+  MetricSummary summary = histogram.summary();
+  TEST_ASSERT_EQUAL(3, summary.p50Us);
+  TEST_ASSERT_EQUAL(3, summary.maxUs);
+
+  histogram.reset();
+  histogram.record(4);
+  summary = histogram.summary();
+  TEST_ASSERT_EQUAL(4, summary.p50Us);
+  TEST_ASSERT_EQUAL(4, summary.p99Us);
+
+  histogram.reset();
+  histogram.record(UINT32_MAX);
+  histogram.record(UINT32_MAX);
+  summary = histogram.summary();
+  TEST_ASSERT_EQUAL(2, summary.count);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, summary.p50Us);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, summary.p99Us);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, summary.maxUs);
+}
+
+void test_percentiles_never_pass_the_max(void) {
+  // 8 shares a bucket with 9
+  histogram.record(8);
+  MetricSummary summary = histogram.summary();
+  TEST_ASSERT_EQUAL(8, summary.p50Us);
+  TEST_ASSERT_EQUAL(8, summary.p99Us);
+  TEST_ASSERT_EQUAL(8, summary.maxUs);
+}
+
+void test_percentile_ranks(void) {
+  for (uint32_t us = 1; us <= 100; us++) histogram.record(us * 1000);
+  MetricSummary summary = histogram.summary();
+  TEST_ASSERT_EQUAL(100, summary.count);
+  TEST_ASSERT_EQUAL(100000, summary.maxUs);
+  // the bucket holding the 50th, 90th and 99th value
+  TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::bucketLimit(LatencyHistogram::bucket(50000)), summary.p50Us);
+  TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::bucketLimit(LatencyHistogram::bucket(90000)), summary.p90Us);
+  // 99000 shares a bucket with the max, so p99 stops there
+  TEST_ASSERT_EQUAL(LatencyHistogram::bucket(100000), LatencyHistogram::bucket(99000));
+  TEST_ASSERT_EQUAL(100000, summary.p99Us);
+
+  // one slow outlier in a hundred moves p99, not p90
+  histogram.reset();
+  for (int i = 0; i < 99; i++) histogram.record(2000);
+  histogram.record(5000000);
+  summary = histogram.summary();
+  TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::bucketLimit(LatencyHistogram::bucket(2000)), summary.p90Us);
+  TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::bucketLimit(LatencyHistogram::bucket(2000)), summary.p99Us);
+  TEST_ASSERT_EQUAL(5000000, summary.maxUs);
+  histogram.record(5000000);
+  TEST_ASSERT_EQUAL(5000000, histogram.summary().p99Us);
+}
+
+void test_records_from_many_threads_all_count(void) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([t] {
+      for (uint32_t i = 0; i < 10000; i++) metricRecord(METRIC_AT_ROUND_TRIP, i * (t + 1));
+    });
+  }
+  for (std::thread &thread : threads) thread.join();
+  MetricSummary summary = metricSummary(METRIC_AT_ROUND_TRIP);
+  TEST_ASSERT_EQUAL(40000, summary.count);
+  TEST_ASSERT_EQUAL(9999 * 4, summary.maxUs);
+}
+
+void test_gauge_tracks_last_min_and_max(void) {
+  TEST_ASSERT_FALSE(gaugeSummary(GAUGE_TEMPERATURE).set);
+  gaugeSet(GAUGE_TEMPERATURE, -55);
+  GaugeSummary summary = gaugeSummary(GAUGE_TEMPERATURE);
+  TEST_ASSERT_TRUE(summary.set);
+  TEST_ASSERT_EQUAL(-55, summary.last);
+  TEST_ASSERT_EQUAL(-55, summary.min);
+  TEST_ASSERT_EQUAL(-55, summary.max);
+
+  gaugeSet(GAUGE_TEMPERATURE, 312);
+  gaugeSet(GAUGE_TEMPERATURE, 120);
+  summary = gaugeSummary(GAUGE_TEMPERATURE);
+  TEST_ASSERT_EQUAL(120, summary.last);
+  TEST_ASSERT_EQUAL(-55, summary.min);
+  TEST_ASSERT_EQUAL(312, summary.max);
+
+  // a reset forgets the range, the next value starts a new one
+  metricsReset();
+  TEST_ASSERT_FALSE(gaugeSummary(GAUGE_TEMPERATURE).set);
+  gaugeSet(GAUGE_TEMPERATURE, 200);
+  summary = gaugeSummary(GAUGE_TEMPERATURE);
+  TEST_ASSERT_EQUAL(200, summary.min);
+  TEST_ASSERT_EQUAL(200, summary.max);
+}
+
+void test_format_lists_what_was_recorded(void) {
+  char text[256];
+  TEST_ASSERT_EQUAL(0, metricsFormat(text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("", text);
+
+  metricRecord(METRIC_CAMERA_GRAB, 4000);
+  gaugeSet(GAUGE_CSQ, 21);
+  size_t length = metricsFormat(text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("cam 1 4/4/4/4 ms\ncsq 21 21..21\n", text);
+  TEST_ASSERT_EQUAL(strlen(text), length);
+}
+
+void test_format_cuts_at_a_line(void) {
+  metricRecord(METRIC_CAMERA_GRAB, 4000);
+  gaugeSet(GAUGE_CSQ, 21);
+  char text[24];
+  TEST_ASSERT_EQUAL(strlen("cam 1 4/4/4/4 ms\n"), metricsFormat(text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("cam 1 4/4/4/4 ms\n", text);
+  TEST_ASSERT_EQUAL(0, metricsFormat(text, 5));
+  TEST_ASSERT_EQUAL_STRING("", text);
+  TEST_ASSERT_EQUAL(0, metricsFormat(text, 0));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_small_values_have_their_own_bucket);
+  RUN_TEST(test_largest_value_is_the_last_bucket);
+  RUN_TEST(test_every_value_lands_in_a_bucket_that_holds_it);
+  RUN_TEST(test_bucket_limits_rise);
+  RUN_TEST(test_empty_histogram_is_all_zero);
+  RUN_TEST(test_single_zero_sample);
+  RUN_TEST(test_edge_values_keep_their_percentiles);
+  RUN_TEST(test_percentiles_never_pass_the_max);
+  RUN_TEST(test_percentile_ranks);
+  RUN_TEST(test_records_from_many_threads_all_count);
+  RUN_TEST(test_gauge_tracks_last_min_and_max);
+  RUN_TEST(test_format_lists_what_was_recorded);
+  RUN_TEST(test_format_cuts_at_a_line);
+  return UNITY_END();
+}
@@ -0,0 +1,185 @@
+// the host stand-ins the other suites build on behave like the hardware
+
+#include <unity.h>
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SD.h>
+#include <Update.h>
+#include <esp_camera.h>
+#include <string>
+#include "mock_modem.h"
+
+static MockModem modem;
+
+static std::string drain() {
+  std::string text;
+  char buffer[64];
+  size_t count;
+  while ((count = modem.readBytes(buffer, sizeof(buffer))) > 0) text.append(buffer, count);
+  return text;
+}
+
+static void send(const char *line) {
+  modem.write((const uint8_t *)line, strlen(line));
+  modem.write((const uint8_t *)"\r\n", 2);
+}
+
+void setUp(void) {
+  modem.reset();
+}
+
+void tearDown(void) {}
+
+void test_modem_answers_chained_commands_with_one_ok(void) {
+  send("AT+CSQ;+CREG?");
+  TEST_ASSERT_EQUAL_STRING("\r\n+CSQ: 20,99\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n", drain().c_str());
+  TEST_ASSERT_EQUAL(1, modem.lines.size());
+  TEST_ASSERT_EQUAL(2, modem.commands.size());
+}
+
+void test_modem_stops_a_line_at_the_first_failure(void) {
+  modem.fail("+CREG");
+  send("AT+CSQ;+CREG?;+CPSI?");
+  TEST_ASSERT_EQUAL_STRING("\r\n+CSQ: 20,99\r\n\r\nERROR\r\n", drain().c_str());
+  send("AT+CREG?");
+  TEST_ASSERT_EQUAL_STRING("\r\n+CREG: 0,1\r\n\r\nOK\r\n", drain().c_str());
+}
+
+void test_modem_takes_efs_data_after_the_prompt(void) {
+  send("AT+CFTRANRX=\"e:/a.txt\",5");
+  TEST_ASSERT_EQUAL_STRING("\r\n>", drain().c_str());
+  TEST_ASSERT_TRUE(modem.inDataMode());
+  modem.write((const uint8_t *)"hel", 3);
+  TEST_ASSERT_EQUAL_STRING("", drain().c_str());
+  modem.write((const uint8_t *)"lo", 2);
+  TEST_ASSERT_EQUAL_STRING("\r\nOK\r\n", drain().c_str());
+  TEST_ASSERT_EQUAL(5, modem.efs["a.txt"].size());
+  send("AT+FSDEL=\"a.txt\"");
+  TEST_ASSERT_EQUAL_STRING("\r\nOK\r\n", drain().c_str());
+  TEST_ASSERT_EQUAL(0, modem.efs.size());
+}
+
+void test_modem_reports_ftp_results_after_ok(void) {
+  modem.efs["p.jpg"] = std::vector<uint8_t>(10, 1);
+  send("AT+CFTPSSTART");
+  TEST_ASSERT_EQUAL_STRING("\r\nOK\r\n\r\n+CFTPSSTART: 0\r\n", drain().c_str());
+  send("AT+CFTPSLOGIN=\"h\",21,\"u\",\"p\",0");
+  drain();
+  modem.ftpResult(9);
+  send("AT+CFTPSPUTFILE=\"/p.jpg\",3");
+  TEST_ASSERT_EQUAL_STRING("\r\nOK\r\n\r\n+CFTPSPUTFILE: 9\r\n", drain().c_str());
+  send("AT+CFTPSPUTFILE=\"/p.jpg\",3");
+  TEST_ASSERT_EQUAL_STRING("\r\nOK\r\n\r\n+CFTPSPUTFILE: 0\r\n", drain().c_str());
+  TEST_ASSERT_EQUAL(1, modem.puts.size());
+}
+
+void test_modem_serves_http_windows(void) {
+  modem.serve("http://x/fw.bin", (const uint8_t *)"abcdef", 6);
+  send("AT+HTTPINIT");
+  send("AT+HTTPPARA=\"URL\",\"http://x/fw.bin\"");
+  send("AT+HTTPACTION=0");
+  drain();
+  modem.setReadWindowLimit(4);
+  send("AT+HTTPREAD=2,10");
+  TEST_ASSERT_EQUAL_STRING("\r\nOK\r\n\r\n+HTTPREAD: DATA,4\r\ncdef\r\n+HTTPREAD: 0\r\n", drain().c_str());
+}
+
+void test_sd_files_live_in_a_host_directory(void) {
+  SD.setRoot(mockTempDir("test-mocks"));
+  File file = SD.open("/a.txt", FILE_WRITE);
+  TEST_ASSERT_TRUE(file);
+  file.print("hello");
+  file.close();
+  file = SD.open("/a.txt", FILE_APPEND);
+  file.print(" world");
+  file.close();
+
+  file = SD.open("/a.txt", FILE_READ);
+  TEST_ASSERT_EQUAL(11, file.size());
+  char text[16] = {0};
+  TEST_ASSERT_EQUAL(11, file.read((uint8_t *)text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("hello world", text);
+  file.close();
+
+  TEST_ASSERT_TRUE(SD.mkdir("/d"));
+  TEST_ASSERT_TRUE(SD.rename("/a.txt", "/d/b.txt"));
+  File dir = SD.open("/d");
+  TEST_ASSERT_TRUE(dir.isDirectory());
+  File entry = dir.openNextFile();
+  TEST_ASSERT_EQUAL_STRING("b.txt", entry.name());
+  TEST_ASSERT_FALSE(dir.openNextFile());
+  TEST_ASSERT_TRUE(SD.remove("/d/b.txt"));
+  TEST_ASSERT_FALSE(SD.exists("/d/b.txt"));
+}
+
+void test_preferences_outlive_the_object(void) {
+  mockPreferencesErase();
+  {
+    Preferences preferences;
+    preferences.begin("camera");
+    preferences.putUInt("sendTimes", 41);
+    preferences.putString("imei", "864764030000001");
+    preferences.end();
+  }
+  Preferences preferences;
+  preferences.begin("camera", true);
+  TEST_ASSERT_EQUAL(41, preferences.getUInt("sendTimes", 0));
+  TEST_ASSERT_EQUAL(7, preferences.getUInt("missing", 7));
+  TEST_ASSERT_EQUAL_STRING("864764030000001", preferences.getString("imei").c_str());
+  TEST_ASSERT_EQUAL(0, preferences.putUInt("sendTimes", 42));
+}
+
+void test_update_collects_the_image_and_fails_on_request(void) {
+  uint8_t data[100];
+  memset(data, 0xA5, sizeof(data));
+  Update.reset();
+  TEST_ASSERT_TRUE(Update.begin(200));
+  TEST_ASSERT_EQUAL(100, Update.write(data, 100));
+  TEST_ASSERT_FALSE(Update.end());
+  TEST_ASSERT_EQUAL(UPDATE_ERROR_SIZE, Update.getError());
+
+  Update.reset();
+  Update.failAt(150);
+  TEST_ASSERT_TRUE(Update.begin(200));
+  TEST_ASSERT_EQUAL(100, Update.write(data, 100));
+  TEST_ASSERT_EQUAL(0, Update.write(data, 100));
+  TEST_ASSERT_TRUE(Update.hasError());
+  Update.abort();
+  TEST_ASSERT_FALSE(Update.isFinished());
+}
+
+void test_camera_hands_out_queued_frames(void) {
+  const uint8_t jpeg[] = {0xFF, 0xD8, 0xFF, 0xD9};
+  mockCameraQueue(jpeg, sizeof(jpeg), 1600, 1200);
+  camera_fb_t *fb = esp_camera_fb_get();
+  TEST_ASSERT_NOT_NULL(fb);
+  TEST_ASSERT_EQUAL(4, fb->len);
+  TEST_ASSERT_EQUAL(1600, fb->width);
+  TEST_ASSERT_EQUAL_MEMORY(jpeg, fb->buf, sizeof(jpeg));
+  esp_camera_fb_return(fb);
+  TEST_ASSERT_NULL(esp_camera_fb_get());
+}
+
+void test_delay_moves_the_clock_without_sleeping(void) {
+  unsigned long start = millis();
+  delay(60000);
+  TEST_ASSERT_GREATER_OR_EQUAL(start + 60000, millis());
+  TEST_ASSERT_LESS_THAN(start + 61000, millis());
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_modem_answers_chained_commands_with_one_ok);
+  RUN_TEST(test_modem_stops_a_line_at_the_first_failure);
+  RUN_TEST(test_modem_takes_efs_data_after_the_prompt);
+  RUN_TEST(test_modem_reports_ftp_results_after_ok);
+  RUN_TEST(test_modem_serves_http_windows);
+  RUN_TEST(test_sd_files_live_in_a_host_directory);
+  RUN_TEST(test_preferences_outlive_the_object);
+  RUN_TEST(test_update_collects_the_image_and_fails_on_request);
+  RUN_TEST(test_camera_hands_out_queued_frames);
+  RUN_TEST(test_delay_moves_the_clock_without_sleeping);
+  return UNITY_END();
+}
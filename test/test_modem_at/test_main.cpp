@@ -0,0 +1,192 @@
+// the AT command layer against the scripted modem, which records every line
+// it gets: settings already in effect are skipped, queries share lines
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "mock_modem.h"
+#include "modem_at.h"
+
+static MockModem modem;
+static AtStats before;
+
+static uint32_t skipped() {
+  return atStats().skipped - before.skipped;
+}
+
+static uint32_t batched() {
+  return atStats().batched - before.batched;
+}
+
+void setUp(void) {
+  modem.reset();
+  atBegin(modem);
+  atSetUrcHandler(NULL);
+  atSetDataHandler(NULL, NULL);
+  before = atStats();
+}
+
+void tearDown(void) {}
+
+void test_settings_in_effect_are_skipped(void) {
+  // what sendFileToEFS() and clearEFS() do for every file
+  for (int i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+FSCD=E:", NULL, 1000));
+  }
+  TEST_ASSERT_EQUAL(1, modem.lines.size());
+  TEST_ASSERT_EQUAL_STRING("AT+FSCD=E:", modem.lines[0].c_str());
+  TEST_ASSERT_EQUAL(4, skipped());
+  TEST_ASSERT_TRUE(atKnown("+FSCD=E:"));
+
+  // a different value goes out and replaces the known one
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+FSCD=C:", NULL, 1000));
+  TEST_ASSERT_FALSE(atKnown("+FSCD=E:"));
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+FSCD=E:", NULL, 1000));
+  TEST_ASSERT_EQUAL(3, modem.lines.size());
+}
+
+void test_queries_always_go_out(void) {
+  char response[32];
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+CSQ", "+CSQ:", 1000, response, sizeof(response)));
+    TEST_ASSERT_EQUAL_STRING("+CSQ: 20,99", response);
+  }
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+CCLK?", "+CCLK:", 1000));
+  TEST_ASSERT_EQUAL(4, modem.lines.size());
+  TEST_ASSERT_EQUAL(0, skipped());
+}
+
+void test_services_pair_start_and_stop(void) {
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+HTTPINIT", NULL, 1000));
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+HTTPINIT", NULL, 1000));
+  TEST_ASSERT_EQUAL(1, modem.lines.size());
+  TEST_ASSERT_TRUE(modem.httpStarted);
+  // stopping replaces the started state, so the next start goes out again
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+HTTPTERM", NULL, 1000));
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+HTTPTERM", NULL, 1000));
+  TEST_ASSERT_EQUAL(2, modem.lines.size());
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+HTTPINIT", NULL, 1000));
+  TEST_ASSERT_EQUAL(3, modem.lines.size());
+}
+
+void test_errors_and_begin_forget_the_state(void) {
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+CGPS=1", NULL, 1000));
+  modem.fail("+CGPS");
+  TEST_ASSERT_EQUAL(AT_RESPONSE_ERROR, atSendOnce("+CGPS=0", NULL, 1000));
+  // the modem may be in either state now
+  TEST_ASSERT_FALSE(atKnown("+CGPS=1"));
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+CGPS=1", NULL, 1000));
+  TEST_ASSERT_EQUAL(3, modem.lines.size());
+
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+FSCD=E:", NULL, 1000));
+  atForget("+FSCD=E:");
+  TEST_ASSERT_FALSE(atKnown("+FSCD=E:"));
+  TEST_ASSERT_TRUE(atKnown("+CGPS=1"));
+  // a modem restart loses everything
+  atBegin(modem);
+  TEST_ASSERT_FALSE(atKnown("+CGPS=1"));
+}
+
+void test_state_slots_are_reused_when_full(void) {
+  char command[24];
+  for (int i = 0; i < AT_STATE_SLOTS + 3; i++) {
+    snprintf(command, sizeof(command), "+SET%d=1", i);
+    TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce(command, NULL, 1000));
+  }
+  // the oldest were overwritten, the newest are still known
+  TEST_ASSERT_FALSE(atKnown("+SET0=1"));
+  snprintf(command, sizeof(command), "+SET%d=1", AT_STATE_SLOTS + 2);
+  TEST_ASSERT_TRUE(atKnown(command));
+}
+
+void test_queries_share_one_line(void) {
+  char imei[24], clock[40], quality[24], registration[24];
+  AtQuery queries[] = {
+    {"+CGSN", "", imei, sizeof(imei), false, false},
+    {"+CCLK?", "+CCLK:", clock, sizeof(clock), false, false},
+    {"+CSQ", "+CSQ:", quality, sizeof(quality), false, false},
+    {"+CREG?", "+CREG:", registration, sizeof(registration), false, false},
+  };
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendBatch(queries, 4, 1000));
+  TEST_ASSERT_EQUAL(1, modem.lines.size());
+  TEST_ASSERT_EQUAL_STRING("AT+CGSN;+CCLK?;+CSQ;+CREG?", modem.lines[0].c_str());
+  TEST_ASSERT_EQUAL(4, modem.commands.size());
+  TEST_ASSERT_EQUAL(3, batched());
+  TEST_ASSERT_EQUAL_STRING("864764030000001", imei);
+  TEST_ASSERT_EQUAL_STRING("+CCLK: \"26/10/16,12:00:00+00\"", clock);
+  TEST_ASSERT_EQUAL_STRING("+CSQ: 20,99", quality);
+  TEST_ASSERT_EQUAL_STRING("+CREG: 0,1", registration);
+  for (const AtQuery &query : queries) TEST_ASSERT_TRUE(query.answered);
+}
+
+void test_batch_skips_known_settings_and_remembers_new_ones(void) {
+  AtQuery queries[] = {
+    {"+FSCD=E:", NULL, NULL, 0, true, false},
+    {"+CGPS=1", NULL, NULL, 0, true, false},
+    {"+CSQ", "+CSQ:", NULL, 0, false, false},
+  };
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendOnce("+FSCD=E:", NULL, 1000));
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendBatch(queries, 3, 1000));
+  TEST_ASSERT_EQUAL_STRING("AT+CGPS=1;+CSQ", modem.lines.back().c_str());
+  TEST_ASSERT_EQUAL(1, skipped());
+  TEST_ASSERT_TRUE(atKnown("+CGPS=1"));
+
+  // everything in effect, the batch costs no round trip at all
+  AtQuery settings[] = {
+    {"+FSCD=E:", NULL, NULL, 0, true, false},
+    {"+CGPS=1", NULL, NULL, 0, true, false},
+  };
+  size_t lines = modem.lines.size();
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendBatch(settings, 2, 1000));
+  TEST_ASSERT_EQUAL(lines, modem.lines.size());
+  TEST_ASSERT_TRUE(settings[0].answered && settings[1].answered);
+}
+
+void test_long_batches_are_split(void) {
+  // each command fills most of a line, so they can't all share one
+  char commands[4][AT_BATCH_LINE / 2];
+  AtQuery queries[4];
+  for (int i = 0; i < 4; i++) {
+    memset(commands[i], 0, sizeof(commands[i]));
+    snprintf(commands[i], sizeof(commands[i]), "+FSLS=%0*d", (int)sizeof(commands[i]) - 12, i);
+    queries[i] = {commands[i], NULL, NULL, 0, false, false};
+  }
+  TEST_ASSERT_EQUAL(AT_RESPONSE_MATCH, atSendBatch(queries, 4, 1000));
+  TEST_ASSERT_EQUAL(4, modem.commands.size());
+  TEST_ASSERT_GREATER_THAN(1, modem.lines.size());
+  TEST_ASSERT_LESS_THAN(4, modem.lines.size());
+  for (const std::string &line : modem.lines) TEST_ASSERT_LESS_THAN(AT_BATCH_LINE + 2, line.size());
+}
+
+void test_failing_command_stops_the_batch(void) {
+  char quality[24];
+  AtQuery queries[] = {
+    {"+CGPS=1", NULL, NULL, 0, true, false},
+    {"+FSCD=E:", NULL, NULL, 0, true, false},
+    {"+CSQ", "+CSQ:", quality, sizeof(quality), false, false},
+  };
+  // the modem gives up on the line at the first failure
+  modem.fail("+FSCD");
+  TEST_ASSERT_EQUAL(AT_RESPONSE_ERROR, atSendBatch(queries, 3, 1000));
+  TEST_ASSERT_FALSE(queries[2].answered);
+  TEST_ASSERT_EQUAL(2, modem.commands.size());
+  TEST_ASSERT_FALSE(atKnown("+FSCD=E:"));
+  TEST_ASSERT_FALSE(atKnown("+CGPS=1"));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_settings_in_effect_are_skipped);
+  RUN_TEST(test_queries_always_go_out);
+  RUN_TEST(test_services_pair_start_and_stop);
+  RUN_TEST(test_errors_and_begin_forget_the_state);
+  RUN_TEST(test_state_slots_are_reused_when_full);
+  RUN_TEST(test_queries_share_one_line);
+  RUN_TEST(test_batch_skips_known_settings_and_remembers_new_ones);
+  RUN_TEST(test_long_batches_are_split);
+  RUN_TEST(test_failing_command_stops_the_batch);
+  return UNITY_END();
+}
@@ -0,0 +1,156 @@
+// the motion detector over synthetic luma thumbnails: sensor noise stays
+// quiet, a moving subject triggers, a lighting change doesn't
+
+#include <unity.h>
+#include <string.h>
+#include "config.h"
+#include "motion.h"
+
+#define WIDTH 160
+#define HEIGHT 120
+
+static const MotionConfig config = {
+  MOTION_NOISE_FLOOR,
+  MOTION_THRESHOLD_K,
+  MOTION_TRIGGER_PERMILLE,
+  MOTION_GLOBAL_PERMILLE,
+  MOTION_LEARN_SHIFT,
+  MOTION_WARMUP_FRAMES
+};
+
+static MotionDetector detector;
+static uint8_t frame[WIDTH * HEIGHT];
+static uint32_t seed;
+
+// flat grey with +-3 of sensor noise, same sequence every run
+static void noisyFrame(uint8_t level) {
+  for (size_t i = 0; i < sizeof(frame); i++) {
+    seed = seed * 1103515245 + 12345;
+    frame[i] = (uint8_t)(level + (int)((seed >> 16) % 7) - 3);
+  }
+}
+
+static void square(int x, int y, int size, uint8_t level) {
+  for (int row = y; row < y + size; row++) memset(frame + row * WIDTH + x, level, size);
+}
+
+static void warmUp() {
+  for (int i = 0; i < MOTION_WARMUP_FRAMES + 10; i++) {
+    noisyFrame(100);
+    TEST_ASSERT_FALSE(detector.update(frame).triggered);
+  }
+}
+
+void setUp(void) {
+  seed = 1;
+  TEST_ASSERT_TRUE(detector.begin(WIDTH, HEIGHT, config));
+}
+
+void tearDown(void) {
+  detector.end();
+}
+
+void test_sad_sums_absolute_differences(void) {
+  const uint8_t a[] = {0, 10, 255, 7};
+  const uint8_t b[] = {5, 0, 0, 7};
+  TEST_ASSERT_EQUAL(5 + 10 + 255, motionSad(a, b, sizeof(a)));
+  TEST_ASSERT_EQUAL(0, motionSad(a, a, sizeof(a)));
+}
+
+void test_size_is_cropped_to_whole_blocks(void) {
+  TEST_ASSERT_TRUE(detector.begin(100, 75, config));
+  TEST_ASSERT_EQUAL(12, detector.blocksWide());
+  TEST_ASSERT_EQUAL(9, detector.blocksHigh());
+  TEST_ASSERT_EQUAL(72, detector.height());
+}
+
+void test_warmup_frames_never_trigger(void) {
+  for (int i = 0; i < MOTION_WARMUP_FRAMES; i++) {
+    noisyFrame(i % 2 ? 30 : 220);
+    MotionResult result = detector.update(frame);
+    TEST_ASSERT_FALSE(result.triggered);
+    TEST_ASSERT_EQUAL(0, result.score);
+  }
+}
+
+void test_sensor_noise_stays_quiet(void) {
+  warmUp();
+  for (int i = 0; i < 50; i++) {
+    noisyFrame(100);
+    MotionResult result = detector.update(frame);
+    TEST_ASSERT_FALSE(result.triggered);
+    TEST_ASSERT_GREATER_OR_EQUAL(MOTION_NOISE_FLOOR, result.threshold);
+  }
+}
+
+void test_subject_triggers_and_marks_its_blocks(void) {
+  warmUp();
+  noisyFrame(100);
+  square(48, 40, 40, 200);
+  MotionResult result = detector.update(frame);
+  TEST_ASSERT_TRUE(result.triggered);
+  TEST_ASSERT_FALSE(result.lightingChange);
+  TEST_ASSERT_EQUAL(25, result.changedBlocks);
+  TEST_ASSERT_EQUAL(25 * 1000 / (20 * 15), result.score);
+
+  const uint8_t *mask = detector.blockMask();
+  for (int by = 0; by < detector.blocksHigh(); by++) {
+    for (int bx = 0; bx < detector.blocksWide(); bx++) {
+      bool inside = bx >= 6 && bx < 11 && by >= 5 && by < 10;
+      TEST_ASSERT_EQUAL(inside, mask[by * detector.blocksWide() + bx] != 0);
+    }
+  }
+}
+
+void test_lighting_change_is_not_motion(void) {
+  warmUp();
+  noisyFrame(160);
+  MotionResult result = detector.update(frame);
+  TEST_ASSERT_TRUE(result.lightingChange);
+  TEST_ASSERT_FALSE(result.triggered);
+
+  // and the background catches up with the new level quickly
+  for (int i = 0; i < 10; i++) {
+    noisyFrame(160);
+    detector.update(frame);
+  }
+  noisyFrame(160);
+  TEST_ASSERT_EQUAL(0, detector.update(frame).score);
+}
+
+void test_subject_that_stays_fades_into_the_background(void) {
+  warmUp();
+  int frames = 0;
+  MotionResult result;
+  do {
+    noisyFrame(100);
+    square(48, 40, 40, 200);
+    result = detector.update(frame);
+    frames++;
+  } while (result.triggered && frames < 500);
+  TEST_ASSERT_FALSE(result.triggered);
+  TEST_ASSERT_GREATER_THAN(1, frames);
+}
+
+void test_reset_starts_a_new_warmup(void) {
+  warmUp();
+  detector.reset();
+  noisyFrame(100);
+  square(48, 40, 40, 200);
+  TEST_ASSERT_FALSE(detector.update(frame).triggered);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_sad_sums_absolute_differences);
+  RUN_TEST(test_size_is_cropped_to_whole_blocks);
+  RUN_TEST(test_warmup_frames_never_trigger);
+  RUN_TEST(test_sensor_noise_stays_quiet);
+  RUN_TEST(test_subject_triggers_and_marks_its_blocks);
+  RUN_TEST(test_lighting_change_is_not_motion);
+  RUN_TEST(test_subject_that_stays_fades_into_the_background);
+  RUN_TEST(test_reset_starts_a_new_warmup);
+  return UNITY_END();
+}
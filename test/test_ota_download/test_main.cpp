@@ -0,0 +1,147 @@
+// OTA downloads through the scripted modem's HTTP stack: a multi-megabyte
+// image full of NULs and AT text lands byte for byte, whatever the windows
+
+#include <unity.h>
+#include <Update.h>
+#include <string.h>
+#include <vector>
+#include "config.h"
+#include "mock_modem.h"
+#include "modem_at.h"
+#include "ota_download.h"
+
+#define FIRMWARE_URL "http://example.com/fw.bin"
+
+static MockModem modem;
+static std::vector<uint8_t> firmware;
+static std::vector<uint8_t> received;
+static size_t abortAt;
+
+// a firmware-like image, with the byte runs that broke the String based reader
+static void makeFirmware(size_t length) {
+  firmware.resize(length);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < length; i++) {
+    seed = seed * 1664525 + 1013904223;
+    firmware[i] = i % 512 < 64 ? 0 : seed >> 24;
+  }
+  const char *trap = "\r\nOK\r\n+HTTPREAD: 0\r\nERROR\r\n";
+  for (size_t offset = 1000; offset + 32 < length; offset += 65521) memcpy(&firmware[offset], trap, strlen(trap));
+}
+
+static bool collect(const uint8_t *data, size_t length, size_t offset, size_t total, void *context) {
+  (void)context;
+  TEST_ASSERT_EQUAL(received.size(), offset);
+  TEST_ASSERT_EQUAL(firmware.size(), total);
+  if (abortAt && offset >= abortAt) return false;
+  received.insert(received.end(), data, data + length);
+  return true;
+}
+
+// the sink main.cpp uses, straight into the update partition
+static bool writeUpdate(const uint8_t *data, size_t length, size_t offset, size_t total, void *context) {
+  (void)context;
+  if (offset == 0 && !Update.begin(total)) return false;
+  return Update.write((uint8_t *)data, length) == length;
+}
+
+static void digestOf(const std::vector<uint8_t> &bytes, uint8_t digest[SHA256_SIZE]) {
+  Sha256 sha;
+  sha256Begin(sha);
+  sha256Update(sha, bytes.data(), bytes.size());
+  sha256Finish(sha, digest);
+}
+
+void setUp(void) {
+  modem.reset();
+  atBegin(modem);
+  atSetUrcHandler(NULL);
+  received.clear();
+  abortAt = 0;
+  makeFirmware(2 * 1024 * 1024 + 123);
+  modem.serve(FIRMWARE_URL, firmware.data(), firmware.size());
+}
+
+void tearDown(void) {}
+
+void test_image_arrives_whole_with_its_digest(void) {
+  uint8_t digest[SHA256_SIZE];
+  uint8_t expected[SHA256_SIZE];
+  OtaDownloadStats stats;
+  TEST_ASSERT_TRUE(otaDownload(FIRMWARE_URL, collect, NULL, digest, &stats));
+  TEST_ASSERT_TRUE(received == firmware);
+  digestOf(firmware, expected);
+  TEST_ASSERT_EQUAL_MEMORY(expected, digest, SHA256_SIZE);
+
+  TEST_ASSERT_EQUAL(firmware.size(), stats.bytes);
+  TEST_ASSERT_EQUAL(firmware.size(), stats.total);
+  TEST_ASSERT_EQUAL((firmware.size() + OTA_READ_WINDOW - 1) / OTA_READ_WINDOW, stats.reads);
+  TEST_ASSERT_EQUAL(0, stats.shortReads);
+  // the session is closed again
+  TEST_ASSERT_FALSE(modem.httpStarted);
+}
+
+void test_short_windows_carry_on_where_they_stopped(void) {
+  modem.setReadWindowLimit(1000);
+  modem.setReadLimit(7);
+  OtaDownloadStats stats;
+  TEST_ASSERT_TRUE(otaDownload(FIRMWARE_URL, collect, NULL, NULL, &stats));
+  TEST_ASSERT_TRUE(received == firmware);
+  TEST_ASSERT_EQUAL(stats.reads, stats.shortReads + 1);
+}
+
+void test_image_streams_into_the_update_partition(void) {
+  Update.reset();
+  uint8_t digest[SHA256_SIZE];
+  TEST_ASSERT_TRUE(otaDownload(FIRMWARE_URL, writeUpdate, NULL, digest));
+  TEST_ASSERT_TRUE(Update.end());
+  TEST_ASSERT_TRUE(Update.image() == firmware);
+}
+
+void test_missing_file_fails_before_any_data(void) {
+  TEST_ASSERT_FALSE(otaDownload("http://example.com/missing.bin", collect, NULL, NULL));
+  TEST_ASSERT_EQUAL(0, received.size());
+  TEST_ASSERT_FALSE(modem.httpStarted);
+}
+
+void test_sink_can_abort(void) {
+  abortAt = 100000;
+  OtaDownloadStats stats;
+  TEST_ASSERT_FALSE(otaDownload(FIRMWARE_URL, collect, NULL, NULL, &stats));
+  TEST_ASSERT_LESS_THAN(abortAt + OTA_READ_WINDOW, stats.bytes);
+  TEST_ASSERT_LESS_THAN(abortAt / OTA_READ_WINDOW + 3, stats.reads);
+}
+
+void test_reads_that_return_nothing_give_up(void) {
+  // the GET goes through but no read is ever answered
+  modem.silence("+HTTPREAD", 1000);
+  OtaDownloadStats stats;
+  TEST_ASSERT_FALSE(otaDownload(FIRMWARE_URL, collect, NULL, NULL, &stats));
+  TEST_ASSERT_EQUAL(OTA_READ_RETRIES + 1, stats.reads);
+  TEST_ASSERT_EQUAL(0, stats.bytes);
+}
+
+void test_text_is_cut_to_size(void) {
+  const char *published = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855  fw.bin\n";
+  modem.serve("http://example.com/fw.sha256", (const uint8_t *)published, strlen(published));
+  char text[128];
+  TEST_ASSERT_TRUE(otaFetchText("http://example.com/fw.sha256", text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING(published, text);
+  char shortText[9];
+  TEST_ASSERT_TRUE(otaFetchText("http://example.com/fw.sha256", shortText, sizeof(shortText)));
+  TEST_ASSERT_EQUAL_STRING("e3b0c442", shortText);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_image_arrives_whole_with_its_digest);
+  RUN_TEST(test_short_windows_carry_on_where_they_stopped);
+  RUN_TEST(test_image_streams_into_the_update_partition);
+  RUN_TEST(test_missing_file_fails_before_any_data);
+  RUN_TEST(test_sink_can_abort);
+  RUN_TEST(test_reads_that_return_nothing_give_up);
+  RUN_TEST(test_text_is_cut_to_size);
+  return UNITY_END();
+}
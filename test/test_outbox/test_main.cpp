@@ -0,0 +1,255 @@
+// the store-and-forward queue on a host directory: restarts, backoff, and
+// recovery from torn journal writes, lost payloads and cut compactions
+
+#include <unity.h>
+#include <FS.h>
+#include <stdio.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "outbox.h"
+
+static std::string dir;
+static uint8_t payload[1000];
+static uint8_t buffer[1000];
+static std::vector<std::string> sent;
+static int failNext;
+
+static bool recordSend(const OutboxItem &item, const uint8_t *data, size_t length, void *context) {
+  (void)context;
+  if (failNext > 0) {
+    failNext--;
+    return false;
+  }
+  TEST_ASSERT_EQUAL_MEMORY(payload, data, length);
+  sent.push_back(item.name);
+  return true;
+}
+
+static bool reportsOnly(const OutboxItem &item, void *context) {
+  (void)context;
+  return item.kind == OUTBOX_REPORT;
+}
+
+static bool imagesOnly(const OutboxItem &item, void *context) {
+  (void)context;
+  return item.kind == OUTBOX_IMAGE;
+}
+
+static void addImages(Outbox &outbox, int count) {
+  for (int i = 0; i < count; i++) {
+    char name[24];
+    snprintf(name, sizeof(name), "img%d.jpg", i);
+    TEST_ASSERT_TRUE(outbox.add(OUTBOX_IMAGE, name, 1000 + i, payload, 100 + i * 100));
+  }
+}
+
+static std::string path(const char *file) {
+  return dir + "/" + file;
+}
+
+static off_t fileSize(const char *file) {
+  struct stat info;
+  return stat(path(file).c_str(), &info) == 0 ? info.st_size : -1;
+}
+
+void setUp(void) {
+  dir = mockTempDir("test-outbox") + "/outbox";
+  for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)(i * 7);
+  sent.clear();
+  failNext = 0;
+}
+
+void tearDown(void) {}
+
+void test_items_outlive_a_restart(void) {
+  {
+    Outbox outbox;
+    TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+    addImages(outbox, 3);
+  }
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  TEST_ASSERT_EQUAL(3, outbox.pending());
+  TEST_ASSERT_EQUAL(3, outbox.stats().recovered);
+
+  TEST_ASSERT_EQUAL(3, outbox.drain(0, recordSend, NULL, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL(3, sent.size());
+  TEST_ASSERT_EQUAL_STRING("img0.jpg", sent[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("img2.jpg", sent[2].c_str());
+  // an empty queue leaves neither journal nor payloads behind
+  TEST_ASSERT_EQUAL(-1, fileSize("journal"));
+  TEST_ASSERT_EQUAL(-1, fileSize("00000001.dat"));
+}
+
+void test_failed_send_backs_off(void) {
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  addImages(outbox, 2);
+
+  failNext = 1;
+  TEST_ASSERT_EQUAL(0, outbox.drain(0, recordSend, NULL, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL(1, outbox.stats().failures);
+  // the failed item waits out at least half the 30 s base, the next one goes
+  TEST_ASSERT_EQUAL(1, outbox.drain(1000, recordSend, NULL, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL_STRING("img1.jpg", sent[0].c_str());
+  TEST_ASSERT_EQUAL(0, outbox.drain(14000, recordSend, NULL, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL(1, outbox.drain(31000, recordSend, NULL, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL(0, outbox.pending());
+}
+
+void test_link_up_makes_everything_due(void) {
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  addImages(outbox, 1);
+  failNext = 3;
+  outbox.drain(0, recordSend, NULL, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL(0, outbox.drain(1000, recordSend, NULL, buffer, sizeof(buffer)));
+  outbox.linkUp();
+  failNext = 0;
+  TEST_ASSERT_EQUAL(1, outbox.drain(1000, recordSend, NULL, buffer, sizeof(buffer)));
+}
+
+void test_filter_holds_items_back_without_a_failure(void) {
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  addImages(outbox, 2);
+  TEST_ASSERT_TRUE(outbox.add(OUTBOX_REPORT, "report.txt", 2000, payload, 50));
+  TEST_ASSERT_EQUAL(1, outbox.drain(0, recordSend, NULL, buffer, sizeof(buffer), reportsOnly));
+  TEST_ASSERT_EQUAL_STRING("report.txt", sent[0].c_str());
+  TEST_ASSERT_EQUAL(2, outbox.pending());
+  TEST_ASSERT_EQUAL(0, outbox.stats().failures);
+}
+
+void test_torn_journal_tail_is_dropped(void) {
+  {
+    Outbox outbox;
+    TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+    addImages(outbox, 3);
+  }
+  // power went while the last ADD record was being written
+  TEST_ASSERT_EQUAL(0, truncate(path("journal").c_str(), fileSize("journal") - 5));
+
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  TEST_ASSERT_EQUAL(2, outbox.pending());
+  TEST_ASSERT_EQUAL(1, outbox.stats().tornRecords);
+  // its payload had no record left to own it
+  TEST_ASSERT_EQUAL(1, outbox.stats().orphans);
+  TEST_ASSERT_EQUAL(-1, fileSize("00000003.dat"));
+
+  // the rewritten journal takes new records cleanly
+  TEST_ASSERT_TRUE(outbox.add(OUTBOX_IMAGE, "img3.jpg", 1003, payload, 10));
+  Outbox reopened;
+  TEST_ASSERT_TRUE(reopened.begin(dir.c_str(), 1));
+  TEST_ASSERT_EQUAL(3, reopened.pending());
+  TEST_ASSERT_EQUAL(0, reopened.stats().tornRecords);
+}
+
+void test_lost_or_damaged_payloads_are_retired(void) {
+  {
+    Outbox outbox;
+    TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+    addImages(outbox, 3);
+  }
+  // one payload went missing, recovery drops its record
+  TEST_ASSERT_EQUAL(0, remove(path("00000001.dat").c_str()));
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  TEST_ASSERT_EQUAL(2, outbox.pending());
+  TEST_ASSERT_EQUAL(1, outbox.stats().corrupt);
+
+  // another one is the right size but damaged, it mustn't block the queue
+  FILE *file = fopen(path("00000002.dat").c_str(), "r+b");
+  TEST_ASSERT_NOT_NULL(file);
+  fputc(0xEE, file);
+  fclose(file);
+  TEST_ASSERT_EQUAL(1, outbox.drain(0, recordSend, NULL, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL_STRING("img2.jpg", sent[0].c_str());
+  TEST_ASSERT_EQUAL(2, outbox.stats().corrupt);
+  TEST_ASSERT_EQUAL(0, outbox.pending());
+}
+
+void test_cut_compaction_keeps_the_queue(void) {
+  {
+    Outbox outbox;
+    TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+    addImages(outbox, 2);
+  }
+  // the old journal was removed but the temp file never renamed over it
+  TEST_ASSERT_EQUAL(0, rename(path("journal").c_str(), path("journal.tmp").c_str()));
+  {
+    Outbox outbox;
+    TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+    TEST_ASSERT_EQUAL(2, outbox.pending());
+  }
+
+  // or both are there and the journal still counts
+  FILE *temp = fopen(path("journal.tmp").c_str(), "wb");
+  fputs("half written", temp);
+  fclose(temp);
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  TEST_ASSERT_EQUAL(2, outbox.pending());
+  TEST_ASSERT_EQUAL(-1, fileSize("journal.tmp"));
+}
+
+void test_orphan_payloads_are_removed(void) {
+  {
+    Outbox outbox;
+    TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  }
+  // payload written, power cut before its ADD record
+  FILE *file = fopen(path("000000ff.dat").c_str(), "wb");
+  fputs("x", file);
+  fclose(file);
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  TEST_ASSERT_EQUAL(1, outbox.stats().orphans);
+  TEST_ASSERT_EQUAL(-1, fileSize("000000ff.dat"));
+}
+
+void test_full_queue_refuses_adds(void) {
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  for (int i = 0; i < OUTBOX_MAX_ITEMS; i++) {
+    TEST_ASSERT_TRUE(outbox.add(OUTBOX_REPORT, "r", i, payload, 1));
+  }
+  TEST_ASSERT_FALSE(outbox.add(OUTBOX_REPORT, "r", 0, payload, 1));
+  TEST_ASSERT_EQUAL(1, outbox.stats().full);
+}
+
+void test_journal_is_compacted_as_it_grows(void) {
+  Outbox outbox;
+  TEST_ASSERT_TRUE(outbox.begin(dir.c_str(), 1));
+  // one item stays pending so the journal never empties on its own
+  TEST_ASSERT_TRUE(outbox.add(OUTBOX_REPORT, "keep", 0, payload, 1));
+  for (int i = 0; i < 400; i++) {
+    TEST_ASSERT_TRUE(outbox.add(OUTBOX_IMAGE, "img.jpg", i, payload, 1));
+    TEST_ASSERT_EQUAL(1, outbox.drain(0, recordSend, NULL, buffer, sizeof(buffer), imagesOnly));
+  }
+  TEST_ASSERT_GREATER_THAN(0, outbox.stats().compactions);
+  TEST_ASSERT_LESS_THAN(16384 + 200, fileSize("journal"));
+
+  Outbox reopened;
+  TEST_ASSERT_TRUE(reopened.begin(dir.c_str(), 1));
+  TEST_ASSERT_EQUAL(1, reopened.pending());
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_items_outlive_a_restart);
+  RUN_TEST(test_failed_send_backs_off);
+  RUN_TEST(test_link_up_makes_everything_due);
+  RUN_TEST(test_filter_holds_items_back_without_a_failure);
+  RUN_TEST(test_torn_journal_tail_is_dropped);
+  RUN_TEST(test_lost_or_damaged_payloads_are_retired);
+  RUN_TEST(test_cut_compaction_keeps_the_queue);
+  RUN_TEST(test_orphan_payloads_are_removed);
+  RUN_TEST(test_full_queue_refuses_adds);
+  RUN_TEST(test_journal_is_compacted_as_it_grows);
+  return UNITY_END();
+}
@@ -0,0 +1,179 @@
+// the host port layer, then the pipeline itself on std::thread with a fake
+// camera that outruns a slow uploader
+
+#include <unity.h>
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include "pipeline.h"
+#include "port.h"
+
+#define EVENTS 20
+#define FRAME_SIZE 500
+
+static FrameRing ring;
+static uint8_t arena[FRAME_RING_MAX_SLOTS * FRAME_SIZE];
+static uint8_t frame[FRAME_SIZE];
+static PortMutex *ringMutex;
+
+static std::atomic<int> events(0);
+static std::atomic<int> modemUsers(0);
+static std::atomic<int> modemOverlaps(0);
+static std::atomic<int> housekeepingRuns(0);
+static std::atomic<int> busyIdles(0);
+
+// every third frame is an event, with the frame before it as pre-trigger
+static bool fakeCapture(PipelineJob *job) {
+  static int frames = 0;
+  portMutexLock(ringMutex);
+  StoredFrame *stored = ring.push(frame, sizeof(frame), 0, 1600, 1200);
+  bool event = stored && events < EVENTS && ++frames % 3 == 0;
+  if (event) {
+    StoredFrame *previous = ring.count() > 1 ? ring.at(ring.count() - 2) : NULL;
+    if (previous) {
+      ring.retain(previous);
+      job->frames[job->count++] = previous;
+    }
+    ring.retain(stored);
+    job->frames[job->count++] = stored;
+    events++;
+  }
+  portMutexUnlock(ringMutex);
+  return event;
+}
+
+static void useModem(uint32_t ms) {
+  if (modemUsers++ > 0) modemOverlaps++;
+  portDelay(ms);
+  modemUsers--;
+}
+
+static bool fakeUpload(PipelineJob *job) {
+  useModem(25);
+  return job->count > 0;
+}
+
+static void fakeRelease(PipelineJob *job) {
+  portMutexLock(ringMutex);
+  for (uint8_t i = 0; i < job->count; i++) ring.release(job->frames[i]);
+  portMutexUnlock(ringMutex);
+}
+
+static void fakeHousekeeping() {
+  housekeepingRuns++;
+  useModem(5);
+}
+
+static void fakeIdle(uint32_t ms, bool busy) {
+  if (busy) busyIdles++;
+  portDelay(ms);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_queue_is_fifo_and_bounded(void) {
+  // the port layer has no delete, queues live as long as the firmware
+  static PortQueue *queue = portQueueCreate(2, sizeof(int));
+  int value = 1;
+  TEST_ASSERT_TRUE(portQueueSend(queue, &value, 0));
+  value = 2;
+  TEST_ASSERT_TRUE(portQueueSend(queue, &value, 0));
+  value = 3;
+  TEST_ASSERT_FALSE(portQueueSend(queue, &value, 0));
+  TEST_ASSERT_EQUAL(2, portQueueCount(queue));
+
+  TEST_ASSERT_TRUE(portQueueReceive(queue, &value, 0));
+  TEST_ASSERT_EQUAL(1, value);
+  TEST_ASSERT_TRUE(portQueueReceive(queue, &value, 0));
+  TEST_ASSERT_EQUAL(2, value);
+  uint32_t startTime = portMillis();
+  TEST_ASSERT_FALSE(portQueueReceive(queue, &value, 30));
+  TEST_ASSERT_GREATER_OR_EQUAL(startTime + 25, portMillis());
+}
+
+void test_blocked_send_resumes_when_space_frees(void) {
+  static PortQueue *queue = portQueueCreate(1, sizeof(int));
+  int value = 1;
+  TEST_ASSERT_TRUE(portQueueSend(queue, &value, 0));
+  std::thread receiver([] {
+    int item;
+    portDelay(20);
+    portQueueReceive(queue, &item, PORT_WAIT_FOREVER);
+  });
+  value = 2;
+  TEST_ASSERT_TRUE(portQueueSend(queue, &value, 1000));
+  receiver.join();
+  TEST_ASSERT_TRUE(portQueueReceive(queue, &value, 0));
+  TEST_ASSERT_EQUAL(2, value);
+}
+
+static const PipelineBackend backend = {fakeCapture, fakeUpload, fakeRelease, fakeHousekeeping, fakeIdle};
+static const PipelineConfig config = {5, 20, 2, PIPELINE_DROP_OLDEST, 100, 1, 0, 4096};
+
+void test_housekeeping_runs_without_capture(void) {
+  // a dead camera or SD card still leaves OTA and reports running
+  TEST_ASSERT_TRUE(pipelineStartHousekeeping(backend, config));
+  uint32_t startTime = portMillis();
+  while (housekeepingRuns < 3 && portMillis() - startTime < 2000) {
+    portDelay(5);
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(3, housekeepingRuns.load());
+  TEST_ASSERT_EQUAL(0, pipelineStats().captured);
+  // starting it again is a no-op
+  TEST_ASSERT_TRUE(pipelineStartHousekeeping(backend, config));
+  // and it waits for the modem like uploads do
+  pipelineLockModem();
+  int runs = housekeepingRuns;
+  portDelay(60);
+  TEST_ASSERT_EQUAL(runs, housekeepingRuns.load());
+  pipelineUnlockModem();
+}
+
+void test_pipeline_drops_oldest_and_releases_every_frame(void) {
+  ringMutex = portMutexCreate();
+  TEST_ASSERT_TRUE(ring.begin(arena, sizeof(arena), FRAME_SIZE, 4));
+  TEST_ASSERT_TRUE(pipelineStart(backend, config));
+
+  // the tasks never end, wait for the events to drain
+  const PipelineStats &stats = pipelineStats();
+  uint32_t startTime = portMillis();
+  while ((events < EVENTS || stats.uploaded + stats.uploadFailures + stats.dropped < EVENTS) &&
+         portMillis() - startTime < 5000) {
+    portDelay(10);
+  }
+
+  TEST_ASSERT_EQUAL(EVENTS, stats.events);
+  TEST_ASSERT_EQUAL(EVENTS, stats.uploaded + stats.dropped);
+  TEST_ASSERT_EQUAL(0, stats.uploadFailures);
+  // capture runs ahead of the uploader, so the queue fills and sheds
+  TEST_ASSERT_GREATER_THAN(0, stats.dropped);
+  TEST_ASSERT_GREATER_THAN(0, stats.backpressureWaits);
+  TEST_ASSERT_EQUAL(2, stats.queueHighWater);
+  TEST_ASSERT_GREATER_THAN(EVENTS, stats.captured);
+  TEST_ASSERT_GREATER_THAN(0, busyIdles.load());
+
+  // uploads and housekeeping never held the modem together
+  TEST_ASSERT_GREATER_THAN(0, housekeepingRuns.load());
+  TEST_ASSERT_EQUAL(0, modemOverlaps.load());
+
+  // uploaded and dropped jobs both gave their frames back: only the
+  // history itself is still held
+  portMutexLock(ringMutex);
+  TEST_ASSERT_EQUAL(ring.count(), ring.stats().slotsInUse);
+  TEST_ASSERT_EQUAL(0, ring.stats().exhausted);
+  portMutexUnlock(ringMutex);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_queue_is_fifo_and_bounded);
+  RUN_TEST(test_blocked_send_resumes_when_space_frees);
+  // the pipeline tasks run for the life of the process, so these go last
+  RUN_TEST(test_housekeeping_runs_without_capture);
+  RUN_TEST(test_pipeline_drops_oldest_and_releases_every_frame);
+  return UNITY_END();
+}
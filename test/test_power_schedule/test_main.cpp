@@ -0,0 +1,261 @@
+// the power scheduler: boots, deadlines carried through deep sleeps, how each
+// gap is spent, a simulated day on the device's schedule and currents, and
+// the tasks sharing one scheduler
+
+#include <unity.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "power_schedule.h"
+
+#define MINUTE_MS 60000LL
+#define HOUR_MS (60 * MINUTE_MS)
+
+static const PowerConfig config = {
+  POWER_LIGHT_SLEEP_MIN_MS,
+  POWER_DEEP_SLEEP_MIN_MS,
+  POWER_MODEM_PSM_MIN_MS,
+  POWER_DEEP_WAKE_MS,
+  {POWER_ACTIVE_MA, POWER_LIGHT_SLEEP_MA, POWER_DEEP_SLEEP_MA},
+  POWER_MODEM_ON_MA,
+  POWER_MODEM_PSM_MA
+};
+
+// RTC memory survives deep sleeps, not power cycles
+static PowerRtcState rtc;
+
+void setUp(void) {
+  memset(&rtc, 0xA5, sizeof(rtc));
+}
+
+void tearDown(void) {}
+
+void test_cold_boots_reset_the_state(void) {
+  PowerScheduler power;
+  // garbage after power on
+  TEST_ASSERT_FALSE(power.begin(&rtc, config, 5000));
+  TEST_ASSERT_EQUAL_HEX32(POWER_STATE_MAGIC, rtc.magic);
+  TEST_ASSERT_EQUAL(1, power.coldBoots());
+  TEST_ASSERT_EQUAL(0, power.deepWakes());
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, power.nextDue(NULL));
+  TEST_ASSERT_EQUAL_INT64(1234, power.now(1234));
+
+  power.every(POWER_JOB_REPORT, 1000, 0);
+  // a reset or brownout starts the schedule over but keeps counting boots
+  PowerScheduler rebooted;
+  TEST_ASSERT_FALSE(rebooted.begin(&rtc, config, -1));
+  TEST_ASSERT_EQUAL(2, rebooted.coldBoots());
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, rebooted.nextDue(NULL));
+}
+
+void test_deep_sleep_carries_the_schedule(void) {
+  PowerScheduler power;
+  power.begin(&rtc, config, -1);
+  power.every(POWER_JOB_REPORT, 24 * HOUR_MS, 0);
+  power.every(POWER_JOB_OTA, 30 * MINUTE_MS, 0);
+  power.sleeping(10 * MINUTE_MS, true);
+
+  PowerScheduler woken;
+  TEST_ASSERT_TRUE(woken.begin(&rtc, config, 15 * MINUTE_MS));
+  TEST_ASSERT_EQUAL(1, woken.deepWakes());
+  // the timeline carries on from the sleep
+  TEST_ASSERT_EQUAL_INT64(25 * MINUTE_MS + 500, woken.now(500));
+  // setup() asks for the same jobs again, the old deadlines stand
+  woken.every(POWER_JOB_REPORT, 24 * HOUR_MS, woken.now(0));
+  woken.every(POWER_JOB_OTA, 30 * MINUTE_MS, woken.now(0));
+  PowerJob job;
+  TEST_ASSERT_EQUAL_INT64(30 * MINUTE_MS, woken.nextDue(&job));
+  TEST_ASSERT_EQUAL(POWER_JOB_OTA, job);
+  TEST_ASSERT_FALSE(woken.due(POWER_JOB_OTA, woken.now(0)));
+  TEST_ASSERT_TRUE(woken.due(POWER_JOB_OTA, 30 * MINUTE_MS));
+
+  // the sleep is on the books, with the modem in PSM
+  TEST_ASSERT_EQUAL(15 * MINUTE_MS, woken.totals().stateMs[POWER_DEEP_SLEEP]);
+  TEST_ASSERT_EQUAL(15 * MINUTE_MS, woken.totals().modemPsmMs);
+
+  // a shorter interval than the one carried over takes effect now
+  woken.every(POWER_JOB_OTA, MINUTE_MS, woken.now(0));
+  TEST_ASSERT_EQUAL_INT64(26 * MINUTE_MS, woken.nextDue(NULL));
+}
+
+void test_plan_picks_the_sleep_for_the_gap(void) {
+  PowerScheduler power;
+  power.begin(&rtc, config, -1);
+  PowerPlan plan;
+
+  power.dueIn(POWER_JOB_CAPTURE, 0, 100);
+  plan = power.plan(0, false);
+  TEST_ASSERT_EQUAL(POWER_ACTIVE, plan.state);
+  TEST_ASSERT_EQUAL(100, plan.sleepMs);
+
+  power.dueIn(POWER_JOB_CAPTURE, 0, 10000);
+  plan = power.plan(0, false);
+  TEST_ASSERT_EQUAL(POWER_LIGHT_SLEEP, plan.state);
+  TEST_ASSERT_EQUAL(10000, plan.sleepMs);
+  TEST_ASSERT_EQUAL(POWER_JOB_CAPTURE, plan.next);
+  // busy means awake, in short steps
+  plan = power.plan(0, true);
+  TEST_ASSERT_EQUAL(POWER_ACTIVE, plan.state);
+  TEST_ASSERT_EQUAL(POWER_LIGHT_SLEEP_MIN_MS, plan.sleepMs);
+
+  // long gaps sleep deep, waking early enough to boot, and park the modem
+  power.dueIn(POWER_JOB_CAPTURE, 0, 5 * MINUTE_MS);
+  plan = power.plan(0, false);
+  TEST_ASSERT_EQUAL(POWER_DEEP_SLEEP, plan.state);
+  TEST_ASSERT_EQUAL(5 * MINUTE_MS - POWER_DEEP_WAKE_MS, plan.sleepMs);
+  TEST_ASSERT_FALSE(plan.modemPsm);
+  power.dueIn(POWER_JOB_CAPTURE, 0, 30 * MINUTE_MS);
+  TEST_ASSERT_TRUE(power.plan(0, false).modemPsm);
+
+  // overdue work keeps it up
+  plan = power.plan(31 * MINUTE_MS, false);
+  TEST_ASSERT_EQUAL(POWER_ACTIVE, plan.state);
+}
+
+void test_inactive_jobs_never_wake_the_device(void) {
+  PowerScheduler power;
+  power.begin(&rtc, config, -1);
+  power.every(POWER_JOB_OUTBOX, 10 * MINUTE_MS, 0);
+  power.every(POWER_JOB_REPORT, 24 * HOUR_MS, 0);
+  power.setActive(POWER_JOB_OUTBOX, false);
+  PowerJob job;
+  TEST_ASSERT_EQUAL_INT64(24 * HOUR_MS, power.nextDue(&job));
+  TEST_ASSERT_EQUAL(POWER_JOB_REPORT, job);
+  TEST_ASSERT_FALSE(power.due(POWER_JOB_OUTBOX, 11 * MINUTE_MS));
+
+  // nothing scheduled at all, sleep the shortest deep sleep and look again
+  power.setActive(POWER_JOB_REPORT, false);
+  PowerPlan plan = power.plan(0, false);
+  TEST_ASSERT_EQUAL(POWER_DEEP_SLEEP, plan.state);
+  TEST_ASSERT_EQUAL(POWER_DEEP_SLEEP_MIN_MS - POWER_DEEP_WAKE_MS, plan.sleepMs);
+}
+
+void test_charge_is_accounted_per_state(void) {
+  PowerScheduler power;
+  power.begin(&rtc, config, -1);
+  power.account(POWER_ACTIVE, false, HOUR_MS);
+  TEST_ASSERT_EQUAL(POWER_ACTIVE_MA + POWER_MODEM_ON_MA, power.milliampHours());
+  power.account(POWER_DEEP_SLEEP, true, 10 * HOUR_MS);
+  TEST_ASSERT_EQUAL(POWER_ACTIVE_MA + POWER_MODEM_ON_MA + 10 * (POWER_DEEP_SLEEP_MA + POWER_MODEM_PSM_MA),
+                    power.milliampHours());
+  TEST_ASSERT_EQUAL(HOUR_MS, power.totals().stateMs[POWER_ACTIVE]);
+  TEST_ASSERT_EQUAL(10 * HOUR_MS, power.totals().modemPsmMs);
+}
+
+// a quiet day at a site: loop() runs what is due, then waits the way the
+// plan says. each deep sleep is a reboot with only rtc kept
+void test_simulated_day(void) {
+  const int64_t workMs = 8000;
+  PowerScheduler *power = new PowerScheduler();
+  power->begin(&rtc, config, -1);
+  int64_t now = 0;
+  int runs[POWER_JOB_COUNT] = {0};
+
+  while (now < 24 * HOUR_MS) {
+    // setup() after every boot
+    power->every(POWER_JOB_REPORT, REPORT_INTERVAL_MS, now);
+    power->every(POWER_JOB_OTA, OTA_CHECK_INTERVAL_MS, now);
+    power->every(POWER_JOB_CLOCK, CLOCK_RESYNC_INTERVAL_MS, now);
+    power->every(POWER_JOB_TELEMETRY, TELEMETRY_INTERVAL_MS, now);
+    power->every(POWER_JOB_CAPTURE, 20 * MINUTE_MS, now);
+
+    bool ran = false;
+    for (int job = 0; job < POWER_JOB_COUNT; job++) {
+      if (power->due((PowerJob)job, now)) {
+        power->done((PowerJob)job, now);
+        runs[job]++;
+        ran = true;
+      }
+    }
+    if (ran) {
+      power->account(POWER_ACTIVE, false, workMs);
+      now += workMs;
+    }
+
+    PowerPlan plan = power->plan(now, false);
+    if (plan.state != POWER_DEEP_SLEEP) {
+      power->account(plan.state, false, plan.sleepMs);
+      now += plan.sleepMs;
+      continue;
+    }
+    power->sleeping(now, plan.modemPsm);
+    delete power;
+    power = new PowerScheduler();
+    TEST_ASSERT_TRUE(power->begin(&rtc, config, plan.sleepMs));
+    // the warm boot itself
+    now += plan.sleepMs;
+    TEST_ASSERT_EQUAL_INT64(now, power->now(0));
+    power->account(POWER_ACTIVE, false, POWER_DEEP_WAKE_MS);
+    now += POWER_DEEP_WAKE_MS;
+  }
+
+  TEST_ASSERT_INT_WITHIN(1, 72, runs[POWER_JOB_CAPTURE]);
+  TEST_ASSERT_INT_WITHIN(1, 48, runs[POWER_JOB_OTA]);
+  TEST_ASSERT_INT_WITHIN(1, 4, runs[POWER_JOB_CLOCK]);
+  TEST_ASSERT_EQUAL(1, power->coldBoots());
+  TEST_ASSERT_GREATER_THAN(70, power->deepWakes());
+
+  // mostly in deep sleep with the modem parked
+  PowerAccount totals = power->totals();
+  uint64_t total = totals.stateMs[POWER_ACTIVE] + totals.stateMs[POWER_LIGHT_SLEEP] + totals.stateMs[POWER_DEEP_SLEEP];
+  TEST_ASSERT_INT_WITHIN(HOUR_MS, 24 * HOUR_MS, (int64_t)total);
+  TEST_ASSERT_GREATER_THAN(total * 9 / 10, totals.stateMs[POWER_DEEP_SLEEP]);
+  TEST_ASSERT_GREATER_THAN(totals.stateMs[POWER_DEEP_SLEEP] / 2, totals.modemPsmMs);
+  // the old loop stayed up with the modem on: 130 mA for 24 h
+  TEST_ASSERT_LESS_THAN(24 * (POWER_ACTIVE_MA + POWER_MODEM_ON_MA) / 10, power->milliampHours());
+  delete power;
+}
+
+void test_tasks_share_the_scheduler(void) {
+  PowerScheduler power;
+  power.begin(&rtc, config, -1);
+  power.every(POWER_JOB_REPORT, 1000, 0);
+  power.every(POWER_JOB_OUTBOX, 1000, 0);
+  // crosses 32 bits, a torn read would show up in the low or high half
+  const uint64_t stepMs = 0x100000001ULL;
+  const int steps = 200000;
+
+  std::vector<std::thread> tasks;
+  // capture: accounts its idle time and plans the next wait
+  tasks.emplace_back([&] {
+    for (int i = 0; i < steps; i++) {
+      power.account(POWER_ACTIVE, true, stepMs);
+      power.dueIn(POWER_JOB_CAPTURE, i, 500);
+      power.plan(i, false);
+    }
+  });
+  // upload: the outbox empties and fills
+  tasks.emplace_back([&] {
+    for (int i = 0; i < steps; i++) power.setActive(POWER_JOB_OUTBOX, i & 1);
+  });
+  // housekeeping: runs due jobs, accounts too and reads the totals
+  bool consistent = true;
+  tasks.emplace_back([&] {
+    for (int i = 0; i < steps; i++) {
+      if (power.due(POWER_JOB_REPORT, i)) power.done(POWER_JOB_REPORT, i);
+      power.account(POWER_ACTIVE, true, stepMs);
+      PowerAccount totals = power.totals();
+      if (totals.stateMs[POWER_ACTIVE] != totals.modemPsmMs || totals.modemPsmMs % stepMs != 0) consistent = false;
+    }
+  });
+  for (std::thread &task : tasks) task.join();
+
+  TEST_ASSERT_TRUE(consistent);
+  TEST_ASSERT_TRUE(power.totals().stateMs[POWER_ACTIVE] == 2 * steps * stepMs);
+  TEST_ASSERT_TRUE(power.totals().modemPsmMs == 2 * steps * stepMs);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_cold_boots_reset_the_state);
+  RUN_TEST(test_deep_sleep_carries_the_schedule);
+  RUN_TEST(test_plan_picks_the_sleep_for_the_gap);
+  RUN_TEST(test_inactive_jobs_never_wake_the_device);
+  RUN_TEST(test_charge_is_accounted_per_state);
+  RUN_TEST(test_simulated_day);
+  RUN_TEST(test_tasks_share_the_scheduler);
+  return UNITY_END();
+}
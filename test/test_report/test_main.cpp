@@ -0,0 +1,105 @@
+// upload file names and the daily report body: the lines sendLogFile()
+// sends, battery and SD fallbacks, the metrics section and cutting at a
+// line when the buffer is short
+
+#include <unity.h>
+#include <string.h>
+#include "config.h"
+#include "metrics.h"
+#include "report.h"
+
+static ReportInfo info;
+
+void setUp(void) {
+  metricsReset();
+  info = {"864764030000001", 21, 31, "17.10.2026 09:30:00", true, 3950, true, 15258, 812, 41, "-33.802058,18.544239"};
+}
+
+void tearDown(void) {}
+
+void test_image_and_report_names(void) {
+  char name[64];
+  TEST_ASSERT_EQUAL(strlen(DEVICENAME "-17102026093000.jpg"), imageName(name, sizeof(name), "17102026093000", ".jpg"));
+  TEST_ASSERT_EQUAL_STRING(DEVICENAME "-17102026093000.jpg", name);
+  imageName(name, sizeof(name), "17102026093000", "-p2.jpg");
+  TEST_ASSERT_EQUAL_STRING(DEVICENAME "-17102026093000-p2.jpg", name);
+  reportName(name, sizeof(name), "17102026093000", "-DailyReport.txt");
+  TEST_ASSERT_EQUAL_STRING("17102026093000-" DEVICENAME "-DailyReport.txt", name);
+}
+
+void test_names_that_dont_fit_are_empty(void) {
+  char name[20];
+  TEST_ASSERT_EQUAL(0, imageName(name, sizeof(name), "17102026093000", ".jpg"));
+  TEST_ASSERT_EQUAL_STRING("", name);
+  TEST_ASSERT_EQUAL(0, reportName(name, 0, "17102026093000", ".jpg"));
+}
+
+void test_report_lines(void) {
+  char text[REPORT_SIZE];
+  size_t length = reportFormat(text, sizeof(text), info);
+  TEST_ASSERT_EQUAL_STRING("IMEI:864764030000001\n"
+                           "CSQ:21\n"
+                           "CamID:" DEVICENAME "\n"
+                           "Temp:31C\n"
+                           "Date:17.10.2026 09:30:00\n"
+                           "Bat:72% 3950mV\n"
+                           "SD:812/15258M\n"
+                           "Total:0\n"
+                           "Send:41\n"
+                           "GPS:-33.802058,18.544239\n",
+                           text);
+  TEST_ASSERT_EQUAL(strlen(text), length);
+}
+
+void test_battery_and_sd_fallbacks(void) {
+  char text[REPORT_SIZE];
+  info.batterySet = false;
+  info.sdReady = false;
+  reportFormat(text, sizeof(text), info);
+  TEST_ASSERT_NOT_NULL(strstr(text, "\nBat:unknown\nSD:none\n"));
+
+  // readings outside the range clamp the percentage
+  info.batterySet = true;
+  info.batteryMv = 2900;
+  reportFormat(text, sizeof(text), info);
+  TEST_ASSERT_NOT_NULL(strstr(text, "\nBat:0% 2900mV\n"));
+  info.batteryMv = 4350;
+  reportFormat(text, sizeof(text), info);
+  TEST_ASSERT_NOT_NULL(strstr(text, "\nBat:100% 4350mV\n"));
+}
+
+void test_metrics_follow_the_header(void) {
+  metricRecord(METRIC_CAMERA_GRAB, 4000);
+  char text[REPORT_SIZE];
+  size_t length = reportFormat(text, sizeof(text), info);
+  TEST_ASSERT_NOT_NULL(strstr(text, "GPS:-33.802058,18.544239\nMetrics:\ncam 1 4/4/4/4 ms\n"));
+  TEST_ASSERT_EQUAL(strlen(text), length);
+}
+
+void test_short_buffer_cuts_at_a_line(void) {
+  char text[40];
+  TEST_ASSERT_EQUAL(strlen("IMEI:864764030000001\nCSQ:21\n"), reportFormat(text, sizeof(text), info));
+  TEST_ASSERT_EQUAL_STRING("IMEI:864764030000001\nCSQ:21\n", text);
+
+  // no room for a metrics line leaves the header out too
+  metricRecord(METRIC_CAMERA_GRAB, 4000);
+  char full[REPORT_SIZE];
+  size_t fixed = reportFormat(full, sizeof(full), info) - strlen("Metrics:\ncam 1 4/4/4/4 ms\n");
+  size_t length = reportFormat(full, fixed + strlen("Metrics:\n") + 4, info);
+  TEST_ASSERT_EQUAL(fixed, length);
+  TEST_ASSERT_EQUAL(fixed, strlen(full));
+  TEST_ASSERT_EQUAL(0, reportFormat(text, 0, info));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_image_and_report_names);
+  RUN_TEST(test_names_that_dont_fit_are_empty);
+  RUN_TEST(test_report_lines);
+  RUN_TEST(test_battery_and_sd_fallbacks);
+  RUN_TEST(test_metrics_follow_the_header);
+  RUN_TEST(test_short_buffer_cuts_at_a_line);
+  return UNITY_END();
+}
@@ -0,0 +1,160 @@
+// the region of interest finder on block masks shaped like the motion
+// detector's UXGA grid: noise is ignored, regions merge, crops stay aligned
+
+#include <unity.h>
+#include <string.h>
+#include "roi.h"
+
+#define BLOCKS_WIDE 25
+#define BLOCKS_HIGH 18
+#define BLOCK_PIXELS 64
+#define FRAME_WIDTH 1600
+#define FRAME_HEIGHT 1200
+
+static RoiFinder finder;
+static uint8_t mask[BLOCKS_WIDE * BLOCKS_HIGH];
+static const RoiConfig config = {2, 64, 256, 800};
+
+static void set(int x, int y) {
+  mask[y * BLOCKS_WIDE + x] = 1;
+}
+
+static uint8_t find(RoiRect *rect, const RoiConfig &with = config) {
+  return finder.find(mask, BLOCKS_WIDE, BLOCKS_HIGH, BLOCK_PIXELS, FRAME_WIDTH, FRAME_HEIGHT, with, rect);
+}
+
+void setUp(void) {
+  memset(mask, 0, sizeof(mask));
+}
+
+void tearDown(void) {}
+
+void test_quiet_mask_gives_no_crop(void) {
+  RoiRect rect;
+  TEST_ASSERT_EQUAL(0, find(&rect));
+  TEST_ASSERT_EQUAL(0, rect.width);
+  TEST_ASSERT_EQUAL(0, rect.height);
+}
+
+void test_small_regions_are_noise(void) {
+  RoiRect rect;
+  set(0, 0);
+  set(20, 10);
+  // touching corners don't join blocks into a region
+  set(5, 5);
+  set(6, 6);
+  TEST_ASSERT_EQUAL(0, find(&rect));
+  TEST_ASSERT_EQUAL(0, rect.width);
+}
+
+void test_region_gets_its_margin(void) {
+  RoiRect rect;
+  set(10, 5);
+  set(11, 5);
+  set(11, 6);
+  TEST_ASSERT_EQUAL(1, find(&rect));
+  // blocks 640..768 x 320..448, 64 pixels more on each side
+  TEST_ASSERT_EQUAL(576, rect.x);
+  TEST_ASSERT_EQUAL(256, rect.y);
+  TEST_ASSERT_EQUAL(256, rect.width);
+  TEST_ASSERT_EQUAL(256, rect.height);
+  TEST_ASSERT_EQUAL(0, roiScaleShift(rect, config.maxSide));
+}
+
+void test_regions_merge_into_one_crop_inside_the_frame(void) {
+  RoiRect rect;
+  set(10, 5);
+  set(11, 5);
+  set(24, 16);
+  set(24, 17);
+  TEST_ASSERT_EQUAL(2, find(&rect));
+  TEST_ASSERT_EQUAL(576, rect.x);
+  TEST_ASSERT_EQUAL(256, rect.y);
+  TEST_ASSERT_EQUAL(FRAME_WIDTH, rect.x + rect.width);
+  TEST_ASSERT_EQUAL(FRAME_HEIGHT, rect.y + rect.height);
+  TEST_ASSERT_EQUAL(1, roiScaleShift(rect, config.maxSide));
+
+  memset(mask, 1, sizeof(mask));
+  TEST_ASSERT_EQUAL(1, find(&rect));
+  TEST_ASSERT_EQUAL(0, rect.x);
+  TEST_ASSERT_EQUAL(0, rect.y);
+  TEST_ASSERT_EQUAL(FRAME_WIDTH, rect.width);
+  TEST_ASSERT_EQUAL(FRAME_HEIGHT, rect.height);
+}
+
+void test_small_crops_grow_away_from_the_edge(void) {
+  RoiRect rect;
+  RoiConfig tight = {2, 0, 256, 800};
+  set(0, 0);
+  set(1, 0);
+  TEST_ASSERT_EQUAL(1, find(&rect, tight));
+  // 128x64 grown to the minimum, pushed back inside the frame
+  TEST_ASSERT_EQUAL(0, rect.x);
+  TEST_ASSERT_EQUAL(0, rect.y);
+  TEST_ASSERT_EQUAL(256, rect.width);
+  TEST_ASSERT_EQUAL(256, rect.height);
+
+  setUp();
+  set(24, 17);
+  set(23, 17);
+  TEST_ASSERT_EQUAL(1, find(&rect, tight));
+  TEST_ASSERT_EQUAL(FRAME_WIDTH, rect.x + rect.width);
+  TEST_ASSERT_EQUAL(FRAME_HEIGHT, rect.y + rect.height);
+  TEST_ASSERT_EQUAL(256, rect.width);
+}
+
+void test_crops_fall_on_mcu_boundaries(void) {
+  // 20 pixel blocks don't line up with 16 pixel MCUs
+  RoiRect rect;
+  RoiConfig loose = {1, 3, 0, 800};
+  uint8_t small[8 * 6];
+  memset(small, 0, sizeof(small));
+  small[2 * 8 + 3] = 1;
+  TEST_ASSERT_EQUAL(1, finder.find(small, 8, 6, 20, 160, 120, loose, &rect));
+  // 60..80 with a 3 pixel margin is 57..83, widened to 48..96
+  TEST_ASSERT_EQUAL(48, rect.x);
+  TEST_ASSERT_EQUAL(32, rect.y);
+  TEST_ASSERT_EQUAL(48, rect.width);
+  TEST_ASSERT_EQUAL(0, rect.x % ROI_ALIGN);
+  TEST_ASSERT_EQUAL(0, (rect.x + rect.width) % ROI_ALIGN);
+  TEST_ASSERT_EQUAL(0, rect.y % ROI_ALIGN);
+}
+
+void test_bad_masks_are_refused(void) {
+  RoiRect rect;
+  set(1, 1);
+  set(1, 2);
+  TEST_ASSERT_EQUAL(0, finder.find(NULL, BLOCKS_WIDE, BLOCKS_HIGH, BLOCK_PIXELS, FRAME_WIDTH, FRAME_HEIGHT, config,
+                                   &rect));
+  TEST_ASSERT_EQUAL(0, finder.find(mask, 0, BLOCKS_HIGH, BLOCK_PIXELS, FRAME_WIDTH, FRAME_HEIGHT, config, &rect));
+  // more blocks than the finder has room for
+  TEST_ASSERT_EQUAL(0, finder.find(mask, ROI_MAX_BLOCKS, 2, BLOCK_PIXELS, FRAME_WIDTH, FRAME_HEIGHT, config, &rect));
+  TEST_ASSERT_EQUAL(0, rect.width);
+}
+
+void test_scale_shift_stops_at_an_eighth(void) {
+  RoiRect rect = {0, 0, 1600, 1200};
+  TEST_ASSERT_EQUAL(1, roiScaleShift(rect, 800));
+  TEST_ASSERT_EQUAL(2, roiScaleShift(rect, 400));
+  TEST_ASSERT_EQUAL(3, roiScaleShift(rect, 100));
+  TEST_ASSERT_EQUAL(0, roiScaleShift(rect, 1600));
+  // no limit
+  TEST_ASSERT_EQUAL(0, roiScaleShift(rect, 0));
+  RoiRect tall = {0, 0, 200, 1200};
+  TEST_ASSERT_EQUAL(1, roiScaleShift(tall, 800));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_quiet_mask_gives_no_crop);
+  RUN_TEST(test_small_regions_are_noise);
+  RUN_TEST(test_region_gets_its_margin);
+  RUN_TEST(test_regions_merge_into_one_crop_inside_the_frame);
+  RUN_TEST(test_small_crops_grow_away_from_the_edge);
+  RUN_TEST(test_crops_fall_on_mcu_boundaries);
+  RUN_TEST(test_bad_masks_are_refused);
+  RUN_TEST(test_scale_shift_stops_at_an_eighth);
+  return UNITY_END();
+}
@@ -0,0 +1,94 @@
+// the SD log task on a host directory: esp_log lines reach the file whole,
+// the file rotates by size and rotated segments are handed out for upload
+
+#include <unity.h>
+#include <Arduino.h>
+#include <SD.h>
+#include <esp_log.h>
+#include <string>
+#include "config.h"
+#include "port.h"
+#include "sd_log.h"
+
+static std::string readFile(const char *path) {
+  std::string text;
+  File file = SD.open(path, FILE_READ);
+  if (!file) return text;
+  char chunk[512];
+  int count;
+  while ((count = file.read((uint8_t *)chunk, sizeof(chunk))) > 0) text.append(chunk, count);
+  file.close();
+  return text;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_lines_reach_the_file_whole(void) {
+  std::string longText(600, 'y');
+  ESP_LOGI(TAG, "Picture taken, %u bytes", 91234u);
+  ESP_LOGI(TAG, "long %s end", longText.c_str());
+  TEST_ASSERT_TRUE(sdLogFlush(5000));
+
+  std::string text = readFile(LOG_FILE_NAME);
+  TEST_ASSERT_TRUE(text.find("SmartCamera: Picture taken, 91234 bytes\n") != std::string::npos);
+  // the old handler cut lines at 128 bytes
+  TEST_ASSERT_TRUE(text.find("long " + longText + " end\n") != std::string::npos);
+  TEST_ASSERT_EQUAL(0, sdLogStats().writeErrors);
+}
+
+void test_full_sectors_go_out_without_a_flush(void) {
+  uint32_t batches = sdLogStats().batches;
+  size_t size = SD.open(LOG_FILE_NAME).size();
+  for (int i = 0; i < 40; i++) ESP_LOGI(TAG, "filler line %d to fill a couple of sectors", i);
+  // delay() only moves the mock clock, the task needs real time
+  uint32_t startTime = portMillis();
+  while (sdLogStats().batches == batches && portMillis() - startTime < 1000) portDelay(10);
+  TEST_ASSERT_GREATER_THAN(batches, sdLogStats().batches);
+  // whole sectors only, the tail waits for a flush or LOG_FLUSH_MS
+  TEST_ASSERT_EQUAL(0, (SD.open(LOG_FILE_NAME).size() - size) % LOG_SECTOR_SIZE);
+}
+
+void test_file_rotates_and_segments_are_handed_out(void) {
+  char segment[48];
+  TEST_ASSERT_FALSE(sdLogTakeSegment(segment, sizeof(segment)));
+
+  // a log grown over earlier boots, the next batch takes it past the limit
+  std::string filler(4096, 'f');
+  File grown = SD.open(LOG_FILE_NAME, FILE_APPEND);
+  while (grown.size() < LOG_MAX_FILE_SIZE - 100) grown.write((const uint8_t *)filler.data(), filler.size());
+  grown.close();
+  ESP_LOGI(TAG, "Going to sleep");
+  TEST_ASSERT_TRUE(sdLogFlush(5000));
+  TEST_ASSERT_EQUAL(1, sdLogStats().rotations);
+  ESP_LOGI(TAG, "Woke up");
+  TEST_ASSERT_TRUE(sdLogFlush(5000));
+  TEST_ASSERT_EQUAL(0, sdLogRingStats().dropped);
+  TEST_ASSERT_TRUE(SD.exists(LOG_FILE_NAME ".1"));
+  TEST_ASSERT_GREATER_OR_EQUAL(LOG_MAX_FILE_SIZE, SD.open(LOG_FILE_NAME ".1").size());
+  TEST_ASSERT_TRUE(readFile(LOG_FILE_NAME).find("Woke up") != std::string::npos);
+
+  TEST_ASSERT_TRUE(sdLogTakeSegment(segment, sizeof(segment)));
+  TEST_ASSERT_EQUAL_STRING(LOG_FILE_NAME ".up", segment);
+  TEST_ASSERT_FALSE(SD.exists(LOG_FILE_NAME ".1"));
+  // an upload that failed leaves it in place and it comes first next time
+  TEST_ASSERT_TRUE(sdLogTakeSegment(segment, sizeof(segment)));
+  TEST_ASSERT_TRUE(SD.remove(segment));
+  TEST_ASSERT_FALSE(sdLogTakeSegment(segment, sizeof(segment)));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  SD.setRoot(mockTempDir("test-sd-log"));
+  esp_log_level_set("*", ESP_LOG_INFO);
+  // the log task runs for the life of the process, one begin for all tests
+  if (!sdLogBegin(SD, LOG_FILE_NAME)) return 1;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_lines_reach_the_file_whole);
+  RUN_TEST(test_full_sectors_go_out_without_a_flush);
+  RUN_TEST(test_file_rotates_and_segments_are_handed_out);
+  return UNITY_END();
+}
@@ -0,0 +1,70 @@
+// the host SHA-256 against the FIPS 180-2 vectors, fed whole and in pieces
+
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include "sha256.h"
+
+static std::string hexDigest(const void *data, size_t length, size_t step) {
+  Sha256 sha;
+  sha256Begin(sha);
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t offset = 0; offset < length; offset += step) {
+    sha256Update(sha, bytes + offset, length - offset < step ? length - offset : step);
+  }
+  uint8_t digest[SHA256_SIZE];
+  sha256Finish(sha, digest);
+  char text[2 * SHA256_SIZE + 1];
+  sha256ToHex(digest, text);
+  return text;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_known_vectors(void) {
+  TEST_ASSERT_EQUAL_STRING("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+                           hexDigest("", 0, 1).c_str());
+  TEST_ASSERT_EQUAL_STRING("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+                           hexDigest("abc", 3, 3).c_str());
+  // 56 bytes, the length no longer fits in the first block
+  const char *twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  TEST_ASSERT_EQUAL_STRING("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+                           hexDigest(twoBlocks, strlen(twoBlocks), 56).c_str());
+}
+
+void test_split_updates_match_one_update(void) {
+  std::string million(1000000, 'a');
+  const char *expected = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+  TEST_ASSERT_EQUAL_STRING(expected, hexDigest(million.data(), million.size(), million.size()).c_str());
+  // odd pieces straddle the 64 byte blocks
+  TEST_ASSERT_EQUAL_STRING(expected, hexDigest(million.data(), million.size(), 1).c_str());
+  TEST_ASSERT_EQUAL_STRING(expected, hexDigest(million.data(), million.size(), 63).c_str());
+  TEST_ASSERT_EQUAL_STRING(expected, hexDigest(million.data(), million.size(), 4097).c_str());
+}
+
+void test_hex_round_trip(void) {
+  uint8_t digest[SHA256_SIZE];
+  // sha256sum output, as published next to the firmware
+  TEST_ASSERT_TRUE(sha256FromHex(
+      "  BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD  sanwildsmartcam04-firmware.bin\n", digest));
+  TEST_ASSERT_EQUAL_HEX8(0xBA, digest[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xAD, digest[31]);
+  char text[2 * SHA256_SIZE + 1];
+  sha256ToHex(digest, text);
+  TEST_ASSERT_EQUAL_STRING("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", text);
+
+  TEST_ASSERT_FALSE(sha256FromHex("ba7816bf", digest));
+  TEST_ASSERT_FALSE(sha256FromHex("<html>404 Not Found</html>", digest));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_known_vectors);
+  RUN_TEST(test_split_updates_match_one_update);
+  RUN_TEST(test_hex_round_trip);
+  return UNITY_END();
+}
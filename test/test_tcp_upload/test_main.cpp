@@ -0,0 +1,130 @@
+// the SCF1 frame sender on a loopback client: thumbnails and full frames go
+// out under their own names, checksummed, and only an OK ack counts
+
+#include <unity.h>
+#include <Client.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "crc32.h"
+#include "tcp_upload.h"
+
+// the receiver end of the socket, with a scripted ack
+class LoopbackClient : public Client {
+public:
+  int connect(const char *host, uint16_t port) override {
+    (void)host;
+    (void)port;
+    return 1;
+  }
+  uint8_t connected() override { return open; }
+  void stop() override { open = false; }
+  int available() override { return ack.size() - ackOffset; }
+  int read() override { return ackOffset < ack.size() ? (uint8_t)ack[ackOffset++] : -1; }
+  int peek() override { return ackOffset < ack.size() ? (uint8_t)ack[ackOffset] : -1; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t length) override {
+    writes++;
+    if (length > largestWrite) largestWrite = length;
+    if (stallAfter >= 0 && received.size() + length > (size_t)stallAfter) return 0;
+    received.insert(received.end(), data, data + length);
+    return length;
+  }
+  using Print::write;
+
+  bool open = true;
+  std::string ack = "OK\n";
+  size_t ackOffset = 0;
+  long stallAfter = -1;
+  std::vector<uint8_t> received;
+  size_t writes = 0;
+  size_t largestWrite = 0;
+};
+
+static uint32_t getLe32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static std::vector<uint8_t> photo(size_t length) {
+  std::vector<uint8_t> bytes(length);
+  for (size_t i = 0; i < length; i++) bytes[i] = (uint8_t)(i * 31 + (i >> 8));
+  return bytes;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_frame_carries_the_image_name(void) {
+  LoopbackClient client;
+  std::vector<uint8_t> payload = photo(5000);
+  const char *name = "sanwildsmartcam04-16102026120000-t.jpg";
+  TEST_ASSERT_TRUE(tcpSendFrame(client, name, 1792152000, payload.data(), payload.size()));
+
+  const std::vector<uint8_t> &frame = client.received;
+  size_t nameLength = strlen(name);
+  TEST_ASSERT_EQUAL(4 + 1 + nameLength + 4 + 4 + payload.size() + 4, frame.size());
+  TEST_ASSERT_EQUAL_MEMORY(TCP_FRAME_MAGIC, frame.data(), 4);
+  TEST_ASSERT_EQUAL(nameLength, frame[4]);
+  TEST_ASSERT_EQUAL_MEMORY(name, &frame[5], nameLength);
+  size_t at = 5 + nameLength;
+  TEST_ASSERT_EQUAL(1792152000, getLe32(&frame[at]));
+  TEST_ASSERT_EQUAL(payload.size(), getLe32(&frame[at + 4]));
+  TEST_ASSERT_EQUAL_MEMORY(payload.data(), &frame[at + 8], payload.size());
+  // the CRC covers everything before it, as photo_receiver.py checks
+  TEST_ASSERT_EQUAL_HEX32(crc32Update(0, frame.data(), frame.size() - 4), getLe32(&frame[frame.size() - 4]));
+  // the payload goes out in chunks, never all at once
+  TEST_ASSERT_LESS_OR_EQUAL(TCP_UPLOAD_CHUNK, client.largestWrite);
+}
+
+void test_long_names_are_cut_to_the_length_byte(void) {
+  LoopbackClient client;
+  std::string name(300, 'n');
+  uint8_t payload[1] = {0xD8};
+  TEST_ASSERT_TRUE(tcpSendFrame(client, name.c_str(), 0, payload, sizeof(payload)));
+  TEST_ASSERT_EQUAL(255, client.received[4]);
+  TEST_ASSERT_EQUAL(4 + 1 + 255 + 4 + 4 + 1 + 4, client.received.size());
+}
+
+void test_only_ok_counts(void) {
+  std::vector<uint8_t> payload = photo(100);
+  LoopbackClient refused;
+  refused.ack = "ER\n";
+  TEST_ASSERT_FALSE(tcpSendFrame(refused, "a.jpg", 0, payload.data(), payload.size()));
+
+  // the receiver hung up before answering
+  LoopbackClient silent;
+  silent.ack = "";
+  silent.open = false;
+  TEST_ASSERT_FALSE(tcpSendFrame(silent, "a.jpg", 0, payload.data(), payload.size()));
+}
+
+void test_stalled_socket_gives_up(void) {
+  std::vector<uint8_t> payload = photo(20000);
+  LoopbackClient stalled;
+  stalled.stallAfter = 8000;
+  unsigned long startTime = millis();
+  TEST_ASSERT_FALSE(tcpSendFrame(stalled, "full.jpg", 0, payload.data(), payload.size()));
+  TEST_ASSERT_LESS_OR_EQUAL(8000, stalled.received.size());
+  TEST_ASSERT_GREATER_OR_EQUAL(TCP_UPLOAD_STALL_TIMEOUT, millis() - startTime);
+
+  // and a dropped connection fails at once
+  LoopbackClient dropped;
+  dropped.stallAfter = 8000;
+  dropped.open = false;
+  startTime = millis();
+  TEST_ASSERT_FALSE(tcpSendFrame(dropped, "full.jpg", 0, payload.data(), payload.size()));
+  TEST_ASSERT_LESS_THAN(100, millis() - startTime);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_carries_the_image_name);
+  RUN_TEST(test_long_names_are_cut_to_the_length_byte);
+  RUN_TEST(test_only_ok_counts);
+  RUN_TEST(test_stalled_socket_gives_up);
+  return UNITY_END();
+}
@@ -0,0 +1,354 @@
+// the binary telemetry records and their SD ring: encode/decode round
+// trips, CRC and length checks, the layout tools/telemetry_decode.py reads,
+// and the ring across the wrap, restarts and torn headers
+
+#include <unity.h>
+#include <FS.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "crc32.h"
+#include "telemetry.h"
+
+#define SLOTS 4
+
+// telemetry_decode.py --fixture, its SCT2 structs packing the sample record
+static const uint8_t toolRecord[320] = {
+    0x53, 0x43, 0x54, 0x32, 0x40, 0x01, 0x07, 0x05, 0x07, 0x00, 0x00, 0x00, 0xc0, 0x11, 0xd2, 0x6a,
+    0x10, 0x0e, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x8c, 0x00, 0x00, 0x00, 0xb0, 0x04, 0x00, 0x00,
+    0x2d, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01, 0x00,
+    0x52, 0x03, 0x00, 0x00, 0x2c, 0x03, 0x00, 0x00, 0x9a, 0x3b, 0x00, 0x00, 0x1c, 0x37, 0xda, 0xeb,
+    0x56, 0xa0, 0x0d, 0x0b, 0x2a, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x03, 0x09, 0x15, 0x02, 0x9f, 0xff,
+    0xfd, 0x4c, 0x54, 0x45, 0x20, 0x43, 0x41, 0x54, 0x2d, 0x4d, 0x31, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x0a, 0x00, 0x00, 0x00, 0xe8, 0x03, 0x00, 0x00, 0xd0, 0x07, 0x00, 0x00, 0xa0, 0x0f, 0x00, 0x00,
+    0x88, 0x13, 0x00, 0x00, 0x0b, 0x00, 0x00, 0x00, 0xd0, 0x07, 0x00, 0x00, 0xa0, 0x0f, 0x00, 0x00,
+    0x40, 0x1f, 0x00, 0x00, 0x10, 0x27, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00, 0xb8, 0x0b, 0x00, 0x00,
+    0x70, 0x17, 0x00, 0x00, 0xe0, 0x2e, 0x00, 0x00, 0x98, 0x3a, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00,
+    0xa0, 0x0f, 0x00, 0x00, 0x40, 0x1f, 0x00, 0x00, 0x80, 0x3e, 0x00, 0x00, 0x20, 0x4e, 0x00, 0x00,
+    0x0e, 0x00, 0x00, 0x00, 0x88, 0x13, 0x00, 0x00, 0x10, 0x27, 0x00, 0x00, 0x20, 0x4e, 0x00, 0x00,
+    0xa8, 0x61, 0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x70, 0x17, 0x00, 0x00, 0xe0, 0x2e, 0x00, 0x00,
+    0xc0, 0x5d, 0x00, 0x00, 0x30, 0x75, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x58, 0x1b, 0x00, 0x00,
+    0xb0, 0x36, 0x00, 0x00, 0x60, 0x6d, 0x00, 0x00, 0xb8, 0x88, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+    0x06, 0xff, 0xff, 0xff, 0xd4, 0xfe, 0xff, 0xff, 0x38, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+    0xce, 0xff, 0xff, 0xff, 0x9c, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+    0x96, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xc8, 0x00, 0x00, 0x00, 0x7a, 0xed, 0x6c, 0xce,
+};
+
+static std::string path;
+static TelemetryRing ring;
+
+// the record telemetry_decode.py's SAMPLE holds
+static TelemetryRecord sampleRecord() {
+  TelemetryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.sequence = 7;
+  record.timestamp = 1792152000;
+  record.uptimeS = 3600;
+  record.coldBoots = 3;
+  record.deepWakes = 140;
+  record.captured = 1200;
+  record.events = 45;
+  record.uploaded = 40;
+  record.uploadFailures = 5;
+  record.outboxPending = 2;
+  record.fullFramesPending = 1;
+  record.milliampHours = 850;
+  record.sdUsedMb = 812;
+  record.sdTotalMb = 15258;
+  record.latitudeE7 = -338020580;
+  record.longitudeE7 = 185442390;
+  record.fixAgeS = 42;
+  record.hdopX10 = 12;
+  record.fixMode = 3;
+  record.satellites = 9;
+  record.csq = 21;
+  record.captureLevel = 2;
+  record.rsrpDbm = -97;
+  record.snrDb = -3;
+  strcpy(record.linkMode, "LTE CAT-M1");
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    record.metrics[i] = {10u + i, 1000u * (i + 1), 2000u * (i + 1), 4000u * (i + 1), 5000u * (i + 1)};
+  }
+  for (int i = 0; i < GAUGE_COUNT; i++) {
+    if (i % 2 == 0) record.gauges[i] = {true, 100 * i - 250, 100 * i - 300, 100 * i - 200};
+  }
+  return record;
+}
+
+static void assertSameRecord(const TelemetryRecord &expected, const TelemetryRecord &actual) {
+  uint8_t a[TELEMETRY_RECORD_SIZE];
+  uint8_t b[TELEMETRY_RECORD_SIZE];
+  TEST_ASSERT_EQUAL(TELEMETRY_RECORD_SIZE, telemetryEncode(expected, a, sizeof(a)));
+  TEST_ASSERT_EQUAL(TELEMETRY_RECORD_SIZE, telemetryEncode(actual, b, sizeof(b)));
+  TEST_ASSERT_EQUAL_MEMORY(a, b, sizeof(a));
+  TEST_ASSERT_EQUAL_STRING(expected.linkMode, actual.linkMode);
+}
+
+static void appendRecords(int count) {
+  for (int i = 0; i < count; i++) {
+    TelemetryRecord record = sampleRecord();
+    TEST_ASSERT_TRUE(ring.append(record));
+  }
+}
+
+// sequences of the records unsent() hands out
+static std::string unsentSequences(size_t capacity, uint32_t *last) {
+  static uint8_t out[SLOTS * TELEMETRY_RECORD_SIZE];
+  size_t length = ring.unsent(out, capacity, last);
+  TEST_ASSERT_EQUAL(0, length % TELEMETRY_RECORD_SIZE);
+  std::string sequences;
+  for (size_t offset = 0; offset < length; offset += TELEMETRY_RECORD_SIZE) {
+    TelemetryRecord record;
+    TEST_ASSERT_TRUE(telemetryDecode(out + offset, length - offset, &record));
+    sequences += (sequences.empty() ? "" : ",") + std::to_string(record.sequence);
+  }
+  return sequences;
+}
+
+static void patchFile(long offset, uint8_t value) {
+  FILE *file = fopen(path.c_str(), "r+b");
+  TEST_ASSERT_NOT_NULL(file);
+  fseek(file, offset, SEEK_SET);
+  fputc(value, file);
+  fclose(file);
+}
+
+void setUp(void) {
+  path = mockTempDir("test-telemetry") + "/telemetry.bin";
+  ring = TelemetryRing();
+}
+
+void tearDown(void) {}
+
+void test_encode_matches_the_host_tool(void) {
+  uint8_t out[TELEMETRY_SLOT_SIZE];
+  TEST_ASSERT_EQUAL(sizeof(toolRecord), TELEMETRY_RECORD_SIZE);
+  TEST_ASSERT_EQUAL(TELEMETRY_RECORD_SIZE, telemetryEncode(sampleRecord(), out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(toolRecord, out, sizeof(toolRecord));
+}
+
+void test_decode_round_trip(void) {
+  TelemetryRecord record;
+  TEST_ASSERT_TRUE(telemetryDecode(toolRecord, sizeof(toolRecord), &record));
+  assertSameRecord(sampleRecord(), record);
+  TEST_ASSERT_EQUAL(-338020580, record.latitudeE7);
+  TEST_ASSERT_EQUAL(-97, record.rsrpDbm);
+  TEST_ASSERT_EQUAL(-3, record.snrDb);
+  TEST_ASSERT_EQUAL(16, record.metrics[METRIC_WAKE].count);
+  TEST_ASSERT_TRUE(record.gauges[GAUGE_HEAP_FREE].set);
+  TEST_ASSERT_EQUAL(-300, record.gauges[GAUGE_HEAP_FREE].min);
+  TEST_ASSERT_FALSE(record.gauges[GAUGE_PSRAM_FREE].set);
+}
+
+void test_round_trip_of_extremes(void) {
+  TelemetryRecord record = sampleRecord();
+  record.timestamp = UINT32_MAX;
+  record.latitudeE7 = INT32_MIN;
+  record.longitudeE7 = INT32_MAX;
+  record.fixAgeS = TELEMETRY_NO_FIX;
+  record.csq = INT8_MIN;
+  record.rsrpDbm = INT16_MIN;
+  record.snrDb = INT8_MAX;
+  record.metrics[0].maxUs = UINT32_MAX;
+  record.gauges[1] = {true, INT32_MIN, INT32_MIN, INT32_MAX};
+  uint8_t out[TELEMETRY_RECORD_SIZE];
+  TelemetryRecord decoded;
+  TEST_ASSERT_EQUAL(TELEMETRY_RECORD_SIZE, telemetryEncode(record, out, sizeof(out)));
+  TEST_ASSERT_TRUE(telemetryDecode(out, sizeof(out), &decoded));
+  assertSameRecord(record, decoded);
+
+  // a link mode without room for its NUL is cut, not run over
+  memset(record.linkMode, 'X', sizeof(record.linkMode));
+  telemetryEncode(record, out, sizeof(out));
+  TEST_ASSERT_TRUE(telemetryDecode(out, sizeof(out), &decoded));
+  TEST_ASSERT_EQUAL(TELEMETRY_LINK_MODE_SIZE - 1, strlen(decoded.linkMode));
+}
+
+void test_encode_needs_room_for_a_record(void) {
+  uint8_t out[TELEMETRY_RECORD_SIZE];
+  memset(out, 0xAA, sizeof(out));
+  TEST_ASSERT_EQUAL(0, telemetryEncode(sampleRecord(), out, sizeof(out) - 1));
+  TEST_ASSERT_EQUAL_HEX8(0xAA, out[0]);
+}
+
+void test_any_flipped_byte_fails_the_crc(void) {
+  uint8_t in[sizeof(toolRecord)];
+  TelemetryRecord record;
+  for (size_t i = 0; i < sizeof(in); i++) {
+    memcpy(in, toolRecord, sizeof(in));
+    in[i] ^= 0x10;
+    TEST_ASSERT_FALSE(telemetryDecode(in, sizeof(in), &record));
+  }
+}
+
+void test_bad_lengths_are_rejected(void) {
+  uint8_t in[sizeof(toolRecord)];
+  TelemetryRecord record;
+  // cut short, down to less than a header
+  TEST_ASSERT_FALSE(telemetryDecode(toolRecord, sizeof(toolRecord) - 1, &record));
+  TEST_ASSERT_FALSE(telemetryDecode(toolRecord, TELEMETRY_HEADER_SIZE, &record));
+  TEST_ASSERT_FALSE(telemetryDecode(toolRecord, 3, &record));
+
+  // a length that doesn't add up to the counts, even with a good crc
+  memcpy(in, toolRecord, sizeof(in));
+  in[6] = METRIC_COUNT - 1;
+  uint32_t crc = crc32Update(0, in, sizeof(in) - 4);
+  memcpy(in + sizeof(in) - 4, &crc, 4);
+  TEST_ASSERT_FALSE(telemetryDecode(in, sizeof(in), &record));
+  in[6] = METRIC_COUNT;
+  crc = crc32Update(0, in, sizeof(in) - 4);
+  memcpy(in + sizeof(in) - 4, &crc, 4);
+  TEST_ASSERT_TRUE(telemetryDecode(in, sizeof(in), &record));
+}
+
+void test_other_metric_counts_decode(void) {
+  // older firmware with one metric and no gauges: the rest reads as empty
+  uint8_t in[TELEMETRY_HEADER_SIZE + TELEMETRY_METRIC_SIZE + 4];
+  memcpy(in, toolRecord, TELEMETRY_HEADER_SIZE + TELEMETRY_METRIC_SIZE);
+  in[4] = sizeof(in) & 0xFF;
+  in[5] = sizeof(in) >> 8;
+  in[6] = 1;
+  in[7] = 0;
+  uint32_t crc = crc32Update(0, in, sizeof(in) - 4);
+  memcpy(in + sizeof(in) - 4, &crc, 4);
+  TelemetryRecord record;
+  TEST_ASSERT_TRUE(telemetryDecode(in, sizeof(in), &record));
+  TEST_ASSERT_EQUAL(10, record.metrics[0].count);
+  TEST_ASSERT_EQUAL(0, record.metrics[1].count);
+  TEST_ASSERT_FALSE(record.gauges[0].set);
+  TEST_ASSERT_EQUAL(1200, record.captured);
+}
+
+void test_ring_wraps_and_keeps_the_newest(void) {
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  TEST_ASSERT_EQUAL(0, ring.pending());
+  uint32_t last;
+  TEST_ASSERT_EQUAL_STRING("", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+  TEST_ASSERT_EQUAL(0, last);
+
+  // _next is well past the slot count, only the last SLOTS are left
+  appendRecords(10);
+  TEST_ASSERT_EQUAL(SLOTS, ring.pending());
+  TEST_ASSERT_EQUAL_STRING("7,8,9,10", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+  TEST_ASSERT_EQUAL(10, last);
+
+  TEST_ASSERT_TRUE(ring.markSent(8));
+  TEST_ASSERT_EQUAL(2, ring.pending());
+  TEST_ASSERT_EQUAL_STRING("9,10", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+
+  // overwriting unsent records drops them from the front
+  appendRecords(3);
+  TEST_ASSERT_EQUAL(SLOTS, ring.pending());
+  TEST_ASSERT_EQUAL_STRING("10,11,12,13", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+  TEST_ASSERT_EQUAL(13, last);
+  TEST_ASSERT_TRUE(ring.markSent(last));
+  TEST_ASSERT_EQUAL(0, ring.pending());
+  TEST_ASSERT_EQUAL_STRING("", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+  TEST_ASSERT_EQUAL(13, last);
+  TEST_ASSERT_EQUAL(13, ring.stats().appended);
+}
+
+void test_unsent_stops_at_capacity(void) {
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  appendRecords(3);
+  uint32_t last;
+  TEST_ASSERT_EQUAL_STRING("1,2", unsentSequences(sizeof(toolRecord) * 2 + 10, &last).c_str());
+  TEST_ASSERT_EQUAL(2, last);
+  TEST_ASSERT_TRUE(ring.markSent(last));
+  TEST_ASSERT_EQUAL_STRING("3", unsentSequences(sizeof(toolRecord) * 2, &last).c_str());
+
+  // a mark past the newest record stops at it
+  TEST_ASSERT_TRUE(ring.markSent(100));
+  TEST_ASSERT_EQUAL(0, ring.pending());
+  appendRecords(1);
+  TEST_ASSERT_EQUAL_STRING("4", unsentSequences(sizeof(toolRecord), &last).c_str());
+}
+
+void test_ring_carries_on_after_a_restart(void) {
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  appendRecords(6);
+  TEST_ASSERT_TRUE(ring.markSent(4));
+
+  ring = TelemetryRing();
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  TEST_ASSERT_EQUAL(SLOTS, ring.stats().recovered);
+  TEST_ASSERT_EQUAL(2, ring.pending());
+  appendRecords(1);
+  uint32_t last;
+  TEST_ASSERT_EQUAL_STRING("5,6,7", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+}
+
+void test_torn_header_starts_over(void) {
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  appendRecords(3);
+  patchFile(9, 0x55); // the sent mark, the header crc no longer matches
+
+  ring = TelemetryRing();
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  TEST_ASSERT_TRUE(ring.ready());
+  TEST_ASSERT_EQUAL(0, ring.pending());
+  TEST_ASSERT_EQUAL(0, ring.stats().recovered);
+  appendRecords(1);
+  uint32_t last;
+  TEST_ASSERT_EQUAL_STRING("1", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+
+  // a header cut short by a power loss
+  FILE *file = fopen(path.c_str(), "wb");
+  fwrite("SCTR", 1, 4, file);
+  fclose(file);
+  ring = TelemetryRing();
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  TEST_ASSERT_EQUAL(0, ring.pending());
+}
+
+void test_other_slot_count_starts_over(void) {
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  appendRecords(3);
+  ring = TelemetryRing();
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS * 2));
+  TEST_ASSERT_EQUAL(0, ring.pending());
+  TEST_ASSERT_EQUAL(0, ring.stats().recovered);
+}
+
+void test_corrupt_slot_is_skipped(void) {
+  TEST_ASSERT_TRUE(ring.begin(path.c_str(), SLOTS));
+  appendRecords(3);
+  // record 2 lives in slot 2, behind the 16 byte ring header
+  patchFile(16 + 2 * TELEMETRY_SLOT_SIZE + 20, 0xEE);
+  uint32_t last;
+  TEST_ASSERT_EQUAL_STRING("1,3", unsentSequences(sizeof(toolRecord) * SLOTS, &last).c_str());
+  TEST_ASSERT_EQUAL(3, last);
+  TEST_ASSERT_EQUAL(1, ring.stats().corrupt);
+}
+
+void test_ring_without_a_file_fails(void) {
+  TEST_ASSERT_FALSE(ring.begin("/nonexistent/dir/telemetry.bin", SLOTS));
+  TEST_ASSERT_FALSE(ring.ready());
+  TelemetryRecord record = sampleRecord();
+  TEST_ASSERT_FALSE(ring.append(record));
+  TEST_ASSERT_FALSE(ring.begin(path.c_str(), 0));
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_encode_matches_the_host_tool);
+  RUN_TEST(test_decode_round_trip);
+  RUN_TEST(test_round_trip_of_extremes);
+  RUN_TEST(test_encode_needs_room_for_a_record);
+  RUN_TEST(test_any_flipped_byte_fails_the_crc);
+  RUN_TEST(test_bad_lengths_are_rejected);
+  RUN_TEST(test_other_metric_counts_decode);
+  RUN_TEST(test_ring_wraps_and_keeps_the_newest);
+  RUN_TEST(test_unsent_stops_at_capacity);
+  RUN_TEST(test_ring_carries_on_after_a_restart);
+  RUN_TEST(test_torn_header_starts_over);
+  RUN_TEST(test_other_slot_count_starts_over);
+  RUN_TEST(test_corrupt_slot_is_skipped);
+  RUN_TEST(test_ring_without_a_file_fails);
+  return UNITY_END();
+}
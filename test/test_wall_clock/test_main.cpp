@@ -0,0 +1,192 @@
+// the local wall clock: +CCLK and GNSS parsing, civil date maths and
+// formatting against the C library, drift learning, steps and deep sleep
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "wall_clock.h"
+
+#define HOUR_US (3600LL * 1000000)
+#define START_UTC_US (1700000000LL * 1000000)
+
+static int64_t timegmOf(int year, int month, int day, int hour, int minute, int second) {
+  struct tm civil;
+  memset(&civil, 0, sizeof(civil));
+  civil.tm_year = year - 1900;
+  civil.tm_mon = month - 1;
+  civil.tm_mday = day;
+  civil.tm_hour = hour;
+  civil.tm_min = minute;
+  civil.tm_sec = second;
+  return timegm(&civil);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_cclk_is_parsed_to_utc(void) {
+  int64_t seconds;
+  int zone;
+  TEST_ASSERT_TRUE(wallClockParseCclk("+CCLK: \"24/05/12,10:20:30+08\"", &seconds, &zone));
+  TEST_ASSERT_EQUAL(8, zone);
+  TEST_ASSERT_EQUAL_INT64(timegmOf(2024, 5, 12, 8, 20, 30), seconds);
+  // a one digit zone west of UTC, without the prefix
+  TEST_ASSERT_TRUE(wallClockParseCclk("\"24/02/29,23:00:00-4\"", &seconds, &zone));
+  TEST_ASSERT_EQUAL(-4, zone);
+  TEST_ASSERT_EQUAL_INT64(timegmOf(2024, 3, 1, 0, 0, 0), seconds);
+  TEST_ASSERT_TRUE(wallClockParseCclk("24/05/12,10:20:30", &seconds, NULL));
+
+  TEST_ASSERT_FALSE(wallClockParseCclk("+CCLK: \"24/13/12,10:20:30+08\"", &seconds, &zone));
+  TEST_ASSERT_FALSE(wallClockParseCclk("+CCLK: \"24/05/12,24:20:30+08\"", &seconds, &zone));
+  TEST_ASSERT_FALSE(wallClockParseCclk("+CCLK: \"24/05/1", &seconds, &zone));
+  TEST_ASSERT_FALSE(wallClockParseCclk("+CCLK: \"24/05/12,10:20:30+99\"", &seconds, &zone));
+}
+
+void test_gnss_fields_keep_the_fraction(void) {
+  int64_t us;
+  TEST_ASSERT_TRUE(wallClockParseGnss("120524", "102030.5", &us));
+  TEST_ASSERT_EQUAL_INT64(timegmOf(2024, 5, 12, 10, 20, 30) * 1000000 + 500000, us);
+  TEST_ASSERT_TRUE(wallClockParseGnss("010170", "000000.123456789", &us));
+  TEST_ASSERT_EQUAL_INT64(timegmOf(2070, 1, 1, 0, 0, 0) * 1000000 + 123456, us);
+  TEST_ASSERT_TRUE(wallClockParseGnss("120524", "102030", &us));
+  TEST_ASSERT_FALSE(wallClockParseGnss("", "102030", &us));
+  TEST_ASSERT_FALSE(wallClockParseGnss("320524", "102030", &us));
+}
+
+void test_civil_days_round_trip(void) {
+  TEST_ASSERT_EQUAL_INT64(0, wallClockDaysFromCivil(1970, 1, 1));
+  TEST_ASSERT_EQUAL_INT64(-1, wallClockDaysFromCivil(1969, 12, 31));
+  for (int64_t days = -800000; days < 800000; days += 37) {
+    int year;
+    unsigned month, day;
+    wallClockCivilFromDays(days, &year, &month, &day);
+    TEST_ASSERT_EQUAL_INT64(days, wallClockDaysFromCivil(year, month, day));
+  }
+}
+
+void test_format_matches_strftime(void) {
+  char out[32];
+  char expected[32];
+  for (int64_t seconds = 0; seconds < 4000000000LL; seconds += 9999991) {
+    time_t when = (time_t)seconds;
+    struct tm civil;
+    gmtime_r(&when, &civil);
+    strftime(expected, sizeof(expected), "%d%m%Y%H%M%S", &civil);
+    TEST_ASSERT_EQUAL(14, wallClockFormat(out, sizeof(out), seconds, WALL_CLOCK_COMPACT));
+    TEST_ASSERT_EQUAL_STRING(expected, out);
+    strftime(expected, sizeof(expected), "%d/%m/%Y %H:%M:%S", &civil);
+    wallClockFormat(out, sizeof(out), seconds, WALL_CLOCK_READABLE);
+    TEST_ASSERT_EQUAL_STRING(expected, out);
+    strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%S", &civil);
+    wallClockFormat(out, sizeof(out), seconds, WALL_CLOCK_ISO);
+    TEST_ASSERT_EQUAL_STRING(expected, out);
+  }
+  // no room for the terminator
+  TEST_ASSERT_EQUAL(0, wallClockFormat(out, 14, 0, WALL_CLOCK_COMPACT));
+  TEST_ASSERT_EQUAL(14, wallClockFormat(out, 15, 0, WALL_CLOCK_COMPACT));
+}
+
+void test_clock_extrapolates_in_local_time(void) {
+  WallClock clock;
+  char out[32];
+  TEST_ASSERT_FALSE(clock.valid());
+  TEST_ASSERT_TRUE(clock.syncDue(0, HOUR_US));
+  TEST_ASSERT_EQUAL(0, clock.format(out, sizeof(out), 0, WALL_CLOCK_COMPACT));
+
+  int64_t utc = timegmOf(2024, 5, 12, 8, 20, 30) * 1000000;
+  clock.sync(utc, 5000000, WALL_CLOCK_MODEM);
+  clock.setZone(8);
+  TEST_ASSERT_TRUE(clock.valid());
+  TEST_ASSERT_EQUAL_INT64(utc / 1000000 + 90, clock.utcSeconds(5000000 + 90500000));
+  TEST_ASSERT_TRUE(clock.format(out, sizeof(out), 5000000 + 90500000, WALL_CLOCK_READABLE) > 0);
+  TEST_ASSERT_EQUAL_STRING("12/05/2024 10:22:00", out);
+  TEST_ASSERT_FALSE(clock.syncDue(5000000 + HOUR_US - 1, HOUR_US));
+  TEST_ASSERT_TRUE(clock.syncDue(5000000 + HOUR_US, HOUR_US));
+}
+
+void test_drift_is_learned(void) {
+  // the monotonic counter runs 40 ppm fast, syncs carry whole seconds
+  WallClock clock;
+  const double ppm = 40;
+  int64_t worst = 0;
+  for (int hour = 0; hour <= 72; hour += 6) {
+    int64_t utc = START_UTC_US + hour * HOUR_US;
+    int64_t mono = (int64_t)((utc - START_UTC_US) * (1 + ppm / 1e6)) + 5000000;
+    // the rate is folded in a quarter at a time, give it two days
+    if (hour >= 48) {
+      int64_t error = clock.utcUs(mono) - utc;
+      if (error < 0) error = -error;
+      if (error > worst) worst = error;
+    }
+    clock.sync(utc / 1000000 * 1000000, mono, WALL_CLOCK_MODEM);
+  }
+  // uncorrected, 6 h at 40 ppm is 864 ms off
+  TEST_ASSERT_LESS_THAN(150000, worst);
+  TEST_ASSERT_INT_WITHIN(8000, -40000, clock.stats().driftPpb);
+  TEST_ASSERT_EQUAL(0, clock.stats().steps);
+}
+
+void test_big_errors_step_the_clock(void) {
+  WallClock clock;
+  clock.sync(START_UTC_US, 0, WALL_CLOCK_MODEM);
+  // network time arrived a minute later than the clock thought
+  clock.sync(START_UTC_US + 2 * HOUR_US + 60000000, 2 * HOUR_US, WALL_CLOCK_MODEM);
+  TEST_ASSERT_EQUAL(1, clock.stats().steps);
+  TEST_ASSERT_EQUAL(0, clock.stats().driftPpb);
+  TEST_ASSERT_EQUAL_INT64(START_UTC_US + 2 * HOUR_US + 60000000, clock.utcUs(2 * HOUR_US));
+
+  // a sync too soon after the last one teaches nothing and keeps the anchor
+  clock.sync(START_UTC_US + 2 * HOUR_US + 60000000 + 1000500, 2 * HOUR_US + 1000000, WALL_CLOCK_MODEM);
+  TEST_ASSERT_EQUAL_INT64(START_UTC_US + 2 * HOUR_US + 60000000 + 1000000, clock.utcUs(2 * HOUR_US + 1000000));
+  TEST_ASSERT_EQUAL(0, clock.stats().driftPpb);
+}
+
+void test_deep_sleep_carries_the_clock(void) {
+  WallClock clock;
+  clock.sync(START_UTC_US, 0, WALL_CLOCK_MODEM);
+  clock.setZone(-4);
+  for (int hour = 6; hour <= 24; hour += 6) {
+    clock.sync(START_UTC_US + hour * HOUR_US, hour * HOUR_US + hour * 72000, WALL_CLOCK_MODEM);
+  }
+  WallClockSnapshot snapshot = clock.snapshot(25 * HOUR_US);
+
+  // the counter starts over after the wakeup
+  WallClock woken;
+  woken.restore(snapshot, 30 * 60 * 1000000LL, 200000);
+  TEST_ASSERT_TRUE(woken.valid());
+  TEST_ASSERT_EQUAL(WALL_CLOCK_RTC, woken.stats().source);
+  TEST_ASSERT_EQUAL(-4, woken.zoneQuarters());
+  TEST_ASSERT_EQUAL(clock.stats().driftPpb, woken.stats().driftPpb);
+  TEST_ASSERT_EQUAL_INT64(snapshot.utcUs + 30 * 60 * 1000000LL, woken.utcUs(200000));
+  TEST_ASSERT_TRUE(woken.syncDue(200000, HOUR_US));
+
+  // the first sync after it replaces the anchor without a step or a lesson
+  int64_t drift = woken.stats().driftPpb;
+  woken.sync(snapshot.utcUs + 31 * 60 * 1000000LL + 3000000, 60 * 1000000LL, WALL_CLOCK_MODEM);
+  TEST_ASSERT_EQUAL(0, woken.stats().steps);
+  TEST_ASSERT_EQUAL(drift, woken.stats().driftPpb);
+  TEST_ASSERT_FALSE(woken.syncDue(60 * 1000000LL, HOUR_US));
+
+  // a clock never synced stays invalid through a sleep
+  WallClock never;
+  WallClock restored;
+  restored.restore(never.snapshot(0), 1000000, 0);
+  TEST_ASSERT_FALSE(restored.valid());
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_cclk_is_parsed_to_utc);
+  RUN_TEST(test_gnss_fields_keep_the_fraction);
+  RUN_TEST(test_civil_days_round_trip);
+  RUN_TEST(test_format_matches_strftime);
+  RUN_TEST(test_clock_extrapolates_in_local_time);
+  RUN_TEST(test_drift_is_learned);
+  RUN_TEST(test_big_errors_step_the_clock);
+  RUN_TEST(test_deep_sleep_carries_the_clock);
+  return UNITY_END();
+}
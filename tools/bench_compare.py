@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compare two runs of the native benchmark suite (test/bench).
+
+Each run is the JSON lines the bench program prints, one per benchmark,
+e.g. one from the last release and one from the current tree:
+
+    pio run -e bench && .pio/build/bench/program > bench_output.txt
+    python3 tools/bench_compare.py release_bench.txt bench_output.txt
+
+Prints old and new ns per operation and the change for every benchmark.
+Exits 1 when one got slower by more than --threshold percent, so it can
+gate a build. Benchmarks only in one of the runs are listed, not failed.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Benchmark name to its result line, the suite header is skipped."""
+    results = {}
+    with open(path) as source:
+        for number, line in enumerate(source, 1):
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            try:
+                row = json.loads(line)
+            except ValueError:
+                sys.exit("%s:%d: not a JSON line" % (path, number))
+            if "name" in row:
+                results[row["name"]] = row
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old", help="baseline run")
+    parser.add_argument("new", help="run to check")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent slower that counts as a regression (default 10)")
+    parser.add_argument("--json", action="store_true", help="print the comparison as JSON lines")
+    args = parser.parse_args()
+
+    old = load(args.old)
+    new = load(args.new)
+    regressions = []
+    for name in sorted(set(old) | set(new)):
+        if name not in old or name not in new:
+            row = {"name": name, "only_in": args.new if name in new else args.old}
+            if args.json:
+                print(json.dumps(row))
+            else:
+                print("%-36s only in %s" % (name, row["only_in"]))
+            continue
+        before = old[name]["ns_per_op"]
+        after = new[name]["ns_per_op"]
+        change = (after - before) * 100.0 / before if before else 0.0
+        regressed = change > args.threshold
+        if regressed:
+            regressions.append(name)
+        if args.json:
+            print(json.dumps({"name": name, "old_ns": before, "new_ns": after, "change_pct": round(change, 1),
+                              "regressed": regressed}))
+        else:
+            print("%-36s %14.1f %14.1f ns %+7.1f%%%s" % (name, before, after, change, "  REGRESSION" if regressed else ""))
+
+    if regressions:
+        print("%d regression(s) over %.0f%%: %s" % (len(regressions), args.threshold, ", ".join(regressions)),
+              file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Decompressor for the SCZ1 streams the camera uploads (src/lzss.h).
+
+Reports and log segments go up LZSS compressed with a ".lzs" suffix:
+    "SCZ1" | u8 window bits | u8 length bits | tokens, MSB first, zero
+    padded to a byte | u32 input length | u32 crc32 of the input
+    token 1, 8 bit literal or 0, distance - 1, length - 3
+
+Writes each file next to it without the suffix, or to stdout with -c.
+A stream with a bad length or checksum is reported and nothing is
+written for it:
+
+    python3 tools/lzss_decompress.py received/*.lzs
+    python3 tools/lzss_decompress.py -c received/log-20240105-1200.txt.lzs | less
+    python3 tools/lzss_decompress.py --compress log.txt   # same stream as the device
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"SCZ1"
+MIN_MATCH = 3
+CHAIN_DEPTH = 16
+HASH_BITS = 10
+
+
+class FormatError(Exception):
+    pass
+
+
+def decompress(data):
+    if len(data) < 6 + 8 or data[:4] != MAGIC:
+        raise FormatError("not an SCZ1 stream")
+    window_bits, length_bits = data[4], data[5]
+    if not 1 <= window_bits <= 16 or not 1 <= length_bits <= 8:
+        raise FormatError("bad window %d / length %d bits" % (window_bits, length_bits))
+    expected, crc = struct.unpack_from("<II", data, len(data) - 8)
+    bits = int.from_bytes(data[6:len(data) - 8], "big")
+    available = (len(data) - 14) * 8
+    match_bits = window_bits + length_bits
+
+    out = bytearray()
+    position = 0
+    # the zero padding at the end is too short for a whole token
+    while available - position >= 9:
+        flag = (bits >> (available - position - 1)) & 1
+        position += 1
+        if flag:
+            out.append((bits >> (available - position - 8)) & 0xFF)
+            position += 8
+            continue
+        if available - position < match_bits:
+            break
+        token = (bits >> (available - position - match_bits)) & ((1 << match_bits) - 1)
+        position += match_bits
+        distance = (token >> length_bits) + 1
+        length = (token & ((1 << length_bits) - 1)) + MIN_MATCH
+        if distance > len(out):
+            raise FormatError("match reaches back %d bytes at output %d" % (distance, len(out)))
+        start = len(out) - distance
+        if distance >= length:
+            out += out[start:start + length]
+        else:
+            # overlapping copy repeats the last distance bytes
+            for index in range(length):
+                out.append(out[start + index])
+
+    if len(out) != expected:
+        raise FormatError("%d bytes decoded, trailer says %d" % (len(out), expected))
+    if zlib.crc32(out) != crc:
+        raise FormatError("checksum mismatch")
+    return bytes(out)
+
+
+def compress(data, window_bits=12, length_bits=5):
+    """Slow reference encoder, same choices as LzssEncoder so the output
+    matches the device byte for byte."""
+    window = 1 << window_bits
+    max_match = MIN_MATCH + (1 << length_bits) - 1
+    heads = {}
+    chains = {}
+    tokens = []
+
+    def key(index):
+        value = (data[index] << 16) | (data[index + 1] << 8) | data[index + 2]
+        return ((value * 2654435761) & 0xFFFFFFFF) >> (32 - HASH_BITS)
+
+    position = hashed = 0
+    while position < len(data):
+        while hashed < position and hashed + MIN_MATCH <= len(data):
+            hash_key = key(hashed)
+            chains[hashed] = heads.get(hash_key)
+            heads[hash_key] = hashed
+            hashed += 1
+        limit = min(max_match, len(data) - position)
+        best, distance = 0, 0
+        if limit >= MIN_MATCH:
+            candidate = heads.get(key(position))
+            for _ in range(CHAIN_DEPTH):
+                if candidate is None or position - candidate > window:
+                    break
+                if data[candidate + best] == data[position + best]:
+                    length = 0
+                    while length < limit and data[candidate + length] == data[position + length]:
+                        length += 1
+                    if length > best:
+                        best, distance = length, position - candidate
+                        if best == limit:
+                            break
+                candidate = chains.get(candidate)
+        if best >= MIN_MATCH:
+            tokens.append((((distance - 1) << length_bits) | (best - MIN_MATCH), 1 + window_bits + length_bits))
+            position += best
+        else:
+            tokens.append((0x100 | data[position], 9))
+            position += 1
+
+    value, count = 0, 0
+    for token, width in tokens:
+        value = (value << width) | token
+        count += width
+    padding = -count % 8
+    payload = (value << padding).to_bytes((count + padding) // 8, "big") if count else b""
+    return MAGIC + bytes([window_bits, length_bits]) + payload + struct.pack("<II", len(data), zlib.crc32(data))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="+")
+    parser.add_argument("-c", "--stdout", action="store_true", help="write to stdout instead of files")
+    parser.add_argument("--compress", action="store_true", help="make SCZ1 streams (FILE.lzs) instead")
+    args = parser.parse_args()
+
+    failed = 0
+    for path in args.files:
+        with open(path, "rb") as source:
+            data = source.read()
+        if args.compress:
+            output, target = compress(data), path + ".lzs"
+        else:
+            try:
+                output = decompress(data)
+            except FormatError as error:
+                print("%s: %s" % (path, error), file=sys.stderr)
+                failed += 1
+                continue
+            target = path[:-4] if path.endswith(".lzs") else path + ".out"
+        if args.stdout:
+            sys.stdout.buffer.write(output)
+        else:
+            with open(target, "wb") as out:
+                out.write(output)
+            print("%s: %d -> %d bytes" % (target, len(data), len(output)), file=sys.stderr)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Firmware patch generator for delta OTA (src/delta_patch.h).
+
+The patch rebuilds NEW from the OLD image that is running on the device.
+It is zlib compressed. Decompressed, it holds, little endian:
+    "SCD1" | u32 old_size | u32 new_size | sha256(old) | sha256(new)
+    'A' u32 old_offset u32 length | length bytes added (mod 256) to old bytes
+    'D' u32 length | length literal bytes
+
+Matching works like bsdiff without the suffix array. Exact 16 byte seeds
+come from an index of the old image. Each seed is then extended while at
+least half of the bytes still agree, so code that moved and only had its
+addresses change becomes an ADD run of mostly zeros, which deflate squeezes
+well.
+
+Publish the patch as <device>-<old version>.patch next to the full image:
+
+    python3 tools/make_delta.py old.bin new.bin -o sanwildsmartcam04-1.4.patch
+    python3 tools/make_delta.py --verify old.bin new.bin sanwildsmartcam04-1.4.patch
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"SCD1"
+SEED = 16
+INDEX_STRIDE = 4
+GIVE_UP = 64
+
+
+def build_index(old):
+    index = {}
+    for offset in range(0, len(old) - SEED + 1, INDEX_STRIDE):
+        index.setdefault(old[offset:offset + SEED], offset)
+    return index
+
+
+def extend(old, old_offset, new, new_offset):
+    """Length of the approximate match, bsdiff's 2 * equal - length score."""
+    best_length = 0
+    best_score = 0
+    score = 0
+    limit = min(len(old) - old_offset, len(new) - new_offset)
+    length = 0
+    while length < limit:
+        score += 1 if old[old_offset + length] == new[new_offset + length] else -1
+        length += 1
+        if score > best_score:
+            best_score = score
+            best_length = length
+        elif length - best_length > GIVE_UP:
+            break
+    return best_length
+
+
+def find_seed(old, new, index, position, delta):
+    # stay on the previous alignment when it still matches, it is usually right
+    candidate = position + delta
+    if 0 <= candidate <= len(old) - SEED and old[candidate:candidate + 8] == new[position:position + 8]:
+        return candidate
+    return index.get(new[position:position + SEED])
+
+
+def make_patch(old, new):
+    index = build_index(old)
+    ops = bytearray()
+    position = 0
+    literal_start = 0
+    delta = 0
+    while position <= len(new) - SEED:
+        old_offset = find_seed(old, new, index, position, delta)
+        length = extend(old, old_offset, new, position) if old_offset is not None else 0
+        if length < SEED:
+            position += 1
+            continue
+
+        if literal_start < position:
+            ops += b"D" + struct.pack("<I", position - literal_start) + new[literal_start:position]
+        ops += b"A" + struct.pack("<II", old_offset, length)
+        ops += bytes((n - o) & 0xFF for n, o in zip(new[position:position + length], old[old_offset:old_offset + length]))
+        delta = old_offset - position
+        position += length
+        literal_start = position
+
+    if literal_start < len(new):
+        ops += b"D" + struct.pack("<I", len(new) - literal_start) + new[literal_start:]
+
+    header = MAGIC + struct.pack("<II", len(old), len(new)) + hashlib.sha256(old).digest() + hashlib.sha256(new).digest()
+    return zlib.compress(header + bytes(ops), 9)
+
+
+def apply_patch(old, patch):
+    """Reference applier, mirrors DeltaPatcher."""
+    data = zlib.decompress(patch)
+    if data[:4] != MAGIC:
+        raise ValueError("not an SCD1 patch")
+    old_size, new_size = struct.unpack_from("<II", data, 4)
+    old_digest = data[12:44]
+    new_digest = data[44:76]
+    if old_size != len(old) or hashlib.sha256(old).digest() != old_digest:
+        raise ValueError("patch was made against a different old image")
+
+    new = bytearray()
+    position = 76
+    while position < len(data):
+        opcode = data[position:position + 1]
+        if opcode == b"A":
+            offset, length = struct.unpack_from("<II", data, position + 1)
+            position += 9
+            diff = data[position:position + length]
+            new += bytes((o + d) & 0xFF for o, d in zip(old[offset:offset + length], diff))
+            position += length
+        elif opcode == b"D":
+            (length,) = struct.unpack_from("<I", data, position + 1)
+            position += 5
+            new += data[position:position + length]
+            position += length
+        else:
+            raise ValueError("bad opcode at %d" % position)
+
+    if len(new) != new_size or hashlib.sha256(new).digest() != new_digest:
+        raise ValueError("patched image does not match")
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old", help="firmware image running on the device")
+    parser.add_argument("new", help="firmware image to update to")
+    parser.add_argument("patch", nargs="?", help="patch to check with --verify")
+    parser.add_argument("-o", "--output", help="where to write the patch")
+    parser.add_argument("--verify", action="store_true", help="apply PATCH to OLD and compare with NEW")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    if args.verify:
+        if not args.patch:
+            parser.error("--verify needs the patch file")
+        with open(args.patch, "rb") as f:
+            patch = f.read()
+    else:
+        patch = make_patch(old, new)
+        if args.output:
+            with open(args.output, "wb") as f:
+                f.write(patch)
+
+    if apply_patch(old, patch) != new:
+        print("patch does not reproduce %s" % args.new)
+        sys.exit(1)
+
+    full = len(zlib.compress(new, 9))
+    print("new image %d bytes (%d deflated), patch %d bytes: %.1f%% of the download"
+          % (len(new), full, len(patch), 100.0 * len(patch) / len(new)))
+
+
+if __name__ == "__main__":
+    main()
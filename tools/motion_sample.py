@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Writes the labelled frame sequence test/replay replays (test/replay/sample).
+
+A fixed 640x480 scene, a yard with a fence, a path and a shed, saved as
+JPEG the way the camera would at a low quality, with a little sensor noise
+in every frame. labels.txt marks each frame 1 where something moves
+through the scene and 0 where it doesn't, which includes frames where only
+the light changes:
+
+    frames  0-9   quiet, the detector warms up
+    frames 10-17  someone walks across the yard                  1
+    frames 18-23  quiet
+    frames 24-25  a cloud, the whole scene darkens               0
+    frames 26-31  quiet under the new light
+    frames 32-35  a cat crosses near the fence                   1
+    frames 36-39  quiet
+
+Same files every run (seeded noise), so replay numbers are comparable:
+
+    python3 tools/motion_sample.py test/replay/sample
+
+--still writes one UXGA (1600x1200) frame of the same scene instead, at
+the quality the camera is set to, for the decoder benchmarks in test/bench:
+
+    python3 tools/motion_sample.py --still test/bench/data/uxga.jpg
+"""
+
+import argparse
+import os
+import random
+
+from PIL import Image, ImageDraw, ImageEnhance
+
+WIDTH = 640
+HEIGHT = 480
+QUALITY = 60
+UXGA = (1600, 1200)
+UXGA_QUALITY = 85  # about what JPEG_QUALITY 10 gives on the OV2640
+
+
+def scene():
+    image = Image.new("RGB", (WIDTH, HEIGHT), (112, 128, 96))
+    draw = ImageDraw.Draw(image)
+    draw.rectangle((0, 0, WIDTH, 150), fill=(150, 170, 190))
+    for x in range(0, WIDTH, 24):
+        draw.rectangle((x, 130, x + 10, 230), fill=(90, 70, 50))
+    draw.rectangle((0, 160, WIDTH, 170), fill=(90, 70, 50))
+    draw.polygon(((250, HEIGHT), (390, HEIGHT), (340, 240), (300, 240)), fill=(160, 150, 130))
+    draw.rectangle((470, 90, 620, 260), fill=(70, 60, 55))
+    draw.rectangle((520, 180, 560, 260), fill=(40, 35, 30))
+    rng = random.Random(1)
+    for _ in range(400):
+        x = rng.randrange(WIDTH)
+        y = rng.randrange(250, HEIGHT)
+        shade = rng.randrange(80, 130)
+        draw.ellipse((x, y, x + 6, y + 3), fill=(shade - 20, shade, shade - 30))
+    return image
+
+
+def person(draw, x):
+    draw.ellipse((x + 12, 200, x + 40, 228), fill=(200, 160, 130))
+    draw.rectangle((x, 228, x + 52, 330), fill=(40, 60, 140))
+    draw.rectangle((x + 6, 330, x + 46, 420), fill=(30, 30, 40))
+
+
+def cat(draw, x):
+    draw.ellipse((x, 250, x + 60, 280), fill=(30, 30, 30))
+    draw.ellipse((x + 50, 238, x + 74, 262), fill=(30, 30, 30))
+
+
+def noisy(image, rng):
+    pixels = image.load()
+    width, height = image.size
+    for _ in range(width * height // 20):
+        x = rng.randrange(width)
+        y = rng.randrange(height)
+        r, g, b = pixels[x, y]
+        d = rng.randint(-6, 6)
+        pixels[x, y] = (max(0, min(255, r + d)), max(0, min(255, g + d)), max(0, min(255, b + d)))
+    return image
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("out", help="directory for the frames and labels.txt, or the --still file")
+    parser.add_argument("--still", action="store_true", help="write one UXGA frame to out")
+    args = parser.parse_args()
+
+    background = scene()
+    if args.still:
+        image = background.resize(UXGA, Image.BICUBIC)
+        person(ImageDraw.Draw(image), 900)
+        noisy(image, random.Random(3)).save(args.out, quality=UXGA_QUALITY)
+        return
+
+    os.makedirs(args.out, exist_ok=True)
+    rng = random.Random(2)
+    labels = []
+    for index in range(40):
+        image = background.copy()
+        draw = ImageDraw.Draw(image)
+        moving = 0
+        if 10 <= index <= 17:
+            person(draw, 40 + (index - 10) * 70)
+            moving = 1
+        elif 32 <= index <= 35:
+            cat(draw, 80 + (index - 32) * 90)
+            moving = 1
+        if index >= 24:
+            image = ImageEnhance.Brightness(image).enhance(0.7 if index <= 25 else 0.75)
+        name = "frame%03d.jpg" % index
+        noisy(image, rng).save(os.path.join(args.out, name), quality=QUALITY)
+        labels.append("%s %d" % (name, moving))
+
+    with open(os.path.join(args.out, "labels.txt"), "w") as out:
+        out.write("# written by tools/motion_sample.py, 1 where something moves\n")
+        out.write("\n".join(labels) + "\n")
+
+
+if __name__ == "__main__":
+    main()
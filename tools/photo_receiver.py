@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Reference receiver for the direct TCP photo upload (src/tcp_upload.h).
+
+Frame layout, little endian:
+    "SCF1" | u8 name_len | name | u32 timestamp | u32 length | payload | u32 crc32
+
+Each verified frame is written to OUTPUT_DIR/<name> when the name is an image
+file name, or OUTPUT_DIR/<device>-<timestamp>.jpg for older firmware that
+sends only the device name, and acknowledged with "OK\\n"; frames with a bad
+magic or checksum get "ER\\n".
+
+Thumbnail-first uploads (UPLOAD_THUMBNAIL_FIRST) arrive as <event>-t.jpg with
+the full frame following as <event>.jpg. For each one the receiver prints the
+time since capture, and a time-to-first-pixel summary on exit. With
+--requests DIR it also stands in for the server's request file: every
+thumbnail adds its full frame to DIR/<device>-request.txt and the full frame
+arriving removes it again. Serve DIR at OTA_UPDATE_URL for the device to see it:
+
+    python3 tools/photo_receiver.py --port 5005 --output received/
+    python3 tools/photo_receiver.py --output received/ --requests www/ &
+    python3 -m http.server 80 --directory www/
+"""
+
+import argparse
+import os
+import socketserver
+import statistics
+import struct
+import threading
+import time
+import zlib
+
+MAGIC = b"SCF1"
+MAX_PAYLOAD = 16 * 1024 * 1024
+THUMBNAIL_SUFFIX = "-t.jpg"
+
+
+class FrameError(Exception):
+    pass
+
+
+def read_exact(stream, count):
+    data = bytearray()
+    while len(data) < count:
+        chunk = stream.read(count - len(data))
+        if not chunk:
+            raise EOFError("connection closed after %d of %d bytes" % (len(data), count))
+        data += chunk
+    return bytes(data)
+
+
+def read_frame(stream):
+    """Read and verify one frame, returns (device, timestamp, payload)."""
+    magic = read_exact(stream, 4)
+    if magic != MAGIC:
+        raise FrameError("bad magic %r" % magic)
+    name_len = read_exact(stream, 1)
+    name = read_exact(stream, name_len[0])
+    fields = read_exact(stream, 8)
+    timestamp, length = struct.unpack("<II", fields)
+    if length > MAX_PAYLOAD:
+        raise FrameError("payload length %d too large" % length)
+
+    crc = zlib.crc32(magic + name_len + name + fields)
+    payload = bytearray()
+    while len(payload) < length:
+        chunk = read_exact(stream, min(64 * 1024, length - len(payload)))
+        crc = zlib.crc32(chunk, crc)
+        payload += chunk
+
+    (expected,) = struct.unpack("<I", read_exact(stream, 4))
+    if crc != expected:
+        raise FrameError("crc mismatch: got %08x, frame says %08x" % (crc, expected))
+    return name.decode("ascii", "replace"), timestamp, bytes(payload)
+
+
+def file_name(name, timestamp):
+    """Where a frame is stored, never outside the output directory."""
+    if name.endswith(".jpg"):
+        return os.path.basename(name)
+    return "%s-%d.jpg" % (name, timestamp)
+
+
+class Latency:
+    """Capture to arrival times of thumbnails and full frames."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.first_pixel = []
+        self.full_frame = []
+
+    def add(self, name, timestamp):
+        # capture times are whole seconds on the device clock
+        seconds = time.time() - timestamp
+        with self.lock:
+            if name.endswith(THUMBNAIL_SUFFIX):
+                self.first_pixel.append(seconds)
+            else:
+                self.full_frame.append(seconds)
+        return seconds
+
+    def report(self):
+        for label, values in (("first pixel", self.first_pixel), ("full frame", self.full_frame)):
+            if values:
+                print("time to %s: %d frames, median %.1f s, min %.1f s, max %.1f s"
+                      % (label, len(values), statistics.median(values), min(values), max(values)), flush=True)
+
+
+def update_requests(directory, name, lock):
+    """Ask for the full frame of a thumbnail, or stop asking once it is here."""
+    device = name.split("-")[0]
+    path = os.path.join(directory, "%s-request.txt" % device)
+    with lock:
+        try:
+            with open(path) as existing:
+                wanted = [line.strip() for line in existing if line.strip()]
+        except FileNotFoundError:
+            wanted = []
+        if name.endswith(THUMBNAIL_SUFFIX):
+            full = name[:-len(THUMBNAIL_SUFFIX)] + ".jpg"
+            if full not in wanted:
+                wanted.append(full)
+        elif name in wanted:
+            wanted.remove(name)
+        else:
+            return
+        with open(path + ".tmp", "w") as out:
+            out.write("".join(line + "\n" for line in wanted))
+        os.replace(path + ".tmp", path)
+
+
+class FrameHandler(socketserver.StreamRequestHandler):
+    def handle(self):
+        peer = "%s:%d" % self.client_address
+        while True:
+            started = time.monotonic()
+            try:
+                device, timestamp, payload = read_frame(self.rfile)
+            except EOFError:
+                return
+            except FrameError as error:
+                print("%s: rejected frame: %s" % (peer, error), flush=True)
+                self.wfile.write(b"ER\n")
+                return
+
+            name = file_name(device, timestamp)
+            with open(os.path.join(self.server.output_dir, name), "wb") as out:
+                out.write(payload)
+            if self.server.request_dir:
+                update_requests(self.server.request_dir, name, self.server.request_lock)
+            self.wfile.write(b"OK\n")
+
+            elapsed = time.monotonic() - started
+            rate = len(payload) / elapsed if elapsed > 0 else 0
+            latency = self.server.latency.add(name, timestamp)
+            print("%s: stored %s (%d bytes, %.1f s, %.0f B/s, %.0f s after capture)"
+                  % (peer, name, len(payload), elapsed, rate, latency), flush=True)
+
+
+class FrameServer(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=5005)
+    parser.add_argument("--output", default="received")
+    parser.add_argument("--requests", metavar="DIR", help="keep <device>-request.txt in DIR asking for full frames")
+    args = parser.parse_args()
+
+    os.makedirs(args.output, exist_ok=True)
+    if args.requests:
+        os.makedirs(args.requests, exist_ok=True)
+    with FrameServer((args.host, args.port), FrameHandler) as server:
+        server.output_dir = args.output
+        server.request_dir = args.requests
+        server.request_lock = threading.Lock()
+        server.latency = Latency()
+        print("listening on %s:%d, writing to %s" % (args.host, args.port, args.output), flush=True)
+        try:
+            server.serve_forever()
+        except KeyboardInterrupt:
+            pass
+        server.latency.report()
+
+
+if __name__ == "__main__":
+    main()
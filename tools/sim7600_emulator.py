@@ -0,0 +1,916 @@
+#!/usr/bin/env python3
+"""SIM7600 stand-in on a pseudo-terminal or serial port, for soak runs.
+
+Implements the AT subset the firmware and TinyGSM use: registration and
+signal (CREG, CSQ, CPSI, CBC, CGSN), clock (CCLK, CNTP, CTZU), EFS (FSCD,
+FSLS, FSDEL, CFTRANRX), FTPS (CFTPS*), HTTP (HTTP*), GNSS (CGPS,
+CGNSSINFO), PSM (CPSMS) and TinyGSM's TCP sockets (NETOPEN, CIPOPEN,
+CIPSEND, CIPRXGET, CIPCLOSE). Commands chained with ';' are answered
+like the modem does, with one final OK. Anything else is answered OK and
+counted, or ERROR with --strict.
+
+Nothing leaves the machine except TCP sockets. FTP puts land in
+--ftp-root, HTTP GETs are served from --www by URL path, and CIPOPEN
+connects to --tcp-redirect (e.g. tools/photo_receiver.py) when given.
+Every network operation goes through a link model: uplink and downlink
+rate, latency and jitter, and per operation error and drop rates. An error
+fails the operation with the modem's result code, a drop also loses the
+session (+CFTPSNOTIFY, +IPCLOSE) or never answers (HTTP).
+
+The firmware reaches it through the modem UART. On a board, wire the
+modem pins to a USB serial adapter and pass --serial; without --serial a
+pty is opened and linked to --link. On the host, the [env:soak] build
+(test/soak) runs the firmware's modem modules against the pty, and
+tools/soak_run.py starts both and collects their summaries. That build
+leaves out the camera, SD card, sleep and TinyGSM, so only the full
+firmware on a board exercises those. A summary of
+throughput, retries and per command latency (p50/p90/p99/max, command to
+final result) is printed every --report-interval seconds and on exit,
+and written to --json for comparing runs:
+
+    python3 tools/sim7600_emulator.py --link /tmp/ttySIM7600 --www www/ --ftp-root ftp/
+    python3 tools/sim7600_emulator.py --serial /dev/ttyUSB0 --up-kbps 64 --error-rate 0.05 \\
+        --drop-rate 0.01 --duration 21600 --json soak.json
+"""
+
+import argparse
+import collections
+import heapq
+import json
+import os
+import random
+import select
+import signal
+import socket
+import sys
+import termios
+import time
+import tty
+import urllib.parse
+
+IMEI = "864764030000001"
+# settings that only need an OK here
+ACCEPTED = {"+CTZU", "+CTZR", "+CMEE", "+CNMP", "+CGDCONT", "+CGACT", "+CGATT", "+CIPMODE", "+CIPSENDMODE",
+            "+CIPCCFG", "+CIPTIMEOUT", "+CFUN", "+CSCLK", "&W", "Z"}
+EFS_SIZE = 4 * 1024 * 1024
+
+# result codes the firmware sees when the link gives out
+FTP_ERROR = 9         # transfer failed
+FTP_NOT_LOGGED_IN = 13
+HTTP_NETWORK_ERROR = 706
+TCP_ERROR = 2
+
+
+class AtError(Exception):
+    """Command fails with this final result."""
+
+    def __init__(self, result="ERROR"):
+        Exception.__init__(self, result)
+        self.result = result
+
+
+class Link:
+    """Time and fate of each network operation."""
+
+    def __init__(self, args, rng):
+        self.up_bps = args.up_kbps * 1000 / 8.0
+        self.down_bps = args.down_kbps * 1000 / 8.0
+        self.latency = args.latency_ms / 1000.0
+        self.jitter = args.jitter
+        self.error_rate = args.error_rate
+        self.drop_rate = args.drop_rate
+        self.rng = rng
+
+    def delay(self, up=0, down=0, round_trips=1):
+        seconds = round_trips * self.latency + up / self.up_bps + down / self.down_bps
+        return max(0.0, seconds * (1 + self.rng.uniform(-self.jitter, self.jitter)))
+
+    def outcome(self):
+        """"ok", "error" (operation fails) or "drop" (the session goes too)."""
+        roll = self.rng.random()
+        if roll < self.drop_rate:
+            return "drop"
+        if roll < self.drop_rate + self.error_rate:
+            return "error"
+        return "ok"
+
+
+class Soak:
+    """Counters and command latencies for the run summary."""
+
+    def __init__(self):
+        self.started = time.monotonic()
+        self.counts = collections.Counter()
+        self.latencies = collections.defaultdict(list)
+        self.failed_puts = set()
+        self.read_offsets = set()
+        self.efs_names = set()
+        self.put_seconds = 0.0
+
+    def latency(self, name, seconds):
+        self.latencies[name].append(seconds)
+
+    def summary(self):
+        elapsed = time.monotonic() - self.started
+        commands = {}
+        for name, values in sorted(self.latencies.items()):
+            ordered = sorted(values)
+
+            def pick(fraction):
+                return round(ordered[min(len(ordered) - 1, int(fraction * len(ordered)))] * 1000, 1)
+
+            commands[name] = {"count": len(ordered), "p50_ms": pick(0.5), "p90_ms": pick(0.9),
+                              "p99_ms": pick(0.99), "max_ms": round(ordered[-1] * 1000, 1)}
+        put_bytes = self.counts["ftp_bytes"]
+        return {
+            "elapsed_s": round(elapsed, 1),
+            "counters": dict(sorted(self.counts.items())),
+            "ftp_put_bytes_per_s": round(put_bytes / self.put_seconds) if self.put_seconds else 0,
+            "uplink_bytes_per_hour": round((put_bytes + self.counts["tcp_bytes_up"]) * 3600 / elapsed) if elapsed else 0,
+            "commands": commands,
+        }
+
+    def report(self, out=sys.stdout):
+        summary = self.summary()
+        counts = summary["counters"]
+        print("soak %.0f s: %d commands, %d puts (%d failed, %d retried), %d B/s per put, %d B/h up, "
+              "%d EFS rewrites, %d HTTP re-reads, %d drops, %d unknown commands"
+              % (summary["elapsed_s"], counts.get("commands", 0), counts.get("ftp_puts", 0),
+                 counts.get("ftp_put_failures", 0), counts.get("ftp_put_retries", 0),
+                 summary["ftp_put_bytes_per_s"], summary["uplink_bytes_per_hour"], counts.get("efs_rewrites", 0),
+                 counts.get("http_rereads", 0), counts.get("drops", 0), counts.get("unknown", 0)), file=out)
+        worst = sorted(summary["commands"].items(), key=lambda item: -item[1]["p99_ms"])
+        for name, row in worst:
+            print("  %-14s %6d  p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f ms"
+                  % (name, row["count"], row["p50_ms"], row["p90_ms"], row["p99_ms"], row["max_ms"]), file=out)
+        out.flush()
+
+
+class Socket:
+    """One CIPOPEN link id."""
+
+    def __init__(self, conn):
+        self.conn = conn
+        self.received = bytearray()
+        self.closing = False  # the peer closed, what it sent before can still be read
+        self.arrives_at = 0.0
+
+
+class Modem:
+    def __init__(self, fd, args):
+        self.fd = fd
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.link = Link(args, self.rng)
+        self.soak = Soak()
+        self.booted_at = time.monotonic() + args.boot_ms / 1000.0
+        self.registered_at = self.booted_at + args.register_ms / 1000.0
+        self.fix_at = self.booted_at + args.fix_after_s
+        self.timers = []
+        self.timer_seq = 0
+        self.input = bytearray()
+        self.output = bytearray()
+        self.output_clock = time.monotonic()
+        self.echo = True
+        self.prompt = None    # (remaining bytes, callback) while raw data is expected
+        self.rdy_sent = False
+
+        self.efs = {}
+        self.ftp_started = False
+        self.ftp_logged_in = False
+        self.ftp_last_use = 0.0
+        self.http_started = False
+        self.http_url = ""
+        self.http_body = b""
+        self.gps_on = False
+        self.gnss_interval = 0
+        self.net_open = False
+        self.sockets = {}
+
+    # output
+
+    def write(self, data):
+        self.output += data
+
+    def line(self, text):
+        self.write(b"\r\n" + text.encode("latin-1") + b"\r\n")
+
+    def later(self, seconds, callback):
+        self.at(time.monotonic() + seconds, callback)
+
+    def at(self, when, callback):
+        # equal times run in the order they were scheduled
+        self.timer_seq += 1
+        heapq.heappush(self.timers, (when, self.timer_seq, callback))
+
+    def finish(self, name, started, text):
+        """Async final result of name, the latency runs from its command."""
+        self.line(text)
+        self.soak.latency(name, time.monotonic() - started)
+
+    def flush(self):
+        if not self.output:
+            return
+        count = len(self.output)
+        if self.args.baud:
+            # the UART is the bottleneck for EFS and HTTPREAD windows
+            now = time.monotonic()
+            self.output_clock = max(self.output_clock, now - 0.05)
+            count = min(count, int((now - self.output_clock) * self.args.baud / 10))
+            if count <= 0:
+                return
+        try:
+            written = os.write(self.fd, bytes(self.output[:count]))
+        except BlockingIOError:
+            return
+        del self.output[:written]
+        if self.args.baud:
+            self.output_clock += written * 10.0 / self.args.baud
+
+    # input
+
+    def receive(self, data):
+        self.input += data
+        while self.input:
+            if self.prompt:
+                remaining, callback = self.prompt
+                chunk = bytes(self.input[:remaining])
+                del self.input[:len(chunk)]
+                callback(chunk)
+                remaining -= len(chunk)
+                self.prompt = (remaining, callback) if remaining else None
+                continue
+            end = self.input.find(b"\r")
+            if end < 0:
+                if len(self.input) > 4096:
+                    del self.input[:]
+                return
+            text = bytes(self.input[:end]).decode("latin-1").strip("\n ")
+            del self.input[:end + 1]
+            if self.input[:1] == b"\n":
+                del self.input[:1]
+            if text:
+                self.command_line(text)
+
+    def command_line(self, text):
+        now = time.monotonic()
+        if now < self.booted_at:
+            return    # still powering up, TinyGSM keeps sending AT
+        if self.echo:
+            self.write(text.encode("latin-1") + b"\r")
+        if text[:2].upper() != "AT":
+            self.line("ERROR")
+            return
+
+        started = now
+        replies = []
+        # commands answered on the spot only count, the ones finishing with a
+        # URC or after a data phase get a latency from finish()
+        result = "OK"
+        for command in split_commands(text[2:]):
+            name, kind, args = parse_command(command)
+            self.soak.counts["commands"] += 1
+            try:
+                replies.extend(self.execute(name, kind, args, started) or [])
+            except AtError as error:
+                result = error.result
+                break
+        for reply in replies:
+            if isinstance(reply, bytes):
+                self.write(reply)
+            else:
+                self.line(reply)
+        if result is not None:
+            self.line(result)
+
+    def execute(self, name, kind, args, started):
+        handler = getattr(self, "at_" + name.lstrip("+&").lower(), None) if name else self.at_
+        if handler is None and name in ACCEPTED:
+            return []
+        if handler is None:
+            self.soak.counts["unknown"] += 1
+            self.soak.counts["unknown " + name] += 1
+            if self.args.strict:
+                raise AtError()
+            return []
+        return handler(kind, args, started)
+
+    # basics
+
+    def at_(self, kind, args, started):
+        return []
+
+    def at_e0(self, kind, args, started):
+        self.echo = False
+
+    def at_e1(self, kind, args, started):
+        self.echo = True
+
+    def at_cpin(self, kind, args, started):
+        return ["+CPIN: READY"] if kind == "?" else []
+
+    def at_cgmi(self, kind, args, started):
+        return ["SIMCOM INCORPORATED"]
+
+    def at_cgmm(self, kind, args, started):
+        return ["SIMCOM_SIM7600G-H"]
+
+    def at_cgmr(self, kind, args, started):
+        return ["+CGMR: LE20B04SIM7600G22"]
+
+    def at_cgsn(self, kind, args, started):
+        return [IMEI]
+
+    def at_creg(self, kind, args, started):
+        if kind != "?":
+            return []
+        return ["+CREG: 0,%d" % (1 if time.monotonic() >= self.registered_at else 2)]
+
+    def at_csq(self, kind, args, started):
+        if time.monotonic() < self.registered_at:
+            return ["+CSQ: 99,99"]
+        csq = max(0, min(31, self.args.csq + self.rng.randint(-2, 2)))
+        return ["+CSQ: %d,99" % csq]
+
+    def at_cpsi(self, kind, args, started):
+        if time.monotonic() < self.registered_at:
+            return ["+CPSI: NO SERVICE,Online"]
+        rsrp = -1100 + self.args.csq * 20
+        return ["+CPSI: LTE,Online,655-01,0x1234,12345678,256,EUTRAN-BAND3,1300,5,5,-100,%d,-700,%d"
+                % (rsrp, self.args.csq // 2)]
+
+    def at_cbc(self, kind, args, started):
+        return ["+CBC: %.3fV" % (self.args.supply_mv / 1000.0)]
+
+    def at_cclk(self, kind, args, started):
+        if kind != "?":
+            return []
+        return [time.strftime('+CCLK: "%y/%m/%d,%H:%M:%S+00"', time.gmtime())]
+
+    def at_cntp(self, kind, args, started):
+        if kind == "=":
+            return []
+
+        def synced():
+            self.finish("+CNTP", started, "+CNTP: 0" if self.link.outcome() == "ok" else "+CNTP: 1")
+        self.later(self.link.delay(round_trips=2), synced)
+        return []
+
+    # EFS
+
+    def at_fscd(self, kind, args, started):
+        return ["+FSCD: E:/"]
+
+    def at_fsls(self, kind, args, started):
+        return ["+FSLS: SUBDIRECTORIES:", "..", "+FSLS: FILES:"] + sorted(self.efs)
+
+    def at_fsdel(self, kind, args, started):
+        name = unquote(args[0]) if args else ""
+        if name == "*.*":
+            self.efs.clear()
+        elif self.efs.pop(efs_name(name), None) is None:
+            raise AtError()
+        return []
+
+    def at_cftranrx(self, kind, args, started):
+        name = efs_name(unquote(args[0]))
+        length = int(args[1])
+        if length > EFS_SIZE - sum(len(data) for other, data in self.efs.items() if other != name):
+            raise AtError()
+        if name in self.soak.efs_names:
+            self.soak.counts["efs_rewrites"] += 1
+        self.soak.efs_names.add(name)
+        received = bytearray()
+
+        def data(chunk):
+            received.extend(chunk)
+            if len(received) == length:
+                self.efs[name] = bytes(received)
+                self.soak.counts["efs_bytes"] += length
+                self.finish("+CFTRANRX", started, "OK")
+        self.prompt = (length, data)
+        self.write(b"\r\n>")
+        raise AtError(None)
+
+    # FTPS
+
+    def ftp_drop(self):
+        self.ftp_logged_in = False
+        self.soak.counts["drops"] += 1
+        self.line("+CFTPSNOTIFY: PEER CLOSED")
+
+    def ftp_idle_check(self):
+        if (self.ftp_logged_in and self.args.ftp_idle_s
+                and time.monotonic() - self.ftp_last_use > self.args.ftp_idle_s):
+            self.ftp_drop()
+
+    def at_cftpsstart(self, kind, args, started):
+        if self.ftp_started:
+            raise AtError()
+        self.ftp_started = True
+        self.later(0.05, lambda: self.finish("+CFTPSSTART", started, "+CFTPSSTART: 0"))
+        return []
+
+    def at_cftpsstop(self, kind, args, started):
+        self.ftp_started = False
+        self.ftp_logged_in = False
+        self.later(0.05, lambda: self.finish("+CFTPSSTOP", started, "+CFTPSSTOP: 0"))
+        return []
+
+    def at_cftpslogin(self, kind, args, started):
+        if not self.ftp_started or time.monotonic() < self.registered_at:
+            raise AtError()
+
+        def logged_in():
+            fate = self.link.outcome()
+            self.ftp_logged_in = fate == "ok"
+            self.ftp_last_use = time.monotonic()
+            self.soak.counts["ftp_logins"] += 1
+            self.finish("+CFTPSLOGIN", started, "+CFTPSLOGIN: %d" % (0 if self.ftp_logged_in else FTP_ERROR))
+        # control connection plus TLS handshake
+        self.later(self.link.delay(up=2048, down=4096, round_trips=4), logged_in)
+        return []
+
+    def at_cftpslogout(self, kind, args, started):
+        was_logged_in = self.ftp_logged_in
+        self.ftp_logged_in = False
+        self.later(self.link.delay(), lambda: self.finish(
+            "+CFTPSLOGOUT", started, "+CFTPSLOGOUT: %d" % (0 if was_logged_in else FTP_NOT_LOGGED_IN)))
+        return []
+
+    def at_cftpspwd(self, kind, args, started):
+        self.ftp_idle_check()
+        if not self.ftp_logged_in:
+            raise AtError()
+        self.ftp_last_use = time.monotonic()
+        return ['+CFTPSPWD: "/"']
+
+    def at_cftpsputfile(self, kind, args, started):
+        self.ftp_idle_check()
+        name = unquote(args[0]).lstrip("/")
+        data = self.efs.get(efs_name(name))
+        self.soak.counts["ftp_puts"] += 1
+        if name in self.soak.failed_puts:
+            self.soak.counts["ftp_put_retries"] += 1
+        if not self.ftp_logged_in or data is None:
+            code = FTP_NOT_LOGGED_IN if not self.ftp_logged_in else FTP_ERROR
+            self.later(0.05, lambda: self.put_done(name, started, code, 0))
+            return []
+
+        fate = self.link.outcome()
+        seconds = self.link.delay(up=len(data), round_trips=3)
+        if fate == "ok":
+            self.later(seconds, lambda: self.put_done(name, started, 0, len(data), data))
+        else:
+            # the link gives out part way through
+            def failed():
+                if fate == "drop":
+                    self.ftp_drop()
+                self.put_done(name, started, FTP_ERROR, 0)
+            self.later(seconds * self.rng.random(), failed)
+        return []
+
+    def put_done(self, name, started, code, length, data=None):
+        if code == 0:
+            self.soak.failed_puts.discard(name)
+            self.soak.counts["ftp_bytes"] += length
+            self.soak.put_seconds += time.monotonic() - started
+            if self.args.ftp_root:
+                with open(os.path.join(self.args.ftp_root, os.path.basename(name)), "wb") as out:
+                    out.write(data)
+        else:
+            self.soak.failed_puts.add(name)
+            self.soak.counts["ftp_put_failures"] += 1
+        self.ftp_last_use = time.monotonic()
+        self.finish("+CFTPSPUTFILE", started, "+CFTPSPUTFILE: %d" % code)
+
+    # HTTP
+
+    def at_httpinit(self, kind, args, started):
+        if self.http_started:
+            raise AtError()
+        self.http_started = True
+        self.http_body = b""
+        return []
+
+    def at_httpterm(self, kind, args, started):
+        if not self.http_started:
+            raise AtError()
+        self.http_started = False
+        return []
+
+    def at_httppara(self, kind, args, started):
+        if not self.http_started:
+            raise AtError()
+        if unquote(args[0]).upper() == "URL":
+            self.http_url = unquote(args[1])
+        return []
+
+    def at_httpaction(self, kind, args, started):
+        if not self.http_started:
+            raise AtError()
+        body, status = None, 404
+        if self.args.www:
+            path = urllib.parse.urlparse(self.http_url).path.lstrip("/")
+            full = os.path.normpath(os.path.join(self.args.www, path))
+            if full.startswith(os.path.normpath(self.args.www) + os.sep) and os.path.isfile(full):
+                with open(full, "rb") as source:
+                    body, status = source.read(), 200
+        fate = self.link.outcome()
+        seconds = self.link.delay(down=len(body or b""), round_trips=3)
+        if fate == "drop":
+            # never answers, the firmware has to time out
+            self.soak.counts["drops"] += 1
+            return []
+
+        def fetched():
+            if fate == "error":
+                self.http_body = b""
+                self.finish("+HTTPACTION", started, "+HTTPACTION: 0,%d,0" % HTTP_NETWORK_ERROR)
+                return
+            self.http_body = body or b""
+            self.soak.counts["http_bytes"] += len(self.http_body)
+            self.finish("+HTTPACTION", started, "+HTTPACTION: 0,%d,%d" % (status, len(self.http_body)))
+        self.later(seconds, fetched)
+        return []
+
+    def at_httpread(self, kind, args, started):
+        if kind == "?":
+            return ["+HTTPREAD: LEN,%d" % len(self.http_body)]
+        offset, length = int(args[0]), int(args[1])
+        if (offset, len(self.http_body)) in self.soak.read_offsets:
+            self.soak.counts["http_rereads"] += 1
+        self.soak.read_offsets.add((offset, len(self.http_body)))
+        chunk = self.http_body[offset:offset + length]
+        # OK first, then the window
+        self.line("OK")
+        self.write(b"\r\n+HTTPREAD: DATA,%d\r\n" % len(chunk) + chunk)
+        self.line("+HTTPREAD: 0")
+        raise AtError(None)
+
+    # GNSS
+
+    def at_cgps(self, kind, args, started):
+        if kind == "?":
+            return ["+CGPS: %d,1" % (1 if self.gps_on else 0)]
+        on = args and args[0] == "1"
+        if on and self.gps_on:
+            raise AtError()
+        self.gps_on = bool(on)
+        return []
+
+    def gnss_line(self):
+        if not self.gps_on or time.monotonic() < self.fix_at:
+            return "+CGNSSINFO: ,,,,,,,,,,,,,,,"
+        latitude, longitude = self.args.position
+        now = time.gmtime()
+        return ("+CGNSSINFO: 3,09,05,00,%s,%s,%s,%s,%s,%s,152.0,0.0,0.0,1.4,0.9,1.1"
+                % (nmea(abs(latitude), 2), "N" if latitude >= 0 else "S", nmea(abs(longitude), 3),
+                   "E" if longitude >= 0 else "W", time.strftime("%d%m%y", now), time.strftime("%H%M%S.0", now)))
+
+    def at_cgnssinfo(self, kind, args, started):
+        if kind == "=":
+            self.gnss_interval = int(args[0])
+            if self.gnss_interval:
+                self.later(self.gnss_interval, self.gnss_report)
+            return []
+        return [self.gnss_line()]
+
+    def gnss_report(self):
+        if self.gnss_interval:
+            self.line(self.gnss_line())
+            self.later(self.gnss_interval, self.gnss_report)
+
+    # power
+
+    def at_cpsms(self, kind, args, started):
+        return ["+CPSMS: 0"] if kind == "?" else []
+
+    # TCP, the way TinyGSM drives it
+
+    def at_netopen(self, kind, args, started):
+        if kind == "?":
+            return ["+NETOPEN: %d" % (1 if self.net_open else 0)]
+        if time.monotonic() < self.registered_at:
+            raise AtError()
+        self.net_open = True
+        self.later(self.link.delay(), lambda: self.finish("+NETOPEN", started, "+NETOPEN: 0"))
+        return []
+
+    def at_netclose(self, kind, args, started):
+        self.net_open = False
+        for mux in list(self.sockets):
+            self.close_socket(mux)
+        self.later(0.05, lambda: self.finish("+NETCLOSE", started, "+NETCLOSE: 0"))
+        return []
+
+    def at_ipaddr(self, kind, args, started):
+        if not self.net_open:
+            raise AtError()
+        return ["+IPADDR: 10.64.0.2"]
+
+    def at_cipopen(self, kind, args, started):
+        mux = int(args[0])
+        host, port = unquote(args[2]), int(args[3])
+        if self.args.tcp_redirect:
+            host, port = self.args.tcp_redirect
+        if not self.net_open or (mux in self.sockets and not self.sockets[mux].closing):
+            raise AtError()
+        self.close_socket(mux)
+        fate = self.link.outcome()
+
+        def opened():
+            if fate != "ok":
+                self.finish("+CIPOPEN", started, "+CIPOPEN: %d,%d" % (mux, TCP_ERROR))
+                return
+            try:
+                conn = socket.create_connection((host, port), timeout=5)
+            except OSError:
+                self.finish("+CIPOPEN", started, "+CIPOPEN: %d,%d" % (mux, TCP_ERROR))
+                return
+            conn.setblocking(False)
+            self.sockets[mux] = Socket(conn)
+            self.finish("+CIPOPEN", started, "+CIPOPEN: %d,0" % mux)
+        self.later(self.link.delay(round_trips=2), opened)
+        return []
+
+    def at_cipsend(self, kind, args, started):
+        mux, length = int(args[0]), int(args[1])
+        sock = self.sockets.get(mux)
+        if sock is None or sock.closing:
+            raise AtError()
+        received = bytearray()
+
+        def data(chunk):
+            received.extend(chunk)
+            if len(received) < length:
+                return
+            self.line("OK")
+            fate = self.link.outcome()
+
+            def sent():
+                if self.sockets.get(mux) is not sock or sock.closing:
+                    return
+                if fate == "drop":
+                    self.soak.counts["drops"] += 1
+                    self.peer_closed(mux)
+                    return
+                try:
+                    sock.conn.sendall(bytes(received))
+                except OSError:
+                    self.peer_closed(mux)
+                    return
+                self.soak.counts["tcp_bytes_up"] += length
+                self.finish("+CIPSEND", started, "+CIPSEND: %d,%d,%d" % (mux, length, length))
+            self.later(self.link.delay(up=length), sent)
+        self.prompt = (length, data)
+        self.write(b"\r\n>")
+        raise AtError(None)
+
+    def at_ciprxget(self, kind, args, started):
+        if kind == "?":
+            return ["+CIPRXGET: 1"]
+        mode = int(args[0])
+        if mode in (0, 1):
+            return []
+        sock = self.sockets.get(int(args[1]))
+        if sock is None:
+            raise AtError()
+        if mode == 4:
+            return ["+CIPRXGET: 4,%s,%d" % (args[1], len(sock.received))]
+        count = min(int(args[2]) if len(args) > 2 else 1500, len(sock.received))
+        chunk = bytes(sock.received[:count])
+        del sock.received[:count]
+        return ["+CIPRXGET: %d,%s,%d,%d" % (mode, args[1], count, len(sock.received)), chunk]
+
+    def at_cipclose(self, kind, args, started):
+        if kind == "?":
+            return ["+CIPCLOSE: " + ",".join("1" if mux in self.sockets and not self.sockets[mux].closing else "0"
+                                             for mux in range(10))]
+        mux = int(args[0])
+        if mux not in self.sockets:
+            raise AtError()
+        self.close_socket(mux)
+        self.later(0.05, lambda: self.finish("+CIPCLOSE", started, "+CIPCLOSE: %d,0" % mux))
+        return []
+
+    def close_socket(self, mux):
+        sock = self.sockets.pop(mux, None)
+        if sock:
+            sock.conn.close()
+
+    def peer_closed(self, mux):
+        # what already arrived can still be read until CIPCLOSE
+        sock = self.sockets.get(mux)
+        if sock and not sock.closing:
+            sock.closing = True
+            sock.conn.close()
+            self.line("+IPCLOSE: %d,1" % mux)
+
+    def socket_readable(self, mux):
+        sock = self.sockets[mux]
+        try:
+            data = sock.conn.recv(4096)
+        except BlockingIOError:
+            return
+        except OSError:
+            data = b""
+        # deliveries keep their order whatever the jitter says
+        sock.arrives_at = max(sock.arrives_at, time.monotonic() + self.link.delay(down=len(data)))
+        if not data:
+            sock.closing = True
+            self.at(sock.arrives_at, lambda: self.sockets.get(mux) is sock and self.peer_closed(mux))
+            return
+        self.soak.counts["tcp_bytes_down"] += len(data)
+
+        def arrived():
+            if self.sockets.get(mux) is sock:
+                sock.received += data
+                self.line("+CIPRXGET: 1,%d" % mux)
+        self.at(sock.arrives_at, arrived)
+
+    # main loop
+
+    def run(self, duration):
+        deadline = time.monotonic() + duration if duration else None
+        next_report = time.monotonic() + self.args.report_interval if self.args.report_interval else None
+        while deadline is None or time.monotonic() < deadline:
+            now = time.monotonic()
+            if not self.rdy_sent and now >= self.booted_at:
+                self.rdy_sent = True
+                self.line("RDY")
+            while self.timers and self.timers[0][0] <= now:
+                _, _, callback = heapq.heappop(self.timers)
+                callback()
+            self.ftp_idle_check()
+            if next_report and now >= next_report:
+                self.soak.report()
+                next_report = now + self.args.report_interval
+
+            timeout = 0.2
+            if self.timers:
+                timeout = min(timeout, max(0.0, self.timers[0][0] - now))
+            if self.output:
+                timeout = min(timeout, 0.002)
+            readers = [self.fd] + [sock.conn for sock in self.sockets.values() if not sock.closing]
+            ready, _, _ = select.select(readers, [], [], timeout)
+            for item in ready:
+                if item == self.fd:
+                    try:
+                        data = os.read(self.fd, 4096)
+                    except (BlockingIOError, OSError):
+                        data = b""
+                    if data:
+                        self.receive(data)
+                else:
+                    for mux, sock in list(self.sockets.items()):
+                        if sock.conn is item:
+                            self.socket_readable(mux)
+            self.flush()
+
+
+def split_commands(text):
+    """"+CGSN;+CSQ" to its commands, ';' inside quotes belongs to the argument."""
+    commands, current, quoted = [], "", False
+    for char in text:
+        if char == '"':
+            quoted = not quoted
+        if char == ";" and not quoted:
+            commands.append(current)
+            current = ""
+        else:
+            current += char
+    commands.append(current)
+    return [command for command in commands if command] or [""]
+
+
+def parse_command(command):
+    """"+CNMP=38" to ("+CNMP", "=", ["38"]), "+CREG?" to ("+CREG", "?", [])."""
+    if command[:1] not in "+&":
+        # basic commands such as E0 carry their argument in the name
+        return command.upper(), "", []
+    for index, char in enumerate(command):
+        if char == "?" and index == len(command) - 1:
+            return command[:index].upper(), "?", []
+        if char == "=":
+            if command[index + 1:] == "?":
+                return command[:index].upper(), "=?", []
+            return command[:index].upper(), "=", split_args(command[index + 1:])
+    return command.upper(), "", []
+
+
+def split_args(text):
+    args, current, quoted = [], "", False
+    for char in text:
+        if char == '"':
+            quoted = not quoted
+        if char == "," and not quoted:
+            args.append(current)
+            current = ""
+        else:
+            current += char
+    args.append(current)
+    return args
+
+
+def unquote(text):
+    return text[1:-1] if len(text) >= 2 and text[0] == text[-1] == '"' else text
+
+
+def efs_name(path):
+    """"e:/photo.jpg", "/photo.jpg" and "photo.jpg" are the same EFS file."""
+    if path[:2].lower() == "e:":
+        path = path[2:]
+    return path.lstrip("/")
+
+
+def nmea(degrees, width):
+    whole = int(degrees)
+    return "%0*d%09.6f" % (width, whole, (degrees - whole) * 60)
+
+
+def open_terminal(args):
+    if args.serial:
+        fd = os.open(args.serial, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        tty.setraw(fd)
+        attrs = termios.tcgetattr(fd)
+        speed = getattr(termios, "B%d" % args.baud)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+        print("answering on %s at %d baud" % (args.serial, args.baud), flush=True)
+        return fd, None
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    os.set_blocking(master, False)
+    path = os.ttyname(slave)
+    if args.link:
+        if os.path.islink(args.link):
+            os.unlink(args.link)
+        os.symlink(path, args.link)
+        path = "%s -> %s" % (args.link, path)
+    print("answering on %s" % path, flush=True)
+    # the slave end stays open so the pty survives the firmware reconnecting
+    return master, slave
+
+
+def host_port(text):
+    host, _, port = text.rpartition(":")
+    return host or "127.0.0.1", int(port)
+
+
+def position(text):
+    latitude, longitude = text.split(",")
+    return float(latitude), float(longitude)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--link", default="/tmp/ttySIM7600", help="symlink to the pty for the firmware to open")
+    parser.add_argument("--serial", help="answer on this serial device instead of a pty")
+    parser.add_argument("--baud", type=int, default=115200, help="UART pacing of replies, 0 for none")
+    parser.add_argument("--www", help="serve HTTP GETs from this directory by URL path")
+    parser.add_argument("--ftp-root", help="store FTP puts in this directory")
+    parser.add_argument("--tcp-redirect", type=host_port, metavar="HOST:PORT", help="connect every CIPOPEN here")
+    parser.add_argument("--up-kbps", type=float, default=256)
+    parser.add_argument("--down-kbps", type=float, default=2048)
+    parser.add_argument("--latency-ms", type=float, default=120, help="one network round trip")
+    parser.add_argument("--jitter", type=float, default=0.2, help="+- fraction applied to every delay")
+    parser.add_argument("--error-rate", type=float, default=0.0, help="network operations that fail")
+    parser.add_argument("--drop-rate", type=float, default=0.0, help="network operations that also lose the session")
+    parser.add_argument("--ftp-idle-s", type=float, default=0, help="server drops FTP logins idle this long")
+    parser.add_argument("--csq", type=int, default=20)
+    parser.add_argument("--supply-mv", type=int, default=3950)
+    parser.add_argument("--position", type=position, default=(-24.0, 31.5), metavar="LAT,LON")
+    parser.add_argument("--boot-ms", type=int, default=3000, help="power-on until the modem answers AT")
+    parser.add_argument("--register-ms", type=int, default=4000, help="answering AT until registered")
+    parser.add_argument("--fix-after-s", type=float, default=30)
+    parser.add_argument("--strict", action="store_true", help="ERROR for commands the emulator doesn't know")
+    parser.add_argument("--seed", type=int, help="random seed, for repeatable runs")
+    parser.add_argument("--duration", type=float, default=0, help="stop after this many seconds, 0 runs until ^C")
+    parser.add_argument("--report-interval", type=float, default=600, help="seconds between summaries, 0 for none")
+    parser.add_argument("--json", help="write the final summary here")
+    args = parser.parse_args()
+
+    if args.ftp_root:
+        os.makedirs(args.ftp_root, exist_ok=True)
+    fd, keep = open_terminal(args)
+    modem = Modem(fd, args)
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    try:
+        modem.run(args.duration)
+    except (KeyboardInterrupt, SystemExit):
+        pass
+    finally:
+        signal.signal(signal.SIGINT, signal.SIG_IGN)
+        modem.soak.report()
+        if args.json:
+            with open(args.json, "w") as out:
+                json.dump(modem.soak.summary(), out, indent=2)
+        if keep is not None:
+            os.close(keep)
+        if args.link and not args.serial and os.path.islink(args.link):
+            os.unlink(args.link)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Soak the firmware's modem path against the SIM7600 emulator.
+
+Starts tools/sim7600_emulator.py on a pty with an HTTP directory holding
+a version file, a firmware image and its digest, runs the host soak
+program (test/soak, the [env:soak] build) against the pty for --duration
+seconds, then stops the emulator and prints both summaries: what the
+firmware saw (runs, failures, retries, throughput and tail latency per
+operation) and what the modem saw (per command latency, drops). Options
+after "--" go to the emulator, so the link can be made worse:
+
+    pio run -e soak
+    python3 tools/soak_run.py --duration 14400 --json soak.json -- \\
+        --up-kbps 64 --latency-ms 400 --error-rate 0.05 --drop-rate 0.01
+
+Exits with the soak program's status: 1 when the modem never came up or
+no photo got through. --max-failure-rate also fails a run where more than
+that fraction of any operation's runs failed.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import re
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def device_name():
+    with open(os.path.join(ROOT, "src", "config.h")) as config:
+        match = re.search(r'#define DEVICENAME "([^"]+)"', config.read())
+    return match.group(1)
+
+
+def make_www(www, firmware_bytes):
+    """The files checkForUpdate() and downloadFirmware() ask for."""
+    os.makedirs(www)
+    name = device_name()
+    image = os.urandom(firmware_bytes)
+    with open(os.path.join(www, name + "-version.txt"), "w") as out:
+        out.write("soak-1\n")
+    with open(os.path.join(www, name + "-firmware.bin"), "wb") as out:
+        out.write(image)
+    with open(os.path.join(www, name + "-firmware.sha256"), "w") as out:
+        out.write("%s  %s-firmware.bin\n" % (hashlib.sha256(image).hexdigest(), name))
+
+
+def wait_for(path, timeout):
+    deadline = time.monotonic() + timeout
+    while not os.path.exists(path):
+        if time.monotonic() > deadline:
+            return False
+        time.sleep(0.1)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--program", default=os.path.join(ROOT, ".pio", "build", "soak", "program"),
+                        help="the [env:soak] build")
+    parser.add_argument("--duration", type=int, default=3600, help="seconds")
+    parser.add_argument("--interval", type=int, default=60, help="seconds between frames")
+    parser.add_argument("--photo-bytes", type=int, default=60000)
+    parser.add_argument("--firmware-bytes", type=int, default=1200000)
+    parser.add_argument("--report-interval", type=int, default=600, help="seconds between summaries")
+    parser.add_argument("--work-dir", help="keep the pty, served files and uploads here")
+    parser.add_argument("--json", help="write both summaries here")
+    parser.add_argument("--max-failure-rate", type=float, help="fail when an operation failed more often")
+    parser.add_argument("--ota-every", type=int, default=30, help="frames between update checks, 0 for none")
+    parser.add_argument("--no-download", action="store_true", help="check for updates but don't download")
+    argv = sys.argv[1:]
+    emulator_args = argv[argv.index("--") + 1:] if "--" in argv else []
+    args = parser.parse_args(argv[:len(argv) - len(emulator_args) - (1 if "--" in argv else 0)])
+    if not os.path.isfile(args.program):
+        sys.exit("%s not built, run pio run -e soak" % args.program)
+
+    work = args.work_dir or tempfile.mkdtemp(prefix="soak-")
+    os.makedirs(work, exist_ok=True)
+    tty = os.path.join(work, "ttySIM7600")
+    www = os.path.join(work, "www")
+    ftp = os.path.join(work, "ftp")
+    modem_json = os.path.join(work, "modem.json")
+    firmware_json = os.path.join(work, "firmware.json")
+    if not os.path.isdir(www):
+        make_www(www, args.firmware_bytes)
+
+    emulator = subprocess.Popen(
+        [sys.executable, os.path.join(ROOT, "tools", "sim7600_emulator.py"), "--link", tty, "--www", www,
+         "--ftp-root", ftp, "--report-interval", "0", "--json", modem_json] + emulator_args)
+    try:
+        if not wait_for(tty, 10):
+            sys.exit("the emulator didn't open %s" % tty)
+        status = subprocess.call(
+            [args.program, "--tty", tty, "--duration", str(args.duration), "--interval", str(args.interval),
+             "--photo-bytes", str(args.photo_bytes), "--report-interval", str(args.report_interval),
+             "--ota-every", str(args.ota_every), "--json", firmware_json] +
+            (["--no-download"] if args.no_download else []))
+    finally:
+        # SIGTERM makes the emulator print and write its summary
+        emulator.send_signal(signal.SIGTERM)
+        emulator.wait(30)
+
+    summary = {}
+    for name, path in (("firmware", firmware_json), ("modem", modem_json)):
+        if os.path.isfile(path):
+            with open(path) as source:
+                summary[name] = json.load(source)
+    summary["uploads"] = len(os.listdir(ftp)) if os.path.isdir(ftp) else 0
+    print("%d files on the FTP side, work files in %s" % (summary["uploads"], work))
+    if args.json:
+        with open(args.json, "w") as out:
+            json.dump(summary, out, indent=2)
+
+    if status == 0 and args.max_failure_rate is not None:
+        for name, op in summary.get("firmware", {}).get("operations", {}).items():
+            if op["runs"] and op["failures"] > args.max_failure_rate * op["runs"]:
+                print("%s: %d of %d runs failed" % (name, op["failures"], op["runs"]))
+                status = 1
+    sys.exit(status)
+
+
+if __name__ == "__main__":
+    main()
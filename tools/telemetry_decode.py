@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""Decoder for the binary telemetry batches (src/telemetry.h).
+
+A batch is records back to back, oldest first. Each record, little endian:
+    "SCT2" | u16 length | u8 metric count | u8 gauge count | header fields
+    | per metric u32 count, p50, p90, p99, max us
+    | per gauge u8 set, 3 x 0, i32 last, min, max | u32 crc32
+
+Records with a bad checksum are reported and skipped, decoding picks up
+again at the next magic. SCT1 records, with a four character link mode,
+from older firmware still decode. Metrics and gauges are named in
+firmware order, newer firmware with more of them gets numbered names.
+Prints one line per record, or JSON lines / CSV for plotting:
+
+    python3 tools/telemetry_decode.py received/sanwildsmartcam04-*.tlm
+    python3 tools/telemetry_decode.py --csv *.tlm > telemetry.csv
+
+--fixture packs SAMPLE with the structs above and prints it as the C array
+test/test_telemetry compares telemetryEncode() against, so a layout change
+on either side fails the test until both agree.
+"""
+
+import argparse
+import csv
+import json
+import re
+import struct
+import sys
+import time
+import zlib
+
+# header layout per version, they only differ in the link mode width
+HEADERS = {
+    b"SCT1": struct.Struct("<4sHBBIIIIIIIIIHHIIIiiIHBBbBhb4s3x"),
+    b"SCT2": struct.Struct("<4sHBBIIIIIIIIIHHIIIiiIHBBbBhb12s3x"),
+}
+MAGIC = re.compile(b"|".join(HEADERS))
+METRIC = struct.Struct("<IIIII")
+GAUGE = struct.Struct("<B3xiii")
+NO_FIX = 0xFFFFFFFF
+
+# src/metrics.cpp order
+METRIC_NAMES = ["cam", "efs", "ftplogin", "ftpput", "at", "ota", "wake"]
+GAUGE_NAMES = ["heap", "psram", "csq", "temp", "bat"]
+FIELDS = ["sequence", "timestamp", "uptime_s", "cold_boots", "deep_wakes", "captured", "events", "uploaded",
+          "upload_failures", "outbox_pending", "full_frames_pending", "milliamp_hours", "sd_used_mb",
+          "sd_total_mb", "latitude_e7", "longitude_e7", "fix_age_s", "hdop_x10", "fix_mode", "satellites",
+          "csq", "capture_level", "rsrp_dbm", "snr_db", "link_mode"]
+
+
+# every field set and distinct, some negative; test/test_telemetry builds the same record
+SAMPLE = {
+    "fields": [7, 1792152000, 3600, 3, 140, 1200, 45, 40, 5, 2, 1, 850, 812, 15258, -338020580, 185442390, 42,
+               12, 3, 9, 21, 2, -97, -3, b"LTE CAT-M1"],
+    "metrics": [(10 + i, 1000 * (i + 1), 2000 * (i + 1), 4000 * (i + 1), 5000 * (i + 1))
+                for i in range(len(METRIC_NAMES))],
+    "gauges": [(1, 100 * i - 250, 100 * i - 300, 100 * i - 200) if i % 2 == 0 else (0, 0, 0, 0)
+               for i in range(len(GAUGE_NAMES))],
+}
+
+
+def pack_sample():
+    header = HEADERS[b"SCT2"]
+    length = header.size + len(SAMPLE["metrics"]) * METRIC.size + len(SAMPLE["gauges"]) * GAUGE.size + 4
+    data = header.pack(b"SCT2", length, len(SAMPLE["metrics"]), len(SAMPLE["gauges"]), *SAMPLE["fields"])
+    data += b"".join(METRIC.pack(*metric) for metric in SAMPLE["metrics"])
+    data += b"".join(GAUGE.pack(*gauge) for gauge in SAMPLE["gauges"])
+    return data + struct.pack("<I", zlib.crc32(data))
+
+
+def print_fixture():
+    data = pack_sample()
+    print("static const uint8_t toolRecord[%d] = {" % len(data))
+    for start in range(0, len(data), 16):
+        print("    " + " ".join("0x%02x," % byte for byte in data[start:start + 16]))
+    print("};")
+
+
+def name(names, index):
+    return names[index] if index < len(names) else "#%d" % index
+
+
+def decode(data):
+    """Yield (offset, record dict or None for a bad record) for each record."""
+    offset = 0
+    while offset + 8 <= len(data):
+        header = HEADERS.get(data[offset:offset + 4])
+        valid = header is not None and offset + header.size + 4 <= len(data)
+        if valid:
+            values = header.unpack_from(data, offset)
+            length, metrics, gauges = values[1], values[2], values[3]
+            end = offset + length
+            expected = header.size + metrics * METRIC.size + gauges * GAUGE.size + 4
+            valid = length == expected and end <= len(data) and \
+                struct.unpack_from("<I", data, end - 4)[0] == zlib.crc32(data[offset:end - 4])
+        if not valid:
+            # lost sync, carry on from the next magic
+            yield offset, None
+            found = MAGIC.search(data, offset + 1)
+            if not found:
+                return
+            offset = found.start()
+            continue
+
+        record = dict(zip(FIELDS, values[4:]))
+        record["link_mode"] = record["link_mode"].rstrip(b"\0").decode("ascii", "replace")
+        record["metrics"] = {}
+        position = offset + header.size
+        for index in range(metrics):
+            count, p50, p90, p99, peak = METRIC.unpack_from(data, position)
+            position += METRIC.size
+            if count:
+                record["metrics"][name(METRIC_NAMES, index)] = {
+                    "count": count, "p50_us": p50, "p90_us": p90, "p99_us": p99, "max_us": peak}
+        record["gauges"] = {}
+        for index in range(gauges):
+            is_set, last, low, high = GAUGE.unpack_from(data, position)
+            position += GAUGE.size
+            if is_set:
+                record["gauges"][name(GAUGE_NAMES, index)] = {"last": last, "min": low, "max": high}
+        yield offset, record
+        offset = end
+
+
+def position_text(record):
+    if record["fix_age_s"] == NO_FIX:
+        return "no fix"
+    return "%.5f,%.5f %dD %d sats hdop %.1f %ds old" % (
+        record["latitude_e7"] / 1e7, record["longitude_e7"] / 1e7, record["fix_mode"], record["satellites"],
+        record["hdop_x10"] / 10.0, record["fix_age_s"])
+
+
+def print_record(record, out):
+    when = time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(record["timestamp"]))
+    print("#%d %s up %ds: %d captured, %d events, %d uploaded, %d failed, outbox %d, full frames %d, "
+          "%d mAh, SD %d/%d MB, %s CSQ %d RSRP %d SNR %d level %d, %s"
+          % (record["sequence"], when, record["uptime_s"], record["captured"], record["events"],
+             record["uploaded"], record["upload_failures"], record["outbox_pending"], record["full_frames_pending"],
+             record["milliamp_hours"], record["sd_used_mb"], record["sd_total_mb"], record["link_mode"],
+             record["csq"], record["rsrp_dbm"], record["snr_db"], record["capture_level"], position_text(record)),
+          file=out)
+    for metric, row in record["metrics"].items():
+        print("    %-8s %6d  p50 %9.1f  p90 %9.1f  p99 %9.1f  max %9.1f ms"
+              % (metric, row["count"], row["p50_us"] / 1000.0, row["p90_us"] / 1000.0, row["p99_us"] / 1000.0,
+                 row["max_us"] / 1000.0), file=out)
+    for gauge, row in record["gauges"].items():
+        print("    %-8s %d (%d..%d)" % (gauge, row["last"], row["min"], row["max"]), file=out)
+
+
+def flatten(record):
+    row = {field: record[field] for field in FIELDS}
+    for metric, values in record["metrics"].items():
+        for key, value in values.items():
+            row["%s_%s" % (metric, key)] = value
+    for gauge, values in record["gauges"].items():
+        for key, value in values.items():
+            row["%s_%s" % (gauge, key)] = value
+    return row
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="*")
+    output = parser.add_mutually_exclusive_group()
+    output.add_argument("--json", action="store_true", help="one JSON object per record")
+    output.add_argument("--csv", action="store_true", help="one CSV row per record, metrics flattened")
+    output.add_argument("--fixture", action="store_true", help="print the sample record as a C array")
+    args = parser.parse_args()
+    if args.fixture:
+        print_fixture()
+        return 0
+    if not args.files:
+        parser.error("no files")
+
+    records, bad = [], 0
+    for path in args.files:
+        with open(path, "rb") as source:
+            data = source.read()
+        for offset, record in decode(data):
+            if record is None:
+                bad += 1
+                print("%s: bad record at %d" % (path, offset), file=sys.stderr)
+            else:
+                records.append(record)
+    # batches can overlap when a send went through but wasn't acknowledged.
+    # sequences start over with a new SD card, so time comes first
+    unique = {(record["timestamp"], record["sequence"]): record for record in records}
+    records = [unique[key] for key in sorted(unique)]
+
+    if args.csv:
+        rows = [flatten(record) for record in records]
+        columns = list(FIELDS)
+        for row in rows:
+            columns.extend(key for key in row if key not in columns)
+        writer = csv.DictWriter(sys.stdout, fieldnames=columns)
+        writer.writeheader()
+        writer.writerows(rows)
+    else:
+        for record in records:
+            if args.json:
+                print(json.dumps(record))
+            else:
+                print_record(record, sys.stdout)
+    if bad:
+        print("%d bad records skipped" % bad, file=sys.stderr)
+    return 1 if bad and not records else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())